@@ -0,0 +1,34 @@
+#version 430 compatibility
+#extension GL_ARB_shader_draw_parameters : require
+
+// earth.vert and space.vert for multi-draws out of a DrawArena (see drawarena.h)
+
+out vec2 vST;
+out vec3 vE;    // eye coordinates, and the normal -- for the shadows
+out vec3 vN;
+
+layout( std140 ) uniform SceneState
+{
+    mat4 uProjection;    // the rest of the block (shaderstate.h) isn't used here
+};
+
+// the depth programs (depth.frag) compute the same depth, for the prepass:
+invariant gl_Position;
+
+layout( std430, binding = 2 ) readonly buffer ArenaDraws
+{
+    mat4 uDrawModelView[ ];
+};
+
+uniform int uArenaBase;    // the index of this multi-draw's first draw
+
+void
+main()
+{
+    vST = gl_MultiTexCoord0.st;
+    mat4 modelView = uDrawModelView[ uArenaBase + gl_DrawIDARB ];
+    vec4 ECposition = modelView * gl_Vertex;
+    vE = ECposition.xyz;
+    vN = normalize( mat3( modelView ) * gl_Normal );    // (the arena's scales are uniform)
+    gl_Position = uProjection * ECposition;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 330 compatibility
+
+// the render queue's depth prepass (see renderqueue.h) -- linked with a shading
+// program's own vertex shader, so the depth comes out the same, and writes nothing else
+
+void
+main()
+{
+}
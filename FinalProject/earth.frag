@@ -1,10 +1,84 @@
 #version 330 compatibility
 in vec2 vST;
+in vec3 vE;	// eye coordinates
+in vec3 vN;
 uniform sampler2D uTexUnit1;
 
+// the shadows from the lights' shadow maps (shadow.h) -- they only darken: each
+// light's share of the light reaching the point is taken away as much as the point
+// is in its shadow. the texture is still the whole color where nothing is in the way
+layout( std140 ) uniform ShadowState
+{
+	mat4	uShadowEyeToWorld;
+	mat4	uShadowMatrices[16];
+	vec4	uShadowRects[16];
+	vec4	uShadowLights[8];	// w = the light's first tile, -1. = not shadowed
+	vec4	uShadowSpots[8];	// w = cos( cutoff ), -1. for a point light
+	vec4	uShadowColors[8];
+	vec4	uShadowParams;		// 1 / atlas size, pcf radius, darkness
+};
+uniform sampler2DShadow	uShadowUnit;
+uniform float		uShadowsOn;	// 0. = no shadows
+
+float
+Lit( vec3 p, vec3 n )
+{
+	float lit = 0.;
+	float total = 0.;
+	for( int i = 0; i < 8; i++ )
+	{
+		if( uShadowLights[i].w < 0. )
+			continue;
+		vec3 l = uShadowLights[i].xyz - p;
+		l = normalize( l );
+		float share = max( dot( n, l ), 0. ) * dot( uShadowColors[i].rgb, vec3( .3, .59, .11 ) );
+		bool point = ( uShadowSpots[i].w <= -1. );
+		if( ! point  &&  dot( -l, normalize( uShadowSpots[i].xyz ) ) < uShadowSpots[i].w )
+			share = 0.;
+		if( share <= 0. )
+			continue;
+
+		// a point light's tile is the cube face the point is on, in world coordinates:
+		int tile = int( uShadowLights[i].w );
+		if( point )
+		{
+			vec3 w = mat3( uShadowEyeToWorld ) * -l;
+			vec3 a = abs( w );
+			if( a.x >= a.y  &&  a.x >= a.z )
+				tile += ( w.x > 0. ) ? 0 : 1;
+			else if( a.y >= a.z )
+				tile += ( w.y > 0. ) ? 2 : 3;
+			else
+				tile += ( w.z > 0. ) ? 4 : 5;
+		}
+		vec4 s = uShadowMatrices[tile] * vec4( p, 1. );
+		s.xyz /= s.w;
+
+		float radius = uShadowParams.y;
+		float visible = 0.;
+		float taps = 0.;
+		for( float t = -radius; t <= radius; t += 1. )
+		{
+			for( float r = -radius; r <= radius; r += 1. )
+			{
+				vec2 st = clamp( s.xy + vec2( r, t ) * uShadowParams.x, uShadowRects[tile].xy, uShadowRects[tile].zw );
+				visible += texture( uShadowUnit, vec3( st, s.z ) );
+				taps += 1.;
+			}
+		}
+		lit += share * visible / taps;
+		total += share;
+	}
+	if( total <= 0. )
+		return 1.;
+	return mix( 1., lit / total, uShadowParams.z );
+}
+
 void
 main()
 {
     vec3 newcolor = texture(uTexUnit1, vST).rgb;
+    if( uShadowsOn > 0. )
+        newcolor *= Lit( vE, normalize( vN ) );
     gl_FragColor = vec4(newcolor, 1.);
 }
\ No newline at end of file
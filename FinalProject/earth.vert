@@ -1,9 +1,24 @@
 #version 330 compatibility
 out vec2 vST;
+out vec3 vE;    // eye coordinates, and the normal -- for the shadows
+out vec3 vN;
+
+uniform mat4 uModelView;
+uniform mat3 uNormalMatrix;
+layout( std140 ) uniform SceneState
+{
+    mat4 uProjection;    // the rest of the block (shaderstate.h) isn't used here
+};
+
+// the depth programs (depth.frag) compute the same depth, for the prepass:
+invariant gl_Position;
 
 void
 main()
 {
     vST = gl_MultiTexCoord0.st;
-    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    vec4 ECposition = uModelView * gl_Vertex;
+    vE = ECposition.xyz;
+    vN = normalize( uNormalMatrix * gl_Normal );
+    gl_Position = uProjection * ECposition;
 }
\ No newline at end of file
@@ -0,0 +1,30 @@
+#version 330 compatibility
+in vec2 vST;
+uniform sampler2D uIndirection;    // one texel per page: cache slot x, y, and the level actually there
+uniform sampler2D uPageCache;
+uniform vec2 uVirtualSize;         // level 0 of the virtual texture, in texels
+uniform float uNumLevels;
+uniform float uPageSize;
+uniform float uBorder;
+uniform float uCacheTiles;
+
+void
+main()
+{
+    vec2 st = vec2( fract( vST.s ), clamp( vST.t, 0., 0.99999 ) );
+    vec2 texel = vST * uVirtualSize;
+    vec2 dx = dFdx( texel );
+    vec2 dy = dFdy( texel );
+    float lod = 0.5 * log2( max( dot( dx, dx ), dot( dy, dy ) ) );
+    float level = clamp( floor( lod ), 0., uNumLevels - 1. );
+
+    // the page for this level, or the closest coarser one that is resident:
+    vec4 entry = floor( textureLod( uIndirection, st, level ) * 255. + 0.5 );
+    vec2 pages = uVirtualSize / ( uPageSize * exp2( entry.z ) );
+    vec2 local = fract( st * pages );
+
+    float tile = uPageSize + 2. * uBorder;
+    vec2 uv = ( entry.xy * tile + uBorder + local * uPageSize ) / ( uCacheTiles * tile );
+    vec3 newcolor = textureLod( uPageCache, uv, 0. ).rgb;
+    gl_FragColor = vec4( newcolor, 1. );
+}
@@ -0,0 +1,22 @@
+#version 330 compatibility
+
+// a particle's sprite: a soft round spot (or the sprite texture) colored from white
+// hot through orange to dark red as its life runs out, added to what's there
+
+in vec2 vST;
+in float vLife;
+uniform sampler2D uTexUnit;
+uniform float uTexMix;     // 0. = no sprite texture
+uniform float uLifeMax;
+
+void
+main()
+{
+    vec2 r = 2. * vST - 1.;
+    float spot = max( 0., 1. - dot( r, r ) );
+    vec3 sprite = mix( vec3( spot ), texture( uTexUnit, vST ).rgb, uTexMix );
+    float heat = clamp( vLife / uLifeMax, 0., 1. );
+    vec3 fire = mix( vec3( 0.5, 0.05, 0. ), vec3( 1., 0.55, 0.1 ), smoothstep( 0., 0.5, heat ) );
+    fire = mix( fire, vec3( 1., 0.95, 0.8 ), smoothstep( 0.6, 1., heat ) );
+    gl_FragColor = vec4( fire * sprite, heat );
+}
@@ -0,0 +1,35 @@
+#version 330 compatibility
+
+// a particle (see particles.h and gpuparticles.h) -- one instance of a 4-vertex
+// triangle strip, aParticle being its position in the emitter's coordinates with
+// the life it has left in w. the strip is a square uPointSize across, facing the
+// eye. a particle with no life left is put outside the clip volume, so its
+// instance draws nothing
+
+layout( location = 1 ) in vec4 aParticle;
+
+out vec2 vST;
+out float vLife;
+
+uniform mat4 uModelView;
+uniform float uPointSize;
+layout( std140 ) uniform SceneState
+{
+    mat4 uProjection;    // the rest of the block (shaderstate.h) isn't used here
+};
+
+void
+main()
+{
+    vST = vec2( float( gl_VertexID & 1 ), float( gl_VertexID >> 1 ) );
+    vLife = aParticle.w;
+    if( aParticle.w <= 0. )
+    {
+        gl_Position = vec4( 2., 2., 2., 1. );
+        return;
+    }
+    vec4 eye = uModelView * vec4( aParticle.xyz, 1. );
+    float scale = length( uModelView[0].xyz );    // the emitter's coordinates may be scaled
+    eye.xy += ( vST - 0.5 ) * uPointSize * scale;
+    gl_Position = uProjection * eye;
+}
@@ -0,0 +1,98 @@
+#version 330 compatibility
+
+// the explosion's particles on the gpu (see gpuparticles.h) -- each vertex is a
+// slot, moved uDt further along explosion.geom's ballistic curve, or emitted again
+// once its particle has died. nothing is drawn: transform feedback captures the
+// outputs into the other buffer
+
+layout( location = 0 ) in vec4 aPosition;    // x, y, z, life left
+layout( location = 1 ) in vec4 aVelocity;    // vx, vy, vz, delay before it is first emitted
+
+out vec4 tfPosition;
+out vec4 tfVelocity;
+
+uniform samplerBuffer uTriangles;    // 3 corners a triangle
+uniform samplerBuffer uAreas;        // running total, 1. at the last triangle
+uniform int uNumTriangles;
+uniform float uVelScale;
+uniform float uGravity;
+uniform float uLifeMin;
+uniform float uLifeMax;
+uniform float uDt;
+uniform int uSeed;                   // different every step
+uniform int uRestart;
+uniform int uEmitting;
+
+uint State;
+
+// a wang hash of the state, 0. to just under 1.:
+float
+Random( )
+{
+    State = ( State ^ 61u ) ^ ( State >> 16 );
+    State *= 9u;
+    State = State ^ ( State >> 4 );
+    State *= 0x27d4eb2du;
+    State = State ^ ( State >> 15 );
+    return float( State >> 8 ) / 16777216.;
+}
+
+void
+main()
+{
+    State = uint( gl_VertexID );
+    Random( );
+    State ^= uint( uSeed ) * 0x9e3779b9u;
+
+    vec4 p = aPosition;
+    vec4 v = aVelocity;
+    if( uRestart != 0 )
+    {
+        p = vec4( 0., 0., 0., 0. );
+        v = vec4( 0., 0., 0., Random( ) * uLifeMax );
+    }
+    else if( p.w > 0. )
+    {
+        p.xyz += v.xyz * uDt + vec3( 0., 0.5 * uGravity * uDt * uDt, 0. );
+        v.y += uGravity * uDt;
+        p.w -= uDt;
+    }
+    else
+    {
+        v.w -= uDt;
+        if( v.w <= 0.  &&  uEmitting != 0 )
+        {
+            // the first triangle whose running area is past a random fraction of the total:
+            float r = Random( );
+            int lo = 0;
+            int hi = uNumTriangles - 1;
+            while( lo < hi )
+            {
+                int mid = ( lo + hi ) / 2;
+                if( texelFetch( uAreas, mid ).r > r )
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            vec3 a = texelFetch( uTriangles, 3*lo   ).xyz;
+            vec3 b = texelFetch( uTriangles, 3*lo+1 ).xyz;
+            vec3 c = texelFetch( uTriangles, 3*lo+2 ).xyz;
+
+            // a uniformly random point of it, flying away from its center:
+            float s = Random( );
+            float t = Random( );
+            if( s + t > 1. )
+            {
+                s = 1. - s;
+                t = 1. - t;
+            }
+            vec3 p0 = a + s * ( b - a ) + t * ( c - a );
+            p = vec4( p0, mix( uLifeMin, uLifeMax, Random( ) ) );
+            v = vec4( uVelScale * ( p0 - ( a + b + c ) / 3. ), 0. );
+        }
+    }
+
+    tfPosition = p;
+    tfVelocity = v;
+    gl_Position = vec4( 0., 0., 0., 1. );
+}
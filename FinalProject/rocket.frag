@@ -12,8 +12,32 @@ uniform float       uMix;
 uniform float       uWhiteMix;
 uniform samplerCube uReflectUnit;
 uniform samplerCube	uRefractUnit;
-uniform float       uWhiteOrRed;
-uniform float 		uWhiteorBlack;
+
+// with the prefiltered cube map (envfilter.cpp) on the units, the hull is glossy:
+// level L of it is roughness L / uEnvLods, so one textureLod( ) does the blurring.
+// uEnvLods = 0. means the maps aren't prefiltered, and are sampled as they are
+uniform float       uRoughness;
+uniform float       uEnvLods;
+
+// the environment's irradiance, as 9 spherical harmonics -- the paint is shaded by
+// how much brighter or darker than average it is in the normal's direction:
+uniform vec3        uIrradiance[9];
+uniform float       uIrradianceMix;		// 0. = not at all
+
+// the lights' shadow maps (shadow.h) -- Lit( ) is earth.frag's, darkening the hull
+// by how much of the light reaching it is blocked:
+layout( std140 ) uniform ShadowState
+{
+	mat4	uShadowEyeToWorld;
+	mat4	uShadowMatrices[16];
+	vec4	uShadowRects[16];
+	vec4	uShadowLights[8];	// w = the light's first tile, -1. = not shadowed
+	vec4	uShadowSpots[8];	// w = cos( cutoff ), -1. for a point light
+	vec4	uShadowColors[8];
+	vec4	uShadowParams;		// 1 / atlas size, pcf radius, darkness
+};
+uniform sampler2DShadow	uShadowUnit;
+uniform float		uShadowsOn;	// 0. = no shadows
 //want to use the same shader, but want the uWhiteMix color to be dark red for the booster.  
 // square-equation uniform variables -- these should be set every time Display( ) is called:
 
@@ -26,8 +50,8 @@ in  vec3  vL;		   // vector from point to light
 in  vec3  vE;		   // vector from point to eye
 in  vec2  vST;		   // (s,t) texture coordinates
 in  vec3  vMC;         // model coordinate positions
-
-vec4  WHITE = vec4(uWhiteOrRed, uWhiteorBlack, uWhiteorBlack, 1.);
+in  vec2  vWhite;      // uWhiteorRed, uWhiteorBlack
+flat in mat3 vNormalMatrix;
 
 vec3
 RotateNormal( float angx, float angy, vec3 n )
@@ -51,6 +75,82 @@ RotateNormal( float angx, float angy, vec3 n )
         return normalize( n );
 }
 
+vec3
+Irradiance( vec3 n )
+{
+	return uIrradiance[0] * 0.282095
+	     + uIrradiance[1] * 0.488603 * n.y
+	     + uIrradiance[2] * 0.488603 * n.z
+	     + uIrradiance[3] * 0.488603 * n.x
+	     + uIrradiance[4] * 1.092548 * n.x * n.y
+	     + uIrradiance[5] * 1.092548 * n.y * n.z
+	     + uIrradiance[6] * 0.315392 * ( 3. * n.z * n.z - 1. )
+	     + uIrradiance[7] * 1.092548 * n.x * n.z
+	     + uIrradiance[8] * 0.546274 * ( n.x * n.x - n.y * n.y );
+}
+
+vec4
+SampleEnv( samplerCube env, vec3 dir )
+{
+	if( uEnvLods > 0. )
+		return textureLod( env, dir, uRoughness * uEnvLods );
+	return texture( env, dir );
+}
+
+float
+Lit( vec3 p, vec3 n )
+{
+	float lit = 0.;
+	float total = 0.;
+	for( int i = 0; i < 8; i++ )
+	{
+		if( uShadowLights[i].w < 0. )
+			continue;
+		vec3 l = uShadowLights[i].xyz - p;
+		l = normalize( l );
+		float share = max( dot( n, l ), 0. ) * dot( uShadowColors[i].rgb, vec3( .3, .59, .11 ) );
+		bool point = ( uShadowSpots[i].w <= -1. );
+		if( ! point  &&  dot( -l, normalize( uShadowSpots[i].xyz ) ) < uShadowSpots[i].w )
+			share = 0.;
+		if( share <= 0. )
+			continue;
+
+		// a point light's tile is the cube face the point is on, in world coordinates:
+		int tile = int( uShadowLights[i].w );
+		if( point )
+		{
+			vec3 w = mat3( uShadowEyeToWorld ) * -l;
+			vec3 a = abs( w );
+			if( a.x >= a.y  &&  a.x >= a.z )
+				tile += ( w.x > 0. ) ? 0 : 1;
+			else if( a.y >= a.z )
+				tile += ( w.y > 0. ) ? 2 : 3;
+			else
+				tile += ( w.z > 0. ) ? 4 : 5;
+		}
+		vec4 s = uShadowMatrices[tile] * vec4( p, 1. );
+		s.xyz /= s.w;
+
+		float radius = uShadowParams.y;
+		float visible = 0.;
+		float taps = 0.;
+		for( float t = -radius; t <= radius; t += 1. )
+		{
+			for( float r = -radius; r <= radius; r += 1. )
+			{
+				vec2 st = clamp( s.xy + vec2( r, t ) * uShadowParams.x, uShadowRects[tile].xy, uShadowRects[tile].zw );
+				visible += texture( uShadowUnit, vec3( st, s.z ) );
+				taps += 1.;
+			}
+		}
+		lit += share * visible / taps;
+		total += share;
+	}
+	if( total <= 0. )
+		return 1.;
+	return mix( 1., lit / total, uShadowParams.z );
+}
+
 void
 main( )
 {
@@ -58,6 +158,7 @@ main( )
 	float t = vST.t;
 
 	vec4 uSpecularColor = vec4(1., 1., 1., 1.);
+	vec4 WHITE = vec4( vWhite.x, vWhite.y, vWhite.y, 1. );
 
 		
 	vec4 nvx = texture( Noise3, uNoiseFreq*vMC );
@@ -76,10 +177,17 @@ main( )
 	vec3 Eye    = normalize(vE);
 
 	vec3 newNormal = RotateNormal( angx, angy, vN );
-	newNormal = normalize( gl_NormalMatrix * newNormal );
+	newNormal = normalize( vNormalMatrix * newNormal );
+
+	if( uIrradianceMix > 0. )
+	{
+		vec3 average = uIrradiance[0] * 0.282095;
+		vec3 shade = Irradiance( newNormal ) / max( average, vec3( 0.0001 ) );
+		WHITE.rgb *= mix( vec3( 1. ), shade, uIrradianceMix );
+	}
 
 	vec3 reflectVector = reflect( vE, newNormal);
-	vec4 reflectColor  = texture( uReflectUnit, reflectVector);
+	vec4 reflectColor  = SampleEnv( uReflectUnit, reflectVector);
 
 	vec3 refractVector = refract( vE, newNormal, uEta );
 	vec4 refractColor;
@@ -89,7 +197,7 @@ main( )
 	}
 	else
 	{
-		refractColor = texture( uRefractUnit, refractVector );
+		refractColor = SampleEnv( uRefractUnit, refractVector );
 		refractColor = mix( refractColor, WHITE, uWhiteMix );
 	}
 
@@ -97,6 +205,8 @@ main( )
 	vec3 vert = vMC; 
 	
 	vec4 color = mix( refractColor, reflectColor, uMix);
+	if( uShadowsOn > 0. )
+		color.rgb *= Lit( vE, Normal );
 	
 	
 	gl_FragColor = vec4( color );
@@ -8,9 +8,27 @@ out  vec3  vE;	  // vector from point to eye
 out  vec2  vST;	  // (s,t) texture coordinates
 out  vec3  vMC;   // model coordinates
 out  float vFlapCounter; // Counts the flaps
+out  vec2  vWhite;      // red, and green and blue, of the color mixed into the refraction
+flat out mat3 vNormalMatrix;
+
+// rocketinst.vert gets these from each instance instead:
+uniform float uWhiteorRed;
+uniform float uWhiteorBlack;
 
 uniform float uFlapWings; // used to make dragon flap wings
 
+// set for each draw by the render queue:
+uniform mat4 uModelView;
+uniform mat3 uNormalMatrix;
+
+layout( std140 ) uniform SceneState
+{
+	mat4 uProjection;    // the rest of the block (shaderstate.h) isn't used here
+};
+
+// the depth programs (depth.frag) compute the same depth, for the prepass:
+invariant gl_Position;
+
 // where the light is:
 
 const vec3 LightPosition = vec3(  0., 5., 5. );
@@ -60,14 +78,16 @@ main( )
 	}	
 	vST = gl_MultiTexCoord0.st;
 	
-	vec4 ECposition = gl_ModelViewMatrix * gl_Vertex;
+	vec4 ECposition = uModelView * gl_Vertex;
 
-	vN = normalize( gl_NormalMatrix * gl_Normal );  // normal vector
+	vNormalMatrix = uNormalMatrix;
+	vN = normalize( uNormalMatrix * gl_Normal );  // normal vector
+	vWhite = vec2( uWhiteorRed, uWhiteorBlack );
 
 	vL = LightPosition - ECposition.xyz;	    // vector from the point
 							// to the light position
 	vE = ECposition.xyz - vec3( 0., 0., 0. );       // vector from the point
 							// to the eye position
 	
-	gl_Position = gl_ModelViewProjectionMatrix * vert;
+	gl_Position = uProjection * uModelView * vert;
 }
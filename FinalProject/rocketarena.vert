@@ -0,0 +1,102 @@
+#version 430 compatibility
+#extension GL_ARB_shader_draw_parameters : require
+
+// rocket.vert for multi-draws out of a DrawArena (see drawarena.h) -- the
+// modelview matrix is this draw's, found with gl_DrawIDARB
+
+layout( std430, binding = 2 ) readonly buffer ArenaDraws
+{
+	mat4	uDrawModelView[ ];
+};
+
+uniform int uArenaBase;		// the index of this multi-draw's first draw
+
+uniform float uWhiteorRed;
+uniform float uWhiteorBlack;
+
+// out variables to be interpolated in the rasterizer and sent to each fragment shader:
+
+out  vec3  vN;	  // normal vector
+out  vec3  vL;	  // vector from point to light
+out  vec3  vE;	  // vector from point to eye
+out  vec2  vST;	  // (s,t) texture coordinates
+out  vec3  vMC;   // model coordinates
+out  float vFlapCounter; // Counts the flaps
+out  vec2  vWhite;      // red, and green and blue, of the color mixed into the refraction
+flat out mat3 vNormalMatrix;
+
+uniform float uFlapWings; // used to make dragon flap wings
+
+layout( std140 ) uniform SceneState
+{
+	mat4 uProjection;    // the rest of the block (shaderstate.h) isn't used here
+};
+
+// the depth programs (depth.frag) compute the same depth, for the prepass:
+invariant gl_Position;
+
+// where the light is:
+
+const vec3 LightPosition = vec3(  0., 5., 5. );
+
+vec4
+RotateClockwise( float uFlapWings, vec4 n, float xo, float yo )
+{
+        
+        float cz = cos( uFlapWings );
+        float sz = sin( uFlapWings );
+
+		         
+        // rotate about z:
+        float xp =  (n.x-xo)*cz + (n.y-yo)*sz + xo;    // x'
+        n.y      = -(n.x-xo)*sz + (n.y-yo)*cz + yo;    // y'
+		n.x      =  xp;                  
+		return n;
+}
+vec4
+RotateCounterClockwise( float uFlapWings, vec4 n, float xo, float yo )
+{
+        
+        float cz = cos( uFlapWings );
+        float sz = sin( uFlapWings );
+
+		         
+        // rotate about z:
+        float xp =  (n.x-xo)*cz - (n.y-yo)*sz + xo;    // x'
+        n.y      = (n.x-xo)*sz + (n.y-yo)*cz + yo;    // y'
+		n.x      =  xp;                 // 
+		return n;
+}
+
+void
+main( )
+{
+	mat4 modelView = uDrawModelView[ uArenaBase + gl_DrawIDARB ];
+
+	vec4 vert = gl_Vertex;
+	vMC = gl_Vertex.xyz;
+	
+	if (vert.x >= 5.)
+	{
+		vert = RotateClockwise(uFlapWings, vert, 5., 12.);
+	}
+	else if (vert.x <= -5.)
+	{
+		vert = RotateCounterClockwise(uFlapWings, vert, -5., 12.);
+	}	
+	vST = gl_MultiTexCoord0.st;
+	
+	vec4 ECposition = modelView * gl_Vertex;
+
+	// the rockets are only ever scaled uniformly, and everything that uses this normalizes:
+	vNormalMatrix = mat3( modelView );
+	vN = normalize( vNormalMatrix * gl_Normal );  // normal vector
+	vWhite = vec2( uWhiteorRed, uWhiteorBlack );
+
+	vL = LightPosition - ECposition.xyz;	    // vector from the point
+							// to the light position
+	vE = ECposition.xyz - vec3( 0., 0., 0. );       // vector from the point
+							// to the eye position
+	
+	gl_Position = uProjection * modelView * vert;
+}
@@ -59,6 +59,17 @@ const int ESCAPE = 0x1b;
 
 const int INIT_WINDOW_SIZE = 600;
 
+// with -headless, the size of the offscreen frame, and how many frames to draw:
+
+const int HEADLESS_SIZE   = 600;
+const int HEADLESS_FRAMES = 100;
+
+// with -batch, the frames of the loop a second, and where the images go:
+
+const int   BATCH_FPS = 60;
+const char *BATCH_DIR = "frames";
+const int   BATCH_BLOCK = 1;		// with -workers, frames dealt to a worker at a time
+
 // size of the 3d box to be drawn:
 
 const float BOXSIZE = 2.f;
@@ -91,6 +102,115 @@ const int RIGHT  = 1;
 // used for animation
 const int MSEC = 40000;   // 10000 = 10 seconds so this is 40 seconds
 
+// texture streaming -- the ring of pixel buffer slots and how much may go up each frame:
+
+const int STREAM_SLOTS           = 4;
+const int STREAM_SLOT_BYTES      = 256*1024;
+const int STREAM_BYTES_PER_FRAME = 512*1024;
+const int STREAM_STRESS_TEXTURES = 256;		// -stream's defaults
+const int STREAM_STRESS_SIZE     = 256;
+
+// texture residency -- how much texture memory the baked textures may use,
+// and how many top mip levels a texture loses before it gets evicted:
+
+const long long RESIDENCY_BUDGET  = 32*1024*1024;
+const long long RESIDENCY_MINIMUM = 256*1024;
+const int       RESIDENCY_DEMOTE  = 2;
+
+// the virtual earth -- level 0 width of the page file baked from Earth.bmp,
+// and the page cache size in pages on a side:
+
+const int VIRTUAL_EARTH_WIDTH = 16384;
+const int VIRTUAL_CACHE_TILES = 16;
+
+// anisotropic filtering of the sky and the planets, while mipmapping is on:
+
+const float SPACE_ANISOTROPY  = 4.f;
+const float PLANET_ANISOTROPY = 8.f;
+
+// texture units the rocket shader samples:
+
+const int ROCKET_REFLECT_UNIT = 6;
+const int ROCKET_REFRACT_UNIT = 7;
+const int ROCKET_NOISE_UNIT   = 3;
+
+// how rough the glossy hull is, 0. to 1., and how much the environment's
+// irradiance shades its paint:
+
+const float ROCKET_ROUGHNESS = 0.25f;
+const float IRRADIANCE_MIX   = 0.5f;
+
+// how many extra starships the instancing stress test adds:
+
+const int STRESS_SHIPS = 10000;
+
+// the reflection probe that follows the starship -- its faces' size, how many of
+// them are rendered a frame, and how finely its scene's spheres are tessellated:
+
+const int PROBE_SIZE            = 128;
+const int PROBE_FACES_PER_FRAME = 1;
+const int PROBE_SPHERE_SLICES   = 24;
+
+// the lights' shadow maps -- the atlas they share, and each one's tile in it:
+
+const int SHADOW_ATLAS_SIZE = 2048;
+const int SHADOW_TILE_SIZE  = 512;
+
+// the explosion -- explosion.geom's ballistics, which the cpu particles fly by too,
+// and the particles' pool, how many a second are emitted, how long they live (in
+// seconds), and how big they are (in the explosion's coordinates):
+
+const float EXPLOSION_VELSCALE    = 30.f;
+const float EXPLOSION_GRAVITY     = -0.075f;
+const int   EXPLOSION_PARTICLES   = 300000;
+const float EXPLOSION_RATE        = 150000.f;
+const float EXPLOSION_LIFE_MIN    = 0.5f;
+const float EXPLOSION_LIFE_MAX    = 1.5f;
+const float EXPLOSION_SPARK_SIZE  = 0.05f;
+const int   EXPLOSION_GPU_SLOTS   = 150000;	// EXPLOSION_RATE x the average life, the same sparks as the cpu's
+
+// the four phases of the loop, each with its own camera, and when each ends
+// (in seconds):
+
+enum Phases
+{
+	PHASE_LAUNCH,
+	PHASE_SPACE,
+	PHASE_RETURN,
+	PHASE_LANDING,
+	NUMPHASES
+};
+
+const float PHASE_END[NUMPHASES]   = { 10.f, 20.01f, 30.01f, 40.f };
+const char *PHASE_NAMES[NUMPHASES] = { "launch", "space", "return", "landing" };
+
+// the objects and lights the scene timeline turns on and off:
+
+enum SceneIds
+{
+	LAUNCH_STARSHIP,
+	SPACE_STARSHIP,
+	PAD_BOOSTER,
+	SPACE_BOOSTER,
+	EARTH,
+	MOON,
+	MOON_SURFACE,
+	LANDING_STARSHIP,
+	EXPLOSION,
+	SPACE_BACKDROP,
+	BOOSTER_LIGHT,
+	MOON_LIGHT,
+	SURFACE_LIGHT,
+	NUMSCENEIDS
+};
+
+char *SCENE_NAMES[NUMSCENEIDS] =
+{
+	(char *)"launch-starship", (char *)"space-starship", (char *)"pad-booster", (char *)"space-booster",
+	(char *)"earth", (char *)"moon", (char *)"moon-surface", (char *)"landing-starship", (char *)"explosion",
+	(char *)"space-backdrop", (char *)"booster-light", (char *)"moon-light", (char *)"surface-light"
+};
+
 // which projection:
 
 enum Projections
@@ -99,6 +219,15 @@ enum Projections
 	PERSP
 };
 
+// how the explosion is drawn:
+
+enum ExplosionModes
+{
+	EXPLOSION_GEOMETRY,		// explosion.geom shattering explosion.obj
+	EXPLOSION_CPU,			// ExplosionParticles
+	EXPLOSION_GPU			// GpuExplosion
+};
+
 // which button:
 
 enum ButtonVals
@@ -187,10 +316,12 @@ int		DepthCueOn;				// != 0 means to use intensity depth cueing
 int		DepthBufferOn;			// != 0 means to use the z-buffer
 int		DepthFightingOn;		// != 0 means to force the creation of z-fighting
 int		MainWindow;				// window id for main graphics window
+int		MipmapsOn;				// != 0 means to use trilinear mipmapping
 int		NowColor;				// index into Colors[ ]
 int		NowProjection;		// ORTHO or PERSP
 float	Scale;					// scaling factor
 int		ShadowsOn;				// != 0 means to turn shadows on
+int		ExplosionMode;			// EXPLOSION_GEOMETRY, EXPLOSION_CPU, or EXPLOSION_GPU
 float	Time;					// used for animation, this has a value between 0. and 1.
 int		Xmouse, Ymouse;			// mouse values
 float	Xrot, Yrot;				// rotation angles in degrees
@@ -200,6 +331,7 @@ GLuint  StarshipTex;            // Starship Texture
 GLuint  EarthDL;
 GLuint  EarthTex;
 GLuint  SphereDL;
+GLuint  ProbeSphereDL;          // ... and coarser, for Probe's faces
 GLuint  MoonDL;
 GLuint  MoonTex;
 GLuint  LaunchPad;
@@ -209,11 +341,39 @@ GLuint  ExplosionTex;
 GLuint  Space;
 GLuint  SpaceTex;
 GLuint  RocketTex;
+GLuint  EnvTex;                 // RocketTex's faces, prefiltered for glossy reflections
+int     EnvLevels;              // ... its roughness levels
+float   EnvIrradiance[9][3];    // ... and their irradiance, as spherical harmonics
+GLuint  Noise3Tex;              // 3d noise for bumping the rocket normals
+int		NumFrames;				// frames drawn since the last frame time report
+float	FrameStart;				// when that report period started
+double	QueueSeconds;			// cpu time queueing the draws, over that period
+double	ExecuteSeconds;			// ... and executing them
+int		InstancingOn;			// != 0 means to draw the rockets with one instanced draw per mesh
+int		ArenaOn;			// != 0 means to draw the static meshes with multi-draws out of Arena
+int		GpuCullOn;			// != 0 means to cull the instanced rockets with InstanceCullProgram
+int		OcclusionOn;			// != 0 means to also cull them against HiZ
+int		SkyboxOn;			// != 0 means to draw the backdrop as Sky instead of the Space grid
+int		PrepassOn;			// != 0 means to draw the opaque draws depth-only first
+int		FrontToBackOn;			// != 0 means to sort the opaque draws nearest first
+int		OverdrawOn;			// != 0 means to show how many times each pixel was drawn
+int		ProbeOn;			// != 0 means the rockets reflect Probe instead of the static cube map
+int		GlossyOn;			// != 0 means the rockets look up EnvTex, blurred by Roughness
+float	Roughness;
+GLuint	FragmentQuery;			// counts the fragments shaded executing the queue and drawing the sky
+GLuint	VertexQuery;			// ... and the vertices
+double	FragmentsShaded;		// ... over the report period
+double	VerticesShaded;
+int		StressShipsOn;			// != 0 means to add the STRESS_SHIPS starships
+double	PhaseSeconds[NUMPHASES];	// cpu time building each phase's frames
+int		PhaseFrames[NUMPHASES];		// ... and how many frames that was
+
+char* IrradianceNames[9] = {
+	"uIrradiance[0]", "uIrradiance[1]", "uIrradiance[2]",
+	"uIrradiance[3]", "uIrradiance[4]", "uIrradiance[5]",
+	"uIrradiance[6]", "uIrradiance[7]", "uIrradiance[8]"
+};
 
-unsigned char* SpaceTexture;
-unsigned char* EarthTexture;
-unsigned char* MoonTexture;
-unsigned char* ExplosionTexture;
 char* FaceFiles[6] = {
 	"nvposx.bmp",
 	"nvnegx.bmp",
@@ -233,19 +393,30 @@ void	DoDepthBufferMenu( int );
 void	DoDepthFightingMenu( int );
 void	DoDepthMenu( int );
 void	DoDebugMenu( int );
+void	DoExplosionMenu( int );
 void	DoMainMenu( int );
 void	DoProjectMenu( int );
 void	DoRasterString( float, float, float, char * );
 void	DoStrokeString( float, float, float, float, char * );
+int	ElapsedMsec( );
 float	ElapsedSeconds( );
 void	InitGraphics( );
 void	InitLists( );
 void	InitMenus( );
+void	InitSceneGraph( );
 void	Keyboard( unsigned char, int, int );
 void	MouseButton( int, int, int, int );
 void	MouseMotion( int, int );
 void	Reset( );
 void	Resize( int, int );
+void	RunBatch( );
+void	RunBatchScaling( );
+void	RunBatchWorker( );
+bool	RunBatchWorkers( int, double * );
+void	RunHeadless( int );
+void	RunStreamStress( int, int );
+void	SetMipmapping( int );
+void	SkipFrame( );
 void	Visibility( int );
 
 void			Axes( float );
@@ -306,9 +477,27 @@ MulArray3(float factor, float a, float b, float c )
 //#include "osucone.cpp"
 //#include "osutorus.cpp"
 #include "bmptotexture.cpp"
+#include "loadtexture.cpp"
 #include "loadobjfile.cpp"
 #include "keytime.cpp"
 #include "glslprogram.cpp"
+#include "hiz.cpp"
+#include "skybox.cpp"
+#include "overdraw.cpp"
+#include "probe.cpp"
+#include "shadow.cpp"
+#include "particles.cpp"
+#include "gpuparticles.cpp"
+#include "instancemesh.cpp"
+#include "drawarena.cpp"
+#include "renderqueue.cpp"
+#include "timeline.cpp"
+#include "scenegraph.cpp"
+#include "shaderstate.cpp"
+#include "headless.cpp"
+#include "framecapture.cpp"
+#include "workers.cpp"
+#include "glm/gtc/matrix_transform.hpp"
 
 GLSLProgram RocketProgram;
 GLSLProgram BoosterS;
@@ -317,6 +506,62 @@ GLSLProgram EarthProgram;
 GLSLProgram MoonProgram;
 GLSLProgram ExplosionProgram;
 GLSLProgram FloorProgram;
+GLSLProgram EarthVtProgram;
+GLSLProgram VtFeedbackProgram;
+GLSLProgram RocketInstProgram;
+GLSLProgram InstanceCullProgram;	// frustum culls the instanced rockets on the gpu
+GLSLProgram HiZBuildProgram;		// builds HiZ's depth pyramid
+GLSLProgram RocketArenaProgram;		// the same, drawing out of Arena with multi-draws
+GLSLProgram EarthArenaProgram;
+GLSLProgram EarthVtArenaProgram;
+GLSLProgram SpaceArenaProgram;
+GLSLProgram SkyboxProgram;		// draws Sky
+GLSLProgram ParticleProgram;		// draws ExplosionParticles and GpuExplosion
+GLSLProgram ParticleSimProgram;		// updates GpuExplosion, by transform feedback
+GLSLProgram RocketDepthProgram;		// the depth prepass's programs: each vertex shader with depth.frag
+GLSLProgram RocketInstDepthProgram;
+GLSLProgram RocketArenaDepthProgram;
+GLSLProgram EarthDepthProgram;
+GLSLProgram ArenaDepthProgram;
+
+RenderQueue Queue;			// the frame's draws, sorted by program and texture
+InstancedMesh StarshipMesh;
+InstancedMesh BoosterMesh;
+DrawArena Arena;			// the static meshes, in one vertex and one index buffer
+HiZBuffer HiZ;				// the earth, moon, and moon surface's depth, for occlusion culling
+Skybox Sky;				// the backdrop, from the rockets' cube map
+OverdrawCounter Overdraw;		// counts the frame's draws of each pixel, in the stencil buffer
+ReflectionProbe Probe;			// the scene around the starship, for its reflections
+RenderQueue ProbeQueue;			// the draws of each of Probe's faces
+ShadowAtlas Shadows;			// the lights' shadow maps
+RenderQueue ShadowQueue;		// the casters drawn into each of their tiles
+ParticleSystem ExplosionParticles;	// the explosion, simulated on the cpu
+GpuParticleSystem GpuExplosion;		// ... or on the gpu
+GLuint	ExplosionSprite;		// ExplosionTex, if explosion.bmp was there, else 0
+float	ExplosionTime;			// the last frame's time, for the particles' step
+float	ExplosionOwed;			// particles owed to the emission rate, a fraction of one
+int	StarshipArena, BoosterArena, SphereArena, SurfaceArena, SpaceArena;	// their meshes in Arena
+
+bool	ArenaDraws( );
+void	QueueRocketTextures( int, GLuint );
+void	QueueShadowTexture( int );
+int	SubmitRocket( GLuint, InstancedMesh *, int, UniformBlock *, GLuint, const float *, float, float );
+void	SubmitRocketInstances( InstancedMesh *, UniformBlock *, GLuint );
+void	RenderProbe( int, const float * );
+void	RenderShadows( const float * );
+void	UpdateExplosion( float );
+
+void	EarthFeedback( float * );
+void	SetGpuCulling( );
+void	SetView( int, glm::mat4 *, float [16] );
+void	SetVirtualUniforms( UniformBlock *, float );
+
+TextureStreamer Streamer;		// uploads the baked textures over the first few frames
+struct StreamStress StreamTest;	// the 'u' key's upload stress test
+ResidencyManager Residency;		// keeps the baked textures under a memory budget
+int		RocketRes, SpaceRes, EarthRes, MoonRes;	// their residency ids
+VirtualTexture VirtualEarth;		// the earth's surface at VIRTUAL_EARTH_WIDTH
+int		VirtualTexOn;			// != 0 means to draw the earth from VirtualEarth
 
 
 Keytimes Ypos1;      // used for Starship1
@@ -335,11 +580,155 @@ Keytimes Iatx;        // Eye look at X
 Keytimes Iaty;       // Eye look at y
 Keytimes Ypos4;      // used to land Starship on the moon
 
+Timeline Scene;			// which objects and lights are active in which part of the loop
+SceneGraph Graph;		// where every object is, see InitSceneGraph( )
+int		SceneNodes[NUMSCENEIDS];	// the node each object is drawn with (-1 for the lights)
+int		SpaceShipCourse;		// the space starship's parent, that carries it along
+int		StressNodes;			// the first of the STRESS_SHIPS stress ships' nodes
+ShaderState State;		// the projection, lights, and material, in the shaders' uniform buffer
+HeadlessContext Headless;	// with -headless, the context and framebuffer instead of a window
+int	HeadlessSize;			// with -headless, its size (0 = a window)
+int	HeadlessFrames;			// ... and how many frames it draws
+int	BatchMsec;			// with -batch, the time of the frame being drawn (-1 = the clock's)
+int	BatchFps;			// the loop's frames a second
+int	BatchFirst, BatchLast;		// the frames to draw, of MSEC * BatchFps / 1000
+int	BatchFormat;			// FRAME_PPM or FRAME_PNG
+bool	BatchSync;			// read back and write each frame before drawing the next
+const char *BatchDir;
+int	BatchWorkers;			// processes drawing the frames (1 = just this one)
+int	BatchBlock;			// ... dealt out this many at a time
+bool	BatchScaling;			// time the batch with 1, 2, 4, ... workers, up to the cores
+bool	ProbeAhead;			// render the probe before the draws that reflect it, not after
+FrameWorkers Workers;			// with -workers, the worker processes
+
 // main program:
 
 int
 main( int argc, char *argv[ ] )
 {
+	// -headless [size [frames]] draws the scene with no window and no glut, into a
+	// size x size framebuffer, frames times, and writes the last one to headless.ppm:
+
+	HeadlessSize = 0;
+	HeadlessFrames = HEADLESS_FRAMES;
+	BatchMsec = -1;
+	ProbeAhead = false;
+	if( argc > 1  &&  strcmp( argv[1], "-headless" ) == 0 )
+	{
+		HeadlessSize = argc > 2 ? atoi( argv[2] ) : HEADLESS_SIZE;
+		if( HeadlessSize <= 0 )
+			HeadlessSize = HEADLESS_SIZE;
+		if( argc > 3 )
+			HeadlessFrames = atoi( argv[3] );
+		InitGraphics( );
+		InitLists( );
+		Reset( );
+		RunHeadless( HeadlessFrames );
+		return 0;
+	}
+
+	// -stream [count [size]] streams count synthetic size x size textures in, headless,
+	// while the scene is drawn, and reports what the uploads cost each frame:
+
+	if( argc > 1  &&  strcmp( argv[1], "-stream" ) == 0 )
+	{
+		int count = argc > 2 ? atoi( argv[2] ) : STREAM_STRESS_TEXTURES;
+		int size = argc > 3 ? atoi( argv[3] ) : STREAM_STRESS_SIZE;
+		if( count <= 0 )
+			count = STREAM_STRESS_TEXTURES;
+		if( size <= 0 )
+			size = STREAM_STRESS_SIZE;
+		HeadlessSize = HEADLESS_SIZE;
+		InitGraphics( );
+		InitLists( );
+		Reset( );
+		RunStreamStress( count, size );
+		return 0;
+	}
+
+	// -batch draws the whole loop headless, stepping the time a fixed 1/fps a frame
+	// instead of reading the clock, so the same frame always comes out the same, and
+	// writes them all out as images:
+	//	-out dir		where (BATCH_DIR)
+	//	-size n			n x n (HEADLESS_SIZE)
+	//	-fps n			frames a second of the loop (BATCH_FPS)
+	//	-frames first last	only those
+	//	-png			png's, not ppm's
+	//	-sync			read back and write each frame before the next, to compare
+	//	-workers n		draw them in n processes at once (0 = one a core), see RunBatchWorkers( )
+	//	-block n		dealing the frames out n at a time (BATCH_BLOCK)
+	//	-scaling		time it with 1, 2, 4, ... workers, up to one a core
+
+	if( argc > 1  &&  strcmp( argv[1], "-batch" ) == 0 )
+	{
+		HeadlessSize = HEADLESS_SIZE;
+		BatchFps = BATCH_FPS;
+		BatchFirst = 0;
+		BatchLast = -1;
+		BatchFormat = FRAME_PPM;
+		BatchSync = false;
+		BatchDir = BATCH_DIR;
+		BatchWorkers = 1;
+		BatchBlock = BATCH_BLOCK;
+		BatchScaling = false;
+		for( int i = 2; i < argc; i++ )
+		{
+			if( strcmp( argv[i], "-out" ) == 0  &&  i+1 < argc )
+				BatchDir = argv[++i];
+			else if( strcmp( argv[i], "-size" ) == 0  &&  i+1 < argc )
+				HeadlessSize = atoi( argv[++i] );
+			else if( strcmp( argv[i], "-fps" ) == 0  &&  i+1 < argc )
+				BatchFps = atoi( argv[++i] );
+			else if( strcmp( argv[i], "-frames" ) == 0  &&  i+2 < argc )
+			{
+				BatchFirst = atoi( argv[++i] );
+				BatchLast = atoi( argv[++i] );
+			}
+			else if( strcmp( argv[i], "-png" ) == 0 )
+				BatchFormat = FRAME_PNG;
+			else if( strcmp( argv[i], "-sync" ) == 0 )
+				BatchSync = true;
+			else if( strcmp( argv[i], "-workers" ) == 0  &&  i+1 < argc )
+				BatchWorkers = atoi( argv[++i] );
+			else if( strcmp( argv[i], "-block" ) == 0  &&  i+1 < argc )
+				BatchBlock = atoi( argv[++i] );
+			else if( strcmp( argv[i], "-scaling" ) == 0 )
+				BatchScaling = true;
+			else
+				fprintf( stderr, "Unknown -batch option '%s'\n", argv[i] );
+		}
+		if( HeadlessSize <= 0 )
+			HeadlessSize = HEADLESS_SIZE;
+		if( BatchFps <= 0 )
+			BatchFps = BATCH_FPS;
+		int numFrames = (int)( (long long)MSEC * BatchFps / 1000 );
+		if( BatchFirst < 0 )
+			BatchFirst = 0;
+		if( BatchLast < 0  ||  BatchLast >= numFrames )
+			BatchLast = numFrames - 1;
+		if( BatchWorkers <= 0 )
+			BatchWorkers = FrameWorkers::NumCores( );
+		if( BatchBlock <= 0 )
+			BatchBlock = BATCH_BLOCK;
+		BatchMsec = 0;
+
+		// (the workers fork before anything makes a context -- and if they can't,
+		//  this process draws them all)
+		double seconds;
+		if( BatchScaling )
+		{
+			RunBatchScaling( );
+			return 0;
+		}
+		if( BatchWorkers > 1  &&  RunBatchWorkers( BatchWorkers, &seconds ) )
+			return 0;
+		InitGraphics( );
+		InitLists( );
+		Reset( );
+		RunBatch( );
+		return 0;
+	}
+
 	// turn on the glut package:
 	// (do this before checking argc and argv since glutInit might
 	// pull some command line arguments out)
@@ -410,10 +799,21 @@ Display( )
 		fprintf(stderr, "Starting Display.\n");
 
 	// set which window we want to do the graphics into:
-	glutSetWindow( MainWindow );
+	if( ! Headless.IsValid( ) )
+		glutSetWindow( MainWindow );
+
+	// send this frame's share of any texture uploads:
+
+	if( StreamTest.textures != NULL )
+		StreamStressFrame( &Streamer, &StreamTest, STREAM_BYTES_PER_FRAME );
+	else
+		Streamer.Update( STREAM_BYTES_PER_FRAME );
+
+	Residency.BeginFrame( );
+	double frameStart = StreamSeconds( );
 
 	// erase the background:
-	glDrawBuffer( GL_BACK );
+	glDrawBuffer( Headless.IsValid( ) ? GL_COLOR_ATTACHMENT0 : GL_BACK );
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
 	glEnable( GL_DEPTH_TEST );
@@ -423,63 +823,25 @@ Display( )
 #endif
 
 	// turn # msec into the cycle ( 0 - MSEC-1 ):
-	int msec = glutGet(GLUT_ELAPSED_TIME) % MSEC;
+	int msec = ElapsedMsec( ) % MSEC;
 
 	// turn that into a time in seconds:
 	float nowTime = (float)msec / 1000.;
 
+	// find what is active now -- everything else is skipped, keytimes and all:
+	Scene.Update( nowTime );
+	int phase = 0;
+	while( phase < NUMPHASES-1  &&  nowTime >= PHASE_END[phase] )
+		phase++;
+
 	// specify shading to be flat:
 
 	glShadeModel( GL_FLAT );
 
-	// set the viewport to be a square centered in the window:
-
-	GLsizei vx = glutGet( GLUT_WINDOW_WIDTH );
-	GLsizei vy = glutGet( GLUT_WINDOW_HEIGHT );
-	GLsizei v = vx < vy ? vx : vy;			// minimum dimension
-	GLint xl = ( vx - v ) / 2;
-	GLint yb = ( vy - v ) / 2;
-	glViewport( xl, yb,  v, v );
-
-
-	// set the viewing volume:
-	// remember that the Z clipping  values are given as DISTANCES IN FRONT OF THE EYE
-	// USE gluOrtho2D( ) IF YOU ARE DOING 2D !
-
-	glMatrixMode( GL_PROJECTION );
-	glLoadIdentity( );
-	if( NowProjection == ORTHO )
-		glOrtho( -2.f, 2.f,     -2.f, 2.f,     0.1f, 1000.f );
-	else
-		gluPerspective( 70.f, 1.f,	0.1f, 1000.f );
-
-	// place the objects into the scene:
-
-	glMatrixMode( GL_MODELVIEW );
-	glLoadIdentity( );
-
-	// set the eye position, look-at position, and up-vector:
-	if (nowTime <= 10)
-		gluLookAt(1.f, -1.f, 5.f, 0.f, 1.f, 0.f, 0.f, 1.f, 0.f);
-	else if (nowTime >= 20.01 && nowTime < 30.01)
-		gluLookAt(1.f, -1.f, 5.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f);
-	else if (nowTime >= 30.01)
-		gluLookAt(0.f, 100.f, 3.f, 0.f, 100.f, 0.f, 0.f, 1.f, 0.f);
-	else
-		gluLookAt(-4.0f, -100.f, 3.0f, 6.f, -100.f, 0.f, 0.f, 1.f, 0.f);
-	//gluLookAt(Iposx.GetValue(nowTime), -Iposy.GetValue(nowTime), Iposz.GetValue(nowTime), Iatx.GetValue(nowTime), Iaty.GetValue(nowTime), 0.f, 0.f, 1.f, 0.f);
-	//gluLookAt( -4.0f, -10.f, 3.0f, 6.f, -10.f, 0.f, 0.f, 1.f, 0.f);
-	
-	// rotate the scene:
-
-	glRotatef( (GLfloat)Yrot, 0.f, 1.f, 0.f );
-	glRotatef( (GLfloat)Xrot, 1.f, 0.f, 0.f );
-
-	// uniformly scale the scene:
-
-	if( Scale < MINSCALE )
-		Scale = MINSCALE;
-	glScalef( (GLfloat)Scale, (GLfloat)Scale, (GLfloat)Scale );
+	// set the viewport, and the viewing volume and transformation for this phase:
+	glm::mat4 projection;
+	float view[16];
+	SetView( phase, &projection, view );
 
 	// set the fog parameters:
 
@@ -507,233 +869,349 @@ Display( )
 
 	// since we are using glScalef( ), be sure the normals get unitized:
 
+	// (the lighting itself only matters if the fixed-function calls are on for comparison --
+	// otherwise the lights and materials just go to the shaders' uniform buffer)
 	glEnable( GL_NORMALIZE );
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-	glEnable(GL_LIGHT1);
-	glEnable(GL_LIGHT2);
-	glEnable(GL_LIGHT3);
-	glEnable(GL_LIGHT5);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	if( State.GetFixed( ) )
+	{
+		glEnable(GL_LIGHTING);
+		glEnable(GL_LIGHT0);
+		glEnable(GL_LIGHT1);
+		glEnable(GL_LIGHT2);
+		glEnable(GL_LIGHT3);
+		glEnable(GL_LIGHT5);
+		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	}
 
 	// a point light
+	State.SetModelview( view );
 	SetPointLight(GL_LIGHT0, 0, 3, 0, 1, 1, 1);	
 	SetSpotLight(GL_LIGHT4, 2, 2, 1, 0, 1, 0, 1, 1, 1);
 
-	// draw Starship that takes off:
-	int ReflectUnit = 6;
-	int RefractUnit = 7;
+	// the rocket shader's uniforms, shared by every rocket draw:
+	float NoiseFreq = 1.0f;
+	float NoiseAmp = 0.0f;		// > 0. bumps the hull reflections
 	float Mix = 0.7f;
 	float uWhiteMix = 0.9f;
 	float uWhiteorBlack = 1.0f;
 	float uWhiteorRed = 1.0f;
 
-	RocketProgram.Use();
-	glActiveTexture(GL_TEXTURE0 + ReflectUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	glActiveTexture(GL_TEXTURE0 + RefractUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	RocketProgram.SetUniformVariable("uMix", Mix);
-	RocketProgram.SetUniformVariable("uWhiteMix", uWhiteMix);
-	RocketProgram.SetUniformVariable("uRefractUnit", RefractUnit);
-	RocketProgram.SetUniformVariable("uReflectUnit", ReflectUnit);
-	RocketProgram.SetUniformVariable("uWhiteorRed", uWhiteorRed);
-	RocketProgram.SetUniformVariable("uWhiteorBlack", uWhiteorBlack);
-	
-	glPushMatrix();
-		//glDisable(GL_TEXTURE_2D);
-		glTranslatef(0.f, Ypos1.GetValue(nowTime), 2.5f);
-		glRotatef(90, -1, 0, 0.);
-		glScalef(0.1f, 0.1f, 0.1f);
-		//SetMaterial(0.8, 0.8, 0.8, 15);
-		glCallList( Starship );
-	glPopMatrix();
-	RocketProgram.UnUse();
-	
-	//Draw Starship that leaves Earth
-	RocketProgram.Use();
-	glActiveTexture(GL_TEXTURE0 + ReflectUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	glActiveTexture(GL_TEXTURE0 + RefractUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	RocketProgram.SetUniformVariable("uMix", Mix);
-	RocketProgram.SetUniformVariable("uWhiteMix", uWhiteMix);
-	RocketProgram.SetUniformVariable("uRefractUnit", RefractUnit);
-	RocketProgram.SetUniformVariable("uReflectUnit", ReflectUnit);
-	RocketProgram.SetUniformVariable("uWhiteorRed", uWhiteorRed);
-	RocketProgram.SetUniformVariable("uWhiteorBlack", uWhiteorBlack);
-
-	glPushMatrix();		
-		glTranslatef(-2.2f, -100.20f, Zpos1.GetValue(nowTime));
-		glRotatef(330, 1, 2, 0.);
-		glRotatef(ThetaY.GetValue(nowTime), 0, -2, 0);
-		glScalef(ScaleR.GetValue(nowTime), ScaleR.GetValue(nowTime), ScaleR.GetValue(nowTime));
-		//SetMaterial(0.5, 0.5, 0.5, 15);
-		glCallList(Starship);
-	glPopMatrix();
-	RocketProgram.UnUse();
+	UniformBlock rocketUniforms;
+	rocketUniforms.Set( (char *)"Noise3", ROCKET_NOISE_UNIT );
+	rocketUniforms.Set( (char *)"uNoiseFreq", NoiseFreq );
+	rocketUniforms.Set( (char *)"uNoiseAmp", NoiseAmp );
+	rocketUniforms.Set( (char *)"uMix", Mix );
+	rocketUniforms.Set( (char *)"uWhiteMix", uWhiteMix );
+	rocketUniforms.Set( (char *)"uRefractUnit", ROCKET_REFRACT_UNIT );
+	rocketUniforms.Set( (char *)"uReflectUnit", ROCKET_REFLECT_UNIT );
+	rocketUniforms.Set( (char *)"uWhiteorRed", uWhiteorRed );
+	rocketUniforms.Set( (char *)"uWhiteorBlack", uWhiteorBlack );
+
+	// the glossy hull, out of the prefiltered cube map:
+	bool glossy = ( GlossyOn != 0  &&  EnvTex != 0 );
+	rocketUniforms.Set( (char *)"uRoughness", Roughness );
+	rocketUniforms.Set( (char *)"uEnvLods", glossy ? (float)( EnvLevels - 1 ) : 0.f );
+	rocketUniforms.Set( (char *)"uIrradianceMix", glossy ? IRRADIANCE_MIX : 0.f );
+	for( int i = 0; i < 9; i++ )
+		rocketUniforms.Set( IrradianceNames[i], EnvIrradiance[i][0], EnvIrradiance[i][1], EnvIrradiance[i][2] );
+
+	// the shadows, for the rockets, the moon, and the earth (but not the virtually-textured one):
+	bool shadows = ( ShadowsOn != 0  &&  Shadows.IsValid( ) );
+	rocketUniforms.Set( (char *)"uShadowUnit", SHADOW_TEXTURE_UNIT );
+	rocketUniforms.Set( (char *)"uShadowsOn", shadows ? 1.f : 0.f );
+
+	GLuint rocketTex = Residency.Bind( RocketRes );
+	int draw;
+	float modelview[16];
+
+	// the draws are queued here and all drawn at once, sorted by program and texture,
+	// at the end -- the lights are still set as they come, in the objects' coordinates:
+
+	double submitStart = StreamSeconds( );
+	Queue.Begin( );
+	StarshipMesh.Begin( );
+	BoosterMesh.Begin( );
+
+	// move the animated nodes of the objects that are active -- only they, and
+	// what hangs under them, get their world matrices rebuilt:
+	if( Scene.IsActive( LAUNCH_STARSHIP ) )
+		Graph.SetTranslation( SceneNodes[LAUNCH_STARSHIP], 0.f, Ypos1.GetValue(nowTime), 0.f );
+	if( Scene.IsActive( PAD_BOOSTER ) )
+		Graph.SetTranslation( SceneNodes[PAD_BOOSTER], 0.f, Ypos2.GetValue(nowTime), 0.f );
+	if( Scene.IsActive( EXPLOSION ) )
+	{
+		Graph.SetTranslation( SceneNodes[EXPLOSION], 0.f, Ypos3.GetValue(nowTime), 0.f );
+		Graph.SetScale( SceneNodes[EXPLOSION], ScaleEx.GetValue(nowTime) );
+	}
+	if( Scene.IsActive( SPACE_STARSHIP ) )
+	{
+		Graph.SetTranslation( SpaceShipCourse, -2.2f, -0.2f, Zpos1.GetValue(nowTime) );
+		Graph.SetRotation( SceneNodes[SPACE_STARSHIP], ThetaY.GetValue(nowTime), 0, -2, 0 );
+		Graph.SetScale( SceneNodes[SPACE_STARSHIP], ScaleR.GetValue(nowTime) );
+	}
+	if( Scene.IsActive( SPACE_BOOSTER ) )
+		Graph.SetScale( SceneNodes[SPACE_BOOSTER], ScaleB.GetValue(nowTime) );
+	if( Scene.IsActive( LANDING_STARSHIP ) )
+		Graph.SetTranslation( SceneNodes[LANDING_STARSHIP], 0., Ypos4.GetValue(nowTime), 0. );
+	Graph.Update( );
+
+	// draw Starship that takes off:
+	if( Scene.IsActive( LAUNCH_STARSHIP ) )
+	{
+		Graph.GetModelview( SceneNodes[LAUNCH_STARSHIP], view, modelview );
+		SubmitRocket( Starship, &StarshipMesh, StarshipArena, &rocketUniforms, rocketTex, modelview, uWhiteorRed, uWhiteorBlack );
+	}
 
+	//Draw Starship that leaves Earth
+	if( Scene.IsActive( SPACE_STARSHIP ) )
+	{
+		Graph.GetModelview( SceneNodes[SPACE_STARSHIP], view, modelview );
+		SubmitRocket( Starship, &StarshipMesh, StarshipArena, &rocketUniforms, rocketTex, modelview, uWhiteorRed, uWhiteorBlack );
+	}
 
 	// draw the Booster object on Earth
-	//uWhiteorBlack = 0.0f;
-	//uWhiteorRed = 0.7f;
-
-	RocketProgram.Use();
-	glActiveTexture(GL_TEXTURE0 + ReflectUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	glActiveTexture(GL_TEXTURE0 + RefractUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	RocketProgram.SetUniformVariable("uMix", Mix);
-	RocketProgram.SetUniformVariable("uWhiteMix", uWhiteMix);
-	RocketProgram.SetUniformVariable("uRefractUnit", RefractUnit);
-	RocketProgram.SetUniformVariable("uReflectUnit", ReflectUnit);
-	RocketProgram.SetUniformVariable("uWhiteorRed", uWhiteorRed);
-	RocketProgram.SetUniformVariable("uWhiteorBlack", uWhiteorBlack);
-	
-	glPushMatrix();
-	//glEnable(GL_TEXTURE_2D);
-		glTranslatef(0.f, Ypos2.GetValue(nowTime), 2.5f);
-		glRotatef(90, -1, 0, 0.);
-		glScalef(0.1f, 0.1f, 0.1f);
-		if (nowTime <= 10)
-			SetPointLight(GL_LIGHT1, 0.0, -2.3, 2.5, 1, 0, 0);
-		else
-			SetPointLight(GL_LIGHT1, 0.0, -2.3, 2.5, 1, 1, 0);
-		//SetMaterial(1., 1., 1., 15);
-		glCallList( Booster );
-		//glDisable(GL_TEXTURE_2D);
-	glPopMatrix();
-	RocketProgram.UnUse();
-	
+	if( Scene.IsActive( PAD_BOOSTER ) )
+	{
+		Graph.GetModelview( SceneNodes[PAD_BOOSTER], view, modelview );
+		if( Scene.IsActive( BOOSTER_LIGHT ) )
+		{
+			State.SetModelview( modelview );
+			if (nowTime <= 10)
+				SetPointLight(GL_LIGHT1, 0.0, -2.3, 2.5, 1, 0, 0);
+			else
+				SetPointLight(GL_LIGHT1, 0.0, -2.3, 2.5, 1, 1, 0);
+			State.SetModelview( view );
+		}
+		SubmitRocket( Booster, &BoosterMesh, BoosterArena, &rocketUniforms, rocketTex, modelview, uWhiteorRed, uWhiteorBlack );
+	}
+	if( ! Scene.IsActive( BOOSTER_LIGHT ) )
+		DisableLight(GL_LIGHT1);
 
 	// The booster that detaches in space
-	//glEnable(GL_TEXTURE_2D);
-	RocketProgram.Use();
-	glActiveTexture(GL_TEXTURE0 + ReflectUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	glActiveTexture(GL_TEXTURE0 + RefractUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	RocketProgram.SetUniformVariable("uMix", Mix);
-	RocketProgram.SetUniformVariable("uWhiteMix", uWhiteMix);
-	RocketProgram.SetUniformVariable("uRefractUnit", RefractUnit);
-	RocketProgram.SetUniformVariable("uReflectUnit", ReflectUnit);
-	RocketProgram.SetUniformVariable("uWhiteorRed", uWhiteorRed);
-	RocketProgram.SetUniformVariable("uWhiteorBlack", uWhiteorBlack);
-	glPushMatrix();
-		glTranslatef(-2.0f, -100.25, 2.0f);
-		glRotatef(30, -1, -2, 0.);
-		glScalef(ScaleB.GetValue(nowTime), ScaleB.GetValue(nowTime), ScaleB.GetValue(nowTime));
-		SetMaterial(1., 1., 1., 15);
-		glCallList(Booster);
-	glPopMatrix();
-	RocketProgram.UnUse();
-	//glDisable(GL_TEXTURE_2D);
-	
+	if( Scene.IsActive( SPACE_BOOSTER ) )
+	{
+		Graph.GetModelview( SceneNodes[SPACE_BOOSTER], view, modelview );
+		draw = SubmitRocket( Booster, &BoosterMesh, BoosterArena, &rocketUniforms, rocketTex, modelview, uWhiteorRed, uWhiteorBlack );
+		if( draw >= 0 )
+			Queue.Material( draw, 1., 1., 1., 15 );
+	}
+
 	// Draw the Earth
-	//glEnable(GL_TEXTURE_2D);
-	EarthProgram.Use();
-	glActiveTexture(GL_TEXTURE11);
-	glBindTexture(GL_TEXTURE_2D, EarthTex);
-	EarthProgram.SetUniformVariable("uTexUnit1", 11);
-	glPushMatrix();
-		glTranslatef(0.0f, -100.f, 0.0f);
-		glScalef(1.2f, 1.2f, 1.2f);
-		glCallList(EarthDL);
-	glPopMatrix();
-	EarthProgram.UnUse();
-	//glDisable(GL_TEXTURE_2D);
-	
-	
+	UniformBlock earthUniforms;
+	if( Scene.IsActive( EARTH ) )
+	{
+		Graph.GetModelview( SceneNodes[EARTH], view, modelview );
+		if( VirtualTexOn != 0  &&  VirtualEarth.IsValid( )  &&  Queue.Visible( EarthDL, modelview ) )
+		{
+			// find out which pages the earth needs now, so the queued draw uses what is resident:
+			EarthFeedback( modelview );
+
+			earthUniforms.Set( (char *)"uPageCache", 11 );
+			earthUniforms.Set( (char *)"uIndirection", 13 );
+			SetVirtualUniforms( &earthUniforms, 0.f );
+			if( ArenaDraws( ) )
+				draw = Queue.Submit( &EarthVtArenaProgram, &earthUniforms, &Arena, SphereArena, modelview );
+			else
+				draw = Queue.Submit( &EarthVtProgram, &earthUniforms, EarthDL, modelview );
+			Queue.Occluder( draw );
+			Queue.Texture( draw, 11, GL_TEXTURE_2D, VirtualEarth.GetCacheTex( ) );
+			Queue.Texture( draw, 13, GL_TEXTURE_2D, VirtualEarth.GetIndirectionTex( ) );
+		}
+		else
+		{
+			earthUniforms.Set( (char *)"uTexUnit1", 11 );
+			earthUniforms.Set( (char *)"uShadowUnit", SHADOW_TEXTURE_UNIT );
+			earthUniforms.Set( (char *)"uShadowsOn", shadows ? 1.f : 0.f );
+			if( ArenaDraws( ) )
+				draw = Queue.Submit( &EarthArenaProgram, &earthUniforms, &Arena, SphereArena, modelview );
+			else
+				draw = Queue.Submit( &EarthProgram, &earthUniforms, EarthDL, modelview );
+			Queue.Occluder( draw );
+			Queue.Texture( draw, 11, GL_TEXTURE_2D, Residency.Bind(EarthRes) );
+			QueueShadowTexture( draw );
+		}
+	}
+
 	// Draw the Moon
-	SetSpotLight(GL_LIGHT2, -4., -100., 3.0, 6.f, -100.f, 0.f, 1, 1, 1);
-	//glEnable(GL_TEXTURE_2D);
-	MoonProgram.Use();
-	glActiveTexture(GL_TEXTURE12);
-	glBindTexture(GL_TEXTURE_2D, MoonTex);
-	MoonProgram.SetUniformVariable("uTexUnit1", 12);
-	glPushMatrix();
-		glTranslatef(5., -100., 1.0);
-		glScalef(1.2f, 1.2f, 1.2f);
-		SetMaterial(1, 1, 1, 15);
-		glCallList(MoonDL);
-	glPopMatrix();
-	MoonProgram.UnUse();
-	//glDisable(GL_TEXTURE_2D);
-	
+	if( Scene.IsActive( MOON_LIGHT ) )
+		SetSpotLight(GL_LIGHT2, -4., -100., 3.0, 6.f, -100.f, 0.f, 1, 1, 1);
+	else
+		DisableLight(GL_LIGHT2);
+	UniformBlock moonUniforms;
+	moonUniforms.Set( (char *)"uTexUnit1", 12 );
+	moonUniforms.Set( (char *)"uShadowUnit", SHADOW_TEXTURE_UNIT );
+	moonUniforms.Set( (char *)"uShadowsOn", shadows ? 1.f : 0.f );
+	if( Scene.IsActive( MOON ) )
+	{
+		Graph.GetModelview( SceneNodes[MOON], view, modelview );
+		if( ArenaDraws( ) )
+			draw = Queue.Submit( &EarthArenaProgram, &moonUniforms, &Arena, SphereArena, modelview );
+		else
+			draw = Queue.Submit( &MoonProgram, &moonUniforms, MoonDL, modelview );
+		Queue.Occluder( draw );
+		Queue.Texture( draw, 12, GL_TEXTURE_2D, Residency.Bind(MoonRes) );
+		QueueShadowTexture( draw );
+		Queue.Material( draw, 1, 1, 1, 15 );
+	}
+
 	// Draw the moon landing surface
-	SetPointLight(GL_LIGHT3, 2, 106, 1, 1, 1, 1);
-	//glEnable(GL_TEXTURE_2D);
-	MoonProgram.Use();
-	glActiveTexture(GL_TEXTURE12);
-	glBindTexture(GL_TEXTURE_2D, MoonTex);
-	MoonProgram.SetUniformVariable("uTexUnit1", 12);
-	glPushMatrix();
-		glTranslatef(0, 118, 10);
-		glCallList(MoonSurface);
-	glPopMatrix();
-	MoonProgram.UnUse();
-	//glDisable(GL_TEXTURE_2D);
-	
+	if( Scene.IsActive( SURFACE_LIGHT ) )
+		SetPointLight(GL_LIGHT3, 2, 106, 1, 1, 1, 1);
+	else
+		DisableLight(GL_LIGHT3);
+	if( Scene.IsActive( MOON_SURFACE ) )
+	{
+		Graph.GetModelview( SceneNodes[MOON_SURFACE], view, modelview );
+		if( ArenaDraws( ) )
+			draw = Queue.Submit( &EarthArenaProgram, &moonUniforms, &Arena, SurfaceArena, modelview );
+		else
+			draw = Queue.Submit( &MoonProgram, &moonUniforms, MoonSurface, modelview );
+		Queue.Occluder( draw );
+		Queue.Texture( draw, 12, GL_TEXTURE_2D, Residency.Bind(MoonRes) );
+		QueueShadowTexture( draw );
+	}
+
 	// Draw the rocket landing on the moon
-	//uWhiteorBlack = 1.0f;
-	//uWhiteorRed = 1.0f;
-
-	RocketProgram.Use();
-	glActiveTexture(GL_TEXTURE0 + ReflectUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	glActiveTexture(GL_TEXTURE0 + RefractUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	RocketProgram.SetUniformVariable("uMix", Mix);
-	RocketProgram.SetUniformVariable("uWhiteMix", uWhiteMix);
-	RocketProgram.SetUniformVariable("uRefractUnit", RefractUnit);
-	RocketProgram.SetUniformVariable("uReflectUnit", ReflectUnit);
-	
-	glPushMatrix();
-		glTranslatef(0., Ypos4.GetValue(nowTime), 0.);
-		glRotatef(90, -1, 0, 0);
-		glScalef(0.1f, 0.1f, 0.1f);
+	if( Scene.IsActive( LANDING_STARSHIP ) )
+	{
+		Graph.GetModelview( SceneNodes[LANDING_STARSHIP], view, modelview );
+		State.SetModelview( modelview );
 		SetSpotLight(GL_LIGHT4, 0, 106, 2, 0, -1, 0, 1, 1, 1);
-		//SetMaterial(0.8, 0.8, 0.8, 15);
-		glCallList(Starship);
-	glPopMatrix();
-	RocketProgram.UnUse();
-	
-	// explosion
-	//glEnable(GL_TEXTURE_2D);
-	float uGravity = -0.075;
-	float uTime = 0.0;
-	float uVelScale = 30.0;
-	
-	ExplosionProgram.Use();
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, ExplosionTex);
-	ExplosionProgram.SetUniformVariable("uTexUnit2", 1);
-	ExplosionProgram.SetUniformVariable("uGravity", uGravity);
-	ExplosionProgram.SetUniformVariable("uTime", uTime);
-	ExplosionProgram.SetUniformVariable("uVelScale", uVelScale);
-	glPushMatrix();
-		glTranslatef(0.f, Ypos3.GetValue(nowTime), 2.5f);
-		glScalef(ScaleEx.GetValue(nowTime), ScaleEx.GetValue(nowTime), ScaleEx.GetValue(nowTime));
-		glRotatef(180, 1, 0, 0);
-		SetMaterial(1.0, 0.5, 0.0, 3);
-		glCallList(Explosion);	
-	glPopMatrix();
-	ExplosionProgram.UnUse();
-	
-	//glDisable(GL_TEXTURE_2D);
-	
-	// Space	
-	glPushMatrix();
-	SpaceProgram.Use();
-	glActiveTexture(GL_TEXTURE5);
-	glBindTexture(GL_TEXTURE_2D, SpaceTex);
-	SpaceProgram.SetUniformVariable("uTexUnit", 5);
-		glTranslatef(0.0f, 0.0f, 2.0f);
-		glScalef(4.5, 4.5, 4.5);
-		glCallList(Space);
-	SpaceProgram.UnUse();
-	glPopMatrix();
+		State.SetModelview( view );
+		SubmitRocket( Starship, &StarshipMesh, StarshipArena, &rocketUniforms, rocketTex, modelview, uWhiteorRed, uWhiteorBlack );
+	}
+
+	// the instancing stress test -- a field of starships out past the launch pad,
+	// that never move, so their world matrices are never rebuilt:
+	if( StressShipsOn != 0 )
+	{
+		for( int i = 0; i < STRESS_SHIPS; i++ )
+		{
+			Graph.GetModelview( StressNodes + i, view, modelview );
+			SubmitRocket( Starship, &StarshipMesh, StarshipArena, &rocketUniforms, rocketTex, modelview, uWhiteorRed, uWhiteorBlack );
+		}
+	}
+
+	// with instancing on, each rocket mesh is a single draw of all its copies:
+	SubmitRocketInstances( &StarshipMesh, &rocketUniforms, rocketTex );
+	SubmitRocketInstances( &BoosterMesh, &rocketUniforms, rocketTex );
+
+	// explosion -- as cpu or gpu particles, drawn after the queue since they are blended,
+	// or with explosion.geom:
+	UniformBlock explosionUniforms;
+	bool sparks = false;
+	float sparksModelview[16];
+	if( Scene.IsActive( EXPLOSION )  &&  ( ( ExplosionMode == EXPLOSION_CPU  &&  ExplosionParticles.IsValid( ) )
+					||  ( ExplosionMode == EXPLOSION_GPU  &&  GpuExplosion.IsValid( ) ) ) )
+	{
+		UpdateExplosion( nowTime );
+		Graph.GetModelview( SceneNodes[EXPLOSION], view, sparksModelview );
+		sparks = true;
+	}
+	else if( Scene.IsActive( EXPLOSION ) )
+	{
+		float uGravity = EXPLOSION_GRAVITY;
+		float uTime = 0.0;
+		float uVelScale = EXPLOSION_VELSCALE;
+
+		explosionUniforms.Set( (char *)"uTexUnit2", 1 );
+		explosionUniforms.Set( (char *)"uGravity", uGravity );
+		explosionUniforms.Set( (char *)"uTime", uTime );
+		explosionUniforms.Set( (char *)"uVelScale", uVelScale );
+		Graph.GetModelview( SceneNodes[EXPLOSION], view, modelview );
+		draw = Queue.Submit( &ExplosionProgram, &explosionUniforms, Explosion, modelview );
+		Queue.Texture( draw, 1, GL_TEXTURE_2D, ExplosionTex );
+		Queue.Material( draw, 1.0, 0.5, 0.0, 3 );
+	}
+
+	// Space -- the textured grid, if the skybox isn't drawn after the queue instead
+	UniformBlock spaceUniforms;
+	bool sky = ( SkyboxOn != 0  &&  Sky.IsValid( ) );
+	if( Scene.IsActive( SPACE_BACKDROP )  &&  ! sky )
+	{
+		spaceUniforms.Set( (char *)"uTexUnit", 5 );
+		Graph.GetModelview( SceneNodes[SPACE_BACKDROP], view, modelview );
+		if( ArenaDraws( ) )
+			draw = Queue.Submit( &SpaceArenaProgram, &spaceUniforms, &Arena, SpaceArena, modelview );
+		else
+			draw = Queue.Submit( &SpaceProgram, &spaceUniforms, Space, modelview );
+		Queue.Texture( draw, 5, GL_TEXTURE_2D, Residency.Bind(SpaceRes) );
+	}
+
+	double executeStart = StreamSeconds( );
+
+	// the lights are where they will be for the whole frame now, so their shadow
+	// maps can be drawn before the draws that look them up:
+	if( shadows )
+	{
+		RenderShadows( view );
+		State.BeginFrame( glm::value_ptr( projection ) );
+	}
+
+	// the reflection probe goes around the starship that is flying now:
+	int ship = -1;
+	if( ProbeOn != 0  &&  Probe.IsValid( ) )
+	{
+		if( Scene.IsActive( LAUNCH_STARSHIP ) )
+			ship = LAUNCH_STARSHIP;
+		else if( Scene.IsActive( SPACE_STARSHIP ) )
+			ship = SPACE_STARSHIP;
+		else if( Scene.IsActive( LANDING_STARSHIP ) )
+			ship = LANDING_STARSHIP;
+	}
+	if( ship >= 0  &&  ProbeAhead )
+	{
+		RenderProbe( SceneNodes[ship], view );
+		State.BeginFrame( glm::value_ptr( projection ) );
+	}
+
+	if( DebugOn != 0  &&  FragmentQuery != 0 )
+	{
+		glBeginQuery( GL_FRAGMENT_SHADER_INVOCATIONS_ARB, FragmentQuery );
+		glBeginQuery( GL_VERTEX_SHADER_INVOCATIONS_ARB, VertexQuery );
+	}
+	if( OverdrawOn != 0 )
+		Overdraw.Begin( );
+	Queue.Execute( );
+
+	// the sky goes behind everything the queue drew, so it only fills what's left:
+	if( Scene.IsActive( SPACE_BACKDROP )  &&  sky )
+		Sky.Draw( Residency.Bind( RocketRes ), view );
+
+	// the explosion's sparks go on last, added to whatever they are in front of:
+	if( sparks  &&  ExplosionMode == EXPLOSION_GPU )
+		GpuExplosion.Draw( ExplosionSprite, sparksModelview, EXPLOSION_SPARK_SIZE );
+	else if( sparks )
+		ExplosionParticles.Draw( ExplosionSprite, sparksModelview, EXPLOSION_SPARK_SIZE );
 
+	if( OverdrawOn != 0 )
+	{
+		Overdraw.End( );
+		if( DebugOn != 0 )
+			Overdraw.Read( );
+		Overdraw.Show( );
+	}
+
+	if( DebugOn != 0  &&  FragmentQuery != 0 )
+	{
+		glEndQuery( GL_VERTEX_SHADER_INVOCATIONS_ARB );
+		glEndQuery( GL_FRAGMENT_SHADER_INVOCATIONS_ARB );
+		GLuint64 fragments, vertices;
+		glGetQueryObjectui64v( FragmentQuery, GL_QUERY_RESULT, &fragments );
+		glGetQueryObjectui64v( VertexQuery, GL_QUERY_RESULT, &vertices );
+		FragmentsShaded += (double)fragments;
+		VerticesShaded += (double)vertices;
+	}
+	QueueSeconds += executeStart - submitStart;
+	ExecuteSeconds += StreamSeconds( ) - executeStart;
+
+	// re-render this frame's share of the reflection probe's faces -- the rockets
+	// reflect them from the next frame on:
+	if( ship >= 0  &&  ! ProbeAhead )
+	{
+		RenderProbe( SceneNodes[ship], view );
+		State.BeginFrame( glm::value_ptr( projection ) );
+	}
 	
 	/*
 	//landing
@@ -819,14 +1297,77 @@ Display( )
 	glColor3f( 1.f, 1.f, 1.f );
 	//DoRasterString( 5.f, 5.f, 0.f, (char *)"Text That Doesn't" );
 
+	PhaseSeconds[phase] += StreamSeconds( ) - frameStart;
+	PhaseFrames[phase]++;
+
 	// swap the double-buffered framebuffers:
+	// (headless, the frame stays in Headless's framebuffer for whoever reads it)
 
-	glutSwapBuffers( );
+	if( ! Headless.IsValid( ) )
+		glutSwapBuffers( );
 
 	// be sure the graphics buffer has been sent:
 	// note: be sure to use glFlush( ) here, not glFinish( ) !
 
 	glFlush( );
+
+	// while debugging, report the average frame time every 100 frames:
+	// (the glFinish( ) makes this include the fragment work, which is what
+	//  the mipmapping toggle changes)
+
+	if( DebugOn != 0 )
+	{
+		glFinish( );
+		NumFrames++;
+		if( NumFrames >= 100 )
+		{
+			float now = ElapsedSeconds( );
+			fprintf( stderr, "Mipmapping %s: %6.2f ms/frame\n", MipmapsOn != 0 ? "on " : "off",
+				1000.f * ( now - FrameStart ) / (float)NumFrames );
+			fprintf( stderr, "Rockets %s%s: %6.2f ms/frame queueing the draws, %6.2f ms/frame executing them\n",
+				ArenaDraws( ) ? "multi-drawn" : ( InstancingOn != 0 ? ( GpuCullOn != 0 ? "instanced, culled on the gpu" : "instanced" ) : "one draw each" ), StressShipsOn != 0 ? ", with the stress ships" : "",
+				1000. * QueueSeconds / (double)NumFrames, 1000. * ExecuteSeconds / (double)NumFrames );
+			QueueSeconds = ExecuteSeconds = 0.;
+			fprintf( stderr, "Timeline %s, cpu per frame:", Scene.GetEnabled( ) ? "on " : "off" );
+			for( int p = 0; p < NUMPHASES; p++ )
+			{
+				if( PhaseFrames[p] > 0 )
+					fprintf( stderr, "  %s %6.2f ms", PHASE_NAMES[p], 1000. * PhaseSeconds[p] / (double)PhaseFrames[p] );
+			}
+			fprintf( stderr, "  (%d of %d objects and lights active)\n", Scene.NumActive( ), (int)NUMSCENEIDS );
+			fprintf( stderr, "Scene graph: %d of %d nodes rebuilt last frame\n", Graph.NodesUpdated, Graph.NumNodes( ) );
+			Queue.PrintStats( );
+			if( FragmentQuery != 0 )
+				fprintf( stderr, "Shaded, hi-z occlusion %s, %s backdrop: %.0f vertices/frame, %.0f fragments/frame\n",
+					Queue.GetOcclusion( ) != NULL ? "on " : "off", SkyboxOn != 0 ? "skybox" : "grid",
+					VerticesShaded / (double)NumFrames, FragmentsShaded / (double)NumFrames );
+			FragmentsShaded = VerticesShaded = 0.;
+			if( OverdrawOn != 0 )
+				Overdraw.PrintStats( );
+			if( ProbeOn != 0 )
+				Probe.PrintStats( );
+			Probe.ResetStats( );
+			if( ShadowsOn != 0 )
+				Shadows.PrintStats( );
+			Shadows.ResetStats( );
+			if( ExplosionMode == EXPLOSION_CPU )
+				ExplosionParticles.PrintStats( );
+			ExplosionParticles.ResetStats( );
+			if( ExplosionMode == EXPLOSION_GPU )
+				GpuExplosion.PrintStats( );
+			GpuExplosion.ResetStats( );
+			if( ArenaDraws( ) )
+				Arena.PrintStats( NumFrames );
+			Arena.ResetStats( );
+			State.PrintStats( NumFrames );
+			State.ResetStats( );
+			Residency.PrintStats( );
+			if( VirtualTexOn != 0  &&  VirtualEarth.IsValid( ) )
+				VirtualEarth.PrintStats( );
+			NumFrames = 0;
+			FrameStart = now;
+		}
+	}
 }
 
 
@@ -920,6 +1461,20 @@ DoMainMenu( int id )
 }
 
 
+void
+DoExplosionMenu( int id )
+{
+	ExplosionMode = id;
+	ExplosionParticles.Clear( );
+	ExplosionParticles.ResetStats( );
+	GpuExplosion.Restart( );
+	GpuExplosion.ResetStats( );
+
+	glutSetWindow( MainWindow );
+	glutPostRedisplay( );
+}
+
+
 void
 DoProjectMenu( int id )
 {
@@ -970,7 +1525,7 @@ ElapsedSeconds( )
 {
 	// get # of milliseconds since the start of the program:
 
-	int ms = glutGet( GLUT_ELAPSED_TIME );
+	int ms = ElapsedMsec( );
 
 	// convert it to seconds:
 
@@ -978,6 +1533,20 @@ ElapsedSeconds( )
 }
 
 
+// the number of milliseconds since the start of the program -- glut's, or, with no
+// window, since Headless was made, or, with -batch, the time of the frame being drawn:
+
+int
+ElapsedMsec( )
+{
+	if( BatchMsec >= 0 )
+		return BatchMsec;
+	if( Headless.IsValid( ) )
+		return (int)( 1000. * Headless.ElapsedSeconds( ) );
+	return glutGet( GLUT_ELAPSED_TIME );
+}
+
+
 // initialize the glui window:
 
 void
@@ -1019,6 +1588,11 @@ InitMenus( )
 	glutAddMenuEntry( "Orthographic",  ORTHO );
 	glutAddMenuEntry( "Perspective",   PERSP );
 
+	int explosionmenu = glutCreateMenu( DoExplosionMenu );
+	glutAddMenuEntry( "Geometry Shader",  EXPLOSION_GEOMETRY );
+	glutAddMenuEntry( "CPU Particles",    EXPLOSION_CPU );
+	glutAddMenuEntry( "GPU Particles",    EXPLOSION_GPU );
+
 	int mainmenu = glutCreateMenu( DoMainMenu );
 	glutAddSubMenu(   "Axes",          axesmenu);
 	glutAddSubMenu(   "Axis Colors",   colormenu);
@@ -1033,6 +1607,7 @@ InitMenus( )
 
 	glutAddSubMenu(   "Depth Cue",     depthcuemenu);
 	glutAddSubMenu(   "Projection",    projmenu );
+	glutAddSubMenu(   "Explosion",     explosionmenu );
 	glutAddMenuEntry( "Reset",         RESET );
 	glutAddSubMenu(   "Debug",         debugmenu);
 	glutAddMenuEntry( "Quit",          QUIT );
@@ -1056,74 +1631,88 @@ InitGraphics( )
 	// request the display modes:
 	// ask for red-green-blue-alpha color, double-buffering, and z-buffering:
 
-	glutInitDisplayMode( GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH );
-
-	// set the initial window configuration:
+	// (or, headless, make a context with no window, and an offscreen framebuffer to
+	//  draw into -- and skip the rest of glut)
 
-	glutInitWindowPosition( 0, 0 );
-	glutInitWindowSize( INIT_WINDOW_SIZE, INIT_WINDOW_SIZE );
-
-	// open the window and set its title:
+	if( HeadlessSize > 0 )
+	{
+		if( ! Headless.Init( HeadlessSize, HeadlessSize ) )
+		{
+			fprintf( stderr, "Cannot render headless\n" );
+			exit( 1 );
+		}
+	}
+	else
+	{
+		glutInitDisplayMode( GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL );	// (the stencil is Overdraw's count)
+
+		// set the initial window configuration:
+
+		glutInitWindowPosition( 0, 0 );
+		glutInitWindowSize( INIT_WINDOW_SIZE, INIT_WINDOW_SIZE );
+
+		// open the window and set its title:
+
+		MainWindow = glutCreateWindow( WINDOWTITLE );
+		glutSetWindowTitle( WINDOWTITLE );
+
+		// setup the callback functions:
+		// DisplayFunc -- redraw the window
+		// ReshapeFunc -- handle the user resizing the window
+		// KeyboardFunc -- handle a keyboard input
+		// MouseFunc -- handle the mouse button going down or up
+		// MotionFunc -- handle the mouse moving with a button down
+		// PassiveMotionFunc -- handle the mouse moving with a button up
+		// VisibilityFunc -- handle a change in window visibility
+		// EntryFunc	-- handle the cursor entering or leaving the window
+		// SpecialFunc -- handle special keys on the keyboard
+		// SpaceballMotionFunc -- handle spaceball translation
+		// SpaceballRotateFunc -- handle spaceball rotation
+		// SpaceballButtonFunc -- handle spaceball button hits
+		// ButtonBoxFunc -- handle button box hits
+		// DialsFunc -- handle dial rotations
+		// TabletMotionFunc -- handle digitizing tablet motion
+		// TabletButtonFunc -- handle digitizing tablet button hits
+		// MenuStateFunc -- declare when a pop-up menu is in use
+		// TimerFunc -- trigger something to happen a certain time from now
+		// IdleFunc -- what to do when nothing else is going on
 
-	MainWindow = glutCreateWindow( WINDOWTITLE );
-	glutSetWindowTitle( WINDOWTITLE );
+		glutSetWindow( MainWindow );
+		glutDisplayFunc( Display );
+		glutReshapeFunc( Resize );
+		glutKeyboardFunc( Keyboard );
+		glutMouseFunc( MouseButton );
+		glutMotionFunc( MouseMotion );
+		glutPassiveMotionFunc(MouseMotion);
+		//glutPassiveMotionFunc( NULL );
+		glutVisibilityFunc( Visibility );
+		glutEntryFunc( NULL );
+		glutSpecialFunc( NULL );
+		glutSpaceballMotionFunc( NULL );
+		glutSpaceballRotateFunc( NULL );
+		glutSpaceballButtonFunc( NULL );
+		glutButtonBoxFunc( NULL );
+		glutDialsFunc( NULL );
+		glutTabletMotionFunc( NULL );
+		glutTabletButtonFunc( NULL );
+		glutMenuStateFunc( NULL );
+		glutTimerFunc( -1, NULL, 0 );
+
+		// setup glut to call Animate( ) every time it has
+		// 	nothing it needs to respond to (which is most of the time)
+		// we don't need to do this for this program, and really should set the argument to NULL
+		// but, this sets us up nicely for doing animation
+
+		glutIdleFunc( Animate );
+	}
 
 	// set the framebuffer clear values:
 
 	glClearColor( BACKCOLOR[0], BACKCOLOR[1], BACKCOLOR[2], BACKCOLOR[3] );
 
-	// setup the callback functions:
-	// DisplayFunc -- redraw the window
-	// ReshapeFunc -- handle the user resizing the window
-	// KeyboardFunc -- handle a keyboard input
-	// MouseFunc -- handle the mouse button going down or up
-	// MotionFunc -- handle the mouse moving with a button down
-	// PassiveMotionFunc -- handle the mouse moving with a button up
-	// VisibilityFunc -- handle a change in window visibility
-	// EntryFunc	-- handle the cursor entering or leaving the window
-	// SpecialFunc -- handle special keys on the keyboard
-	// SpaceballMotionFunc -- handle spaceball translation
-	// SpaceballRotateFunc -- handle spaceball rotation
-	// SpaceballButtonFunc -- handle spaceball button hits
-	// ButtonBoxFunc -- handle button box hits
-	// DialsFunc -- handle dial rotations
-	// TabletMotionFunc -- handle digitizing tablet motion
-	// TabletButtonFunc -- handle digitizing tablet button hits
-	// MenuStateFunc -- declare when a pop-up menu is in use
-	// TimerFunc -- trigger something to happen a certain time from now
-	// IdleFunc -- what to do when nothing else is going on
-
-	glutSetWindow( MainWindow );
-	glutDisplayFunc( Display );
-	glutReshapeFunc( Resize );
-	glutKeyboardFunc( Keyboard );
-	glutMouseFunc( MouseButton );
-	glutMotionFunc( MouseMotion );
-	glutPassiveMotionFunc(MouseMotion);
-	//glutPassiveMotionFunc( NULL );
-	glutVisibilityFunc( Visibility );
-	glutEntryFunc( NULL );
-	glutSpecialFunc( NULL );
-	glutSpaceballMotionFunc( NULL );
-	glutSpaceballRotateFunc( NULL );
-	glutSpaceballButtonFunc( NULL );
-	glutButtonBoxFunc( NULL );
-	glutDialsFunc( NULL );
-	glutTabletMotionFunc( NULL );
-	glutTabletButtonFunc( NULL );
-	glutMenuStateFunc( NULL );
-	glutTimerFunc( -1, NULL, 0 );
-
-	// setup glut to call Animate( ) every time it has
-	// 	nothing it needs to respond to (which is most of the time)
-	// we don't need to do this for this program, and really should set the argument to NULL
-	// but, this sets us up nicely for doing animation
-
-	glutIdleFunc( Animate );
-
 	// init the glew package (a window must be open to do this):
 
-#ifdef WIN32
+	glewExperimental = GL_TRUE;
 	GLenum err = glewInit( );
 	if( err != GLEW_OK )
 	{
@@ -1132,7 +1721,6 @@ InitGraphics( )
 	else
 		fprintf( stderr, "GLEW initialized OK\n" );
 	fprintf( stderr, "Status: Using GLEW %s\n", glewGetString(GLEW_VERSION));
-#endif
 
 	// all other setups go here, such as GLSLProgram and KeyTime setups:
 	/*
@@ -1151,36 +1739,36 @@ InitGraphics( )
 	unsigned char* ExplosionTexture = BmpToTexture(explosionArray, &widthex, &heightex);
 	*/
 	//glGenTextures(1, &StarshipTex);
-	glGenTextures(1, &EarthTex);
-	glGenTextures(1, &MoonTex);
-	glGenTextures(1, &ExplosionTex);
-	glGenTextures(1, &SpaceTex);
-	glGenTextures(1, &RocketTex);
 
 	// Store the textures bytes in GPU memory
+	// every texture is trilinear-filtered from a mip chain baked once into a .texcache file,
+	// the planets also get anisotropic filtering since they are seen edge-on near their limbs
+	// the sky faces are BC1 (6:1), the planets BC7 (3:1) since their coastlines band badly in BC1
+
+	// the big ones (the sky cube and the planets) are streamed in rather than uploaded up front
+
+	Streamer.Init( STREAM_SLOTS, STREAM_SLOT_BYTES );
+	InitResidency( &Residency, RESIDENCY_BUDGET, RESIDENCY_DEMOTE );
+
+	struct TexParams cubeParams      = { GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, 1.f,               true,  MIP_BOX,    TEXCACHE_BC1,  &Streamer };
+	struct TexParams spaceParams     = { GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, SPACE_ANISOTROPY,  true,  MIP_BOX,    TEXCACHE_BC1,  NULL };
+	struct TexParams planetParams    = { GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, PLANET_ANISOTROPY, true,  MIP_KAISER, TEXCACHE_BC7,  &Streamer };
+	struct TexParams explosionParams = { GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, 1.f,               false, MIP_BOX,    TEXCACHE_RGB8, NULL };
 	
 	//Shader Stuff CS 457
 	//Rocket Shader Init
-	glBindTexture(GL_TEXTURE_CUBE_MAP, RocketTex);
-	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	for (int file = 0; file < 6; file++)
-	{
-		int nums, numt;
-		unsigned char* texture2d = BmpToTexture(FaceFiles[file], &nums, &numt);
-		if (texture2d == NULL)
-			fprintf(stderr, "Could not open BMP 2D texture '%s'", FaceFiles[file]);
-		else
-			fprintf(stderr, "BMP 2D texture '%s' read -- nums = %d, numt = %d\n", FaceFiles[file], nums, numt);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + file, 0, 3, nums, numt, 0,
-			GL_RGB, GL_UNSIGNED_BYTE, texture2d);
-
-		delete[] texture2d;
-	}
+	RocketRes = LoadResidentCubeMap(&Residency, FaceFiles, &cubeParams);
+	RocketTex = Residency.Get(RocketRes)->tex;
+
+	// ... and prefiltered, for the glossy reflections -- its small levels need
+	// filtering across the faces' edges:
+	EnvTex = LoadPrefilteredCubeMap( FaceFiles, EnvIrradiance, &EnvLevels );
+	if( EnvTex != 0 )
+		glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
+	else
+		fprintf(stderr, "Could not prefilter the cube map -- the rockets are mirrors\n");
+	// (the shipped noise volume is up with the code, not here with the shaders)
+	Noise3Tex = LoadNoiseTexture3D((char*)"../noise3d.064.tex", 64);
 	RocketProgram.Init();
 	bool valid = RocketProgram.Create("rocket.vert", "rocket.frag");
 	if (!valid)
@@ -1188,6 +1776,21 @@ InitGraphics( )
 	else
 		fprintf(stderr, "Rocket shader created!\n");
 
+	RocketInstProgram.Init();
+	if( ! RocketInstProgram.Create("rocketinst.vert", "rocket.frag") )
+		fprintf(stderr, "Could not create the instanced Rocket shader!\n");
+	InstanceCullProgram.Init();
+	if( ! InstanceCullProgram.Create("instcull.comp") )
+		fprintf(stderr, "Could not create the instance culling shader -- culling on the cpu\n");
+	HiZBuildProgram.Init();
+	if( ! HiZBuildProgram.Create("hizbuild.comp")  ||  ! HiZ.Init( &HiZBuildProgram ) )
+		fprintf(stderr, "No hi-z occlusion culling\n");
+	if( GLEW_ARB_pipeline_statistics_query )
+	{
+		glGenQueries( 1, &FragmentQuery );
+		glGenQueries( 1, &VertexQuery );
+	}
+
 	//Booster Shader Init
 	BoosterS.Init();
 	bool valid1 = BoosterS.Create("booster.vert", "booster.frag");
@@ -1197,14 +1800,8 @@ InitGraphics( )
 		fprintf(stderr, "Booster shader created!\n");
 
 	//Space Texture stuff followed by Initializing space shader
-	int nums1, numt1;
-	SpaceTexture = BmpToTexture("nvposz.bmp", &nums1, &numt1);
-	glBindTexture(GL_TEXTURE_2D, SpaceTex);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, 3, nums1, numt1, 0, GL_RGB, GL_UNSIGNED_BYTE, SpaceTexture);
+	SpaceRes = LoadResidentTexture2D(&Residency, (char*)"nvposz.bmp", &spaceParams);
+	SpaceTex = Residency.Get(SpaceRes)->tex;
 
 	SpaceProgram.Init();
 	bool valid2 = SpaceProgram.Create("space.vert", "space.frag");
@@ -1214,14 +1811,8 @@ InitGraphics( )
 		fprintf(stderr, "Space shader created!\n");
 
 	//Earth Texture stuff followed by Earth Shader Init
-	int nums2, numt2;
-	EarthTexture = BmpToTexture("Earth.bmp", &nums2, &numt2);
-	glBindTexture(GL_TEXTURE_2D, EarthTex);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, 3, nums2, numt2, 0, GL_RGB, GL_UNSIGNED_BYTE, EarthTexture);
+	EarthRes = LoadResidentTexture2D(&Residency, (char*)"Earth.bmp", &planetParams);
+	EarthTex = Residency.Get(EarthRes)->tex;
 
 	EarthProgram.Init();
 	bool valid3 = EarthProgram.Create("earth.vert", "earth.frag");
@@ -1230,15 +1821,25 @@ InitGraphics( )
 	else
 		fprintf(stderr, "Earth shader created!\n");
 
+	//Virtual Earth (baked on the first run) and its two shaders
+	if (!LoadVirtualPlanet(&VirtualEarth, (char*)"Earth.bmp", VIRTUAL_EARTH_WIDTH, VIRTUAL_CACHE_TILES))
+		fprintf(stderr, "Could not create the virtual Earth texture!\n");
+
+	EarthVtProgram.Init();
+	bool validvt = EarthVtProgram.Create("earth.vert", "earthvt.frag");
+	VtFeedbackProgram.Init();
+	validvt = VtFeedbackProgram.Create("earth.vert", "vtfeedback.frag") && validvt;
+	if (!validvt)
+	{
+		fprintf(stderr, "Could not create the virtual texture shaders!\n");
+		VirtualEarth.Destroy();
+	}
+	else
+		fprintf(stderr, "Virtual texture shaders created!\n");
+
 	//Moon Texture stuff followed by Moon Shader Init
-	int nums3, numt3;
-	MoonTexture = BmpToTexture("moon.bmp", &nums3, &numt3);
-	glBindTexture(GL_TEXTURE_2D, MoonTex);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, 3, nums3, numt3, 0, GL_RGB, GL_UNSIGNED_BYTE, MoonTexture);
+	MoonRes = LoadResidentTexture2D(&Residency, (char*)"moon.bmp", &planetParams);
+	MoonTex = Residency.Get(MoonRes)->tex;
 
 	MoonProgram.Init();
 	bool valid4 = MoonProgram.Create("earth.vert", "earth.frag");
@@ -1248,14 +1849,7 @@ InitGraphics( )
 		fprintf(stderr, "Moon shader created!\n");
 
 	//Explosion Texture stuff followed by Explosion Shader Init
-	int nums4, numt4;
-	ExplosionTexture = BmpToTexture("explosion.bmp", &nums4, &numt4);
-	glBindTexture(GL_TEXTURE_2D, ExplosionTex);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, 3, nums4, numt4, 0, GL_RGB, GL_UNSIGNED_BYTE, ExplosionTexture);
+	ExplosionTex = LoadTexture2D((char*)"explosion.bmp", &explosionParams);
 	/*
 	ExplosionProgram.Init();
 	bool valid5 = ExplosionProgram.Create("explosion.vert", "explosion.geom", "explosion.frag");
@@ -1274,6 +1868,112 @@ InitGraphics( )
 	{
 		fprintf(stderr, "Floor Program Shader created!");
 	}
+
+	// the multi-draw versions of the rocket, earth, and space shaders:
+	RocketArenaProgram.Init();
+	bool validArena = RocketArenaProgram.Create("rocketarena.vert", "rocket.frag");
+	EarthArenaProgram.Init();
+	validArena = EarthArenaProgram.Create("arena.vert", "earth.frag") && validArena;
+	EarthVtArenaProgram.Init();
+	validArena = EarthVtArenaProgram.Create("arena.vert", "earthvt.frag") && validArena;
+	SpaceArenaProgram.Init();
+	validArena = SpaceArenaProgram.Create("arena.vert", "space.frag") && validArena;
+	if( ! validArena )
+		fprintf(stderr, "Could not create the multi-draw shaders!\n");
+
+	// the depth prepass draws the opaque draws with their own vertex shaders and depth.frag:
+	RocketDepthProgram.Init();
+	RocketInstDepthProgram.Init();
+	RocketArenaDepthProgram.Init();
+	EarthDepthProgram.Init();
+	ArenaDepthProgram.Init();
+	bool validDepth = RocketDepthProgram.Create("rocket.vert", "depth.frag");
+	validDepth = RocketInstDepthProgram.Create("rocketinst.vert", "depth.frag") && validDepth;
+	validDepth = EarthDepthProgram.Create("earth.vert", "depth.frag") && validDepth;
+	if( validArena )
+	{
+		validDepth = RocketArenaDepthProgram.Create("rocketarena.vert", "depth.frag") && validDepth;
+		validDepth = ArenaDepthProgram.Create("arena.vert", "depth.frag") && validDepth;
+	}
+	if( ! validDepth )
+		fprintf(stderr, "Could not create the depth prepass shaders -- those draws won't be prepassed\n");
+	Queue.SetDepthProgram( &RocketProgram, &RocketDepthProgram );
+	Queue.SetDepthProgram( &RocketInstProgram, &RocketInstDepthProgram );
+	Queue.SetDepthProgram( &EarthProgram, &EarthDepthProgram );
+	Queue.SetDepthProgram( &EarthVtProgram, &EarthDepthProgram );
+	Queue.SetDepthProgram( &MoonProgram, &EarthDepthProgram );
+	if( validArena )
+	{
+		Queue.SetDepthProgram( &RocketArenaProgram, &RocketArenaDepthProgram );
+		Queue.SetDepthProgram( &EarthArenaProgram, &ArenaDepthProgram );
+		Queue.SetDepthProgram( &EarthVtArenaProgram, &ArenaDepthProgram );
+	}
+
+	// the backdrop, from the same cube map the rockets reflect:
+	SkyboxProgram.Init();
+	if( ! SkyboxProgram.Create("skybox.vert", "skybox.frag")  ||  ! Sky.Init( &SkyboxProgram ) )
+		fprintf(stderr, "Could not create the skybox shader -- drawing the Space grid\n");
+
+	// the reflection probe that follows the starship:
+	if( ! Probe.Init( PROBE_SIZE, PROBE_FACES_PER_FRAME ) )
+		fprintf(stderr, "Could not create the reflection probe -- the rockets reflect the static cube map\n");
+
+	// the lights' shadow maps:
+	if( ! Shadows.Init( SHADOW_ATLAS_SIZE, SHADOW_TILE_SIZE ) )
+		fprintf(stderr, "Could not create the shadow atlas -- no shadows\n");
+
+	// the explosion as cpu particles, flying out of the triangles explosion.geom
+	// shatters -- the booster's, if explosion.obj isn't there:
+	ParticleProgram.Init();
+	if( ! ParticleProgram.Create("particle.vert", "particle.frag")  ||  ! ExplosionParticles.Init( EXPLOSION_PARTICLES, &ParticleProgram ) )
+		fprintf(stderr, "Could not create the particle shader -- no cpu explosion\n");
+	else
+	{
+		ExplosionParticles.SetBallistics( EXPLOSION_VELSCALE, EXPLOSION_GRAVITY );
+		ExplosionParticles.SetLife( EXPLOSION_LIFE_MIN, EXPLOSION_LIFE_MAX );
+		if( ! ExplosionParticles.SetEmitter( (char *)"explosion.obj" ) )
+			ExplosionParticles.SetEmitter( (char *)"SuperHeavy.obj" );
+	}
+
+	// ... and the same, kept and moved on the gpu:
+	static const char *feedbackVaryings[ ] = { "tfPosition", "tfVelocity" };
+	ParticleSimProgram.Init();
+	ParticleSimProgram.SetFeedbackVaryings( 2, feedbackVaryings );
+	if( ! ParticleSimProgram.Create("particlesim.vert")  ||  ! GpuExplosion.Init( EXPLOSION_GPU_SLOTS, &ParticleSimProgram, &ParticleProgram ) )
+		fprintf(stderr, "Could not create the particle simulation shader -- no gpu explosion\n");
+	else
+	{
+		GpuExplosion.SetBallistics( EXPLOSION_VELSCALE, EXPLOSION_GRAVITY );
+		GpuExplosion.SetLife( EXPLOSION_LIFE_MIN, EXPLOSION_LIFE_MAX );
+		if( ! GpuExplosion.SetEmitter( (char *)"explosion.obj" ) )
+			GpuExplosion.SetEmitter( (char *)"SuperHeavy.obj" );
+	}
+
+	FILE *sprite = fopen( "explosion.bmp", "rb" );
+	ExplosionSprite = ( sprite != NULL )  ?  ExplosionTex  :  0;
+	if( sprite != NULL )
+		fclose( sprite );
+	ExplosionTime = 0.f;
+	ExplosionOwed = 0.f;
+
+	// the shaders get the projection, lights, and material from State's uniform buffer:
+	if( State.Init( ) )
+	{
+		State.MakeCurrent( );
+		GLSLProgram *programs[ ] = { &RocketProgram, &RocketInstProgram, &SpaceProgram, &EarthProgram,
+			&EarthVtProgram, &VtFeedbackProgram, &MoonProgram, &ExplosionProgram,
+			&RocketArenaProgram, &EarthArenaProgram, &EarthVtArenaProgram, &SpaceArenaProgram,
+			&InstanceCullProgram, &SkyboxProgram, &ParticleProgram, &RocketDepthProgram, &RocketInstDepthProgram,
+			&RocketArenaDepthProgram, &EarthDepthProgram, &ArenaDepthProgram };
+		for( int i = 0; i < (int)( sizeof(programs) / sizeof(programs[0]) ); i++ )
+			State.Bind( programs[i] );
+	}
+
+	// ... and the ones that receive shadows get the lights' shadow matrices from Shadows' buffer:
+	GLSLProgram *receivers[ ] = { &RocketProgram, &RocketInstProgram, &RocketArenaProgram,
+		&EarthProgram, &MoonProgram, &EarthArenaProgram };
+	for( int i = 0; i < (int)( sizeof(receivers) / sizeof(receivers[0]) ); i++ )
+		Shadows.Bind( receivers[i] );
 	 
 	// Starship
 	/*
@@ -1403,6 +2103,31 @@ InitGraphics( )
 	Ypos4.AddTimeValue(30.0, 105.);
 	Ypos4.AddTimeValue(35.0, 100.0);
 	Ypos4.AddTimeValue(40.0, 99.0);
+
+	// when each object and light is on the screen -- the booster and the space
+	// backdrop are back for the return, since the camera is:
+	Scene.Init( (float)MSEC / 1000.f );
+	Scene.Add( LAUNCH_STARSHIP,  0.f,                         PHASE_END[PHASE_LAUNCH] );
+	Scene.Add( EXPLOSION,        0.f,                         PHASE_END[PHASE_LAUNCH] );
+	Scene.Add( PAD_BOOSTER,      0.f,                         PHASE_END[PHASE_LAUNCH] );
+	Scene.Add( PAD_BOOSTER,      PHASE_END[PHASE_SPACE],      PHASE_END[PHASE_RETURN] );
+	Scene.Add( BOOSTER_LIGHT,    0.f,                         PHASE_END[PHASE_LAUNCH] );
+	Scene.Add( BOOSTER_LIGHT,    PHASE_END[PHASE_SPACE],      PHASE_END[PHASE_RETURN] );
+	Scene.Add( SPACE_BACKDROP,   0.f,                         PHASE_END[PHASE_LAUNCH] );
+	Scene.Add( SPACE_BACKDROP,   PHASE_END[PHASE_SPACE],      PHASE_END[PHASE_RETURN] );
+	Scene.Add( SPACE_STARSHIP,   PHASE_END[PHASE_LAUNCH],     PHASE_END[PHASE_SPACE] );
+	Scene.Add( SPACE_BOOSTER,    PHASE_END[PHASE_LAUNCH],     PHASE_END[PHASE_SPACE] );
+	Scene.Add( EARTH,            PHASE_END[PHASE_LAUNCH],     PHASE_END[PHASE_SPACE] );
+	Scene.Add( MOON,             PHASE_END[PHASE_LAUNCH],     PHASE_END[PHASE_SPACE] );
+	Scene.Add( MOON_LIGHT,       PHASE_END[PHASE_LAUNCH],     PHASE_END[PHASE_SPACE] );
+	Scene.Add( MOON_SURFACE,     PHASE_END[PHASE_RETURN],     PHASE_END[PHASE_LANDING] );
+	Scene.Add( SURFACE_LIGHT,    PHASE_END[PHASE_RETURN],     PHASE_END[PHASE_LANDING] );
+	Scene.Add( LANDING_STARSHIP, PHASE_END[PHASE_RETURN],     PHASE_END[PHASE_LANDING] );
+	Scene.Build( );
+	if( DebugOn != 0 )
+		Scene.PrintIntervals( SCENE_NAMES );
+
+	InitSceneGraph( );
 }
 
 
@@ -1418,7 +2143,8 @@ InitLists( )
 		fprintf(stderr, "Starting InitLists.\n");
 
 	
-	glutSetWindow( MainWindow );
+	if( ! Headless.IsValid( ) )
+		glutSetWindow( MainWindow );
 
 	// create the earth and moon:
 	
@@ -1446,21 +2172,51 @@ InitLists( )
 		glPopMatrix();
 	glEndList();
 
+	// both are the unit sphere:
+	float sphereBounds[6] = { -1.f, -1.f, -1.f,   1.f, 1.f, 1.f };
+	Queue.SetBounds(EarthDL, sphereBounds);
+	Queue.SetBounds(MoonDL, sphereBounds);
+	ShadowQueue.SetBounds(EarthDL, sphereBounds);
+	ShadowQueue.SetBounds(MoonDL, sphereBounds);
+
+	// the reflection probe's faces are small, so its earth and moon needn't be as round:
+	ProbeSphereDL = glGenLists(1);
+	glNewList(ProbeSphereDL, GL_COMPILE);
+		glColor3f(1, 1, 1);
+		OsuSphere(1., PROBE_SPHERE_SLICES, PROBE_SPHERE_SLICES);
+	glEndList();
+	ProbeQueue.SetBounds(ProbeSphereDL, sphereBounds);
+
 	// load the obj files:
 
+	// (with their bounding boxes, for culling)
+	float bounds[6];
+
 	//Starship
 	Starship = glGenLists(1);
 	glNewList(Starship, GL_COMPILE);
-		LoadObjFile("Starship.obj");
+		if( LoadObjFile("Starship.obj", bounds) == 0 )
+		{
+			Queue.SetBounds(Starship, bounds);
+			ShadowQueue.SetBounds(Starship, bounds);
+		}
 	glEndList();
 
 	// Rocket Booster
 	Booster = glGenLists(1);
 	glNewList(Booster, GL_COMPILE);
 		//glBindTexture(GL_TEXTURE_2D, StarshipTex);
-		LoadObjFile("SuperHeavy.obj");
+		if( LoadObjFile("SuperHeavy.obj", bounds) == 0 )
+		{
+			Queue.SetBounds(Booster, bounds);
+			ShadowQueue.SetBounds(Booster, bounds);
+		}
 	glEndList();
 
+	// ... and both again as buffers for instancing:
+	StarshipMesh.Init("Starship.obj");
+	BoosterMesh.Init("SuperHeavy.obj");
+
 	//Launch Pad
 	/*
 	LaunchPad = glGenLists(1);
@@ -1473,14 +2229,20 @@ InitLists( )
 	// MoonLanding
 	MoonSurface = glGenLists(1);
 	glNewList(MoonSurface, GL_COMPILE);
-		LoadObjFile("moonSurface.obj");
+		if( LoadObjFile("moonSurface.obj", bounds) == 0 )
+		{
+			Queue.SetBounds(MoonSurface, bounds);
+			ProbeQueue.SetBounds(MoonSurface, bounds);
+			ShadowQueue.SetBounds(MoonSurface, bounds);
+		}
 		//glBindTexture(GL_TEXTURE_2D, MoonTex);
 	glEndList();
 
 	// Explosion
 	Explosion = glGenLists(1);
 	glNewList(Explosion, GL_COMPILE);
-		LoadObjFile("explosion.obj");
+		if( LoadObjFile("explosion.obj", bounds) == 0 )
+			Queue.SetBounds(Explosion, bounds);
 		//glBindTexture(GL_TEXTURE_3D, ExplosionTex);
 	glEndList();
 
@@ -1510,6 +2272,19 @@ InitLists( )
 		glEnd();
 	}
 	glEndList();
+	float spaceBounds[6] = { xmin, ymin, z,   xmax, ymax, z };
+	Queue.SetBounds(Space, spaceBounds);
+
+	// ... and everything that is drawn with the rocket, earth, and space shaders again,
+	// all in one arena for the multi-draws (the explosion stays a display list --
+	// its program hands eye coordinates on to a geometry shader):
+	StarshipArena = Arena.AddObj("Starship.obj");
+	BoosterArena = Arena.AddObj("SuperHeavy.obj");
+	SphereArena = Arena.AddSphere(1., 200, 200);
+	SurfaceArena = Arena.AddObj("moonSurface.obj");
+	SpaceArena = Arena.AddGrid(xmin, xmax, ymin, ymax, z, numx, numy);
+	if( StarshipArena < 0  ||  BoosterArena < 0  ||  SurfaceArena < 0  ||  ! Arena.Finish( ) )
+		Arena.Destroy( );
 
 	// create the axes:
 		
@@ -1542,6 +2317,188 @@ Keyboard( unsigned char c, int x, int y )
 			NowProjection = PERSP;
 			break;
 
+		case 'm':
+		case 'M':
+			SetMipmapping( ! MipmapsOn );
+			break;
+
+		case 'v':
+		case 'V':
+			VirtualTexOn = ! VirtualTexOn;
+			break;
+
+		case 'b':
+		case 'B':
+			// halve the texture budget, wrapping back around to the full one:
+			if( Residency.GetBudget( ) / 2 < RESIDENCY_MINIMUM )
+				Residency.SetBudget( RESIDENCY_BUDGET );
+			else
+				Residency.SetBudget( Residency.GetBudget( ) / 2 );
+			Residency.PrintStats( );
+			break;
+
+		case 'c':
+		case 'C':
+			Queue.SetCulling( ! Queue.GetCulling( ) );
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'i':
+		case 'I':
+			InstancingOn = ! InstancingOn;
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'g':
+		case 'G':
+			GpuCullOn = ! GpuCullOn;
+			SetGpuCulling( );
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'h':
+		case 'H':
+			OcclusionOn = ! OcclusionOn;
+			Queue.SetOcclusion( OcclusionOn != 0 ? &HiZ : NULL );
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FragmentsShaded = VerticesShaded = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'k':
+		case 'K':
+			SkyboxOn = ! SkyboxOn;
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FragmentsShaded = VerticesShaded = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'z':
+		case 'Z':
+			PrepassOn = ! PrepassOn;
+			Queue.SetPrepass( PrepassOn != 0 );
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FragmentsShaded = VerticesShaded = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'n':
+		case 'N':
+			FrontToBackOn = ! FrontToBackOn;
+			Queue.SetFrontToBack( FrontToBackOn != 0 );
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FragmentsShaded = VerticesShaded = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'w':
+		case 'W':
+			OverdrawOn = ! OverdrawOn;
+			break;
+
+		case 'e':
+		case 'E':
+			ProbeOn = ! ProbeOn;
+			Probe.ResetStats( );
+			break;
+
+		case 'l':
+		case 'L':
+			GlossyOn = ! GlossyOn;
+			break;
+
+		case 'y':
+		case 'Y':
+			// 0., .25, .5, .75, 1., and around again:
+			Roughness += 0.25f;
+			if( Roughness > 1.001f )
+				Roughness = 0.f;
+			fprintf( stderr, "Roughness %.2f\n", Roughness );
+			break;
+
+		case 'd':
+		case 'D':
+			ShadowsOn = ! ShadowsOn;
+			Shadows.ResetStats( );
+			break;
+
+		case 'j':
+		case 'J':
+			// redraw everything into the shadow maps every frame, or only what moves:
+			Shadows.SetCaching( ! Shadows.GetCaching( ) );
+			Shadows.ResetStats( );
+			NumFrames = 0;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'x':
+		case 'X':
+			// 1, 2, then all 6 faces a frame:
+			Probe.SetFacesPerFrame( Probe.GetFacesPerFrame( ) == 1 ? 2 : ( Probe.GetFacesPerFrame( ) == 2 ? PROBE_FACES : 1 ) );
+			Probe.ResetStats( );
+			NumFrames = 0;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 's':
+		case 'S':
+			StressShipsOn = ! StressShipsOn;
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'a':
+		case 'A':
+			ArenaOn = ! ArenaOn;
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			Arena.ResetStats( );
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'f':
+		case 'F':
+			State.SetFixed( ! State.GetFixed( ) );
+			State.ResetStats( );
+			NumFrames = 0;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 'r':
+		case 'R':
+			Queue.SetSorting( ! Queue.GetSorting( ) );
+			NumFrames = 0;
+			QueueSeconds = ExecuteSeconds = 0.;
+			FrameStart = ElapsedSeconds( );
+			break;
+
+		case 't':
+		case 'T':
+			Scene.SetEnabled( ! Scene.GetEnabled( ) );
+			for( int p = 0; p < NUMPHASES; p++ )
+			{
+				PhaseSeconds[p] = 0.;
+				PhaseFrames[p] = 0;
+			}
+			break;
+
+		case 'u':
+		case 'U':
+			if( StreamTest.textures == NULL  &&  Streamer.IsIdle( ) )
+				StartStreamStress( &Streamer, &StreamTest, 16, 1024 );
+			break;
+
 		case 'q':
 		case 'Q':
 		case ESCAPE:
@@ -1667,10 +2624,525 @@ Reset( )
 	DepthFightingOn = 0;
 	DepthCueOn = 0;
 	Scale  = 1.0;
-	ShadowsOn = 0;
+	ShadowsOn = 1;
+	Shadows.SetCaching( true );
+	ExplosionMode = EXPLOSION_CPU;
+	ExplosionParticles.Clear( );
+	GpuExplosion.Restart( );
 	NowColor = YELLOW;
 	NowProjection = PERSP;
 	Xrot = Yrot = 0.;
+	SetMipmapping( 1 );
+	VirtualTexOn = 1;
+	Queue.SetSorting( true );
+	Queue.SetCulling( true );
+	InstancingOn = 1;
+	ArenaOn = 1;
+	GpuCullOn = 1;
+	SetGpuCulling( );
+	OcclusionOn = 1;
+	Queue.SetOcclusion( &HiZ );
+	SkyboxOn = 1;
+	PrepassOn = 0;
+	Queue.SetPrepass( false );
+	FrontToBackOn = 0;
+	Queue.SetFrontToBack( false );
+	OverdrawOn = 0;
+	ProbeOn = 1;
+	Probe.SetFacesPerFrame( PROBE_FACES_PER_FRAME );
+	GlossyOn = 1;
+	Roughness = ROCKET_ROUGHNESS;
+	StressShipsOn = 0;
+	Scene.SetEnabled( true );
+	State.SetFixed( false );
+}
+
+
+// the textures every rocket draw samples -- glossy, the static cube map is
+// the prefiltered one, and with the probe on they reflect it, and still refract
+// the static cube map. with the shadows on, the shadow atlas as well:
+
+void
+QueueRocketTextures( int draw, GLuint rocketTex )
+{
+	GLuint envTex = ( GlossyOn != 0  &&  EnvTex != 0 ) ? EnvTex : rocketTex;
+	GLuint reflectTex = ( ProbeOn != 0  &&  Probe.IsValid( ) ) ? Probe.GetTexture( ) : envTex;
+	Queue.Texture( draw, ROCKET_REFLECT_UNIT, GL_TEXTURE_CUBE_MAP, reflectTex );
+	Queue.Texture( draw, ROCKET_REFRACT_UNIT, GL_TEXTURE_CUBE_MAP, envTex );
+	Queue.Texture( draw, ROCKET_NOISE_UNIT, GL_TEXTURE_3D, Noise3Tex );
+	QueueShadowTexture( draw );
+}
+
+
+// the shadow atlas, for a draw that receives shadows:
+
+void
+QueueShadowTexture( int draw )
+{
+	if( ShadowsOn != 0  &&  Shadows.IsValid( ) )
+		Queue.Texture( draw, SHADOW_TEXTURE_UNIT, GL_TEXTURE_2D, Shadows.GetTexture( ) );
+}
+
+
+// queue a rocket drawn with this modelview matrix -- out of the arena if the
+// multi-draws are on, or else, with instancing on, it is only added to the mesh's
+// instances (and -1 is returned instead of a draw):
+
+int
+SubmitRocket( GLuint list, InstancedMesh *mesh, int arenaMesh, UniformBlock *uniforms, GLuint rocketTex, const float *modelview, float whiteOrRed, float whiteOrBlack )
+{
+	int draw;
+	if( ArenaDraws( ) )
+	{
+		draw = Queue.Submit( &RocketArenaProgram, uniforms, &Arena, arenaMesh, modelview );
+		QueueRocketTextures( draw, rocketTex );
+		return draw;
+	}
+
+	if( InstancingOn != 0  &&  mesh->IsValid( ) )
+	{
+		mesh->Add( modelview, whiteOrRed, whiteOrBlack );
+		return -1;
+	}
+
+	draw = Queue.Submit( &RocketProgram, uniforms, list, modelview );
+	QueueRocketTextures( draw, rocketTex );
+	return draw;
+}
+
+
+// are the static meshes being drawn out of the arena?
+
+bool
+ArenaDraws( )
+{
+	return ArenaOn != 0  &&  Arena.IsValid( );
+}
+
+
+// queue the one draw of all of a mesh's instances:
+
+void
+SubmitRocketInstances( InstancedMesh *mesh, UniformBlock *uniforms, GLuint rocketTex )
+{
+	if( mesh->NumInstances( ) == 0 )
+		return;
+
+	int draw = Queue.Submit( &RocketInstProgram, uniforms, mesh );
+	QueueRocketTextures( draw, rocketTex );
+}
+
+
+// render this frame's share of Probe's faces, from where node is, in eye
+// coordinates (which is how the rockets look it up). the probe sees less than the
+// frame does: the earth, the moon, and the moon's surface, the spheres coarser and
+// without the virtual texture or the hi-z culling, and the sky behind them -- and
+// not the rockets, the probe being inside one of them:
+
+void
+RenderProbe( int node, const float *view )
+{
+	float modelview[16];
+	Graph.GetModelview( node, view, modelview );
+	int faces = Probe.Begin( &modelview[12] );
+
+	// (the shadow matrices are for the frame's eye coordinates, not the probe's)
+	UniformBlock earthUniforms;
+	earthUniforms.Set( (char *)"uTexUnit1", 11 );
+	earthUniforms.Set( (char *)"uShadowsOn", 0.f );
+	UniformBlock moonUniforms;
+	moonUniforms.Set( (char *)"uTexUnit1", 12 );
+	moonUniforms.Set( (char *)"uShadowsOn", 0.f );
+	glEnable( GL_DEPTH_TEST );
+	for( int i = 0; i < faces; i++ )
+	{
+		// the face's view goes on top of the frame's:
+		float faceView[16];
+		Probe.BeginFace( i, faceView );
+		glm::mat4 probeViewing = glm::make_mat4( faceView ) * glm::make_mat4( view );
+		const float *probeView = glm::value_ptr( probeViewing );
+
+		int draw;
+		ProbeQueue.Begin( );
+		if( Scene.IsActive( EARTH ) )
+		{
+			Graph.GetModelview( SceneNodes[EARTH], probeView, modelview );
+			draw = ProbeQueue.Submit( &EarthProgram, &earthUniforms, ProbeSphereDL, modelview );
+			ProbeQueue.Texture( draw, 11, GL_TEXTURE_2D, Residency.Bind(EarthRes) );
+		}
+		if( Scene.IsActive( MOON ) )
+		{
+			Graph.GetModelview( SceneNodes[MOON], probeView, modelview );
+			draw = ProbeQueue.Submit( &MoonProgram, &moonUniforms, ProbeSphereDL, modelview );
+			ProbeQueue.Texture( draw, 12, GL_TEXTURE_2D, Residency.Bind(MoonRes) );
+		}
+		if( Scene.IsActive( MOON_SURFACE ) )
+		{
+			Graph.GetModelview( SceneNodes[MOON_SURFACE], probeView, modelview );
+			draw = ProbeQueue.Submit( &MoonProgram, &moonUniforms, MoonSurface, modelview );
+			ProbeQueue.Texture( draw, 12, GL_TEXTURE_2D, Residency.Bind(MoonRes) );
+		}
+		ProbeQueue.Execute( );
+
+		// the static cube map is what the rockets reflected before, so it is
+		// the probe's backdrop whichever backdrop the frame has:
+		if( Sky.IsValid( ) )
+			Sky.Draw( Residency.Bind( RocketRes ), faceView );
+		Probe.EndFace( );
+	}
+	Probe.End( );
+}
+
+
+// draw the shadow maps of the lights that are on, out of what the frame is drawing:
+// the earth, the moon, its surface, and the stress ships don't move, so with caching
+// on they are only drawn again when a light moves or one of them comes or goes --
+// the rockets are drawn every frame. the casters are drawn with the depth programs,
+// the spheres without the virtual texture, and all as display lists
+
+void
+RenderShadows( const float *view )
+{
+	unsigned int staticKey = ( Scene.IsActive( EARTH ) ? 1 : 0 )  |  ( Scene.IsActive( MOON ) ? 2 : 0 )
+			       | ( Scene.IsActive( MOON_SURFACE ) ? 4 : 0 )  |  ( StressShipsOn != 0 ? 8 : 0 );
+	static const int rockets[ ] = { LAUNCH_STARSHIP, SPACE_STARSHIP, PAD_BOOSTER, SPACE_BOOSTER, LANDING_STARSHIP };
+
+	int tiles = Shadows.Begin( view, staticKey );
+	for( int i = 0; i < tiles; i++ )
+	{
+		float lightView[16], modelview[16];
+		if( Shadows.BeginTile( i, lightView ) )
+		{
+			ShadowQueue.Begin( );
+			if( Scene.IsActive( EARTH ) )
+			{
+				Graph.GetModelview( SceneNodes[EARTH], lightView, modelview );
+				ShadowQueue.Submit( &EarthDepthProgram, NULL, EarthDL, modelview );
+			}
+			if( Scene.IsActive( MOON ) )
+			{
+				Graph.GetModelview( SceneNodes[MOON], lightView, modelview );
+				ShadowQueue.Submit( &EarthDepthProgram, NULL, MoonDL, modelview );
+			}
+			if( Scene.IsActive( MOON_SURFACE ) )
+			{
+				Graph.GetModelview( SceneNodes[MOON_SURFACE], lightView, modelview );
+				ShadowQueue.Submit( &EarthDepthProgram, NULL, MoonSurface, modelview );
+			}
+			if( StressShipsOn != 0 )
+			{
+				for( int s = 0; s < STRESS_SHIPS; s++ )
+				{
+					Graph.GetModelview( StressNodes + s, lightView, modelview );
+					ShadowQueue.Submit( &RocketDepthProgram, NULL, Starship, modelview );
+				}
+			}
+			ShadowQueue.Execute( );
+		}
+
+		Shadows.BeginDynamic( i );
+		ShadowQueue.Begin( );
+		for( int r = 0; r < (int)( sizeof(rockets) / sizeof(rockets[0]) ); r++ )
+		{
+			if( ! Scene.IsActive( rockets[r] ) )
+				continue;
+			Graph.GetModelview( SceneNodes[ rockets[r] ], lightView, modelview );
+			bool booster = ( rockets[r] == PAD_BOOSTER  ||  rockets[r] == SPACE_BOOSTER );
+			ShadowQueue.Submit( &RocketDepthProgram, NULL, booster ? Booster : Starship, modelview );
+		}
+		ShadowQueue.Execute( );
+		Shadows.EndTile( i, ShadowQueue.Draws );
+	}
+	Shadows.End( );
+}
+
+
+// step the explosion's particles up to nowTime and send them to be drawn -- they
+// start over when the loop comes back around to the explosion, and are emitted at
+// EXPLOSION_RATE a second in between. the gpu's never leave it, and keep their own
+// rate:
+
+void
+UpdateExplosion( float nowTime )
+{
+	float dt = nowTime - ExplosionTime;
+	ExplosionTime = nowTime;
+	if( dt < 0.f  ||  dt > 0.25f )
+	{
+		ExplosionParticles.Clear( );
+		GpuExplosion.Restart( );
+		ExplosionOwed = 0.f;
+		dt = 0.f;
+	}
+	if( ExplosionMode == EXPLOSION_GPU )
+	{
+		GpuExplosion.Update( dt );
+		return;
+	}
+	ExplosionParticles.Update( dt );
+
+	ExplosionOwed += EXPLOSION_RATE * dt;
+	int emit = (int)ExplosionOwed;
+	ExplosionOwed -= (float)emit;
+	ExplosionParticles.Emit( emit );
+	ExplosionParticles.Upload( );
+}
+
+
+// set the viewport to a square centered in the window, and the viewing volume and
+// transformation for this phase, and hand the two matrices back:
+
+void
+SetView( int phase, glm::mat4 *projection, float view[16] )
+{
+	GLsizei vx = Headless.IsValid( ) ? Headless.GetWidth( )  : glutGet( GLUT_WINDOW_WIDTH );
+	GLsizei vy = Headless.IsValid( ) ? Headless.GetHeight( ) : glutGet( GLUT_WINDOW_HEIGHT );
+	GLsizei v = vx < vy ? vx : vy;			// minimum dimension
+	GLint xl = ( vx - v ) / 2;
+	GLint yb = ( vy - v ) / 2;
+	glViewport( xl, yb,  v, v );
+
+
+	// set the viewing volume:
+	// remember that the Z clipping  values are given as DISTANCES IN FRONT OF THE EYE
+	// USE gluOrtho2D( ) IF YOU ARE DOING 2D !
+
+	// (the matrices are built with glm, for the shaders, and loaded into the fixed-function
+	// matrices only for the axes and the culling)
+	if( NowProjection == ORTHO )
+		*projection = glm::ortho( -2.f, 2.f,     -2.f, 2.f,     0.1f, 1000.f );
+	else
+		*projection = glm::perspective( glm::radians( 70.f ), 1.f,	0.1f, 1000.f );
+
+	// place the objects into the scene:
+
+	// set the eye position, look-at position, and up-vector:
+	// (by phase, so the camera and the timeline always agree on where we are)
+	glm::mat4 viewing;
+	if (phase == PHASE_LAUNCH)
+		viewing = glm::lookAt(glm::vec3(1.f, -1.f, 5.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+	else if (phase == PHASE_RETURN)
+		viewing = glm::lookAt(glm::vec3(1.f, -1.f, 5.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+	else if (phase == PHASE_LANDING)
+		viewing = glm::lookAt(glm::vec3(0.f, 100.f, 3.f), glm::vec3(0.f, 100.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+	else
+		viewing = glm::lookAt(glm::vec3(-4.0f, -100.f, 3.0f), glm::vec3(6.f, -100.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+	//gluLookAt(Iposx.GetValue(nowTime), -Iposy.GetValue(nowTime), Iposz.GetValue(nowTime), Iatx.GetValue(nowTime), Iaty.GetValue(nowTime), 0.f, 0.f, 1.f, 0.f);
+	//gluLookAt( -4.0f, -10.f, 3.0f, 6.f, -10.f, 0.f, 0.f, 1.f, 0.f);
+	
+	// rotate the scene:
+
+	viewing = glm::rotate( viewing, glm::radians( (GLfloat)Yrot ), glm::vec3( 0.f, 1.f, 0.f ) );
+	viewing = glm::rotate( viewing, glm::radians( (GLfloat)Xrot ), glm::vec3( 1.f, 0.f, 0.f ) );
+
+	// uniformly scale the scene:
+
+	if( Scale < MINSCALE )
+		Scale = MINSCALE;
+	viewing = glm::scale( viewing, glm::vec3( (GLfloat)Scale, (GLfloat)Scale, (GLfloat)Scale ) );
+
+	// the viewing transformation, that every world matrix goes under:
+	memcpy( view, glm::value_ptr( viewing ), 16 * sizeof(float) );
+
+	glMatrixMode( GL_PROJECTION );
+	glLoadMatrixf( glm::value_ptr( *projection ) );
+	glMatrixMode( GL_MODELVIEW );
+	glLoadMatrixf( view );
+	State.BeginFrame( glm::value_ptr( *projection ) );
+}
+
+
+// draw the earth into the virtual texture's feedback framebuffer, and bring in the
+// pages it asks for:
+
+void
+EarthFeedback( float *modelview )
+{
+	UniformBlock feedbackUniforms;
+	SetVirtualUniforms( &feedbackUniforms, VirtualEarth.GetLodBias( ) );
+	VirtualEarth.BeginFeedback( );
+	VtFeedbackProgram.Use();
+	feedbackUniforms.Apply( &VtFeedbackProgram );
+	VtFeedbackProgram.SetUniformMatrix4( (char *)"uModelView", modelview );
+	State.Flush( );
+	glCallList(EarthDL);
+	VtFeedbackProgram.UnUse();
+	VirtualEarth.EndFeedback( );
+	VirtualEarth.Update( );
+}
+
+
+// bring what Display( ) carries from frame to frame up to a frame that isn't drawn
+// here -- a batch worker skips the other workers' frames, and without this its
+// textures would arrive, its explosion be stepped, and its virtual earth's pages
+// come and go, by its own frames rather than the loop's:
+
+void
+SkipFrame( )
+{
+	if( StreamTest.textures != NULL )
+		StreamStressFrame( &Streamer, &StreamTest, STREAM_BYTES_PER_FRAME );
+	else
+		Streamer.Update( STREAM_BYTES_PER_FRAME );
+
+	float nowTime = (float)( ElapsedMsec( ) % MSEC ) / 1000.;
+	Scene.Update( nowTime );
+	int phase = 0;
+	while( phase < NUMPHASES-1  &&  nowTime >= PHASE_END[phase] )
+		phase++;
+
+	// (which pages are resident decides what the earth falls back to where the
+	// feedback missed, so the page cache has to see every frame's feedback)
+	if( Scene.IsActive( EARTH )  &&  VirtualTexOn != 0  &&  VirtualEarth.IsValid( ) )
+	{
+		glm::mat4 projection;
+		float view[16], modelview[16];
+		SetView( phase, &projection, view );
+		Graph.GetModelview( SceneNodes[EARTH], view, modelview );
+		if( Queue.Visible( EarthDL, modelview ) )
+			EarthFeedback( modelview );
+	}
+
+	if( Scene.IsActive( EXPLOSION )  &&  ( ( ExplosionMode == EXPLOSION_CPU  &&  ExplosionParticles.IsValid( ) )
+					||  ( ExplosionMode == EXPLOSION_GPU  &&  GpuExplosion.IsValid( ) ) ) )
+		UpdateExplosion( nowTime );
+}
+
+
+// give the instanced meshes the culling shader, or take it away -- if it can't be
+// used, they go on culling on the cpu:
+
+void
+SetGpuCulling( )
+{
+	GLSLProgram *program = GpuCullOn != 0 ? &InstanceCullProgram : NULL;
+	bool onGpu = StarshipMesh.SetCullProgram( program );
+	onGpu = BoosterMesh.SetCullProgram( program ) && onGpu;
+	if( ! onGpu )
+	{
+		StarshipMesh.SetCullProgram( NULL );
+		BoosterMesh.SetCullProgram( NULL );
+		GpuCullOn = 0;
+	}
+}
+
+
+// the uniforms vtfeedback.frag and earthvt.frag share:
+
+void
+SetVirtualUniforms( UniformBlock *uniforms, float lodBias )
+{
+	uniforms->Set( (char *)"uVirtualSize", (float)VirtualEarth.VirtualWidth( ), (float)VirtualEarth.VirtualHeight( ) );
+	uniforms->Set( (char *)"uNumLevels", (float)VirtualEarth.GetNumLevels( ) );
+	uniforms->Set( (char *)"uPageSize", (float)VT_PAGESIZE );
+	uniforms->Set( (char *)"uBorder", (float)VT_BORDER );
+	uniforms->Set( (char *)"uCacheTiles", (float)VirtualEarth.GetCacheTiles( ) );
+	uniforms->Set( (char *)"uLodBias", lodBias );
+}
+
+
+// build the scene graph -- each object's node is what used to be its
+// glTranslatef( ), glRotatef( ), glScalef( ), with the parts that objects share pulled
+// up into a parent. Display( ) only sets what the keytimes move:
+
+void
+InitSceneGraph( )
+{
+	Graph.Clear( );
+	for( int i = 0; i < NUMSCENEIDS; i++ )
+		SceneNodes[i] = -1;
+
+	// on the launch pad:
+	int pad = Graph.AddNode( -1 );
+	Graph.SetTranslation( pad, 0.f, 0.f, 2.5f );
+
+	SceneNodes[LAUNCH_STARSHIP] = Graph.AddNode( pad );
+	Graph.SetRotation( SceneNodes[LAUNCH_STARSHIP], 90, -1, 0, 0 );
+	Graph.SetScale( SceneNodes[LAUNCH_STARSHIP], 0.1f );
+
+	SceneNodes[PAD_BOOSTER] = Graph.AddNode( pad );
+	Graph.SetRotation( SceneNodes[PAD_BOOSTER], 90, -1, 0, 0 );
+	Graph.SetScale( SceneNodes[PAD_BOOSTER], 0.1f );
+
+	// (the scale is uniform, so it doesn't matter that it was applied before the rotation)
+	SceneNodes[EXPLOSION] = Graph.AddNode( pad );
+	Graph.SetRotation( SceneNodes[EXPLOSION], 180, 1, 0, 0 );
+
+	SceneNodes[SPACE_BACKDROP] = Graph.AddNode( -1 );
+	Graph.SetTranslation( SceneNodes[SPACE_BACKDROP], 0.f, 0.f, 2.f );
+	Graph.SetScale( SceneNodes[SPACE_BACKDROP], 4.5f );
+
+	// out in space:
+	int space = Graph.AddNode( -1 );
+	Graph.SetTranslation( space, 0.f, -100.f, 0.f );
+
+	SceneNodes[EARTH] = Graph.AddNode( space );
+	Graph.SetScale( SceneNodes[EARTH], 1.2f );
+
+	SceneNodes[MOON] = Graph.AddNode( space );
+	Graph.SetTranslation( SceneNodes[MOON], 5.f, 0.f, 1.f );
+	Graph.SetScale( SceneNodes[MOON], 1.2f );
+
+	SpaceShipCourse = Graph.AddNode( space );
+	Graph.SetRotation( SpaceShipCourse, 330, 1, 2, 0 );
+	SceneNodes[SPACE_STARSHIP] = Graph.AddNode( SpaceShipCourse );
+
+	SceneNodes[SPACE_BOOSTER] = Graph.AddNode( space );
+	Graph.SetTranslation( SceneNodes[SPACE_BOOSTER], -2.f, -0.25f, 2.f );
+	Graph.SetRotation( SceneNodes[SPACE_BOOSTER], 30, -1, -2, 0 );
+
+	// on the moon:
+	SceneNodes[MOON_SURFACE] = Graph.AddNode( -1 );
+	Graph.SetTranslation( SceneNodes[MOON_SURFACE], 0.f, 118.f, 10.f );
+
+	SceneNodes[LANDING_STARSHIP] = Graph.AddNode( -1 );
+	Graph.SetRotation( SceneNodes[LANDING_STARSHIP], 90, -1, 0, 0 );
+	Graph.SetScale( SceneNodes[LANDING_STARSHIP], 0.1f );
+
+	// the stress test's field of starships:
+	int field = Graph.AddNode( -1 );
+	int side = (int)sqrtf( (float)STRESS_SHIPS );
+	StressNodes = Graph.NumNodes( );
+	for( int i = 0; i < STRESS_SHIPS; i++ )
+	{
+		int ship = Graph.AddNode( field );
+		Graph.SetTranslation( ship, -10.f + 20.f * (float)( i % side ) / (float)side, -1.f, -25.f + 20.f * (float)( i / side ) / (float)side );
+		Graph.SetRotation( ship, 90, -1, 0, 0 );
+		Graph.SetScale( ship, 0.02f );
+	}
+
+	Graph.SetSimd( true );
+	Graph.Update( );
+}
+
+
+// switch every scene texture between trilinear mipmapping and plain bilinear:
+// (the mip levels stay resident, so this only changes how they are sampled)
+// anisotropic filtering goes off with the mipmapping -- with no coarser level to
+// take its probes from, each of the 4 or 8 probes filters the full-size level
+// across the whole footprint, and that costs far more than the mipmaps save
+
+void
+SetMipmapping( int on )
+{
+	MipmapsOn = on;
+	GLenum minFilter = ( on != 0 )  ?  GL_LINEAR_MIPMAP_LINEAR  :  GL_LINEAR;
+
+	glBindTexture( GL_TEXTURE_CUBE_MAP, RocketTex );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, minFilter );
+
+	GLuint textures[ ]   = { SpaceTex,         EarthTex,          MoonTex,           ExplosionTex };
+	float  anisotropy[ ] = { SPACE_ANISOTROPY, PLANET_ANISOTROPY, PLANET_ANISOTROPY, 1.f };
+	for( int i = 0; i < (int)( sizeof(textures) / sizeof(GLuint) ); i++ )
+	{
+		glBindTexture( GL_TEXTURE_2D, textures[i] );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter );
+		SetTexAnisotropy( GL_TEXTURE_2D, ( on != 0 )  ?  anisotropy[i]  :  1.f );
+	}
+
+	NumFrames = 0;
+	QueueSeconds = ExecuteSeconds = 0.;
+	FrameStart = ElapsedSeconds( );
 }
 
 
@@ -1687,6 +3159,289 @@ Resize( int width, int height )
 }
 
 
+// with -headless, draw the scene frames times into Headless's framebuffer, as
+// glutMainLoop( ) would into the window, and keep the last frame:
+
+void
+RunHeadless( int frames )
+{
+	double start = Headless.ElapsedSeconds( );
+	for( int frame = 0; frame < frames; frame++ )
+		Display( );
+	glFinish( );
+	double seconds = Headless.ElapsedSeconds( ) - start;
+
+	if( frames > 0 )
+		fprintf( stderr, "Headless: %d frames, %d x %d, %8.2f ms/frame (%.2f frames/s)\n", frames,
+			Headless.GetWidth( ), Headless.GetHeight( ), 1000. * seconds / (double)frames, (double)frames / seconds );
+	if( Headless.WritePpm( (char *)"headless.ppm" ) )
+		fprintf( stderr, "Headless: the last frame is in headless.ppm\n" );
+	Headless.Destroy( );
+}
+
+
+// with -stream, let the baked textures finish streaming in, then stream count
+// size x size textures at STREAM_BYTES_PER_FRAME while the scene is drawn --
+// StreamStressFrame( ), from Display( ), reports the uploads' per-frame cost when
+// they are all in:
+
+void
+RunStreamStress( int count, int size )
+{
+	while( ! Streamer.IsIdle( ) )
+		Display( );
+	glFinish( );
+
+	StartStreamStress( &Streamer, &StreamTest, count, size );
+	double start = Headless.ElapsedSeconds( );
+	int frames = 0;
+	while( StreamTest.textures != NULL )
+	{
+		Display( );
+		frames++;
+	}
+	double seconds = Headless.ElapsedSeconds( ) - start;
+	fprintf( stderr, "Stream stress: %d frames, %d x %d, %8.2f ms/frame drawing and uploading\n", frames,
+		Headless.GetWidth( ), Headless.GetHeight( ), 1000. * seconds / (double)frames );
+	Headless.Destroy( );
+}
+
+
+// with -batch, draw frames BatchFirst to BatchLast of the loop into Headless's
+// framebuffer, frame n at n / BatchFps seconds, and write each to BatchDir. the
+// readback of each frame goes on while the next is drawn, and the writing on the
+// writer's thread (or, with BatchSync, each happens in turn, for comparison):
+
+void
+RunBatch( )
+{
+	int numFrames = (int)( (long long)MSEC * BatchFps / 1000 );
+	int first = BatchFirst;
+	int last = BatchLast;
+	int width = Headless.GetWidth( );
+	int height = Headless.GetHeight( );
+
+	// the textures, and the virtual earth's pages, arrive on the same frames whatever
+	// the gpu's and the disk's speed, and each frame renders the whole reflection, ahead
+	// of the rockets that reflect it, so that a frame doesn't depend on which others
+	// this process drew:
+	Streamer.SetBlocking( true );
+	VirtualEarth.SetBlocking( true );
+	Probe.SetFacesPerFrame( PROBE_FACES );
+	ProbeAhead = true;
+
+	// (a worker sends its frames to the parent to write, instead)
+	FrameWriter writer;
+	FrameReadback readback;
+	if( ! Workers.IsWorker( )  &&  ! writer.Init( BatchDir, BatchFormat ) )
+		return;
+	if( ! BatchSync )
+		readback.Init( width, height );
+	for( int p = 0; p < NUMPHASES; p++ )
+	{
+		PhaseSeconds[p] = 0.;
+		PhaseFrames[p] = 0;
+	}
+
+	double drawSeconds = 0., readSeconds = 0., writeSeconds = 0.;
+	long long syncBytes = 0;
+	int frames = 0;
+	double start = Headless.ElapsedSeconds( );
+	for( int frame = first; frame <= last; frame++ )
+	{
+		BatchMsec = (int)( (long long)frame * 1000 / BatchFps );
+		if( ! Workers.Owns( frame ) )
+		{
+			SkipFrame( );
+			continue;
+		}
+		frames++;
+		double t0 = Headless.ElapsedSeconds( );
+		Display( );
+		double t1 = Headless.ElapsedSeconds( );
+		drawSeconds += t1 - t0;
+
+		if( BatchSync )
+		{
+			unsigned char *pixels = new unsigned char[ 4 * width * height ];
+			glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+			glReadPixels( 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+			double t2 = Headless.ElapsedSeconds( );
+			if( Workers.IsWorker( ) )
+			{
+				Workers.Send( frame, width, height, pixels );
+			}
+			else
+			{
+				std::string file = FrameWriter::FileName( BatchDir, frame, BatchFormat );
+				syncBytes += FrameWriter::WriteFile( file.c_str( ), BatchFormat, width, height, pixels );
+			}
+			delete [ ] pixels;
+			readSeconds += t2 - t1;
+			writeSeconds += Headless.ElapsedSeconds( ) - t2;
+			continue;
+		}
+
+		// (a frame that couldn't be read back is lost, and counted in the readback's
+		//  stats -- a worker's parent finds it missing, and fails the batch)
+		readback.Start( frame );
+		if( readback.NumPending( ) == READBACK_SLOTS )
+		{
+			unsigned char *pixels = new unsigned char[ 4 * width * height ];
+			int done = readback.Finish( pixels );
+			if( done < 0 )
+				delete [ ] pixels;
+			else if( Workers.IsWorker( ) )
+			{
+				Workers.Send( done, width, height, pixels );
+				delete [ ] pixels;
+			}
+			else
+				writer.Write( done, width, height, pixels );
+		}
+		writeSeconds += Headless.ElapsedSeconds( ) - t1;
+	}
+	while( readback.NumPending( ) > 0 )
+	{
+		unsigned char *pixels = new unsigned char[ 4 * width * height ];
+		int done = readback.Finish( pixels );
+		if( done < 0 )
+			delete [ ] pixels;
+		else if( Workers.IsWorker( ) )
+		{
+			Workers.Send( done, width, height, pixels );
+			delete [ ] pixels;
+		}
+		else
+			writer.Write( done, width, height, pixels );
+	}
+	writer.Finish( );
+	double seconds = Headless.ElapsedSeconds( ) - start;
+	BatchMsec = -1;
+
+	if( frames <= 0 )
+		return;
+	char who[64] = "";
+	if( Workers.IsWorker( ) )
+		sprintf( who, " (worker %d of %d)", Workers.GetWorker( ), Workers.GetNumWorkers( ) );
+	fprintf( stderr, "Batch%s, %d x %d, %d frames, %d to %d of %d at %d a second, %s: %.2f s, %.2f frames/s\n", who,
+		width, height, frames, first, last, numFrames, BatchFps, BatchSync ? "in turn" : "overlapped", seconds, (double)frames / seconds );
+	fprintf( stderr, "  per frame: %7.2f ms drawing, %7.2f ms %s, %7.2f ms in all\n", 1000. * drawSeconds / (double)frames,
+		1000. * ( readSeconds + writeSeconds ) / (double)frames, BatchSync ? "reading back and writing" : "reading back and queueing",
+		1000. * seconds / (double)frames );
+	if( BatchSync )
+		fprintf( stderr, "  of which %7.2f ms reading back and %7.2f ms writing, %.1f MB\n", 1000. * readSeconds / (double)frames,
+			1000. * writeSeconds / (double)frames, (double)syncBytes / 1000000. );
+	fprintf( stderr, "  drawing, cpu per frame:" );
+	for( int p = 0; p < NUMPHASES; p++ )
+	{
+		if( PhaseFrames[p] > 0 )
+			fprintf( stderr, "  %s %6.2f ms (%d frames)", PHASE_NAMES[p], 1000. * PhaseSeconds[p] / (double)PhaseFrames[p], PhaseFrames[p] );
+	}
+	fprintf( stderr, "\n" );
+	if( ! BatchSync )
+		readback.PrintStats( );
+	if( Workers.IsWorker( ) )
+		Workers.PrintStats( );
+	else if( ! BatchSync )
+		writer.PrintStats( );
+	readback.Destroy( );
+	Headless.Destroy( );
+}
+
+
+// draw the batch in n worker processes, each with its own headless context -- the
+// frames dealt out BatchBlock at a time, round robin, so that each gets its share of
+// the cheap parts of the loop and the dear ones -- and write them here, in order, as
+// they come back. returns false (having drawn nothing) if the workers couldn't
+// fork, and the time it took in seconds:
+
+bool
+RunBatchWorkers( int n, double *seconds )
+{
+	double start = StreamSeconds( );
+	Workers.Fork( n, BatchFirst, BatchBlock );
+	if( Workers.IsWorker( ) )
+		RunBatchWorker( );
+	if( ! Workers.IsValid( ) )
+		return false;
+
+	FrameWriter writer;
+	bool ok = writer.Init( BatchDir, BatchFormat );
+	for( int frame = BatchFirst; ok  &&  frame <= BatchLast; frame++ )
+	{
+		int width, height;
+		unsigned char *pixels = Workers.Receive( frame, &width, &height );
+		if( pixels == NULL )
+			ok = false;
+		else
+			writer.Write( frame, width, height, pixels );
+	}
+	writer.Finish( );
+	if( ! Workers.Wait( ) )
+		ok = false;
+	*seconds = StreamSeconds( ) - start;
+
+	int frames = BatchLast - BatchFirst + 1;
+	fprintf( stderr, "Batch, %d workers, %d frames, %d to %d: %s%.2f s, %.2f frames/s\n", n, frames, BatchFirst, BatchLast,
+		ok ? "" : "FAILED, ", *seconds, (double)frames / *seconds );
+	Workers.PrintStats( );
+	writer.PrintStats( );
+	return true;
+}
+
+
+// a worker: draw its frames, send them back, and go:
+
+void
+RunBatchWorker( )
+{
+	InitGraphics( );
+	InitLists( );
+	Reset( );
+	RunBatch( );
+	Workers.Wait( );
+	exit( 0 );
+}
+
+
+// the batch with 1, 2, 4, ... workers, up to one a core, each writing the same
+// frames over again, and how much faster each is than the one:
+
+void
+RunBatchScaling( )
+{
+	// (-workers past the cores goes on past them, to see what oversubscribing does)
+	int cores = FrameWorkers::NumCores( );
+	int most = BatchWorkers > cores ? BatchWorkers : cores;
+	std::vector<int> counts;
+	for( int n = 1; n < most; n *= 2 )
+		counts.push_back( n );
+	counts.push_back( cores );
+	counts.push_back( most );
+	std::sort( counts.begin( ), counts.end( ) );
+	counts.erase( std::unique( counts.begin( ), counts.end( ) ), counts.end( ) );
+
+	std::vector<double> times;
+	for( int i = 0; i < (int)counts.size( ); i++ )
+	{
+		double seconds;
+		if( ! RunBatchWorkers( counts[i], &seconds ) )
+			break;
+		times.push_back( seconds );
+	}
+
+	int frames = BatchLast - BatchFirst + 1;
+	fprintf( stderr, "Scaling, %d frames, %d x %d, blocks of %d, %d cores:\n", frames, HeadlessSize, HeadlessSize, BatchBlock, cores );
+	for( int i = 0; i < (int)times.size( ); i++ )
+	{
+		double speedup = times[0] / times[i];
+		fprintf( stderr, "  %3d workers: %8.2f s, %7.2f frames/s, %5.2fx, %5.1f%% of linear\n", counts[i], times[i],
+			(double)frames / times[i], speedup, 100. * speedup / (double)counts[i] );
+	}
+}
+
+
 // handle a change to the window's visibility:
 
 void
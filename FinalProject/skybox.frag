@@ -0,0 +1,10 @@
+#version 330 compatibility
+in vec3 vDirection;
+uniform samplerCube uSkyUnit;
+
+void
+main()
+{
+    vec3 newcolor = texture(uSkyUnit, vDirection).rgb;
+    gl_FragColor = vec4(newcolor, 1.);
+}
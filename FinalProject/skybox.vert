@@ -0,0 +1,24 @@
+#version 330 compatibility
+
+// a skybox (see skybox.h) -- one triangle, from gl_VertexID, that covers the
+// viewport with its corners on the far plane. each corner's direction out of the
+// eye is taken back through the viewing rotation into world coordinates, and
+// interpolated across the triangle for the cube-map lookup
+
+out vec3 vDirection;
+
+uniform mat4 uView;    // the viewing transformation -- only its rotation is used
+layout( std140 ) uniform SceneState
+{
+    mat4 uProjection;    // the rest of the block (shaderstate.h) isn't used here
+};
+
+void
+main()
+{
+    // vertices 0, 1, 2 are at ( -1, -1 ), ( 3, -1 ), and ( -1, 3 ) in clip coordinates:
+    vec2 corner = vec2( float( ( gl_VertexID & 1 ) * 4 - 1 ), float( ( gl_VertexID & 2 ) * 2 - 1 ) );
+    vec4 eye = inverse( uProjection ) * vec4( corner, 1., 1. );
+    vDirection = transpose( mat3( uView ) ) * ( eye.xyz / eye.w );
+    gl_Position = vec4( corner, 1., 1. );
+}
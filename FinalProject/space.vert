@@ -1,9 +1,15 @@
 #version 330 compatibility
 out vec2 vST;
 
+uniform mat4 uModelView;
+layout( std140 ) uniform SceneState
+{
+    mat4 uProjection;    // the rest of the block (shaderstate.h) isn't used here
+};
+
 void
 main()
 {
     vST = gl_MultiTexCoord0.st;
-    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    gl_Position = uProjection * uModelView * gl_Vertex;
 }
\ No newline at end of file
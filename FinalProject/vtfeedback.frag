@@ -0,0 +1,26 @@
+#version 330 compatibility
+in vec2 vST;
+uniform vec2 uVirtualSize;      // level 0 of the virtual texture, in texels
+uniform float uNumLevels;
+uniform float uPageSize;
+uniform float uLodBias;         // the feedback buffer is this many levels smaller than the window
+
+// writes which page this fragment would sample -- page x and y (low 8 bits each,
+// then both high 4 bits), and level + 1 so that 0 means nothing was drawn
+
+void
+main()
+{
+    vec2 st = vec2( fract( vST.s ), clamp( vST.t, 0., 0.99999 ) );
+    vec2 texel = vST * uVirtualSize;
+    vec2 dx = dFdx( texel );
+    vec2 dy = dFdy( texel );
+    float lod = 0.5 * log2( max( dot( dx, dx ), dot( dy, dy ) ) ) - uLodBias;
+    float level = clamp( floor( lod ), 0., uNumLevels - 1. );
+
+    vec2 pages = uVirtualSize / ( uPageSize * exp2( level ) );
+    vec2 page = floor( st * pages );
+    vec2 lo = mod( page, 256. );
+    vec2 hi = floor( page / 256. );
+    gl_FragColor = vec4( lo.x, lo.y, hi.x + 16. * hi.y, level + 1. ) / 255.;
+}
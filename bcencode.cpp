@@ -0,0 +1,556 @@
+#ifndef BCENCODE_CPP
+#define BCENCODE_CPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// software block-compression encoders for baking textures
+//
+// BC1:	4x4 texels in 8 bytes -- two rgb565 endpoints and 2-bit indices (6:1 from rgb8)
+// BC7:	4x4 texels in 16 bytes -- only mode 6 is produced (one subset, rgba 7777 endpoints
+//	with a p-bit each, 4-bit indices), which is the best single mode for smooth opaque
+//	images and keeps the encoder small (3:1 from rgb8)
+//
+// both encoders fit the endpoints along the principal axis of the block's colors, then
+// pick the closest palette entry for each texel. blocks are independent, so a whole
+// image is encoded with one openmp thread per row of blocks.
+
+enum BcFormat
+{
+	BC_1,
+	BC_7
+};
+
+
+// seconds on a wall clock, for the throughput reports:
+
+double
+BcSeconds( )
+{
+#ifdef _OPENMP
+	return omp_get_wtime( );
+#else
+	return (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+int
+BcBlockBytes( enum BcFormat format )
+{
+	return ( format == BC_1 )  ?  8  :  16;
+}
+
+
+int
+BcImageBytes( enum BcFormat format, int width, int height )
+{
+	return BcBlockBytes( format ) * ( (width+3)/4 ) * ( (height+3)/4 );
+}
+
+
+// find the two ends of the block's colors along their principal axis:
+
+static
+void
+FitEndpoints( unsigned char block[16][3], float lo[3], float hi[3] )
+{
+	float mean[3] = { 0.f, 0.f, 0.f };
+	for( int i = 0; i < 16; i++ )
+		for( int c = 0; c < 3; c++ )
+			mean[c] += block[i][c] / 16.f;
+
+	float cov[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };	// xx, xy, xz, yy, yz, zz
+	for( int i = 0; i < 16; i++ )
+	{
+		float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+		cov[0] += d[0]*d[0];	cov[1] += d[0]*d[1];	cov[2] += d[0]*d[2];
+		cov[3] += d[1]*d[1];	cov[4] += d[1]*d[2];	cov[5] += d[2]*d[2];
+	}
+
+	// power iteration for the largest eigenvector:
+
+	float axis[3] = { 1.f, 1.f, 1.f };
+	for( int iter = 0; iter < 8; iter++ )
+	{
+		float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+		float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+		float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+		float len = sqrtf( x*x + y*y + z*z );
+		if( len < 1.e-6f )
+			break;
+		axis[0] = x / len;	axis[1] = y / len;	axis[2] = z / len;
+	}
+
+	float tmin = 1.e+37f;
+	float tmax = -tmin;
+	for( int i = 0; i < 16; i++ )
+	{
+		float t = ( block[i][0] - mean[0] )*axis[0] + ( block[i][1] - mean[1] )*axis[1] + ( block[i][2] - mean[2] )*axis[2];
+		if( t < tmin )	tmin = t;
+		if( t > tmax )	tmax = t;
+	}
+
+	for( int c = 0; c < 3; c++ )
+	{
+		lo[c] = mean[c] + tmin*axis[c];
+		hi[c] = mean[c] + tmax*axis[c];
+		if( lo[c] < 0.f )	lo[c] = 0.f;
+		if( lo[c] > 255.f )	lo[c] = 255.f;
+		if( hi[c] < 0.f )	hi[c] = 0.f;
+		if( hi[c] > 255.f )	hi[c] = 255.f;
+	}
+}
+
+
+static
+int
+ColorError( unsigned char a[3], int b[3] )
+{
+	int dr = a[0] - b[0];
+	int dg = a[1] - b[1];
+	int db = a[2] - b[2];
+	return dr*dr + dg*dg + db*db;
+}
+
+
+// pick the closest palette entry for each texel, returning the total squared error:
+
+static
+int
+ChooseIndices( unsigned char block[16][3], int palette[ ][3], int numColors, int indices[16] )
+{
+	int total = 0;
+	for( int i = 0; i < 16; i++ )
+	{
+		int best = 0;
+		int bestErr = ColorError( block[i], palette[0] );
+		for( int p = 1; p < numColors; p++ )
+		{
+			int err = ColorError( block[i], palette[p] );
+			if( err < bestErr )
+			{
+				best = p;
+				bestErr = err;
+			}
+		}
+		indices[i] = best;
+		total += bestErr;
+	}
+	return total;
+}
+
+
+//////////////////////////////////////////////  BC1:
+
+
+static
+int
+To565( float c[3] )
+{
+	int r = (int)( c[0] * 31.f / 255.f + 0.5f );
+	int g = (int)( c[1] * 63.f / 255.f + 0.5f );
+	int b = (int)( c[2] * 31.f / 255.f + 0.5f );
+	return ( r << 11 )  |  ( g << 5 )  |  b;
+}
+
+
+static
+void
+From565( int c, int rgb[3] )
+{
+	int r = ( c >> 11 ) & 0x1f;
+	int g = ( c >> 5 ) & 0x3f;
+	int b = c & 0x1f;
+	rgb[0] = ( r << 3 ) | ( r >> 2 );
+	rgb[1] = ( g << 2 ) | ( g >> 4 );
+	rgb[2] = ( b << 3 ) | ( b >> 2 );
+}
+
+
+// the 4-color palette, valid when c0 > c1:
+
+static
+void
+Bc1Palette( int c0, int c1, int palette[ ][3] )
+{
+	From565( c0, palette[0] );
+	From565( c1, palette[1] );
+	for( int c = 0; c < 3; c++ )
+	{
+		palette[2][c] = ( 2*palette[0][c] + palette[1][c] ) / 3;
+		palette[3][c] = ( palette[0][c] + 2*palette[1][c] ) / 3;
+	}
+}
+
+
+void
+EncodeBc1Block( unsigned char block[16][3], unsigned char out[8] )
+{
+	float lo[3], hi[3];
+	FitEndpoints( block, lo, hi );
+
+	int c0 = To565( hi );
+	int c1 = To565( lo );
+	if( c0 < c1 )
+	{
+		int tmp = c0;	c0 = c1;	c1 = tmp;
+	}
+
+	int indices[16];
+	if( c0 == c1 )
+	{
+		// a flat block -- every index can point at c0:
+		for( int i = 0; i < 16; i++ )
+			indices[i] = 0;
+	}
+	else
+	{
+		int palette[4][3];
+		Bc1Palette( c0, c1, palette );
+		ChooseIndices( block, palette, 4, indices );
+	}
+
+	out[0] = c0 & 0xff;	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;	out[3] = c1 >> 8;
+	unsigned int bits = 0;
+	for( int i = 15; i >= 0; i-- )
+		bits = ( bits << 2 ) | indices[i];
+	out[4] = bits & 0xff;
+	out[5] = ( bits >> 8 ) & 0xff;
+	out[6] = ( bits >> 16 ) & 0xff;
+	out[7] = ( bits >> 24 ) & 0xff;
+}
+
+
+void
+DecodeBc1Block( unsigned char in[8], unsigned char block[16][3] )
+{
+	int c0 = in[0] | ( in[1] << 8 );
+	int c1 = in[2] | ( in[3] << 8 );
+	unsigned int bits = in[4] | ( in[5] << 8 ) | ( in[6] << 16 ) | ( (unsigned int)in[7] << 24 );
+
+	int palette[4][3];
+	Bc1Palette( c0, c1, palette );
+	if( c0 <= c1 )
+	{
+		// 3-color mode: entry 2 is the midpoint, entry 3 is black
+		for( int c = 0; c < 3; c++ )
+		{
+			palette[2][c] = ( palette[0][c] + palette[1][c] ) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	for( int i = 0; i < 16; i++ )
+	{
+		int index = ( bits >> (2*i) ) & 0x3;
+		for( int c = 0; c < 3; c++ )
+			block[i][c] = (unsigned char)palette[index][c];
+	}
+}
+
+
+//////////////////////////////////////////////  BC7 (mode 6):
+
+
+static const int Bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+static
+void
+Bc7Palette( int e0[4], int e1[4], int palette[16][3] )
+{
+	for( int p = 0; p < 16; p++ )
+		for( int c = 0; c < 3; c++ )
+			palette[p][c] = ( ( 64 - Bc7Weights4[p] ) * e0[c] + Bc7Weights4[p] * e1[c] + 32 ) >> 6;
+}
+
+
+// little bit-writer for the 128-bit block:
+
+static
+void
+PutBits( unsigned char out[16], int *pos, int value, int numBits )
+{
+	for( int b = 0; b < numBits; b++, (*pos)++ )
+	{
+		if( ( value >> b ) & 1 )
+			out[ *pos / 8 ] |= 1 << ( *pos % 8 );
+	}
+}
+
+
+static
+int
+GetBits( unsigned char in[16], int *pos, int numBits )
+{
+	int value = 0;
+	for( int b = 0; b < numBits; b++, (*pos)++ )
+	{
+		if( ( in[ *pos / 8 ] >> ( *pos % 8 ) ) & 1 )
+			value |= 1 << b;
+	}
+	return value;
+}
+
+
+void
+EncodeBc7Block( unsigned char block[16][3], unsigned char out[16] )
+{
+	float lo[3], hi[3];
+	FitEndpoints( block, lo, hi );
+
+	// try all four p-bit combinations and keep the best:
+
+	int bestErr = -1;
+	int best7[2][3], bestP[2] = { 0, 0 }, bestIndices[16];		// (the first try always sets them)
+	for( int p0 = 0; p0 < 2; p0++ )
+	{
+		for( int p1 = 0; p1 < 2; p1++ )
+		{
+			int q7[2][3], e0[4], e1[4];
+			for( int c = 0; c < 3; c++ )
+			{
+				q7[0][c] = (int)( ( lo[c] - p0 ) / 2.f + 0.5f );
+				q7[1][c] = (int)( ( hi[c] - p1 ) / 2.f + 0.5f );
+				if( q7[0][c] < 0 )	q7[0][c] = 0;
+				if( q7[0][c] > 127 )	q7[0][c] = 127;
+				if( q7[1][c] < 0 )	q7[1][c] = 0;
+				if( q7[1][c] > 127 )	q7[1][c] = 127;
+				e0[c] = ( q7[0][c] << 1 ) | p0;
+				e1[c] = ( q7[1][c] << 1 ) | p1;
+			}
+
+			int palette[16][3], indices[16];
+			Bc7Palette( e0, e1, palette );
+			int err = ChooseIndices( block, palette, 16, indices );
+			if( bestErr < 0  ||  err < bestErr )
+			{
+				bestErr = err;
+				memcpy( best7, q7, sizeof(best7) );
+				bestP[0] = p0;
+				bestP[1] = p1;
+				memcpy( bestIndices, indices, sizeof(bestIndices) );
+			}
+		}
+	}
+
+	// the anchor (texel 0) index is stored without its top bit, so it must be < 8:
+
+	if( bestIndices[0] >= 8 )
+	{
+		for( int c = 0; c < 3; c++ )
+		{
+			int tmp = best7[0][c];	best7[0][c] = best7[1][c];	best7[1][c] = tmp;
+		}
+		int tmp = bestP[0];	bestP[0] = bestP[1];	bestP[1] = tmp;
+		for( int i = 0; i < 16; i++ )
+			bestIndices[i] = 15 - bestIndices[i];
+	}
+
+	memset( out, 0, 16 );
+	int pos = 0;
+	PutBits( out, &pos, 1 << 6, 7 );		// mode 6
+	for( int c = 0; c < 3; c++ )
+	{
+		PutBits( out, &pos, best7[0][c], 7 );
+		PutBits( out, &pos, best7[1][c], 7 );
+	}
+	PutBits( out, &pos, 127, 7 );			// alpha: opaque
+	PutBits( out, &pos, 127, 7 );
+	PutBits( out, &pos, bestP[0], 1 );
+	PutBits( out, &pos, bestP[1], 1 );
+	PutBits( out, &pos, bestIndices[0], 3 );
+	for( int i = 1; i < 16; i++ )
+		PutBits( out, &pos, bestIndices[i], 4 );
+}
+
+
+// only mode 6 is decoded -- that is all EncodeBc7Block( ) writes:
+
+void
+DecodeBc7Block( unsigned char in[16], unsigned char block[16][3] )
+{
+	int pos = 0;
+	int mode = GetBits( in, &pos, 7 );
+	if( mode != ( 1 << 6 ) )
+	{
+		memset( block, 0, 16*3 );
+		return;
+	}
+
+	int q7[2][4];
+	for( int c = 0; c < 4; c++ )
+	{
+		q7[0][c] = GetBits( in, &pos, 7 );
+		q7[1][c] = GetBits( in, &pos, 7 );
+	}
+	int p0 = GetBits( in, &pos, 1 );
+	int p1 = GetBits( in, &pos, 1 );
+
+	int e0[4], e1[4];
+	for( int c = 0; c < 4; c++ )
+	{
+		e0[c] = ( q7[0][c] << 1 ) | p0;
+		e1[c] = ( q7[1][c] << 1 ) | p1;
+	}
+
+	int palette[16][3];
+	Bc7Palette( e0, e1, palette );
+	for( int i = 0; i < 16; i++ )
+	{
+		int index = GetBits( in, &pos, ( i == 0 ) ? 3 : 4 );
+		for( int c = 0; c < 3; c++ )
+			block[i][c] = (unsigned char)palette[index][c];
+	}
+}
+
+
+//////////////////////////////////////////////  whole images:
+
+
+// returns new[ ]'ed blocks, BcImageBytes( ) long
+// (partial blocks at the right and top edges repeat the last row/column)
+
+unsigned char *
+EncodeBc( unsigned char *rgb, int width, int height, enum BcFormat format )
+{
+	int bw = ( width+3 ) / 4;
+	int bh = ( height+3 ) / 4;
+	int blockBytes = BcBlockBytes( format );
+	unsigned char *blocks = new unsigned char[ blockBytes * bw * bh ];
+
+	#pragma omp parallel for schedule(dynamic)
+	for( int by = 0; by < bh; by++ )
+	{
+		for( int bx = 0; bx < bw; bx++ )
+		{
+			unsigned char block[16][3];
+			for( int i = 0; i < 16; i++ )
+			{
+				int x = 4*bx + i%4;	if( x >= width )	x = width-1;
+				int y = 4*by + i/4;	if( y >= height )	y = height-1;
+				memcpy( block[i], &rgb[ 3 * ( width*y + x ) ], 3 );
+			}
+
+			unsigned char *out = &blocks[ blockBytes * ( bw*by + bx ) ];
+			if( format == BC_1 )
+				EncodeBc1Block( block, out );
+			else
+				EncodeBc7Block( block, out );
+		}
+	}
+	return blocks;
+}
+
+
+unsigned char *
+DecodeBc( unsigned char *blocks, int width, int height, enum BcFormat format )
+{
+	int bw = ( width+3 ) / 4;
+	int bh = ( height+3 ) / 4;
+	int blockBytes = BcBlockBytes( format );
+	unsigned char *rgb = new unsigned char[ 3 * width * height ];
+
+	#pragma omp parallel for
+	for( int by = 0; by < bh; by++ )
+	{
+		for( int bx = 0; bx < bw; bx++ )
+		{
+			unsigned char block[16][3];
+			unsigned char *in = &blocks[ blockBytes * ( bw*by + bx ) ];
+			if( format == BC_1 )
+				DecodeBc1Block( in, block );
+			else
+				DecodeBc7Block( in, block );
+
+			for( int i = 0; i < 16; i++ )
+			{
+				int x = 4*bx + i%4;
+				int y = 4*by + i/4;
+				if( x < width  &&  y < height )
+					memcpy( &rgb[ 3 * ( width*y + x ) ], block[i], 3 );
+			}
+		}
+	}
+	return rgb;
+}
+
+
+// peak signal-to-noise ratio in dB between two rgb8 images:
+
+double
+Psnr( unsigned char *a, unsigned char *b, int numBytes )
+{
+	double sum = 0.;
+	for( int i = 0; i < numBytes; i++ )
+	{
+		double d = (double)a[i] - (double)b[i];
+		sum += d * d;
+	}
+	if( sum == 0. )
+		return 99.;
+	double mse = sum / (double)numBytes;
+	return 10. * log10( 255.*255. / mse );
+}
+
+
+//#define TEST
+#ifdef TEST
+
+#include "bmptotexture.cpp"
+
+int
+main( int argc, char *argv[ ] )
+{
+	char *file = ( argc > 1 )  ?  argv[1]  :  (char *)"Earth.bmp";
+	int width, height;
+	unsigned char *rgb = BmpToTexture( file, &width, &height );
+	if( rgb == NULL )
+		return 1;
+
+	int maxThreads = 1;
+#ifdef _OPENMP
+	maxThreads = omp_get_num_procs( );
+#endif
+
+	fprintf( stderr, "'%s': %d x %d, %d bytes raw\n", file, width, height, 3*width*height );
+	for( int f = BC_1; f <= BC_7; f++ )
+	{
+		enum BcFormat format = (enum BcFormat)f;
+		for( int threads = 1; threads <= maxThreads; threads *= 2 )
+		{
+#ifdef _OPENMP
+			omp_set_num_threads( threads );
+#endif
+			double t0 = BcSeconds( );
+			unsigned char *blocks = EncodeBc( rgb, width, height, format );
+			double t1 = BcSeconds( );
+
+			unsigned char *decoded = DecodeBc( blocks, width, height, format );
+			double mpix = (double)width * (double)height / 1000000. / ( t1 - t0 );
+			fprintf( stderr, "BC%d, %2d threads: %8d bytes (%4.1f%%), %7.2f Mpixels/s (%6.2f per thread), PSNR = %5.2f dB\n",
+				( format == BC_1 ) ? 1 : 7, threads, BcImageBytes( format, width, height ),
+				100. * (double)BcImageBytes( format, width, height ) / (double)( 3*width*height ),
+				mpix, mpix / (double)threads, Psnr( rgb, decoded, 3*width*height ) );
+
+			delete [ ] blocks;
+			delete [ ] decoded;
+		}
+	}
+
+	delete [ ] rgb;
+	return 0;
+}
+#endif
+
+#endif		// #ifndef BCENCODE_CPP
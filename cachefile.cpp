@@ -0,0 +1,55 @@
+#ifndef CACHEFILE_CPP
+#define CACHEFILE_CPP
+
+#include <stdio.h>
+
+#ifdef WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sys/types.h>
+#endif
+
+
+// baked files (.texcache, .vtpages, .sh9, .tex) are written under a name of their own
+// and renamed into place once they are complete. several processes can bake the same
+// file at once -- the batch workers each bake what they find missing -- and writing
+// the real name directly would truncate it under a process that is reading it. the
+// rename replaces the file whole, so a reader sees either the old one or the new one:
+//
+//	char tmp[300];
+//	FILE *fp = OpenCacheFile( file, tmp, sizeof(tmp) );
+//	... ok = fwrite( ... ) ...
+//	ok = CloseCacheFile( fp, tmp, file, ok );
+
+
+FILE *
+OpenCacheFile( const char *file, char *tmp, int size )
+{
+#ifdef WIN32
+	snprintf( tmp, size, "%s.%d.tmp", file, _getpid( ) );
+#else
+	snprintf( tmp, size, "%s.%d.tmp", file, (int)getpid( ) );
+#endif
+	return fopen( tmp, "wb" );
+}
+
+
+// close it, and if everything was written, put it in place -- otherwise throw it away:
+
+bool
+CloseCacheFile( FILE *fp, const char *tmp, const char *file, bool ok )
+{
+	ok = ( fclose( fp ) == 0 )  &&  ok;
+#ifdef WIN32
+	// (windows won't rename over a file that is there)
+	if( ok )
+		remove( file );
+#endif
+	if( ok  &&  rename( tmp, file ) == 0 )
+		return true;
+	remove( tmp );
+	return false;
+}
+
+#endif		// #ifndef CACHEFILE_CPP
@@ -0,0 +1,428 @@
+#ifndef DRAWARENA_CPP
+#define DRAWARENA_CPP
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#ifndef F_PI
+#define F_PI		((float)(M_PI))
+#define F_2_PI		((float)(2.f*F_PI))
+#define F_PI_2		((float)(F_PI/2.f))
+#endif
+
+#include "drawarena.h"
+#include "instancemesh.cpp"		// for reading obj files into shared vertices
+
+
+DrawArena::DrawArena( )
+{
+	Vao = VertexBuffer = IndexBuffer = CommandBuffer = DrawBuffer = 0;
+	CommandCapacity = 0;
+	ResetStats( );
+}
+
+
+// add a draw of a mesh with this (column-major) modelview matrix -- returns the
+// draw's command index:
+
+int
+DrawArena::Add( int mesh, const float *modelview )
+{
+	struct ArenaMesh *am = &Meshes[mesh];
+	struct ArenaCommand ac;
+	ac.count = am->numIndices;
+	ac.instanceCount = 1;
+	ac.firstIndex = am->firstIndex;
+	ac.baseVertex = am->baseVertex;
+	ac.baseInstance = 0;
+	Commands.push_back( ac );
+
+	Draws.insert( Draws.end( ), modelview, modelview + 16 );
+
+	return (int)Commands.size( ) - 1;
+}
+
+
+// a flat grid in z = z, as two triangles a cell, textured 0. - 1. across it
+// and facing +z. returns the mesh's index:
+
+int
+DrawArena::AddGrid( float xmin, float xmax, float ymin, float ymax, float z, int numx, int numy )
+{
+	std::vector<struct ArenaVertex> vertices;
+	std::vector<GLuint> indices;
+	for( int iy = 0; iy <= numy; iy++ )
+	{
+		for( int ix = 0; ix <= numx; ix++ )
+		{
+			struct ArenaVertex av;
+			av.s = (float)ix / (float)numx;
+			av.t = (float)iy / (float)numy;
+			av.x = xmin + ( xmax - xmin ) * av.s;
+			av.y = ymin + ( ymax - ymin ) * av.t;
+			av.z = z;
+			av.nx = 0.f;	av.ny = 0.f;	av.nz = 1.f;
+			vertices.push_back( av );
+		}
+	}
+	for( int iy = 0; iy < numy; iy++ )
+	{
+		for( int ix = 0; ix < numx; ix++ )
+		{
+			GLuint v00 = iy * ( numx + 1 ) + ix;
+			GLuint v01 = v00 + numx + 1;
+			indices.push_back( v00 );	indices.push_back( v00 + 1 );	indices.push_back( v01 );
+			indices.push_back( v01 );	indices.push_back( v00 + 1 );	indices.push_back( v01 + 1 );
+		}
+	}
+	return AddMesh( vertices, indices, NULL );
+}
+
+
+// add the vertices and indices of one mesh to the arena:
+
+int
+DrawArena::AddMesh( std::vector<struct ArenaVertex> &vertices, std::vector<GLuint> &indices, const float *bounds )
+{
+	if( Vao != 0 )
+	{
+		fprintf( stderr, "DrawArena: meshes have to be added before Finish( )\n" );
+		return -1;
+	}
+
+	struct ArenaMesh am;
+	am.firstIndex = (GLuint)Indices.size( );
+	am.numIndices = (GLuint)indices.size( );
+	am.baseVertex = (GLint)Vertices.size( );
+
+	if( bounds != NULL )
+	{
+		memcpy( am.bounds, bounds, sizeof(am.bounds) );
+	}
+	else
+	{
+		am.bounds[0] = am.bounds[1] = am.bounds[2] =  FLT_MAX;
+		am.bounds[3] = am.bounds[4] = am.bounds[5] = -FLT_MAX;
+		for( int i = 0; i < (int)vertices.size( ); i++ )
+		{
+			float *v = &vertices[i].x;
+			for( int c = 0; c < 3; c++ )
+			{
+				if( v[c] < am.bounds[c] )	am.bounds[c] = v[c];
+				if( v[c] > am.bounds[c+3] )	am.bounds[c+3] = v[c];
+			}
+		}
+	}
+	BoundsToSphere( am.bounds, &am.sphere );
+
+	Vertices.insert( Vertices.end( ), vertices.begin( ), vertices.end( ) );
+	Indices.insert( Indices.end( ), indices.begin( ), indices.end( ) );
+	Meshes.push_back( am );
+	return (int)Meshes.size( ) - 1;
+}
+
+
+static void
+ToArenaVertices( struct MeshBuild *mb, std::vector<struct ArenaVertex> *vertices )
+{
+	vertices->resize( mb->vertices.size( ) );
+	for( int i = 0; i < (int)mb->vertices.size( ); i++ )
+	{
+		struct ObjVertex *ov = &mb->vertices[i];
+		struct ArenaVertex *av = &(*vertices)[i];
+		av->x = ov->x;		av->y = ov->y;		av->z = ov->z;
+		av->nx = ov->nx;	av->ny = ov->ny;	av->nz = ov->nz;
+		av->s = ov->s;		av->t = ov->t;
+	}
+}
+
+
+// identical corners of the obj file's triangles are shared, as in an InstancedMesh.
+// returns the mesh's index (and its bounding box in bounds, if given), or -1:
+
+int
+DrawArena::AddObj( char *objFile, float *bounds )
+{
+	struct MeshBuild mb;
+	float box[6];
+	if( ReadObjFile( objFile, AddMeshVertex, &mb, box ) != 0  ||  mb.indices.size( ) == 0 )
+	{
+		fprintf( stderr, "DrawArena: no triangles in '%s'\n", objFile );
+		return -1;
+	}
+	if( bounds != NULL )
+		memcpy( bounds, box, sizeof(box) );
+
+	std::vector<struct ArenaVertex> vertices;
+	ToArenaVertices( &mb, &vertices );
+	return AddMesh( vertices, mb.indices, box );
+}
+
+
+// one corner of OsuSphere( ):
+
+static void
+AddSphereCorner( struct MeshBuild *mb, float radius, float lat, float lng )
+{
+	struct ObjVertex v;
+	float xz = cosf( lat );
+	v.nx = xz * sinf( lng );
+	v.ny = sinf( lat );
+	v.nz = xz * cosf( lng );
+	v.x = v.nx * radius;
+	v.y = v.ny * radius;
+	v.z = v.nz * radius;
+	v.s = ( lng + F_PI )   / F_2_PI;
+	v.t = ( lat + F_PI_2 ) / F_PI;
+	AddMeshVertex( &v, mb );
+}
+
+
+// the same triangles as OsuSphere( ), with the shared corners indexed:
+
+int
+DrawArena::AddSphere( float radius, int slices, int stacks )
+{
+	radius = fabsf( radius );
+	if( slices < 4 )	slices = 4;
+	if( stacks < 4 )	stacks = 4;
+
+	struct MeshBuild mb;
+	for( int istack = 0; istack < stacks; istack++ )
+	{
+		float north = -F_PI_2 + F_PI * (float)(istack + 1) / (float)stacks;
+		float south = -F_PI_2 + F_PI * (float)(istack + 0) / (float)stacks;
+		for( int islice = 0; islice < slices; islice++ )
+		{
+			float west = -F_PI + F_2_PI * (float)(islice + 0) / (float)slices;
+			float east = -F_PI + F_2_PI * (float)(islice + 1) / (float)slices;
+
+			if( istack == 0 )
+			{
+				AddSphereCorner( &mb, radius, south, .5f * (east + west) );
+				AddSphereCorner( &mb, radius, north, east );
+				AddSphereCorner( &mb, radius, north, west );
+			}
+			else if( istack == stacks - 1 )
+			{
+				AddSphereCorner( &mb, radius, north, .5f * (east + west) );
+				AddSphereCorner( &mb, radius, south, west );
+				AddSphereCorner( &mb, radius, south, east );
+			}
+			else
+			{
+				AddSphereCorner( &mb, radius, north, west );
+				AddSphereCorner( &mb, radius, south, west );
+				AddSphereCorner( &mb, radius, north, east );
+
+				AddSphereCorner( &mb, radius, north, east );
+				AddSphereCorner( &mb, radius, south, west );
+				AddSphereCorner( &mb, radius, south, east );
+			}
+		}
+	}
+
+	std::vector<struct ArenaVertex> vertices;
+	ToArenaVertices( &mb, &vertices );
+	float bounds[6] = { -radius, -radius, -radius,   radius, radius, radius };
+	return AddMesh( vertices, mb.indices, bounds );
+}
+
+
+// start a new frame's list of draws:
+
+void
+DrawArena::Begin( )
+{
+	Commands.clear( );
+	Draws.clear( );
+}
+
+
+void
+DrawArena::Destroy( )
+{
+	if( Vao != 0 )
+		glDeleteVertexArrays( 1, &Vao );
+	GLuint buffers[4] = { VertexBuffer, IndexBuffer, CommandBuffer, DrawBuffer };
+	for( int i = 0; i < 4; i++ )
+	{
+		if( buffers[i] != 0 )
+			glDeleteBuffers( 1, &buffers[i] );
+	}
+	Vao = VertexBuffer = IndexBuffer = CommandBuffer = DrawBuffer = 0;
+	CommandCapacity = 0;
+	Vertices.clear( );
+	Indices.clear( );
+	Meshes.clear( );
+	Begin( );
+}
+
+
+// draw count of this frame's commands, starting at first, with one call -- the
+// program has to be in use, and Upload( ) has to have been called since the last Add( ):
+
+void
+DrawArena::Draw( GLSLProgram *program, int first, int count )
+{
+	if( Vao == 0  ||  count <= 0 )
+		return;
+
+	program->SetUniformVariable( (char *)"uArenaBase", first );
+	glBindVertexArray( Vao );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, CommandBuffer );
+	glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, (void *)( first * sizeof(struct ArenaCommand) ), count, 0 );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+	glBindVertexArray( 0 );
+
+	MultiDrawCalls++;
+	DrawsIssued += count;
+}
+
+
+// draw one mesh by itself, with whatever is in use -- for passes that don't
+// read the draw data, like the hi-z occluders:
+
+void
+DrawArena::DrawMesh( int mesh )
+{
+	if( Vao == 0  ||  mesh < 0  ||  mesh >= (int)Meshes.size( ) )
+		return;
+
+	struct ArenaMesh *am = &Meshes[mesh];
+	glBindVertexArray( Vao );
+	glDrawElementsBaseVertex( GL_TRIANGLES, am->numIndices, GL_UNSIGNED_INT, (void *)( am->firstIndex * sizeof(GLuint) ), am->baseVertex );
+	glBindVertexArray( 0 );
+}
+
+
+// send the meshes to the gpu -- returns false if this gl can't do the multi-draw:
+
+bool
+DrawArena::Finish( )
+{
+	if( ! GLEW_ARB_multi_draw_indirect  ||  ! GLEW_ARB_shader_draw_parameters  ||  ! GLEW_ARB_shader_storage_buffer_object )
+	{
+		fprintf( stderr, "DrawArena: this system can't do glMultiDrawElementsIndirect( ) with gl_DrawIDARB\n" );
+		return false;
+	}
+	if( Indices.size( ) == 0 )
+	{
+		fprintf( stderr, "DrawArena: no meshes\n" );
+		return false;
+	}
+
+	glGenVertexArrays( 1, &Vao );
+	glBindVertexArray( Vao );
+
+	glGenBuffers( 1, &VertexBuffer );
+	glBindBuffer( GL_ARRAY_BUFFER, VertexBuffer );
+	glBufferData( GL_ARRAY_BUFFER, Vertices.size( ) * sizeof(struct ArenaVertex), &Vertices[0], GL_STATIC_DRAW );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, sizeof(struct ArenaVertex), (void *)offsetof( struct ArenaVertex, x ) );
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glNormalPointer( GL_FLOAT, sizeof(struct ArenaVertex), (void *)offsetof( struct ArenaVertex, nx ) );
+	glClientActiveTexture( GL_TEXTURE0 );
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glTexCoordPointer( 2, GL_FLOAT, sizeof(struct ArenaVertex), (void *)offsetof( struct ArenaVertex, s ) );
+
+	glGenBuffers( 1, &IndexBuffer );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, IndexBuffer );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, Indices.size( ) * sizeof(GLuint), &Indices[0], GL_STATIC_DRAW );
+
+	glBindVertexArray( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	glGenBuffers( 1, &CommandBuffer );
+	glGenBuffers( 1, &DrawBuffer );
+	CommandCapacity = 0;
+
+	fprintf( stderr, "DrawArena: %d meshes, %d vertices, %d triangles\n",
+		NumMeshes( ), (int)Vertices.size( ), (int)Indices.size( ) / 3 );
+
+	// the gpu has its own copy now:
+	std::vector<struct ArenaVertex>( ).swap( Vertices );
+	std::vector<GLuint>( ).swap( Indices );
+	return true;
+}
+
+
+const struct Sphere *
+DrawArena::GetSphere( int mesh )
+{
+	return &Meshes[mesh].sphere;
+}
+
+
+bool
+DrawArena::IsValid( )
+{
+	return Vao != 0;
+}
+
+
+int
+DrawArena::NumDraws( )
+{
+	return (int)Commands.size( );
+}
+
+
+int
+DrawArena::NumMeshes( )
+{
+	return (int)Meshes.size( );
+}
+
+
+void
+DrawArena::PrintStats( int numFrames )
+{
+	if( numFrames <= 0 )
+		numFrames = 1;
+	fprintf( stderr, "DrawArena: %5.1f draws in %4.1f multi-draw calls per frame (%.1f draws/call), %.0f bytes of commands and matrices per frame\n",
+		(float)DrawsIssued / (float)numFrames, (float)MultiDrawCalls / (float)numFrames,
+		MultiDrawCalls > 0 ? (float)DrawsIssued / (float)MultiDrawCalls : 0.f, (float)CommandBytes / (float)numFrames );
+}
+
+
+void
+DrawArena::ResetStats( )
+{
+	MultiDrawCalls = 0;
+	DrawsIssued = 0;
+	CommandBytes = 0;
+}
+
+
+// send this frame's commands and draw data -- the old ones are orphaned rather
+// than waited for:
+
+void
+DrawArena::Upload( )
+{
+	int n = (int)Commands.size( );
+	if( Vao == 0  ||  n == 0 )
+		return;
+
+	if( n > CommandCapacity )
+		CommandCapacity = n;
+
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, CommandBuffer );
+	glBufferData( GL_DRAW_INDIRECT_BUFFER, CommandCapacity * sizeof(struct ArenaCommand), NULL, GL_STREAM_DRAW );
+	glBufferSubData( GL_DRAW_INDIRECT_BUFFER, 0, n * sizeof(struct ArenaCommand), &Commands[0] );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, DrawBuffer );
+	glBufferData( GL_SHADER_STORAGE_BUFFER, CommandCapacity * 16 * sizeof(float), NULL, GL_STREAM_DRAW );
+	glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, n * 16 * sizeof(float), &Draws[0] );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, ARENA_DRAW_BINDING, DrawBuffer );
+
+	CommandBytes += n * ( sizeof(struct ArenaCommand) + 16 * sizeof(float) );
+}
+
+#endif		// #ifndef DRAWARENA_CPP
@@ -0,0 +1,114 @@
+#ifndef DRAWARENA_H
+#define DRAWARENA_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "frustum.h"
+
+
+// all the static meshes in one shared vertex buffer and one shared index buffer,
+// so that any number of draws of any of them can go out in a single
+// glMultiDrawElementsIndirect( )
+//
+// the meshes are added once with AddObj( ), AddSphere( ), and AddGrid( ), and then
+// sent to the gpu with Finish( ). each frame, the draws are added with Add( ) --
+// that only appends a 20-byte indirect command and the draw's modelview matrix --
+// and Upload( ) sends both arrays. Draw( )
+// then issues a range of the commands with one call.
+//
+// a vertex shader finds its draw's data in the ArenaDraws shader storage block with
+// gl_DrawIDARB (from GL_ARB_shader_draw_parameters), which counts from 0 in every
+// call -- so the index of the call's first command is given to it as uArenaBase:
+//
+//	layout( std430, binding = 2 ) readonly buffer ArenaDraws
+//	{
+//		mat4	uDrawModelView[ ];
+//	};
+//
+//	mat4 modelview = uDrawModelView[ uArenaBase + gl_DrawIDARB ];
+//
+// the vertices reach the shader through the regular gl_Vertex, gl_Normal, and
+// gl_MultiTexCoord0, as InstancedMesh's do
+
+#define ARENA_DRAW_BINDING	2	// the shader storage binding point ArenaDraws is on
+
+
+// the same as an obj file's struct ObjVertex:
+
+struct ArenaVertex
+{
+	float		x, y, z;
+	float		nx, ny, nz;
+	float		s, t;
+};
+
+
+struct ArenaMesh
+{
+	GLuint		firstIndex;
+	GLuint		numIndices;
+	GLint		baseVertex;
+	float		bounds[6];		// xmin, ymin, zmin, xmax, ymax, zmax
+	struct Sphere	sphere;
+};
+
+// laid out as glMultiDrawElementsIndirect( ) reads it:
+
+struct ArenaCommand
+{
+	GLuint		count;
+	GLuint		instanceCount;
+	GLuint		firstIndex;
+	GLint		baseVertex;
+	GLuint		baseInstance;
+};
+
+class DrawArena
+{
+  private:
+	GLuint				Vao;
+	GLuint				VertexBuffer;
+	GLuint				IndexBuffer;
+	GLuint				CommandBuffer;
+	GLuint				DrawBuffer;
+	int				CommandCapacity;	// commands the buffers have room for
+	std::vector<struct ArenaVertex>	Vertices;		// until Finish( )
+	std::vector<GLuint>		Indices;
+	std::vector<struct ArenaMesh>	Meshes;
+	std::vector<struct ArenaCommand>	Commands;		// this frame's
+	std::vector<float>			Draws;			// 16 a draw
+
+	int		AddMesh( std::vector<struct ArenaVertex> &, std::vector<GLuint> &, const float * );
+
+  public:
+	// statistics, since ResetStats( ):
+	int		MultiDrawCalls;
+	long long	DrawsIssued;
+	long long	CommandBytes;		// indirect commands and draw data sent
+
+		DrawArena( );
+
+	int	Add( int, const float * );
+	int	AddGrid( float, float, float, float, float, int, int );
+	int	AddObj( char *, float * = NULL );
+	int	AddSphere( float, int, int );
+	void	Begin( );
+	void	Destroy( );
+	void	Draw( GLSLProgram *, int, int );
+	void	DrawMesh( int );
+	bool	Finish( );
+	const struct Sphere *	GetSphere( int );
+	bool	IsValid( );
+	int	NumDraws( );
+	int	NumMeshes( );
+	void	PrintStats( int );
+	void	ResetStats( );
+	void	Upload( );
+};
+
+#endif		// #ifndef DRAWARENA_H
@@ -0,0 +1,638 @@
+#ifndef ENVFILTER_CPP
+#define ENVFILTER_CPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef TEST
+#undef TEST
+#define ENVFILTER_TEST
+#endif
+
+#include "texcache.cpp"
+
+
+unsigned char *	BmpToTexture( char *, int *, int * );
+
+
+// cpu prefiltering of a cube map for glossy reflections
+//
+// level L of the prefiltered chain is the environment convolved with the GGX lobe of
+// roughness L / ( ENV_LEVELS-1 ), taking the view, normal, and reflection directions
+// to be the same (the split-sum approximation) -- so a shader gets a glossy reflection
+// out of one textureLod( cube, R, roughness * ( ENV_LEVELS-1 ) ) instead of a loop of
+// samples. each texel sums ENV_SAMPLES importance-sampled directions, each of them read
+// from the source's own box-filtered chain at the level whose texels are about the size
+// of the sample's share of the lobe, so few samples give a smooth result. the rows of
+// all six faces are shared out among the openmp threads
+//
+// the environment's diffuse irradiance is also projected onto the first 9 spherical
+// harmonics (bands 0-2) and convolved with the cosine lobe. the coefficients are
+// scaled by 1/pi, so that summing them times the basis functions (EnvShBasis( )) gives
+// the light a white diffuse surface facing that way reflects
+//
+// both are worked out in linear light and cached next to the first face, like a
+// .texcache: the chain as a TexCache file with ENV_EXTENSION, the coefficients in a
+// small file with ENVSH_EXTENSION. the caches remember the faces' sizes and time
+// stamps, and the filter's settings, so changing either rebakes them
+
+#define ENV_SIZE		128		// level 0 of the prefiltered chain, at most
+#define ENV_LEVELS		6		// roughness 0, .2, .4, .6, .8, 1
+#define ENV_SAMPLES		128		// per texel
+#define ENV_SH_SIZE		32		// the source level the harmonics are summed over, at most
+#define ENV_EXTENSION		".ggx"
+#define ENVSH_EXTENSION		".sh9"
+#define ENVSH_MAGIC		0x4853534f	// "OSSH"
+#define ENVSH_VERSION		1
+
+
+// the source faces in linear light, each with a box-filtered chain down to 1 x 1:
+
+struct EnvSource
+{
+	int		numLevels;
+	int		size[MAXMIPLEVELS];
+	float *		faces[MAXMIPLEVELS][6];		// 4 floats/texel, like mipmaps.cpp's
+};
+
+
+// a direction through point ( s, t ) of a face, s and t from -1 to +1 -- the gl cube
+// map layout, +x, -x, +y, -y, +z, -z:
+
+static
+void
+EnvFaceDirection( int face, float s, float t, float dir[3] )
+{
+	switch( face )
+	{
+		case 0:	dir[0] =  1.f;	dir[1] = -t;	dir[2] = -s;	break;
+		case 1:	dir[0] = -1.f;	dir[1] = -t;	dir[2] =  s;	break;
+		case 2:	dir[0] =  s;	dir[1] =  1.f;	dir[2] =  t;	break;
+		case 3:	dir[0] =  s;	dir[1] = -1.f;	dir[2] = -t;	break;
+		case 4:	dir[0] =  s;	dir[1] = -t;	dir[2] =  1.f;	break;
+		default: dir[0] = -s;	dir[1] = -t;	dir[2] = -1.f;	break;
+	}
+}
+
+
+// ... and back -- the face a direction goes through, and where, s and t from 0 to 1:
+
+static
+int
+EnvDirectionFace( const float dir[3], float *s, float *t )
+{
+	float ax = fabsf( dir[0] ), ay = fabsf( dir[1] ), az = fabsf( dir[2] );
+	int face;
+	float sc, tc, ma;
+	if( ax >= ay  &&  ax >= az )
+	{
+		face = dir[0] > 0.f ? 0 : 1;
+		sc = dir[0] > 0.f ? -dir[2] : dir[2];
+		tc = -dir[1];
+		ma = ax;
+	}
+	else if( ay >= az )
+	{
+		face = dir[1] > 0.f ? 2 : 3;
+		sc = dir[0];
+		tc = dir[1] > 0.f ? dir[2] : -dir[2];
+		ma = ay;
+	}
+	else
+	{
+		face = dir[2] > 0.f ? 4 : 5;
+		sc = dir[2] > 0.f ? dir[0] : -dir[0];
+		tc = -dir[1];
+		ma = az;
+	}
+	*s = 0.5f * ( sc / ma + 1.f );
+	*t = 0.5f * ( tc / ma + 1.f );
+	return face;
+}
+
+
+// bilinear, clamped to the face's edges:
+
+static
+void
+EnvSampleLevel( struct EnvSource *src, int level, int face, float s, float t, float out[3] )
+{
+	int size = src->size[level];
+	float *texels = src->faces[level][face];
+	float x = s * (float)size - 0.5f;
+	float y = t * (float)size - 0.5f;
+	if( x < 0.f )			x = 0.f;
+	if( y < 0.f )			y = 0.f;
+	if( x > (float)( size-1 ) )	x = (float)( size-1 );
+	if( y > (float)( size-1 ) )	y = (float)( size-1 );
+	int x0 = (int)x, y0 = (int)y;
+	int x1 = x0 + 1 < size ? x0 + 1 : x0;
+	int y1 = y0 + 1 < size ? y0 + 1 : y0;
+	float fx = x - (float)x0, fy = y - (float)y0;
+	float *t00 = &texels[ 4*( y0*size + x0 ) ];
+	float *t10 = &texels[ 4*( y0*size + x1 ) ];
+	float *t01 = &texels[ 4*( y1*size + x0 ) ];
+	float *t11 = &texels[ 4*( y1*size + x1 ) ];
+	for( int c = 0; c < 3; c++ )
+	{
+		float a = t00[c] + fx * ( t10[c] - t00[c] );
+		float b = t01[c] + fx * ( t11[c] - t01[c] );
+		out[c] = a + fy * ( b - a );
+	}
+}
+
+
+// trilinear, along a direction:
+
+static
+void
+EnvSample( struct EnvSource *src, const float dir[3], float lod, float out[3] )
+{
+	float s, t;
+	int face = EnvDirectionFace( dir, &s, &t );
+	float maxLod = (float)( src->numLevels - 1 );
+	if( lod < 0.f )		lod = 0.f;
+	if( lod > maxLod )	lod = maxLod;
+	int l0 = (int)lod;
+	float f = lod - (float)l0;
+	EnvSampleLevel( src, l0, face, s, t, out );
+	if( f > 0.f  &&  l0 + 1 < src->numLevels )
+	{
+		float next[3];
+		EnvSampleLevel( src, l0 + 1, face, s, t, next );
+		for( int c = 0; c < 3; c++ )
+			out[c] += f * ( next[c] - out[c] );
+	}
+}
+
+
+// read the six faces -- they have to be the same square size:
+
+bool
+LoadEnvSource( char *files[6], struct EnvSource *src )
+{
+	InitMipTables( );
+	memset( src, 0, sizeof(struct EnvSource) );
+	for( int face = 0; face < 6; face++ )
+	{
+		int width, height;
+		unsigned char *rgb = BmpToTexture( files[face], &width, &height );
+		if( rgb == NULL  ||  width != height  ||  ( face > 0  &&  width != src->size[0] ) )
+		{
+			fprintf( stderr, "LoadEnvSource: '%s' is missing or not the same square size as the other faces\n", files[face] );
+			delete [ ] rgb;
+			return false;
+		}
+		if( face == 0 )
+		{
+			src->numLevels = NumMipLevels( width, height );
+			for( int level = 0; level < src->numLevels; level++ )
+				src->size[level] = ( width >> level ) > 0 ? ( width >> level ) : 1;
+		}
+
+		src->faces[0][face] = RgbToLinear( rgb, width, height );
+		delete [ ] rgb;
+		for( int level = 1; level < src->numLevels; level++ )
+		{
+			int w = src->size[level-1];
+			src->faces[level][face] = BoxDownsample( src->faces[level-1][face], w, w, src->size[level], src->size[level] );
+		}
+	}
+	return true;
+}
+
+
+void
+FreeEnvSource( struct EnvSource *src )
+{
+	for( int level = 0; level < MAXMIPLEVELS; level++ )
+	{
+		for( int face = 0; face < 6; face++ )
+		{
+			delete [ ] src->faces[level][face];
+			src->faces[level][face] = NULL;
+		}
+	}
+	src->numLevels = 0;
+}
+
+
+// the i'th of n points of the hammersley set:
+
+static
+void
+Hammersley( int i, int n, float *u, float *v )
+{
+	unsigned int bits = (unsigned int)i;
+	bits = ( bits << 16 ) | ( bits >> 16 );
+	bits = ( ( bits & 0x55555555u ) << 1 ) | ( ( bits & 0xAAAAAAAAu ) >> 1 );
+	bits = ( ( bits & 0x33333333u ) << 2 ) | ( ( bits & 0xCCCCCCCCu ) >> 2 );
+	bits = ( ( bits & 0x0F0F0F0Fu ) << 4 ) | ( ( bits & 0xF0F0F0F0u ) >> 4 );
+	bits = ( ( bits & 0x00FF00FFu ) << 8 ) | ( ( bits & 0xFF00FF00u ) >> 8 );
+	*u = (float)i / (float)n;
+	*v = (float)bits * 2.3283064365386963e-10f;
+}
+
+
+// one sample of a level's lobe, around +z, and the source level to read it from:
+
+struct EnvLobeSample
+{
+	float	dir[3];
+	float	weight;		// n . l
+	float	lod;
+};
+
+
+// the prefiltered chain, into tc, from src: size x size at level 0 and numLevels
+// levels, with samples samples per texel:
+
+void
+PrefilterEnvMap( struct EnvSource *src, int size, int numLevels, int samples, struct TexCache *tc )
+{
+	InitTexCache( tc, TEXCACHE_RGB8, size, size, 6, numLevels );
+	float texelSolidAngle = 4.f * (float)M_PI / ( 6.f * (float)src->size[0] * (float)src->size[0] );
+	struct EnvLobeSample *lobe = new struct EnvLobeSample[samples];
+
+	for( int level = 0; level < numLevels; level++ )
+	{
+		int s = ( size >> level ) > 0 ? ( size >> level ) : 1;
+		float roughness = numLevels > 1 ? (float)level / (float)( numLevels - 1 ) : 0.f;
+		float a = roughness * roughness;
+
+		// the lobe's directions, with n = v = +z -- roughness 0 is a mirror, so only
+		// the source's level the size of these texels is needed:
+		int numLobe = 0;
+		if( level == 0 )
+		{
+			lobe[0].dir[0] = lobe[0].dir[1] = 0.f;
+			lobe[0].dir[2] = 1.f;
+			lobe[0].weight = 1.f;
+			lobe[0].lod = log2f( (float)src->size[0] / (float)s );
+			numLobe = 1;
+		}
+		else
+		{
+			for( int i = 0; i < samples; i++ )
+			{
+				float u, v;
+				Hammersley( i, samples, &u, &v );
+				float phi = 2.f * (float)M_PI * u;
+				float cosTheta = sqrtf( ( 1.f - v ) / ( 1.f + ( a*a - 1.f ) * v ) );
+				float sinTheta = sqrtf( 1.f - cosTheta*cosTheta );
+				float h[3] = { sinTheta * cosf( phi ), sinTheta * sinf( phi ), cosTheta };
+
+				// l = 2 ( v . h ) h - v:
+				float nDotL = 2.f * cosTheta * cosTheta - 1.f;
+				if( nDotL <= 0.f )
+					continue;
+				struct EnvLobeSample *ls = &lobe[numLobe++];
+				ls->dir[0] = 2.f * cosTheta * h[0];
+				ls->dir[1] = 2.f * cosTheta * h[1];
+				ls->dir[2] = nDotL;
+				ls->weight = nDotL;
+
+				// the pdf of l is D( h ) / 4 when n = v:
+				float d = cosTheta*cosTheta * ( a*a - 1.f ) + 1.f;
+				float pdf = a*a / ( (float)M_PI * d * d ) / 4.f;
+				float sampleSolidAngle = 1.f / ( (float)samples * pdf + 0.0001f );
+				ls->lod = 0.5f * log2f( sampleSolidAngle / texelSolidAngle ) + 1.f;
+			}
+		}
+
+		float *out[6];
+		for( int face = 0; face < 6; face++ )
+			out[face] = new float[ 4*s*s ];
+
+		#pragma omp parallel for schedule(dynamic)
+		for( int row = 0; row < 6*s; row++ )
+		{
+			int face = row / s;
+			int y = row % s;
+			for( int x = 0; x < s; x++ )
+			{
+				float n[3];
+				EnvFaceDirection( face, 2.f * ( (float)x + 0.5f ) / (float)s - 1.f, 2.f * ( (float)y + 0.5f ) / (float)s - 1.f, n );
+				float len = sqrtf( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+				n[0] /= len;	n[1] /= len;	n[2] /= len;
+
+				// a frame around n:
+				float up[3] = { 0.f, 0.f, 1.f };
+				if( fabsf( n[2] ) > 0.999f )
+				{
+					up[0] = 1.f;
+					up[2] = 0.f;
+				}
+				float tx[3] = { up[1]*n[2] - up[2]*n[1], up[2]*n[0] - up[0]*n[2], up[0]*n[1] - up[1]*n[0] };
+				float tlen = sqrtf( tx[0]*tx[0] + tx[1]*tx[1] + tx[2]*tx[2] );
+				tx[0] /= tlen;	tx[1] /= tlen;	tx[2] /= tlen;
+				float ty[3] = { n[1]*tx[2] - n[2]*tx[1], n[2]*tx[0] - n[0]*tx[2], n[0]*tx[1] - n[1]*tx[0] };
+
+				float sum[3] = { 0.f, 0.f, 0.f };
+				float weights = 0.f;
+				for( int i = 0; i < numLobe; i++ )
+				{
+					struct EnvLobeSample *ls = &lobe[i];
+					float l[3];
+					for( int c = 0; c < 3; c++ )
+						l[c] = tx[c]*ls->dir[0] + ty[c]*ls->dir[1] + n[c]*ls->dir[2];
+					float color[3];
+					EnvSample( src, l, ls->lod, color );
+					for( int c = 0; c < 3; c++ )
+						sum[c] += ls->weight * color[c];
+					weights += ls->weight;
+				}
+
+				float *texel = &out[face][ 4*( y*s + x ) ];
+				for( int c = 0; c < 3; c++ )
+					texel[c] = sum[c] / weights;
+				texel[3] = 1.f;
+			}
+		}
+
+		for( int face = 0; face < 6; face++ )
+		{
+			tc->sizes[level][face] = 3*s*s;
+			tc->data[level][face] = LinearToRgb( out[face], s, s );
+			delete [ ] out[face];
+		}
+	}
+	delete [ ] lobe;
+}
+
+
+// the 9 basis functions at a unit direction:
+
+void
+EnvShBasis( const float dir[3], float y[9] )
+{
+	float x = dir[0], yy = dir[1], z = dir[2];
+	y[0] = 0.282095f;
+	y[1] = 0.488603f * yy;
+	y[2] = 0.488603f * z;
+	y[3] = 0.488603f * x;
+	y[4] = 1.092548f * x * yy;
+	y[5] = 1.092548f * yy * z;
+	y[6] = 0.315392f * ( 3.f*z*z - 1.f );
+	y[7] = 1.092548f * x * z;
+	y[8] = 0.546274f * ( x*x - yy*yy );
+}
+
+
+// the irradiance coefficients, from the first source level at most ENV_SH_SIZE across:
+
+void
+ProjectEnvSh( struct EnvSource *src, float sh[9][3] )
+{
+	int level = 0;
+	while( level < src->numLevels - 1  &&  src->size[level] > ENV_SH_SIZE )
+		level++;
+	int size = src->size[level];
+
+	double sum[9][3];
+	memset( sum, 0, sizeof(sum) );
+	for( int face = 0; face < 6; face++ )
+	{
+		for( int y = 0; y < size; y++ )
+		{
+			for( int x = 0; x < size; x++ )
+			{
+				float s = 2.f * ( (float)x + 0.5f ) / (float)size - 1.f;
+				float t = 2.f * ( (float)y + 0.5f ) / (float)size - 1.f;
+				float dir[3];
+				EnvFaceDirection( face, s, t, dir );
+				float r2 = 1.f + s*s + t*t;
+				float len = sqrtf( r2 );
+				dir[0] /= len;	dir[1] /= len;	dir[2] /= len;
+
+				// the texel's solid angle:
+				float dw = ( 2.f / (float)size ) * ( 2.f / (float)size ) / ( r2 * len );
+				float basis[9];
+				EnvShBasis( dir, basis );
+				float *texel = &src->faces[level][face][ 4*( y*size + x ) ];
+				for( int i = 0; i < 9; i++ )
+					for( int c = 0; c < 3; c++ )
+						sum[i][c] += (double)( texel[c] * basis[i] * dw );
+			}
+		}
+	}
+
+	// the cosine lobe's bands are pi, 2pi/3, and pi/4 -- over pi:
+	static const float band[9] = { 1.f,  2.f/3.f, 2.f/3.f, 2.f/3.f,  .25f, .25f, .25f, .25f, .25f };
+	for( int i = 0; i < 9; i++ )
+		for( int c = 0; c < 3; c++ )
+			sh[i][c] = (float)sum[i][c] * band[i];
+}
+
+
+// the settings the caches depend on, folded into the faces' stamp:
+
+static
+long long
+EnvStamp( char *files[6] )
+{
+	long long stamp = SourceStamp( files, 6 );
+	if( stamp == -1 )
+		return -1;
+	stamp = 31 * stamp + ENV_SIZE;
+	stamp = 31 * stamp + ENV_LEVELS;
+	stamp = 31 * stamp + ENV_SAMPLES;
+	stamp = 31 * stamp + ENV_SH_SIZE;
+	return stamp;
+}
+
+
+static
+bool
+ReadEnvSh( char *file, long long stamp, float sh[9][3] )
+{
+	FILE *fp = fopen( file, "rb" );
+	if( fp == NULL )
+		return false;
+	int header[2];
+	long long fileStamp;
+	bool ok = fread( header, sizeof(int), 2, fp ) == 2  &&  header[0] == ENVSH_MAGIC  &&  header[1] == ENVSH_VERSION;
+	ok = ok  &&  fread( &fileStamp, sizeof(long long), 1, fp ) == 1  &&  fileStamp == stamp;
+	ok = ok  &&  fread( sh, sizeof(float), 27, fp ) == 27;
+	fclose( fp );
+	return ok;
+}
+
+
+static
+bool
+WriteEnvSh( char *file, long long stamp, float sh[9][3] )
+{
+	char tmp[300];
+	FILE *fp = OpenCacheFile( file, tmp, sizeof(tmp) );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write irradiance cache '%s'\n", file );
+		return false;
+	}
+	int header[2] = { ENVSH_MAGIC, ENVSH_VERSION };
+	bool ok = fwrite( header, sizeof(int), 2, fp ) == 2;
+	ok = ok  &&  fwrite( &stamp, sizeof(long long), 1, fp ) == 1;
+	ok = ok  &&  fwrite( sh, sizeof(float), 27, fp ) == 27;
+	ok = CloseCacheFile( fp, tmp, file, ok );
+	if( ! ok )
+		fprintf( stderr, "Error writing irradiance cache '%s'\n", file );
+	return ok;
+}
+
+
+// the prefiltered chain and the irradiance of these faces, baking them first if
+// either cache is missing or stale -- returns false if the faces can't be read:
+
+bool
+GetEnvMap( char *files[6], struct TexCache *tc, float sh[9][3] )
+{
+	char chainFile[256], shFile[256];
+	snprintf( chainFile, sizeof(chainFile), "%s%s", files[0], ENV_EXTENSION );
+	snprintf( shFile, sizeof(shFile), "%s%s", files[0], ENVSH_EXTENSION );
+
+	long long stamp = EnvStamp( files );
+	if( stamp != -1  &&  ReadTexCache( chainFile, stamp, TEXCACHE_RGB8, tc ) )
+	{
+		if( ReadEnvSh( shFile, stamp, sh ) )
+			return true;
+		FreeTexCache( tc );
+	}
+
+	struct EnvSource src;
+	if( ! LoadEnvSource( files, &src ) )
+	{
+		FreeEnvSource( &src );
+		return false;
+	}
+
+	int size = src.size[0] < ENV_SIZE ? src.size[0] : ENV_SIZE;
+	int numLevels = NumMipLevels( size, size ) < ENV_LEVELS ? NumMipLevels( size, size ) : ENV_LEVELS;
+	double t0 = BcSeconds( );
+	PrefilterEnvMap( &src, size, numLevels, ENV_SAMPLES, tc );
+	double t1 = BcSeconds( );
+	ProjectEnvSh( &src, sh );
+	double t2 = BcSeconds( );
+	FreeEnvSource( &src );
+
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads( );
+#endif
+	fprintf( stderr, "Prefiltered '%s': %d levels from %d x %d, %d samples a texel, %.1f ms on %d threads; irradiance %.1f ms\n",
+		files[0], numLevels, size, size, ENV_SAMPLES, 1000. * ( t1 - t0 ), threads, 1000. * ( t2 - t1 ) );
+	WriteTexCache( chainFile, stamp, tc );
+	WriteEnvSh( shFile, stamp, sh );
+	return true;
+}
+
+
+//#define TEST
+#ifdef ENVFILTER_TEST
+
+// the prefiltering benchmark: the six faces given (or the nv* ones) prefiltered on
+// 1, 2, 4, ... threads. the average of each level is printed as well -- the filter
+// only spreads the light around, so every level should average what the source does
+
+#include "bmptotexture.cpp"
+
+int
+main( int argc, char *argv[ ] )
+{
+	char *nvFiles[6] = { (char *)"nvposx.bmp", (char *)"nvnegx.bmp", (char *)"nvposy.bmp",
+			     (char *)"nvnegy.bmp", (char *)"nvposz.bmp", (char *)"nvnegz.bmp" };
+	char **files = ( argc > 6 )  ?  &argv[1]  :  nvFiles;
+
+	double t0 = BcSeconds( );
+	struct EnvSource src;
+	if( ! LoadEnvSource( files, &src ) )
+		return 1;
+	fprintf( stderr, "'%s' ...: %d x %d faces, read and box-filtered in %.1f ms\n", files[0], src.size[0], src.size[0], 1000. * ( BcSeconds( ) - t0 ) );
+
+	int maxThreads = 1;
+#ifdef _OPENMP
+	maxThreads = omp_get_num_procs( );
+#endif
+
+	int size = src.size[0] < ENV_SIZE ? src.size[0] : ENV_SIZE;
+	struct TexCache tc;
+	for( int threads = 1; threads <= maxThreads; threads *= 2 )
+	{
+#ifdef _OPENMP
+		omp_set_num_threads( threads );
+#endif
+		double t1 = BcSeconds( );
+		PrefilterEnvMap( &src, size, ENV_LEVELS, ENV_SAMPLES, &tc );
+		double t2 = BcSeconds( );
+
+		double samples = 0.;
+		for( int level = 1; level < ENV_LEVELS; level++ )
+			samples += 6. * (double)( size >> level ) * (double)( size >> level ) * (double)ENV_SAMPLES;
+		fprintf( stderr, "%2d threads: %8.2f ms, %7.2f Msamples/s (%6.2f per thread)\n", threads, 1000. * ( t2 - t1 ),
+			samples / 1000000. / ( t2 - t1 ), samples / 1000000. / ( t2 - t1 ) / (double)threads );
+		if( threads * 2 <= maxThreads )
+			FreeTexCache( &tc );
+	}
+
+	// the averages, in linear light:
+	double mean = 0.;
+	int top = src.numLevels - 1;
+	for( int face = 0; face < 6; face++ )
+		for( int c = 0; c < 3; c++ )
+			mean += src.faces[top][face][c] / 18.;
+	fprintf( stderr, "source average %.4f; prefiltered level averages:", mean );
+	for( int level = 0; level < ENV_LEVELS; level++ )
+	{
+		int s = size >> level;
+		double sum = 0.;
+		for( int face = 0; face < 6; face++ )
+			for( int i = 0; i < 3*s*s; i++ )
+				sum += SrgbToLinearTable[ tc.data[level][face][i] ];
+		fprintf( stderr, " %.4f", sum / (double)( 18*s*s ) );
+	}
+	fprintf( stderr, "\n" );
+	FreeTexCache( &tc );
+
+	float sh[9][3];
+	double t3 = BcSeconds( );
+	ProjectEnvSh( &src, sh );
+	double t4 = BcSeconds( );
+	fprintf( stderr, "irradiance in %.2f ms, facing:", 1000. * ( t4 - t3 ) );
+	const char *names[6] = { "+x", "-x", "+y", "-y", "+z", "-z" };
+	for( int face = 0; face < 6; face++ )
+	{
+		float dir[3], basis[9];
+		EnvFaceDirection( face, 0.f, 0.f, dir );
+		EnvShBasis( dir, basis );
+		float e = 0.f;
+		for( int i = 0; i < 9; i++ )
+			e += ( sh[i][0] + sh[i][1] + sh[i][2] ) / 3.f * basis[i];
+		fprintf( stderr, "  %s %.4f", names[face], e );
+	}
+	fprintf( stderr, "\n" );
+
+	FreeEnvSource( &src );
+	return 0;
+}
+#endif
+
+// EXPECTED_RESULTS (g++ -O2 -fopenmp -DTEST, in FinalProject/ with the nv* faces):
+//
+//	'nvposx.bmp' ...: 1024 x 1024 faces, read and box-filtered in 175.6 ms
+//	 1 threads:   226.94 ms,   18.46 Msamples/s ( 18.46 per thread)
+//	source average 0.0199; prefiltered level averages: 0.0199 0.0200 0.0202 0.0202 0.0201 0.0199
+//	irradiance in 0.34 ms, facing:  +x 0.0230  -x 0.0168  +y 0.0299  -y 0.0191  +z 0.0171  -z 0.0184
+//
+// (on a one-core machine, so only the 1-thread line -- with more cores the rows
+// split between the threads and the time drops nearly in proportion.) the level
+// averages staying at the source's shows the filter keeps the energy, and the sky
+// being brightest straight up shows in the +y irradiance
+
+#endif		// #ifndef ENVFILTER_CPP
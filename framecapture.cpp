@@ -0,0 +1,476 @@
+#ifndef FRAMECAPTURE_CPP
+#define FRAMECAPTURE_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "framecapture.h"
+
+
+static double
+CaptureSeconds( )
+{
+#ifdef _OPENMP
+	return omp_get_wtime( );
+#else
+	return (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+FrameReadback::FrameReadback( )
+{
+	Width = Height = 0;
+	for( int i = 0; i < READBACK_SLOTS; i++ )
+	{
+		Pbos[i] = 0;
+		Fences[i] = 0;
+		Frames[i] = -1;
+	}
+	Oldest = 0;
+	Pending = 0;
+	ResetStats( );
+}
+
+
+// slots for frames of width x height:
+
+bool
+FrameReadback::Init( int width, int height )
+{
+	Destroy( );
+	Width = width;
+	Height = height;
+	glGenBuffers( READBACK_SLOTS, Pbos );
+	for( int i = 0; i < READBACK_SLOTS; i++ )
+	{
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, Pbos[i] );
+		glBufferData( GL_PIXEL_PACK_BUFFER, 4 * Width * Height, NULL, GL_STREAM_READ );
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	Oldest = 0;
+	Pending = 0;
+	return true;
+}
+
+
+bool
+FrameReadback::IsValid( )
+{
+	return Pbos[0] != 0;
+}
+
+
+void
+FrameReadback::Destroy( )
+{
+	for( int i = 0; i < READBACK_SLOTS; i++ )
+	{
+		if( Fences[i] != 0 )
+			glDeleteSync( Fences[i] );
+		Fences[i] = 0;
+	}
+	if( Pbos[0] != 0 )
+		glDeleteBuffers( READBACK_SLOTS, Pbos );
+	for( int i = 0; i < READBACK_SLOTS; i++ )
+		Pbos[i] = 0;
+	Pending = 0;
+}
+
+
+int
+FrameReadback::NumPending( )
+{
+	return Pending;
+}
+
+
+// queue the read of the current read framebuffer as frame -- with every slot
+// pending, Finish( ) one first:
+
+void
+FrameReadback::Start( int frame )
+{
+	if( ! IsValid( )  ||  Pending >= READBACK_SLOTS )
+		return;
+	double t0 = CaptureSeconds( );
+
+	int slot = ( Oldest + Pending ) % READBACK_SLOTS;
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, Pbos[slot] );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0 );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	Fences[slot] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	Frames[slot] = frame;
+	Pending++;
+
+	Reads++;
+	StartSeconds += CaptureSeconds( ) - t0;
+}
+
+
+// copy the oldest pending frame into rgba (4 x Width x Height bytes) and return
+// which frame it is, or -1 if none is pending -- or if its buffer couldn't be read,
+// in which case the frame is lost (it isn't pending any more, and rgba is untouched):
+
+int
+FrameReadback::Finish( unsigned char *rgba )
+{
+	if( Pending == 0 )
+		return -1;
+	int slot = Oldest;
+
+	double t0 = CaptureSeconds( );
+	if( glClientWaitSync( Fences[slot], 0, 0 ) == GL_TIMEOUT_EXPIRED )
+	{
+		Stalls++;
+		while( glClientWaitSync( Fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 ) == GL_TIMEOUT_EXPIRED )
+			;
+	}
+	glDeleteSync( Fences[slot] );
+	Fences[slot] = 0;
+	double t1 = CaptureSeconds( );
+
+	// (an unmap that fails means the contents went bad while they were mapped)
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, Pbos[slot] );
+	void *mapped = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, 4 * Width * Height, GL_MAP_READ_BIT );
+	bool ok = mapped != NULL;
+	if( ok )
+	{
+		memcpy( rgba, mapped, 4 * Width * Height );
+		ok = glUnmapBuffer( GL_PIXEL_PACK_BUFFER ) == GL_TRUE;
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	Oldest = ( Oldest + 1 ) % READBACK_SLOTS;
+	Pending--;
+	WaitSeconds += t1 - t0;
+	CopySeconds += CaptureSeconds( ) - t1;
+	if( ! ok )
+	{
+		fprintf( stderr, "FrameReadback: couldn't read frame %d back\n", Frames[slot] );
+		Failed++;
+		return -1;
+	}
+	return Frames[slot];
+}
+
+
+void
+FrameReadback::PrintStats( )
+{
+	if( Reads == 0 )
+		return;
+	fprintf( stderr, "Readback, %d x %d: %d frames (%d failed), %6.2f ms/frame queueing, %6.2f waiting (%d stalls), %6.2f copying out\n",
+		Width, Height, Reads, Failed, 1000. * StartSeconds / (double)Reads, 1000. * WaitSeconds / (double)Reads, Stalls,
+		1000. * CopySeconds / (double)Reads );
+}
+
+
+void
+FrameReadback::ResetStats( )
+{
+	Reads = 0;
+	Failed = 0;
+	Stalls = 0;
+	StartSeconds = WaitSeconds = CopySeconds = 0.;
+}
+
+
+FrameWriter::FrameWriter( )
+{
+	Format = FRAME_PPM;
+	Running = false;
+	Stopping = false;
+	Written = Failed = 0;
+	BytesWritten = 0.;
+	EncodeSeconds = 0.;
+	Waits = 0;
+	WaitSeconds = 0.;
+}
+
+
+FrameWriter::~FrameWriter( )
+{
+	Finish( );
+}
+
+
+// write into directory (made if it isn't there), in format -- FRAME_PPM or FRAME_PNG:
+
+bool
+FrameWriter::Init( const char *directory, int format )
+{
+	Finish( );
+	Directory = directory;
+	Format = format;
+#ifdef WIN32
+	int status = _mkdir( directory );
+#else
+	int status = mkdir( directory, 0755 );
+#endif
+	if( status != 0  &&  errno != EEXIST )
+	{
+		fprintf( stderr, "FrameWriter: cannot make the directory '%s'\n", directory );
+		return false;
+	}
+
+	Written = Failed = 0;
+	BytesWritten = 0.;
+	EncodeSeconds = 0.;
+	Waits = 0;
+	WaitSeconds = 0.;
+	Stopping = false;
+	Running = true;
+	Worker = std::thread( &FrameWriter::Run, this );
+	return true;
+}
+
+
+// hand the writer frame, width x height rgba pixels from new[ ] -- it deletes them:
+
+void
+FrameWriter::Write( int frame, int width, int height, unsigned char *pixels )
+{
+	if( ! Running )
+	{
+		delete [ ] pixels;
+		return;
+	}
+
+	struct FrameJob job;
+	job.frame = frame;
+	job.width = width;
+	job.height = height;
+	job.pixels = pixels;
+
+	std::unique_lock<std::mutex> lock( Lock );
+	if( (int)Jobs.size( ) >= FRAMEWRITER_QUEUE )
+	{
+		double t0 = CaptureSeconds( );
+		Waits++;
+		Room.wait( lock, [this]{ return (int)Jobs.size( ) < FRAMEWRITER_QUEUE; } );
+		WaitSeconds += CaptureSeconds( ) - t0;
+	}
+	Jobs.push_back( job );
+	lock.unlock( );
+	Wake.notify_one( );
+}
+
+
+// write everything still queued, and stop the thread:
+
+void
+FrameWriter::Finish( )
+{
+	if( ! Running )
+		return;
+	{
+		std::lock_guard<std::mutex> lock( Lock );
+		Stopping = true;
+	}
+	Wake.notify_one( );
+	Worker.join( );
+	Running = false;
+}
+
+
+// the writer's thread -- until Finish( ), and the queue is empty:
+
+void
+FrameWriter::Run( )
+{
+	for( ; ; )
+	{
+		std::unique_lock<std::mutex> lock( Lock );
+		Wake.wait( lock, [this]{ return ! Jobs.empty( )  ||  Stopping; } );
+		if( Jobs.empty( ) )
+			return;
+		struct FrameJob job = Jobs.front( );
+		Jobs.pop_front( );
+		lock.unlock( );
+		Room.notify_one( );
+
+		double t0 = CaptureSeconds( );
+		std::string file = FileName( Directory.c_str( ), job.frame, Format );
+		long long bytes = WriteFile( file.c_str( ), Format, job.width, job.height, job.pixels );
+		delete [ ] job.pixels;
+		double seconds = CaptureSeconds( ) - t0;
+
+		lock.lock( );
+		if( bytes > 0 )
+		{
+			Written++;
+			BytesWritten += (double)bytes;
+		}
+		else
+			Failed++;
+		EncodeSeconds += seconds;
+	}
+}
+
+
+void
+FrameWriter::PrintStats( )
+{
+	std::lock_guard<std::mutex> lock( Lock );
+	fprintf( stderr, "Writer, %s: %d frames (%d failed), %.1f MB, %6.2f ms/frame encoding and writing on its thread; "
+		"%d waits for room, %6.2f ms in all\n", Format == FRAME_PNG ? "png" : "ppm", Written, Failed,
+		BytesWritten / 1000000., Written > 0 ? 1000. * EncodeSeconds / (double)Written : 0., Waits, 1000. * WaitSeconds );
+}
+
+
+// <directory>/frame00042.ppm:
+
+std::string
+FrameWriter::FileName( const char *directory, int frame, int format )
+{
+	char name[64];
+	sprintf( name, "/frame%05d.%s", frame, format == FRAME_PNG ? "png" : "ppm" );
+	return std::string( directory ) + name;
+}
+
+
+// the png's checksums:
+// (the table is a function-local static, so the first call builds it exactly once,
+//  even with the writer's thread and a direct WriteFrame( ) calling at the same time)
+
+struct PngCrcTable
+{
+	unsigned int entry[256];
+
+	PngCrcTable( )
+	{
+		for( unsigned int i = 0; i < 256; i++ )
+		{
+			unsigned int c = i;
+			for( int k = 0; k < 8; k++ )
+				c = ( c & 1 ) ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+			entry[i] = c;
+		}
+	}
+};
+
+static unsigned int
+PngCrc( unsigned int crc, const unsigned char *bytes, int n )
+{
+	static const PngCrcTable table;
+	crc = ~crc;
+	for( int i = 0; i < n; i++ )
+		crc = table.entry[ ( crc ^ bytes[i] ) & 0xff ] ^ ( crc >> 8 );
+	return ~crc;
+}
+
+static void
+PngChunk( FILE *fp, const char *type, const unsigned char *data, int n )
+{
+	unsigned char header[8] = { (unsigned char)( n >> 24 ), (unsigned char)( n >> 16 ), (unsigned char)( n >> 8 ), (unsigned char)n,
+		(unsigned char)type[0], (unsigned char)type[1], (unsigned char)type[2], (unsigned char)type[3] };
+	unsigned int crc = PngCrc( 0, &header[4], 4 );
+	crc = PngCrc( crc, data, n );
+	unsigned char trailer[4] = { (unsigned char)( crc >> 24 ), (unsigned char)( crc >> 16 ), (unsigned char)( crc >> 8 ), (unsigned char)crc };
+	fwrite( header, 1, 8, fp );
+	if( n > 0 )
+		fwrite( data, 1, n, fp );
+	fwrite( trailer, 1, 4, fp );
+}
+
+
+// one frame, width x height rgba, bottom row first, as an rgb ppm or png -- returns
+// the bytes written, 0 if it couldn't. (thread-safe: it is what the writer's thread
+// calls, and what to call to write a frame right away)
+
+long long
+FrameWriter::WriteFile( const char *file, int format, int width, int height, const unsigned char *rgba )
+{
+	FILE *fp = fopen( file, "wb" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "FrameWriter: cannot write '%s'\n", file );
+		return 0;
+	}
+
+	// the rows top down, rgb -- each with a png filter byte (0, none) in front:
+	int rowBytes = 3 * width + ( format == FRAME_PNG ? 1 : 0 );
+	std::vector<unsigned char> rows( rowBytes * height );
+	for( int y = 0; y < height; y++ )
+	{
+		const unsigned char *in = &rgba[ 4 * width * ( height - 1 - y ) ];
+		unsigned char *out = &rows[ rowBytes * y ];
+		if( format == FRAME_PNG )
+			*out++ = 0;
+		for( int x = 0; x < width; x++ )
+		{
+			*out++ = in[0];
+			*out++ = in[1];
+			*out++ = in[2];
+			in += 4;
+		}
+	}
+
+	if( format == FRAME_PPM )
+	{
+		fprintf( fp, "P6\n%d %d\n255\n", width, height );
+		fwrite( &rows[0], 1, rows.size( ), fp );
+	}
+	else
+	{
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		fwrite( signature, 1, 8, fp );
+		unsigned char ihdr[13] = { (unsigned char)( width >> 24 ), (unsigned char)( width >> 16 ), (unsigned char)( width >> 8 ), (unsigned char)width,
+			(unsigned char)( height >> 24 ), (unsigned char)( height >> 16 ), (unsigned char)( height >> 8 ), (unsigned char)height,
+			8, 2, 0, 0, 0 };		// 8 bits, rgb, deflate, adaptive filtering, not interlaced
+		PngChunk( fp, "IHDR", ihdr, 13 );
+
+		// a zlib stream of stored blocks, each up to 65535 bytes:
+		int n = (int)rows.size( );
+		int blocks = ( n + 65534 ) / 65535;
+		std::vector<unsigned char> idat;
+		idat.reserve( 2 + 5 * blocks + n + 4 );
+		idat.push_back( 0x78 );
+		idat.push_back( 0x01 );
+		unsigned int a = 1, b = 0;
+		for( int i = 0; i < n; i += 65535 )
+		{
+			int len = ( n - i < 65535 ) ? n - i : 65535;
+			idat.push_back( i + len >= n ? 1 : 0 );
+			idat.push_back( (unsigned char)len );
+			idat.push_back( (unsigned char)( len >> 8 ) );
+			idat.push_back( (unsigned char)~len );
+			idat.push_back( (unsigned char)( ~len >> 8 ) );
+			idat.insert( idat.end( ), rows.begin( ) + i, rows.begin( ) + i + len );
+			for( int j = i; j < i + len; j++ )
+			{
+				a = ( a + rows[j] ) % 65521;
+				b = ( b + a ) % 65521;
+			}
+		}
+		unsigned int adler = ( b << 16 ) | a;
+		idat.push_back( (unsigned char)( adler >> 24 ) );
+		idat.push_back( (unsigned char)( adler >> 16 ) );
+		idat.push_back( (unsigned char)( adler >> 8 ) );
+		idat.push_back( (unsigned char)adler );
+		PngChunk( fp, "IDAT", &idat[0], (int)idat.size( ) );
+		PngChunk( fp, "IEND", NULL, 0 );
+	}
+
+	long long bytes = (long long)ftell( fp );
+	if( fclose( fp ) != 0 )
+		return 0;
+	return bytes;
+}
+
+#endif		// #ifndef FRAMECAPTURE_CPP
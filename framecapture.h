@@ -0,0 +1,123 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+
+// getting rendered frames out to image files without holding up the rendering
+//
+// FrameReadback reads the framebuffer into one of READBACK_SLOTS pixel pack buffers
+// -- Start( frame ) only queues the glReadPixels( ), and fences it, so the copy goes
+// on while the next frame is drawn. Finish( ) takes the oldest frame out, waiting on
+// its fence only if it still isn't done (a stall, counted). with two slots, frame n
+// is taken out after frame n+1 has been started:
+//
+//	Display( n );	Start( n );
+//	Display( n+1 );	Start( n+1 );	Finish( ) -> n
+//	...
+//
+// FrameWriter encodes and writes the frames on a thread of its own, as
+// <directory>/frame00000.ppm (or .png), ... -- Write( ) hands it a frame and returns
+// at once, unless FRAMEWRITER_QUEUE frames are already waiting, in which case it
+// waits for room (counted too), so a slow disk can't pile up the whole animation in
+// memory. the png's are stored, not deflated: every encoder has the same cost, and
+// it needs no zlib
+//
+// frames are rgba, Width x Height, the bottom row first, as glReadPixels( ) gives them
+
+#define READBACK_SLOTS		2
+#define FRAMEWRITER_QUEUE	8
+
+enum FrameFormats
+{
+	FRAME_PPM,
+	FRAME_PNG
+};
+
+
+class FrameReadback
+{
+  private:
+	int		Width, Height;
+	GLuint		Pbos[READBACK_SLOTS];
+	GLsync		Fences[READBACK_SLOTS];
+	int		Frames[READBACK_SLOTS];
+	int		Oldest;			// the slot Finish( ) takes next
+	int		Pending;		// slots started and not finished
+
+  public:
+	// statistics, since ResetStats( ):
+	int		Reads;
+	int		Failed;			// frames that couldn't be read back, and were lost
+	int		Stalls;			// Finish( )es that had to wait for the copy
+	double		StartSeconds;		// queueing the reads
+	double		WaitSeconds;		// waiting on their fences
+	double		CopySeconds;		// mapping and copying them out
+
+		FrameReadback( );
+
+	void	Destroy( );
+	int	Finish( unsigned char * );
+	bool	Init( int, int );
+	bool	IsValid( );
+	int	NumPending( );
+	void	PrintStats( );
+	void	ResetStats( );
+	void	Start( int );
+};
+
+
+struct FrameJob
+{
+	int		frame;
+	int		width, height;
+	unsigned char *	pixels;		// owned by the job, delete[ ]'ed once it is written
+};
+
+
+class FrameWriter
+{
+  private:
+	std::string		Directory;
+	int			Format;
+	std::deque<struct FrameJob>	Jobs;
+	std::mutex		Lock;		// Jobs, Stopping, and the statistics
+	std::condition_variable	Wake;		// a job, or stopping, for the thread
+	std::condition_variable	Room;		// a job taken, for Write( )
+	std::thread		Worker;
+	bool			Running;
+	bool			Stopping;
+
+	void	Run( );
+
+  public:
+	// statistics, since Init( ):
+	int		Written;
+	int		Failed;
+	double		BytesWritten;
+	double		EncodeSeconds;		// on the writer's thread
+	int		Waits;			// Write( )s that found the queue full
+	double		WaitSeconds;		// ... and waited this long, in all, for room
+
+		FrameWriter( );
+		~FrameWriter( );
+
+	void		Finish( );
+	bool		Init( const char *, int );
+	void		PrintStats( );
+	void		Write( int, int, int, unsigned char * );
+
+	static long long	WriteFile( const char *, int, int, int, const unsigned char * );
+	static std::string	FileName( const char *, int, int );
+};
+
+#endif		// #ifndef FRAMECAPTURE_H
@@ -0,0 +1,40 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <stdio.h>
+
+
+// view-frustum culling with bounding spheres
+//
+// the six planes are pulled straight out of a clip matrix (Gribb and Hartmann):
+// from the projection matrix alone they are in eye coordinates, from
+// projection * modelview they are in that modelview's object coordinates. a sphere
+// is visible unless it is entirely on the outside of one of the planes -- spheres
+// near a corner of the frustum can come out visible when they aren't, but never
+// the other way around.
+//
+// CullSpheres( ) tests the spheres 4 at a time with sse, or 8 at a time with avx
+// if the compiler is targeting it (-mavx)
+
+struct Sphere
+{
+	float		x, y, z;
+	float		r;
+};
+
+
+class Frustum
+{
+  public:
+	float	Planes[6][4];		// a, b, c, d, with a x + b y + c z + d >= 0 on the inside
+
+	int	CullSpheres( int, const float *, const float *, const float *, const float *, unsigned char * );
+	void	FromMatrix( const float * );
+	bool	SphereVisible( float, float, float, float );
+};
+
+
+void	BoundsToSphere( const float *, struct Sphere * );
+void	TransformSphere( const float *, struct Sphere *, struct Sphere * );
+
+#endif		// #ifndef FRUSTUM_H
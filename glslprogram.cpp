@@ -12,6 +12,8 @@ ShaderTypes [ ] =
 	{ (char *)".vs",   GL_VERTEX_SHADER },
 	{ (char *)".frag", GL_FRAGMENT_SHADER },
 	{ (char *)".fs",   GL_FRAGMENT_SHADER },
+	{ (char *)".comp", GL_COMPUTE_SHADER },
+	{ (char *)".cs",   GL_COMPUTE_SHADER },
 };
 
 static
@@ -145,6 +147,19 @@ GLSLProgram::CreateHelper( char *file0, ... )
 						shader = glCreateShader( GL_FRAGMENT_SHADER );
 					}
 					break;
+
+				case GL_COMPUTE_SHADER:
+					if( ! CanDoComputeShaders )
+					{
+						fprintf( stderr, "Warning: this system cannot handle compute shaders\n" );
+						Valid = false;
+						SkipToNextVararg = true;
+					}
+					else
+					{
+						shader = glCreateShader( GL_COMPUTE_SHADER );
+					}
+					break;
 			}
 		}
 
@@ -235,6 +250,11 @@ GLSLProgram::CreateHelper( char *file0, ... )
 
 	va_end( args );
 
+	// the outputs transform feedback captures have to be named before linking:
+
+	if( NumFeedbackVaryings > 0 )
+		glTransformFeedbackVaryings( Program, NumFeedbackVaryings, FeedbackVaryings, GL_INTERLEAVED_ATTRIBS );
+
 	// link the entire shader program:
 
 	glLinkProgram( Program );
@@ -316,13 +336,17 @@ void
 GLSLProgram::Init( )
 {
 	Verbose = false;
+	FeedbackVaryings = NULL;
+	NumFeedbackVaryings = 0;
 
 	CanDoVertexShaders      = IsExtensionSupported( "GL_ARB_vertex_shader" );
 	CanDoFragmentShaders    = IsExtensionSupported( "GL_ARB_fragment_shader" );
+	CanDoComputeShaders     = IsExtensionSupported( "GL_ARB_compute_shader" );
 
 	fprintf( stderr, "Can do: " );
 	if( CanDoVertexShaders )		fprintf( stderr, "vertex shaders, " );
 	if( CanDoFragmentShaders )		fprintf( stderr, "fragment shaders, " );
+	if( CanDoComputeShaders )		fprintf( stderr, "compute shaders, " );
 	fprintf( stderr, "\n" );
 }
 
@@ -347,6 +371,36 @@ GLSLProgram::SetVerbose( bool v )
 	Verbose = v;
 }
 
+
+// the vertex shader outputs transform feedback writes, interleaved in this order
+// -- call this before Create( ), and keep the names around:
+
+void
+GLSLProgram::SetFeedbackVaryings( int num, const char **names )
+{
+	NumFeedbackVaryings = num;
+	FeedbackVaryings = names;
+}
+
+// run a compute shader over this many work groups:
+
+void
+GLSLProgram::DispatchCompute( int numx, int numy, int numz )
+{
+	this->Use();
+	glDispatchCompute( numx, numy, numz );
+}
+
+
+// the program in use, to go back to after a compute dispatch:
+
+GLuint
+GLSLProgram::GetCurrentProgram( )
+{
+	return CurrentProgram;
+}
+
+
 void
 GLSLProgram::UnUse( )
 {
@@ -509,6 +563,18 @@ GLSLProgram::SetUniformVariable( char* name, float val )
 };
 
 
+void
+GLSLProgram::SetUniformVariable( char* name, float val0, float val1 )
+{
+	int loc;
+	if( ( loc = GetUniformLocation( name ) )  >= 0 )
+	{
+		this->Use();
+		glUniform2f( loc, val0, val1 );
+	}
+};
+
+
 void
 GLSLProgram::SetUniformVariable( char* name, float val0, float val1, float val2 )
 {
@@ -535,6 +601,57 @@ GLSLProgram::SetUniformVariable( char* name, float vals[3] )
 };
 
 
+// column-major, as from glGetFloatv( ) or glm::value_ptr( ):
+
+void
+GLSLProgram::SetUniformMatrix3( char* name, const float *vals )
+{
+	int loc;
+	if( ( loc = GetUniformLocation( name ) )  >= 0 )
+	{
+		this->Use();
+		glUniformMatrix3fv( loc, 1, GL_FALSE, vals );
+	}
+};
+
+
+void
+GLSLProgram::SetUniformMatrix4( char* name, const float *vals )
+{
+	int loc;
+	if( ( loc = GetUniformLocation( name ) )  >= 0 )
+	{
+		this->Use();
+		glUniformMatrix4fv( loc, 1, GL_FALSE, vals );
+	}
+};
+
+
+void
+GLSLProgram::SetUniformVec4Array( char* name, int count, const float *vals )
+{
+	int loc;
+	if( ( loc = GetUniformLocation( name ) )  >= 0 )
+	{
+		this->Use();
+		glUniform4fv( loc, count, vals );
+	}
+};
+
+
+// connect a uniform block to a buffer binding point:
+
+void
+GLSLProgram::SetUniformBlockBinding( char* name, int binding )
+{
+	GLuint index = glGetUniformBlockIndex( this->Program, name );
+	if( index != GL_INVALID_INDEX )
+		glUniformBlockBinding( this->Program, index, binding );
+	else if( Verbose )
+		fprintf( stderr, "Program %d has no uniform block '%s'\n", this->Program, name );
+};
+
+
 bool
 GLSLProgram::IsExtensionSupported( const char *extension )
 {
@@ -36,10 +36,12 @@ class GLSLProgram
 {
   private:
 	std::map<char *, int>	AttributeLocs;
+	const char **		FeedbackVaryings;
 	char *			Ffile;
 	unsigned int		Fshader;
 	bool			IncludeGstap;
 	GLuint			Program;
+	int			NumFeedbackVaryings;
 	std::map<char *, int>	UniformLocs;
 	bool			Valid;
 	char *			Vfile;
@@ -49,6 +51,7 @@ class GLSLProgram
 	static int		CurrentProgram;
 
 	void	AttachShader( GLuint );
+	bool	CanDoComputeShaders;
 	bool	CanDoFragmentShaders;
 	bool	CanDoVertexShaders;
 	int	CompileShader( GLuint );
@@ -62,7 +65,9 @@ class GLSLProgram
 
 	bool	Create( char *, char * = NULL, char * = NULL, char * = NULL, char * = NULL, char * = NULL );
 	void	DisableVertexAttribArray( const char * );
+	void	DispatchCompute( int, int, int );
 	void	EnableVertexAttribArray( const char * );
+	static GLuint	GetCurrentProgram( );
 	void	Init( );
 	bool	IsExtensionSupported( const char * );
 	bool	IsNotValid( );
@@ -72,11 +77,17 @@ class GLSLProgram
 	void	SetAttributeVariable( char *, float );
 	void	SetAttributeVariable( char *, float, float, float );
 	void	SetAttributeVariable( char *, float[3] );
+	void	SetFeedbackVaryings( int, const char ** );
 	void	VertexAttrib3f( const char *, float, float, float );
 	void	SetUniformVariable( char *, int );
 	void	SetUniformVariable( char *, float );
+	void	SetUniformVariable( char *, float, float );
 	void	SetUniformVariable( char *, float, float, float );
 	void	SetUniformVariable( char *, float[3] );
+	void	SetUniformBlockBinding( char *, int );
+	void	SetUniformMatrix3( char *, const float * );
+	void	SetUniformMatrix4( char *, const float * );
+	void	SetUniformVec4Array( char *, int, const float * );
 	void	SetVerbose( bool );
 	void	UnUse( );
 	void	Use( );
@@ -0,0 +1,642 @@
+#ifndef GPUPARTICLES_CPP
+#define GPUPARTICLES_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "gpuparticles.h"
+#include "particles.cpp"		// for reading the emitter's triangles
+
+
+GpuParticleSystem::GpuParticleSystem( )
+{
+	SimProgram = DrawProgram = NULL;
+	Buffers[0] = Buffers[1] = 0;
+	SimVaos[0] = SimVaos[1] = 0;
+	DrawVaos[0] = DrawVaos[1] = 0;
+	Current = 0;
+	TriangleBuffer = TriangleTex = AreaBuffer = AreaTex = 0;
+	NumTriangles = 0;
+	TimeQueries[0] = TimeQueries[1] = 0;
+	QueryPending[0] = QueryPending[1] = false;
+	QueryIndex = 0;
+	Capacity = 0;
+	Step = 0;
+	Restarting = true;
+	Emitting = true;
+	VelScale = 30.f;
+	Gravity = -0.075f;
+	LifeMin = 1.f;
+	LifeMax = 2.f;
+	ResetStats( );
+}
+
+
+// maxParticles slots, updated by simProgram -- particlesim.vert, created with
+// SetFeedbackVaryings( ) of tfPosition and tfVelocity -- and drawn by drawProgram,
+// particle.vert and particle.frag. returns false if either didn't build:
+
+bool
+GpuParticleSystem::Init( int maxParticles, GLSLProgram *simProgram, GLSLProgram *drawProgram )
+{
+	Destroy( );
+	if( simProgram == NULL  ||  ! simProgram->IsValid( )  ||  drawProgram == NULL  ||  ! drawProgram->IsValid( ) )
+	{
+		fprintf( stderr, "GpuParticleSystem: no particle programs\n" );
+		return false;
+	}
+	SimProgram = simProgram;
+	DrawProgram = drawProgram;
+	Capacity = maxParticles;
+
+	glGenBuffers( 2, Buffers );
+	glGenVertexArrays( 2, SimVaos );
+	glGenVertexArrays( 2, DrawVaos );
+	for( int b = 0; b < 2; b++ )
+	{
+		glBindBuffer( GL_ARRAY_BUFFER, Buffers[b] );
+		glBufferData( GL_ARRAY_BUFFER, (GLsizeiptr)Capacity * GPUPARTICLE_FLOATS * sizeof(float), NULL, GL_DYNAMIC_COPY );
+
+		glBindVertexArray( SimVaos[b] );
+		glEnableVertexAttribArray( 0 );
+		glVertexAttribPointer( 0, 4, GL_FLOAT, GL_FALSE, GPUPARTICLE_FLOATS * sizeof(float), (void *)0 );
+		glEnableVertexAttribArray( 1 );
+		glVertexAttribPointer( 1, 4, GL_FLOAT, GL_FALSE, GPUPARTICLE_FLOATS * sizeof(float), (void *)( 4 * sizeof(float) ) );
+
+		glBindVertexArray( DrawVaos[b] );
+		glEnableVertexAttribArray( PARTICLE_ATTRIB );
+		glVertexAttribPointer( PARTICLE_ATTRIB, 4, GL_FLOAT, GL_FALSE, GPUPARTICLE_FLOATS * sizeof(float), (void *)0 );
+		glVertexAttribDivisor( PARTICLE_ATTRIB, 1 );
+	}
+	glBindVertexArray( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	glGenBuffers( 1, &TriangleBuffer );
+	glGenTextures( 1, &TriangleTex );
+	glGenBuffers( 1, &AreaBuffer );
+	glGenTextures( 1, &AreaTex );
+
+	// without timer queries, only the cpu time is reported:
+	if( GLEW_ARB_timer_query )
+		glGenQueries( 2, TimeQueries );
+	QueryPending[0] = QueryPending[1] = false;
+	QueryIndex = 0;
+
+	// the buffers hold nothing yet -- the first update fills them in:
+	Current = 0;
+	Step = 0;
+	Restarting = true;
+	return true;
+}
+
+
+bool
+GpuParticleSystem::IsValid( )
+{
+	return Capacity > 0  &&  NumTriangles > 0;
+}
+
+
+void
+GpuParticleSystem::Destroy( )
+{
+	if( Buffers[0] != 0 )
+		glDeleteBuffers( 2, Buffers );
+	if( SimVaos[0] != 0 )
+		glDeleteVertexArrays( 2, SimVaos );
+	if( DrawVaos[0] != 0 )
+		glDeleteVertexArrays( 2, DrawVaos );
+	if( TriangleBuffer != 0 )
+		glDeleteBuffers( 1, &TriangleBuffer );
+	if( TriangleTex != 0 )
+		glDeleteTextures( 1, &TriangleTex );
+	if( AreaBuffer != 0 )
+		glDeleteBuffers( 1, &AreaBuffer );
+	if( AreaTex != 0 )
+		glDeleteTextures( 1, &AreaTex );
+	if( TimeQueries[0] != 0 )
+		glDeleteQueries( 2, TimeQueries );
+	Buffers[0] = Buffers[1] = 0;
+	SimVaos[0] = SimVaos[1] = 0;
+	DrawVaos[0] = DrawVaos[1] = 0;
+	TriangleBuffer = TriangleTex = AreaBuffer = AreaTex = 0;
+	TimeQueries[0] = TimeQueries[1] = 0;
+	NumTriangles = 0;
+	Capacity = 0;
+	SimProgram = DrawProgram = NULL;
+}
+
+
+// emit from the triangles of an obj file (after Init( ), since they go to the gpu):
+
+bool
+GpuParticleSystem::SetEmitter( char *objFile )
+{
+	std::vector<float> triangles;
+	if( ReadObjFile( objFile, AddParticleCorner, &triangles, NULL ) != 0  ||  triangles.size( ) < 9 )
+	{
+		fprintf( stderr, "GpuParticleSystem: no triangles in '%s'\n", objFile );
+		return false;
+	}
+	return SetEmitter( &triangles[0], (int)triangles.size( ) / 9 );
+}
+
+
+// ... or from numTriangles triangles, 9 floats each -- the corners go into an rgba
+// buffer texture (rgb ones need gl 4), and the running areas, as fractions of the
+// total, into a red one:
+
+bool
+GpuParticleSystem::SetEmitter( const float *triangles, int numTriangles )
+{
+	if( Capacity == 0 )
+		return false;
+
+	std::vector<float> corners( 12 * numTriangles );
+	std::vector<float> areas( numTriangles );
+	double total = 0.;
+	for( int t = 0; t < numTriangles; t++ )
+	{
+		const float *v = &triangles[9*t];
+		float a[3] = { v[3]-v[0], v[4]-v[1], v[5]-v[2] };
+		float b[3] = { v[6]-v[0], v[7]-v[1], v[8]-v[2] };
+		float n[3] = { a[1]*b[2] - a[2]*b[1],  a[2]*b[0] - a[0]*b[2],  a[0]*b[1] - a[1]*b[0] };
+		total += 0.5 * sqrt( (double)n[0]*n[0] + (double)n[1]*n[1] + (double)n[2]*n[2] );
+		areas[t] = (float)total;
+		for( int c = 0; c < 3; c++ )
+		{
+			corners[12*t + 4*c + 0] = v[3*c + 0];
+			corners[12*t + 4*c + 1] = v[3*c + 1];
+			corners[12*t + 4*c + 2] = v[3*c + 2];
+			corners[12*t + 4*c + 3] = 1.f;
+		}
+	}
+	if( total <= 0. )
+	{
+		fprintf( stderr, "GpuParticleSystem: the emitter has no area\n" );
+		NumTriangles = 0;
+		return false;
+	}
+	for( int t = 0; t < numTriangles; t++ )
+		areas[t] = (float)( areas[t] / total );
+	areas[numTriangles-1] = 1.f;
+
+	glBindBuffer( GL_TEXTURE_BUFFER, TriangleBuffer );
+	glBufferData( GL_TEXTURE_BUFFER, corners.size( ) * sizeof(float), &corners[0], GL_STATIC_DRAW );
+	glBindBuffer( GL_TEXTURE_BUFFER, AreaBuffer );
+	glBufferData( GL_TEXTURE_BUFFER, areas.size( ) * sizeof(float), &areas[0], GL_STATIC_DRAW );
+	glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+	glBindTexture( GL_TEXTURE_BUFFER, TriangleTex );
+	glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, TriangleBuffer );
+	glBindTexture( GL_TEXTURE_BUFFER, AreaTex );
+	glTexBuffer( GL_TEXTURE_BUFFER, GL_R32F, AreaBuffer );
+	glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	NumTriangles = numTriangles;
+	return true;
+}
+
+
+// explosion.geom's uVelScale and uGravity:
+
+void
+GpuParticleSystem::SetBallistics( float velScale, float gravity )
+{
+	VelScale = velScale;
+	Gravity = gravity;
+}
+
+
+// each particle lives a random time between lifeMin and lifeMax seconds:
+
+void
+GpuParticleSystem::SetLife( float lifeMin, float lifeMax )
+{
+	LifeMin = lifeMin;
+	LifeMax = lifeMax  >  lifeMin  ?  lifeMax  :  lifeMin;
+}
+
+
+// with emitting off, the particles flying go on until they die, and no more come:
+
+void
+GpuParticleSystem::SetEmitting( bool emitting )
+{
+	Emitting = emitting;
+}
+
+
+// start over -- every slot waits up to the longest life to be emitted:
+
+void
+GpuParticleSystem::Restart( )
+{
+	Restarting = true;
+}
+
+
+// the buffer the last Update( ) wrote, GPUPARTICLE_FLOATS a slot, and how many slots:
+
+GLuint
+GpuParticleSystem::GetBuffer( )
+{
+	return Buffers[Current];
+}
+
+
+int
+GpuParticleSystem::GetCapacity( )
+{
+	return Capacity;
+}
+
+
+// take every slot dt seconds further, from one buffer into the other:
+
+void
+GpuParticleSystem::Update( float dt )
+{
+	if( ! IsValid( ) )
+		return;
+
+	double t0 = ParticleSeconds( );
+
+	// the query used two updates ago is (almost always) done by now:
+	if( QueryPending[QueryIndex] )
+	{
+		GLuint available = 0;
+		glGetQueryObjectuiv( TimeQueries[QueryIndex], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( available )
+		{
+			GLuint64 ns;
+			glGetQueryObjectui64v( TimeQueries[QueryIndex], GL_QUERY_RESULT, &ns );
+			GpuSeconds += (double)ns / 1.e9;
+			GpuUpdates++;
+		}
+		QueryPending[QueryIndex] = false;
+	}
+
+	GLint activeUnit;
+	glGetIntegerv( GL_ACTIVE_TEXTURE, &activeUnit );
+	glActiveTexture( GL_TEXTURE0 + GPUPARTICLE_TRIANGLE_UNIT );
+	glBindTexture( GL_TEXTURE_BUFFER, TriangleTex );
+	glActiveTexture( GL_TEXTURE0 + GPUPARTICLE_AREA_UNIT );
+	glBindTexture( GL_TEXTURE_BUFFER, AreaTex );
+	glActiveTexture( activeUnit );
+
+	GLuint previous = GLSLProgram::GetCurrentProgram( );
+	SimProgram->Use( );
+	SimProgram->SetUniformVariable( (char *)"uTriangles", GPUPARTICLE_TRIANGLE_UNIT );
+	SimProgram->SetUniformVariable( (char *)"uAreas", GPUPARTICLE_AREA_UNIT );
+	SimProgram->SetUniformVariable( (char *)"uNumTriangles", NumTriangles );
+	SimProgram->SetUniformVariable( (char *)"uVelScale", VelScale );
+	SimProgram->SetUniformVariable( (char *)"uGravity", Gravity );
+	SimProgram->SetUniformVariable( (char *)"uLifeMin", LifeMin );
+	SimProgram->SetUniformVariable( (char *)"uLifeMax", LifeMax );
+	SimProgram->SetUniformVariable( (char *)"uDt", dt );
+	SimProgram->SetUniformVariable( (char *)"uSeed", Step );
+	SimProgram->SetUniformVariable( (char *)"uRestart", Restarting ? 1 : 0 );
+	SimProgram->SetUniformVariable( (char *)"uEmitting", Emitting ? 1 : 0 );
+
+	int next = 1 - Current;
+	if( TimeQueries[0] != 0 )
+		glBeginQuery( GL_TIME_ELAPSED, TimeQueries[QueryIndex] );
+	glEnable( GL_RASTERIZER_DISCARD );
+	glBindVertexArray( SimVaos[Current] );
+	glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, Buffers[next] );
+	glBeginTransformFeedback( GL_POINTS );
+	glDrawArrays( GL_POINTS, 0, Capacity );
+	glEndTransformFeedback( );
+	glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0 );
+	glBindVertexArray( 0 );
+	glDisable( GL_RASTERIZER_DISCARD );
+	if( TimeQueries[0] != 0 )
+	{
+		glEndQuery( GL_TIME_ELAPSED );
+		QueryPending[QueryIndex] = true;
+		QueryIndex = 1 - QueryIndex;
+	}
+
+	SimProgram->Use( previous );
+	Current = next;
+	Restarting = false;
+	Step++;
+
+	Updates++;
+	Updated += Capacity;
+	CpuSeconds += ParticleSeconds( ) - t0;
+}
+
+
+// draw the slots that are flying, in the coordinates of modelview, with the sprite
+// tex (0 = none). pointSize is a particle's size in those coordinates, and the
+// projection is the current ShaderState's:
+
+void
+GpuParticleSystem::Draw( GLuint tex, const float *modelview, float pointSize )
+{
+	if( ! IsValid( )  ||  Step == 0 )
+		return;
+
+	GLint activeUnit;
+	glGetIntegerv( GL_ACTIVE_TEXTURE, &activeUnit );
+	glActiveTexture( GL_TEXTURE0 + PARTICLE_TEXTURE_UNIT );
+	glBindTexture( GL_TEXTURE_2D, tex );
+	glActiveTexture( activeUnit );
+
+	GLuint previous = GLSLProgram::GetCurrentProgram( );
+	DrawProgram->Use( );
+	DrawProgram->SetUniformMatrix4( (char *)"uModelView", modelview );
+	DrawProgram->SetUniformVariable( (char *)"uPointSize", pointSize );
+	DrawProgram->SetUniformVariable( (char *)"uLifeMax", LifeMax );
+	DrawProgram->SetUniformVariable( (char *)"uTexUnit", PARTICLE_TEXTURE_UNIT );
+	DrawProgram->SetUniformVariable( (char *)"uTexMix", tex != 0 ? 1.f : 0.f );
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+		state->Flush( );
+
+	glPushAttrib( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT );
+	glEnable( GL_DEPTH_TEST );
+	glDepthMask( GL_FALSE );
+	glEnable( GL_BLEND );
+	glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+	glBindVertexArray( DrawVaos[Current] );
+	glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, PARTICLE_CORNERS, Capacity );
+	glBindVertexArray( 0 );
+	glPopAttrib( );
+
+	DrawProgram->Use( previous );
+	Draws++;
+}
+
+
+void
+GpuParticleSystem::PrintStats( )
+{
+	if( Updates == 0 )
+		return;
+	fprintf( stderr, "GPU particles, %d slots: %6.2f ms/frame cpu", Capacity, 1000. * CpuSeconds / (double)Updates );
+	if( GpuUpdates > 0  &&  GpuSeconds > 0. )
+		fprintf( stderr, ", %6.2f ms/frame gpu (%.1f Mparticles/s)", 1000. * GpuSeconds / (double)GpuUpdates,
+			(double)Capacity * GpuUpdates / GpuSeconds / 1000000. );
+	fprintf( stderr, "\n" );
+}
+
+
+void
+GpuParticleSystem::ResetStats( )
+{
+	Updates = 0;
+	Updated = 0.;
+	CpuSeconds = GpuSeconds = 0.;
+	GpuUpdates = 0;
+	Draws = 0;
+}
+
+
+//#define TEST
+#ifdef TEST
+
+// a headless test, run from FinalProject/: the particles fly out of Starship.obj's
+// triangles. first the buffer is read back twice, half a second apart, and every
+// particle flying in both has to have moved along the ballistic curve. then the
+// updates are timed at 100 thousand to 10 million particles, next to the cpu
+// particles' update, emission, and upload of the same number, and then a million of
+// each are drawn. the context comes from HeadlessContext
+
+#undef TEST		// so the files included below leave their own tests out
+
+#include "headless.cpp"
+#include "glslprogram.cpp"
+#include "shaderstate.cpp"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#define CHECKED		4096
+#define WIDTH		256
+#define HEIGHT		256
+
+void
+SetMaterial( float, float, float, float )	// the test sets no materials
+{
+}
+
+void
+Cross( float v1[3], float v2[3], float vout[3] )
+{
+	float tmp[3];
+	tmp[0] = v1[1]*v2[2] - v2[1]*v1[2];
+	tmp[1] = v2[0]*v1[2] - v1[0]*v2[2];
+	tmp[2] = v1[0]*v2[1] - v2[0]*v1[1];
+	vout[0] = tmp[0];
+	vout[1] = tmp[1];
+	vout[2] = tmp[2];
+}
+
+float
+Unit( float vin[3], float vout[3] )
+{
+	float dist = sqrtf( vin[0]*vin[0] + vin[1]*vin[1] + vin[2]*vin[2] );
+	if( dist > 0. )
+	{
+		vout[0] = vin[0] / dist;
+		vout[1] = vin[1] / dist;
+		vout[2] = vin[2] / dist;
+	}
+	return dist;
+}
+
+static void
+ReadSlots( GpuParticleSystem *particles, std::vector<float> *slots )
+{
+	slots->resize( particles->GetCapacity( ) * GPUPARTICLE_FLOATS );
+	glBindBuffer( GL_ARRAY_BUFFER, particles->GetBuffer( ) );
+	glGetBufferSubData( GL_ARRAY_BUFFER, 0, slots->size( ) * sizeof(float), &(*slots)[0] );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+int
+main( int argc, char *argv[ ] )
+{
+	// the context, with its framebuffer bound -- even the updates need one:
+	HeadlessContext headless;
+	if( ! headless.Init( WIDTH, HEIGHT ) )
+		return 1;
+
+	GLSLProgram simProgram, drawProgram;
+	simProgram.Init( );
+	drawProgram.Init( );
+	static const char *varyings[ ] = { "tfPosition", "tfVelocity" };
+	simProgram.SetFeedbackVaryings( 2, varyings );
+	simProgram.Create( (char *)"particlesim.vert" );
+	drawProgram.Create( (char *)"particle.vert", (char *)"particle.frag" );
+	ShaderState state;
+	state.Init( );
+	state.MakeCurrent( );
+	state.Bind( &drawProgram );
+
+	// along the curve -- the slots flying both times, and not emitted again in between:
+	GpuParticleSystem particles;
+	if( ! particles.Init( CHECKED, &simProgram, &drawProgram )  ||  ! particles.SetEmitter( (char *)"Starship.obj" ) )
+		return 1;
+	particles.SetBallistics( 30.f, -0.075f );
+	particles.SetLife( 2.f, 3.f );
+	std::vector<float> before, after;
+	for( int s = 0; s < 60; s++ )
+		particles.Update( 1.f / 60.f );
+	ReadSlots( &particles, &before );
+	for( int s = 0; s < 30; s++ )
+		particles.Update( 1.f / 60.f );
+	ReadSlots( &particles, &after );
+	int flying = 0, checked = 0;
+	double worst = 0.;
+	float t = 0.5f;
+	for( int i = 0; i < CHECKED; i++ )
+	{
+		float *b = &before[GPUPARTICLE_FLOATS*i];
+		float *a = &after[GPUPARTICLE_FLOATS*i];
+		if( a[3] > 0.f )
+			flying++;
+		if( b[3] <= 0.f  ||  fabsf( ( b[3] - a[3] ) - t ) > 0.001f )
+			continue;
+		double curve[3] = { b[0] + b[4]*t,  b[1] + b[5]*t + 0.5 * -0.075 * t*t,  b[2] + b[6]*t };
+		double dist = sqrt( ( curve[0] - a[0] ) * ( curve[0] - a[0] ) + ( curve[1] - a[1] ) * ( curve[1] - a[1] )
+			+ ( curve[2] - a[2] ) * ( curve[2] - a[2] ) );
+		double travel = sqrt( (double)b[4]*b[4] + (double)b[5]*b[5] + (double)b[6]*b[6] ) * t;
+		double error = dist / ( travel + 1. );
+		if( error > worst )
+			worst = error;
+		checked++;
+	}
+	fprintf( stderr, "%d slots after 1.5 s: %d flying, %d checked, worst distance from the curve %.2g of how far they went\n",
+		CHECKED, flying, checked, worst );
+
+	// the update alone, gpu and cpu, at a steady state:
+	int sizes[ ] = { 100000, 1000000, 10000000 };
+	for( int n = 0; n < 3; n++ )
+	{
+		int frames = sizes[n] > 1000000 ? 10 : 30;
+
+		particles.Init( sizes[n], &simProgram, &drawProgram );
+		particles.SetEmitter( (char *)"Starship.obj" );
+		particles.SetLife( 0.25f, 1.25f );
+		for( int s = 0; s < 4; s++ )
+			particles.Update( 1.f / 60.f );
+		glFinish( );
+		particles.ResetStats( );
+		double t0 = ParticleSeconds( );
+		for( int frame = 0; frame < frames; frame++ )
+			particles.Update( 1.f / 60.f );
+		glFinish( );
+		double ms = 1000. * ( ParticleSeconds( ) - t0 ) / (double)frames;
+		fprintf( stderr, "%8d particles, gpu: %8.2f ms/frame with glFinish( ), %6.1f Mparticles/s -- ", sizes[n], ms,
+			(double)sizes[n] / ms / 1000. );
+		particles.PrintStats( );
+		particles.Destroy( );
+
+		ParticleSystem cpu;
+		cpu.Init( sizes[n], &drawProgram );
+		cpu.SetEmitter( (char *)"Starship.obj" );
+		cpu.SetLife( 0.25f, 1.25f );
+		cpu.Emit( sizes[n] );
+		cpu.ResetStats( );
+		t0 = ParticleSeconds( );
+		for( int frame = 0; frame < frames; frame++ )
+		{
+			cpu.Update( 1.f / 60.f );
+			cpu.Emit( sizes[n] );
+			cpu.Upload( );
+		}
+		glFinish( );
+		ms = 1000. * ( ParticleSeconds( ) - t0 ) / (double)frames;
+		fprintf( stderr, "%8d particles, cpu: %8.2f ms/frame with glFinish( ), %6.1f Mparticles/s -- ", sizes[n], ms,
+			(double)sizes[n] / ms / 1000. );
+		cpu.PrintStats( );
+		cpu.Destroy( );
+	}
+
+	// and drawn:
+	glm::mat4 projection = glm::perspective( glm::radians( 70.f ), 1.f, 0.1f, 1000.f );
+	state.BeginFrame( glm::value_ptr( projection ) );
+	// the ship is 11.5 units long, along z:
+	glm::mat4 modelview = glm::lookAt( glm::vec3( 20.f, 0.f, 6.f ), glm::vec3( 0.f, 0.f, 6.f ), glm::vec3( 0.f, 0.f, 1.f ) );
+	unsigned char *pixels = new unsigned char[ 4*WIDTH*HEIGHT ];
+	for( int gpu = 1; gpu >= 0; gpu-- )
+	{
+		ParticleSystem cpu;
+		if( gpu )
+		{
+			particles.Init( 1000000, &simProgram, &drawProgram );
+			particles.SetEmitter( (char *)"Starship.obj" );
+			particles.SetLife( 0.25f, 1.25f );
+			for( int s = 0; s < 90; s++ )		// past the longest life, so all the slots are in use
+				particles.Update( 1.f / 60.f );
+		}
+		else
+		{
+			cpu.Init( 1000000, &drawProgram );
+			cpu.SetEmitter( (char *)"Starship.obj" );
+			cpu.SetLife( 0.25f, 1.25f );
+			cpu.Emit( 1000000 );
+		}
+		glFinish( );
+		double t0 = ParticleSeconds( );
+		for( int frame = 0; frame < 10; frame++ )
+		{
+			if( gpu )
+			{
+				particles.Update( 1.f / 60.f );
+			}
+			else
+			{
+				cpu.Update( 1.f / 60.f );
+				cpu.Emit( 1000000 );
+				cpu.Upload( );
+			}
+			glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+			if( gpu )
+				particles.Draw( 0, glm::value_ptr( modelview ), 0.05f );
+			else
+				cpu.Draw( 0, glm::value_ptr( modelview ), 0.05f );
+		}
+		glFinish( );
+		double ms = 1000. * ( ParticleSeconds( ) - t0 ) / 10.;
+		glReadPixels( 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+		int lit = 0;
+		for( int p = 0; p < WIDTH*HEIGHT; p++ )
+		{
+			if( pixels[4*p] > 0 )
+				lit++;
+		}
+		fprintf( stderr, "1000000 particles drawn, %s: %d of %d pixels lit, %7.2f ms/frame with glFinish( )\n",
+			gpu ? "gpu" : "cpu", lit, WIDTH*HEIGHT, ms );
+		cpu.Destroy( );
+	}
+	delete [ ] pixels;
+	return 0;
+}
+
+#endif
+
+// EXPECTED_RESULTS (g++ -O1 -fopenmp -DTEST -I.. ../gpuparticles.cpp -lGLEW -lEGL -lGL -lGLU, on mesa's llvmpipe, software rendering, one core):
+//
+//	4096 slots after 1.5 s: 2046 flying, 1360 checked, worst distance from the curve 1.3e-05 of how far they went
+//	  100000 particles, gpu:     7.38 ms/frame with glFinish( ),   13.5 Mparticles/s -- GPU particles, 100000 slots:   7.38 ms/frame cpu,   0.00 ms/frame gpu (...)
+//	  100000 particles, cpu:     0.51 ms/frame with glFinish( ),  194.5 Mparticles/s -- Particles, 100000 of 100000:   0.11 ms/frame emitting,   0.23 updating (442.9 Mparticles/s),   0.18 uploading; 833 emitted, 833 died per frame
+//	 1000000 particles, gpu:    58.11 ms/frame with glFinish( ),   17.2 Mparticles/s -- GPU particles, 1000000 slots:  58.11 ms/frame cpu,   0.00 ms/frame gpu (...)
+//	 1000000 particles, cpu:     6.47 ms/frame with glFinish( ),  154.6 Mparticles/s -- Particles, 1000000 of 1000000:   1.11 ms/frame emitting,   3.36 updating (297.2 Mparticles/s),   1.99 uploading; 8342 emitted, 8342 died per frame
+//	10000000 particles, gpu:   547.54 ms/frame with glFinish( ),   18.3 Mparticles/s -- GPU particles, 10000000 slots: 547.54 ms/frame cpu,   0.00 ms/frame gpu (...)
+//	10000000 particles, cpu:    37.26 ms/frame with glFinish( ),  268.4 Mparticles/s -- Particles, 10000000 of 10000000:   0.00 ms/frame emitting,  20.25 updating (493.8 Mparticles/s),  17.01 uploading; 0 emitted, 0 died per frame
+//	1000000 particles drawn, gpu: 11364 of 65536 pixels lit,  973.63 ms/frame with glFinish( )
+//	1000000 particles drawn, cpu: 4399 of 65536 pixels lit,  855.74 ms/frame with glFinish( )
+//
+// (here the "gpu" is llvmpipe, one core running the vertex shader a few at a time,
+// so the transform feedback comes out a tenth of the cpu path's rate, or less, and its
+// timer queries read as nothing, since the work is done on the cpu as it is
+// submitted. on a real gpu the shader runs over thousands of lanes at once, while
+// the cpu still does nothing for any particle and nothing crosses the bus -- which,
+// more than the update, is what the cpu path's upload costs. the cpu draw lights
+// fewer pixels only because its million all start together, next to the ship)
+
+#endif		// #ifndef GPUPARTICLES_CPP
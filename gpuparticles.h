@@ -0,0 +1,109 @@
+#ifndef GPUPARTICLES_H
+#define GPUPARTICLES_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "shaderstate.h"
+#include "particles.h"
+
+
+// the explosion's particles kept and moved on the gpu -- the same ballistics as
+// ParticleSystem (particles.h), with nothing done on the cpu a particle at a time
+//
+// the particles live in two vertex buffers, 8 floats each:
+//
+//	x, y, z, life left		life <= 0. = not flying
+//	vx, vy, vz, delay		seconds until it is first emitted
+//
+// Update( dt ) draws one buffer as points through a vertex shader like
+// particlesim.vert, with the rasterizer off, and transform feedback writes what it
+// outputs into the other one -- then the two trade places. the pool is a fixed
+// number of slots: a slot whose particle has died is emitted again at once (while
+// emitting is on), at a random point of a random triangle of the emitter, picked by
+// area. the emitter's corners and running areas are in buffer textures, so the
+// shader can search them, and the random numbers are hashed from the slot and a
+// per-step seed. Restart( ) makes the next Update( ) put every slot back to waiting
+// a random delay of up to the longest life, so they come in evenly instead of all at
+// once -- the particles flying at any time come to about Capacity, emitted at about
+// Capacity / ( the average life ) a second
+//
+//	layout( location = 0 ) in vec4	aPosition;
+//	layout( location = 1 ) in vec4	aVelocity;
+//	out vec4	tfPosition;		// captured, interleaved
+//	out vec4	tfVelocity;
+//	uniform samplerBuffer	uTriangles;	// 3 corners a triangle, on GPUPARTICLE_TRIANGLE_UNIT
+//	uniform samplerBuffer	uAreas;		// the running total of their areas, 1. at the last,
+//						// on GPUPARTICLE_AREA_UNIT
+//	uniform int		uNumTriangles;
+//	uniform float		uVelScale, uGravity, uLifeMin, uLifeMax, uDt;
+//	uniform int		uSeed;
+//	uniform int		uRestart;
+//	uniform int		uEmitting;
+//
+// Draw( ) draws the slots as billboards with particle.vert and particle.frag,
+// straight out of the buffer the last Update( ) wrote -- the slots that aren't
+// flying draw nothing. the update's gpu time is measured with a timer query,
+// read a frame late so it never waits
+
+#define GPUPARTICLE_TRIANGLE_UNIT	17
+#define GPUPARTICLE_AREA_UNIT		18
+#define GPUPARTICLE_FLOATS		8
+
+
+class GpuParticleSystem
+{
+  private:
+	GLSLProgram *	SimProgram;
+	GLSLProgram *	DrawProgram;
+	GLuint		Buffers[2];
+	GLuint		SimVaos[2];		// reading each buffer, to update
+	GLuint		DrawVaos[2];		// ... and to draw
+	int		Current;		// the buffer the last Update( ) wrote
+	GLuint		TriangleBuffer, TriangleTex;
+	GLuint		AreaBuffer, AreaTex;
+	int		NumTriangles;
+	GLuint		TimeQueries[2];		// this frame's update, and last frame's
+	bool		QueryPending[2];
+	int		QueryIndex;
+	int		Capacity;
+	int		Step;			// Update( )s so far, for the seed
+	bool		Restarting;
+	bool		Emitting;
+	float		VelScale;
+	float		Gravity;
+	float		LifeMin, LifeMax;
+
+  public:
+	// statistics, since ResetStats( ):
+	int		Updates;
+	double		Updated;		// slots updated, over all the Update( )s
+	double		CpuSeconds;		// submitting the updates
+	double		GpuSeconds;		// running them, over GpuUpdates of them
+	int		GpuUpdates;
+	int		Draws;
+
+		GpuParticleSystem( );
+
+	void	Destroy( );
+	void	Draw( GLuint, const float *, float );
+	GLuint	GetBuffer( );
+	int	GetCapacity( );
+	bool	Init( int, GLSLProgram *, GLSLProgram * );
+	bool	IsValid( );
+	void	PrintStats( );
+	void	ResetStats( );
+	void	Restart( );
+	void	SetBallistics( float, float );
+	bool	SetEmitter( char * );
+	bool	SetEmitter( const float *, int );
+	void	SetEmitting( bool );
+	void	SetLife( float, float );
+	void	Update( float );
+};
+
+#endif		// #ifndef GPUPARTICLES_H
@@ -0,0 +1,270 @@
+#ifndef HEADLESS_CPP
+#define HEADLESS_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "headless.h"
+
+
+static double
+HeadlessSeconds( )
+{
+#ifdef _OPENMP
+	return omp_get_wtime( );
+#else
+	return (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+HeadlessContext::HeadlessContext( )
+{
+	Width = Height = 0;
+	Fbo = ColorRb = DepthRb = 0;
+	Backend = NULL;
+	StartSeconds = 0.;
+#ifdef HEADLESS_OSMESA
+	Context = NULL;
+#elif !defined(WIN32)
+	Display = EGL_NO_DISPLAY;
+	Context = EGL_NO_CONTEXT;
+#endif
+}
+
+
+// make a width x height context current, with its framebuffer bound. returns false
+// if there is no way to get one here:
+
+bool
+HeadlessContext::Init( int width, int height )
+{
+	Destroy( );
+
+#if defined(HEADLESS_OSMESA)
+	const int attribs[ ] =
+	{
+		OSMESA_FORMAT, OSMESA_RGBA,
+		OSMESA_DEPTH_BITS, 24,
+		OSMESA_STENCIL_BITS, 8,
+		OSMESA_PROFILE, OSMESA_COMPAT_PROFILE,
+		OSMESA_CONTEXT_MAJOR_VERSION, 4,
+		OSMESA_CONTEXT_MINOR_VERSION, 5,
+		0
+	};
+	Context = OSMesaCreateContextAttribs( attribs, NULL );
+	OsBuffer.resize( 4 * width * height );
+	if( Context == NULL  ||  ! OSMesaMakeCurrent( Context, &OsBuffer[0], GL_UNSIGNED_BYTE, width, height ) )
+	{
+		fprintf( stderr, "HeadlessContext: no OSMesa context\n" );
+		Destroy( );
+		return false;
+	}
+	Backend = "OSMesa";
+#elif !defined(WIN32)
+	// mesa's surfaceless platform needs no display server at all:
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	if( getPlatformDisplay != NULL )
+		Display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+	Backend = "EGL surfaceless";
+	EGLint major, minor;
+	if( Display == EGL_NO_DISPLAY  ||  ! eglInitialize( Display, &major, &minor ) )
+	{
+		Display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+		Backend = "EGL";
+		if( Display == EGL_NO_DISPLAY  ||  ! eglInitialize( Display, &major, &minor ) )
+		{
+			fprintf( stderr, "HeadlessContext: no EGL display\n" );
+			Display = EGL_NO_DISPLAY;
+			Backend = NULL;
+			return false;
+		}
+	}
+	eglBindAPI( EGL_OPENGL_API );
+
+	// the config only matters for its api -- nothing is drawn to a surface:
+	EGLint configAttribs[ ] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	eglChooseConfig( Display, configAttribs, &config, 1, &numConfigs );
+	EGLint contextAttribs[ ] = { EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE };
+	Context = eglCreateContext( Display, numConfigs > 0 ? config : (EGLConfig)NULL, EGL_NO_CONTEXT, contextAttribs );
+	if( Context == EGL_NO_CONTEXT  ||  ! eglMakeCurrent( Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context ) )
+	{
+		fprintf( stderr, "HeadlessContext: no surfaceless EGL context\n" );
+		Destroy( );
+		return false;
+	}
+#else
+	fprintf( stderr, "HeadlessContext: no headless rendering on windows\n" );
+	return false;
+#endif
+
+	// every gl entry point past 1.1 goes through glew, so it has to be loaded now that
+	// a context is current. glewExperimental makes glew fetch each function pointer
+	// rather than trusting the extension string. a glx-built glew also complains that
+	// there is no glx display, but only after the gl pointers are already loaded:
+	glewExperimental = GL_TRUE;
+	GLenum err = glewInit( );
+	if( err != GLEW_OK )
+		fprintf( stderr, "HeadlessContext: glewInit: %s\n", (const char *)glewGetErrorString( err ) );
+	if( glGenFramebuffers == NULL  ||  glGenRenderbuffers == NULL )
+	{
+		fprintf( stderr, "HeadlessContext: no framebuffer objects\n" );
+		Destroy( );
+		return false;
+	}
+
+	Width = width;
+	Height = height;
+	glGenRenderbuffers( 1, &ColorRb );
+	glBindRenderbuffer( GL_RENDERBUFFER, ColorRb );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, Width, Height );
+	glGenRenderbuffers( 1, &DepthRb );
+	glBindRenderbuffer( GL_RENDERBUFFER, DepthRb );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Width, Height );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+	glGenFramebuffers( 1, &Fbo );
+	glBindFramebuffer( GL_FRAMEBUFFER, Fbo );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ColorRb );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, DepthRb );
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		fprintf( stderr, "HeadlessContext: the %d x %d framebuffer is incomplete (0x%x)\n", Width, Height, status );
+		Destroy( );
+		return false;
+	}
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glViewport( 0, 0, Width, Height );
+
+	fprintf( stderr, "Headless, %s: %s, %s, %d x %d\n", Backend, glGetString( GL_RENDERER ), glGetString( GL_VERSION ), Width, Height );
+	StartSeconds = HeadlessSeconds( );
+	return true;
+}
+
+
+bool
+HeadlessContext::IsValid( )
+{
+	return Fbo != 0;
+}
+
+
+void
+HeadlessContext::Destroy( )
+{
+	if( Fbo != 0 )
+		glDeleteFramebuffers( 1, &Fbo );
+	if( ColorRb != 0 )
+		glDeleteRenderbuffers( 1, &ColorRb );
+	if( DepthRb != 0 )
+		glDeleteRenderbuffers( 1, &DepthRb );
+	Fbo = ColorRb = DepthRb = 0;
+	Width = Height = 0;
+	Backend = NULL;
+
+#ifdef HEADLESS_OSMESA
+	if( Context != NULL )
+		OSMesaDestroyContext( Context );
+	Context = NULL;
+#elif !defined(WIN32)
+	if( Display != EGL_NO_DISPLAY )
+	{
+		eglMakeCurrent( Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+		if( Context != EGL_NO_CONTEXT )
+			eglDestroyContext( Display, Context );
+		eglTerminate( Display );
+	}
+	Display = EGL_NO_DISPLAY;
+	Context = EGL_NO_CONTEXT;
+#endif
+}
+
+
+// draw into the context's framebuffer again (after something left another bound):
+
+void
+HeadlessContext::Bind( )
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, Fbo );
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+}
+
+
+// seconds since Init( ) -- what glutGet( GLUT_ELAPSED_TIME ) would be counting:
+
+double
+HeadlessContext::ElapsedSeconds( )
+{
+	return HeadlessSeconds( ) - StartSeconds;
+}
+
+
+const char *
+HeadlessContext::GetBackend( )
+{
+	return Backend != NULL ? Backend : "none";
+}
+
+
+int
+HeadlessContext::GetHeight( )
+{
+	return Height;
+}
+
+
+int
+HeadlessContext::GetWidth( )
+{
+	return Width;
+}
+
+
+// the frame, Width x Height rgb's, the bottom row first, as gl has them:
+
+void
+HeadlessContext::ReadPixels( unsigned char *rgb )
+{
+	GLint savedFbo;
+	glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &savedFbo );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, Fbo );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, Width, Height, GL_RGB, GL_UNSIGNED_BYTE, rgb );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, savedFbo );
+}
+
+
+// the frame, into a binary ppm file:
+
+bool
+HeadlessContext::WritePpm( char *file )
+{
+	if( ! IsValid( ) )
+		return false;
+	Pixels.resize( 3 * Width * Height );
+	ReadPixels( &Pixels[0] );
+
+	FILE *fp = fopen( file, "wb" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "HeadlessContext: cannot write '%s'\n", file );
+		return false;
+	}
+	fprintf( fp, "P6\n%d %d\n255\n", Width, Height );
+	for( int y = Height - 1; y >= 0; y-- )		// ppm's rows go top down
+		fwrite( &Pixels[3*Width*y], 3, Width, fp );
+	fclose( fp );
+	return true;
+}
+
+#endif		// #ifndef HEADLESS_CPP
@@ -0,0 +1,66 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#ifdef HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#elif !defined(WIN32)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+
+// a gl context with no window -- for rendering the scene on machines with no
+// display and no gpu (a render farm, or the tests), with mesa's llvmpipe
+//
+// Init( width, height ) makes a compatibility-profile context current, from EGL
+// with no surface at all (EGL_MESA_platform_surfaceless, or the default display and
+// EGL_KHR_surfaceless_context), or, built with -DHEADLESS_OSMESA, from OSMesa. the
+// scene is drawn into the context's own framebuffer object, width x height, with
+// rgba color and a depth and stencil buffer (the stencil is Overdraw's count), which
+// Init( ) leaves bound -- so everything that saves and restores the framebuffer
+// binding comes back to it, just as it would to a window's
+//
+// there is no back buffer to swap: draw into GL_COLOR_ATTACHMENT0, and take the
+// frame out with ReadPixels( ) or WritePpm( ). there is no headless context on
+// windows -- Init( ) returns false
+
+class HeadlessContext
+{
+  private:
+	int		Width, Height;
+	GLuint		Fbo;
+	GLuint		ColorRb;
+	GLuint		DepthRb;		// depth and stencil
+	const char *	Backend;		// which of the ways got the context, or NULL
+	double		StartSeconds;		// when Init( ) made it
+	std::vector<unsigned char>	Pixels;	// WritePpm( )'s, bottom row first
+#ifdef HEADLESS_OSMESA
+	OSMesaContext	Context;
+	std::vector<unsigned char>	OsBuffer;	// OSMesa wants a buffer, even if nothing is drawn in it
+#elif !defined(WIN32)
+	EGLDisplay	Display;
+	EGLContext	Context;
+#endif
+
+  public:
+		HeadlessContext( );
+
+	void		Bind( );
+	void		Destroy( );
+	double		ElapsedSeconds( );
+	const char *	GetBackend( );
+	int		GetHeight( );
+	int		GetWidth( );
+	bool		Init( int, int );
+	bool		IsValid( );
+	void		ReadPixels( unsigned char * );
+	bool		WritePpm( char * );
+};
+
+#endif		// #ifndef HEADLESS_H
@@ -0,0 +1,509 @@
+#ifndef HIZ_CPP
+#define HIZ_CPP
+
+#include <stdio.h>
+
+#include "hiz.h"
+
+
+HiZBuffer::HiZBuffer( )
+{
+	BuildProgram = NULL;
+	Fbo = DepthTex = PyramidTex = 0;
+	Width = Height = 0;
+	NumLevels = 0;
+	Built = false;
+	SavedFbo = 0;
+	CpuLevel = CpuWidth = CpuHeight = 0;
+	ResetStats( );
+}
+
+
+// the compute program that builds the pyramid, hizbuild.comp -- returns false if
+// this gl can't build it:
+
+bool
+HiZBuffer::Init( GLSLProgram *build )
+{
+	Destroy( );
+	if( ! GLEW_ARB_compute_shader  ||  ! GLEW_ARB_shader_image_load_store  ||  build == NULL  ||  ! build->IsValid( ) )
+	{
+		fprintf( stderr, "HiZBuffer: this system can't build the depth pyramid\n" );
+		return false;
+	}
+	BuildProgram = build;
+	return true;
+}
+
+
+bool
+HiZBuffer::IsValid( )
+{
+	return BuildProgram != NULL;
+}
+
+
+void
+HiZBuffer::Destroy( )
+{
+	if( Fbo != 0 )
+		glDeleteFramebuffers( 1, &Fbo );
+	if( DepthTex != 0 )
+		glDeleteTextures( 1, &DepthTex );
+	if( PyramidTex != 0 )
+		glDeleteTextures( 1, &PyramidTex );
+	Fbo = DepthTex = PyramidTex = 0;
+	Width = Height = 0;
+	NumLevels = 0;
+	Built = false;
+	BuildProgram = NULL;
+}
+
+
+// (re)make the framebuffer and the pyramid for a viewport this size:
+
+bool
+HiZBuffer::Resize( int width, int height )
+{
+	if( width == Width  &&  height == Height  &&  Fbo != 0 )
+		return true;
+
+	if( Fbo != 0 )
+		glDeleteFramebuffers( 1, &Fbo );
+	if( DepthTex != 0 )
+		glDeleteTextures( 1, &DepthTex );
+	if( PyramidTex != 0 )
+		glDeleteTextures( 1, &PyramidTex );
+	Width = width;
+	Height = height;
+
+	NumLevels = 1;
+	for( int size = ( width > height ? width : height ); size > 1; size /= 2 )
+		NumLevels++;
+
+	CpuLevel = 0;
+	CpuWidth = Width;
+	CpuHeight = Height;
+	while( CpuWidth > HIZ_CPU_SIZE  ||  CpuHeight > HIZ_CPU_SIZE )
+	{
+		CpuLevel++;
+		if( CpuWidth > 1 )	CpuWidth /= 2;
+		if( CpuHeight > 1 )	CpuHeight /= 2;
+	}
+	CpuDepth.resize( CpuWidth * CpuHeight );
+
+	glGenTextures( 1, &DepthTex );
+	glBindTexture( GL_TEXTURE_2D, DepthTex );
+	glTexStorage2D( GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, Width, Height );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE );
+
+	glGenTextures( 1, &PyramidTex );
+	glBindTexture( GL_TEXTURE_2D, PyramidTex );
+	glTexStorage2D( GL_TEXTURE_2D, NumLevels, GL_R32F, Width, Height );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	glGenFramebuffers( 1, &Fbo );
+	glBindFramebuffer( GL_FRAMEBUFFER, Fbo );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, DepthTex, 0 );
+	glDrawBuffer( GL_NONE );
+	glReadBuffer( GL_NONE );
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		fprintf( stderr, "HiZBuffer: the occluder framebuffer is incomplete (0x%x)\n", status );
+		Destroy( );
+		return false;
+	}
+	return true;
+}
+
+
+// start drawing the occluders, into a depth buffer the size of the current
+// viewport -- draw them with the projection and modelview the frame itself uses.
+// returns false, with nothing changed, if there's no pyramid to draw them into:
+
+bool
+HiZBuffer::BeginOccluders( int width, int height )
+{
+	Built = false;
+	if( BuildProgram == NULL  ||  width <= 0  ||  height <= 0 )
+		return false;
+
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &SavedFbo );
+	if( ! Resize( width, height ) )
+		return false;
+
+	glPushAttrib( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT | GL_VIEWPORT_BIT );
+	glBindFramebuffer( GL_FRAMEBUFFER, Fbo );
+	glViewport( 0, 0, Width, Height );
+	glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+	glEnable( GL_DEPTH_TEST );
+	glDepthFunc( GL_LESS );
+	glDepthMask( GL_TRUE );
+	glClearDepth( 1. );
+	glClear( GL_DEPTH_BUFFER_BIT );
+	return true;
+}
+
+
+// go back to the frame's framebuffer and build the pyramid from the occluders' depth:
+
+void
+HiZBuffer::EndOccluders( )
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+	glPopAttrib( );
+
+	GLint activeUnit;
+	glGetIntegerv( GL_ACTIVE_TEXTURE, &activeUnit );
+	glActiveTexture( GL_TEXTURE0 + HIZ_TEXTURE_UNIT );
+	glBindTexture( GL_TEXTURE_2D, DepthTex );
+	glActiveTexture( activeUnit );
+
+	GLuint previous = GLSLProgram::GetCurrentProgram( );
+	BuildProgram->SetUniformVariable( (char *)"uDepth", HIZ_TEXTURE_UNIT );
+
+	// level 0 is a copy of the depth, every level after it is built from the one before:
+	int width = Width, height = Height;
+	for( int level = 0; level < NumLevels; level++ )
+	{
+		BuildProgram->SetUniformVariable( (char *)"uFirst", level == 0 ? 1 : 0 );
+		if( level > 0 )
+			glBindImageTexture( 0, PyramidTex, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F );
+		glBindImageTexture( 1, PyramidTex, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F );
+		BuildProgram->DispatchCompute( ( width + HIZ_GROUP - 1 ) / HIZ_GROUP, ( height + HIZ_GROUP - 1 ) / HIZ_GROUP, 1 );
+		glMemoryBarrier( GL_SHADER_IMAGE_ACCESS_BARRIER_BIT );
+
+		if( width > 1 )		width /= 2;
+		if( height > 1 )	height /= 2;
+	}
+	BuildProgram->Use( previous );
+
+	// the culling shaders sample the pyramid with texelFetch( ), and SphereHidden( )
+	// reads its small level -- this waits for the occluders, but they are all the
+	// gpu has been given so far this frame:
+	glMemoryBarrier( GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT );
+	glActiveTexture( GL_TEXTURE0 + HIZ_TEXTURE_UNIT );
+	glBindTexture( GL_TEXTURE_2D, PyramidTex );
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	glGetTexImage( GL_TEXTURE_2D, CpuLevel, GL_RED, GL_FLOAT, &CpuDepth[0] );
+	glActiveTexture( activeUnit );
+
+	Built = true;
+	Builds++;
+}
+
+
+// put the pyramid on HIZ_TEXTURE_UNIT, leaving the active unit as it was:
+
+void
+HiZBuffer::BindPyramid( )
+{
+	GLint activeUnit;
+	glGetIntegerv( GL_ACTIVE_TEXTURE, &activeUnit );
+	glActiveTexture( GL_TEXTURE0 + HIZ_TEXTURE_UNIT );
+	glBindTexture( GL_TEXTURE_2D, PyramidTex );
+	glActiveTexture( activeUnit );
+}
+
+
+// how many levels a culling shader can use -- 0 if there's no pyramid this frame:
+
+int
+HiZBuffer::GetLevels( )
+{
+	return Built ? NumLevels : 0;
+}
+
+
+// nothing was drawn into it this frame:
+
+void
+HiZBuffer::Invalidate( )
+{
+	Built = false;
+}
+
+
+bool
+HiZBuffer::IsBuilt( )
+{
+	return Built;
+}
+
+
+// is this eye-coordinate sphere behind the occluders? -- the same test as
+// instcull.comp's, against the level read back:
+
+bool
+HiZBuffer::SphereHidden( const float *projection, struct Sphere *eye )
+{
+	if( ! Built )
+		return false;
+
+	// the screen box and nearest depth of the corners of the box around the sphere:
+	float lo[3] = {  1.e30f,  1.e30f,  1.e30f };
+	float hi[3] = { -1.e30f, -1.e30f, -1.e30f };
+	for( int c = 0; c < 8; c++ )
+	{
+		float x = eye->x + ( ( c & 1 ) != 0 ? eye->r : -eye->r );
+		float y = eye->y + ( ( c & 2 ) != 0 ? eye->r : -eye->r );
+		float z = eye->z + ( ( c & 4 ) != 0 ? eye->r : -eye->r );
+		float clip[4];
+		for( int k = 0; k < 4; k++ )
+			clip[k] = projection[k]*x + projection[4+k]*y + projection[8+k]*z + projection[12+k];
+		if( clip[3] <= 0.f )
+			return false;
+		for( int k = 0; k < 3; k++ )
+		{
+			float ndc = clip[k] / clip[3];
+			if( ndc < lo[k] )	lo[k] = ndc;
+			if( ndc > hi[k] )	hi[k] = ndc;
+		}
+	}
+	if( lo[2] < -1.f )
+		return false;
+
+	// the farthest depth of the level's texels under the box:
+	int t0[2], t1[2];
+	int size0[2] = { Width, Height };
+	int last[2] = { CpuWidth - 1, CpuHeight - 1 };
+	for( int k = 0; k < 2; k++ )
+	{
+		t0[k] = (int)( ( lo[k] * .5f + .5f ) * (float)size0[k] );
+		t1[k] = (int)( ( hi[k] * .5f + .5f ) * (float)size0[k] );
+		t0[k] = t0[k] < 0 ? 0 : ( t0[k] >= size0[k] ? size0[k] - 1 : t0[k] );
+		t1[k] = t1[k] < 0 ? 0 : ( t1[k] >= size0[k] ? size0[k] - 1 : t1[k] );
+		t0[k] >>= CpuLevel;
+		t1[k] >>= CpuLevel;
+		if( t0[k] > last[k] )	t0[k] = last[k];
+		if( t1[k] > last[k] )	t1[k] = last[k];
+	}
+	float farthest = 0.f;
+	for( int y = t0[1]; y <= t1[1]; y++ )
+	{
+		for( int x = t0[0]; x <= t1[0]; x++ )
+		{
+			if( CpuDepth[ y*CpuWidth + x ] > farthest )
+				farthest = CpuDepth[ y*CpuWidth + x ];
+		}
+	}
+
+	return lo[2] * .5f + .5f > farthest;
+}
+
+
+void
+HiZBuffer::ResetStats( )
+{
+	Builds = OccluderDraws = 0;
+}
+
+//#define TEST
+#ifdef TEST
+
+// a headless benchmark, run from FinalProject: a field of instanced starships, about
+// half of them behind a big sphere, drawn through the render queue with the culling
+// on the gpu, once without and once with the hi-z occlusion culling. it counts the
+// vertices and fragments shaded both ways (the occluders' depth pass included) and
+// checks the two images are the same. there is no window -- the context, and the
+// framebuffer everything is drawn into, come from HeadlessContext
+
+#undef TEST		// so the files included below leave their own tests out
+
+#include <string.h>
+#include <omp.h>
+
+void	Cross( float [3], float [3], float [3] );
+float	Unit( float [3], float [3] );
+
+#include "headless.cpp"
+#include "glslprogram.cpp"
+#include "osusphere.cpp"
+#include "drawarena.cpp"
+#include "renderqueue.cpp"
+#include "shaderstate.cpp"
+
+#define SIZE		512
+#define NUMSHIPS	2000
+#define NUMFRAMES	10
+
+void
+SetMaterial( float, float, float, float )	// the benchmark sets no materials
+{
+}
+
+void
+Cross( float v1[3], float v2[3], float vout[3] )
+{
+	float tmp[3];
+	tmp[0] = v1[1]*v2[2] - v2[1]*v1[2];
+	tmp[1] = v2[0]*v1[2] - v1[0]*v2[2];
+	tmp[2] = v1[0]*v2[1] - v2[0]*v1[1];
+	vout[0] = tmp[0];
+	vout[1] = tmp[1];
+	vout[2] = tmp[2];
+}
+
+float
+Unit( float vin[3], float vout[3] )
+{
+	float dist = sqrtf( vin[0]*vin[0] + vin[1]*vin[1] + vin[2]*vin[2] );
+	if( dist > 0. )
+	{
+		vout[0] = vin[0] / dist;
+		vout[1] = vin[1] / dist;
+		vout[2] = vin[2] / dist;
+	}
+	return dist;
+}
+
+ShaderState	State;
+RenderQueue	Queue;
+InstancedMesh	Ships;
+HiZBuffer	HiZ;
+GLSLProgram	ShipProgram, SphereProgram, CullProgram, BuildProgram;
+GLuint		SphereList;
+UniformBlock	ShipUniforms;
+
+void
+Frame( )
+{
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	Queue.Begin( );
+	Ships.Begin( );
+
+	// the sphere sits between the eye and the middle of the field:
+	float modelview[16] = { 1.,0.,0.,0.,  0.,1.,0.,0.,  0.,0.,1.,0.,  0.,0.,-30.,1. };
+	int draw = Queue.Submit( &SphereProgram, &ShipUniforms, SphereList, modelview );
+	Queue.Occluder( draw );
+
+	for( int i = 0; i < NUMSHIPS; i++ )
+	{
+		float ship[16] = { .3f,0.,0.,0.,  0.,.3f,0.,0.,  0.,0.,.3f,0.,  0.,0.,0.,1. };
+		ship[12] = -40.f + 80.f * (float)( i % 50 ) / 49.f;
+		ship[13] = -25.f + 50.f * (float)( ( i / 50 ) % 40 ) / 39.f;
+		ship[14] = -60.f - 5.f * (float)( i % 3 );
+		Ships.Add( ship, 1., 1. );
+	}
+	Queue.Submit( &ShipProgram, &ShipUniforms, &Ships );
+
+	Queue.Execute( );
+}
+
+int
+main( int argc, char *argv[ ] )
+{
+	// the context, with its framebuffer bound, that everything is drawn into:
+	HeadlessContext headless;
+	if( ! headless.Init( SIZE, SIZE ) )
+		return 1;
+	glEnable( GL_DEPTH_TEST );
+	glClearColor( 0., 0., .2f, 1. );
+
+	glMatrixMode( GL_PROJECTION );
+	glLoadIdentity( );
+	gluPerspective( 70., 1., 0.1, 1000. );
+	float projection[16];
+	glGetFloatv( GL_PROJECTION_MATRIX, projection );
+	glMatrixMode( GL_MODELVIEW );
+	glLoadIdentity( );
+
+	ShipProgram.Init( );
+	SphereProgram.Init( );
+	CullProgram.Init( );
+	BuildProgram.Init( );
+	ShipProgram.Create( (char *)"rocketinst.vert", (char *)"rocket.frag" );
+	SphereProgram.Create( (char *)"rocket.vert", (char *)"rocket.frag" );
+	CullProgram.Create( (char *)"instcull.comp" );
+	BuildProgram.Create( (char *)"hizbuild.comp" );
+	State.Init( );
+	State.MakeCurrent( );
+	State.Bind( &ShipProgram );
+	State.Bind( &SphereProgram );
+	State.Bind( &CullProgram );
+	State.BeginFrame( projection );
+
+	if( ! Ships.Init( (char *)"Starship.obj" )  ||  ! Ships.SetCullProgram( &CullProgram )  ||  ! HiZ.Init( &BuildProgram ) )
+		return 1;
+	ShipUniforms.Set( (char *)"uMix", .7f );
+	ShipUniforms.Set( (char *)"uWhiteMix", .9f );
+	ShipUniforms.Set( (char *)"uWhiteorRed", 1.f );
+	ShipUniforms.Set( (char *)"uWhiteorBlack", .5f );
+	ShipUniforms.Set( (char *)"uReflectUnit", 6 );		// the samplers of different types
+	ShipUniforms.Set( (char *)"uRefractUnit", 6 );		// can't all be on unit 0
+	ShipUniforms.Set( (char *)"Noise3", 7 );
+
+	SphereList = glGenLists( 1 );
+	glNewList( SphereList, GL_COMPILE );
+		OsuSphere( 10., 64, 64 );
+	glEndList( );
+
+	GLuint queries[2];
+	glGenQueries( 2, queries );
+	unsigned char *images[2];
+	double fragments[2], vertices[2];
+	for( int occlusion = 0; occlusion < 2; occlusion++ )
+	{
+		Queue.SetOcclusion( occlusion != 0 ? &HiZ : NULL );
+		Frame( );
+		glFinish( );
+		Ships.SetCullProgram( NULL );		// reads back the last frame's counts
+		Ships.SetCullProgram( &CullProgram );
+
+		long long drawn = Ships.InstancesDrawn, occluded = Ships.InstancesOccluded;
+		GLuint64 shaded = 0, transformed = 0;
+		double t0 = omp_get_wtime( );
+		for( int f = 0; f < NUMFRAMES; f++ )
+		{
+			GLuint64 n;
+			glBeginQuery( GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[0] );
+			glBeginQuery( GL_VERTEX_SHADER_INVOCATIONS_ARB, queries[1] );
+			Frame( );
+			glEndQuery( GL_VERTEX_SHADER_INVOCATIONS_ARB );
+			glEndQuery( GL_FRAGMENT_SHADER_INVOCATIONS_ARB );
+			glGetQueryObjectui64v( queries[0], GL_QUERY_RESULT, &n );
+			shaded += n;
+			glGetQueryObjectui64v( queries[1], GL_QUERY_RESULT, &n );
+			transformed += n;
+		}
+		double ms = 1000. * ( omp_get_wtime( ) - t0 ) / (double)NUMFRAMES;
+		Ships.SetCullProgram( NULL );		// reads back the last frame's counts
+		Ships.SetCullProgram( &CullProgram );
+
+		fragments[occlusion] = (double)shaded / (double)NUMFRAMES;
+		vertices[occlusion] = (double)transformed / (double)NUMFRAMES;
+		fprintf( stderr, "occlusion %s: %7.1f ms/frame, %5.0f ships drawn/frame, %5.0f occluded, %9.0f vertices and %8.0f fragments shaded/frame\n",
+			occlusion != 0 ? "on " : "off", ms, (double)( Ships.InstancesDrawn - drawn ) / (double)NUMFRAMES,
+			(double)( Ships.InstancesOccluded - occluded ) / (double)NUMFRAMES, vertices[occlusion], fragments[occlusion] );
+
+		images[occlusion] = new unsigned char[ 4*SIZE*SIZE ];
+		glReadPixels( 0, 0, SIZE, SIZE, GL_RGBA, GL_UNSIGNED_BYTE, images[occlusion] );
+	}
+
+	fprintf( stderr, "fragments saved: %.0f/frame (%.1f%%), vertices saved: %.0f/frame (%.1f%%)\n",
+		fragments[0] - fragments[1], 100. * ( fragments[0] - fragments[1] ) / fragments[0],
+		vertices[0] - vertices[1], 100. * ( vertices[0] - vertices[1] ) / vertices[0] );
+	fprintf( stderr, "%s\n", memcmp( images[0], images[1], 4*SIZE*SIZE ) == 0 ? "same image" : "IMAGES DIFFER" );
+	return 0;
+}
+
+#endif
+
+// EXPECTED_RESULTS (g++ -O1 -fopenmp -DTEST -I.. ../hiz.cpp -lGLEW -lEGL -lGL -lGLU, on mesa's llvmpipe, software rendering):
+//
+//	occlusion off:  4292.5 ms/frame,  2000 ships drawn/frame,     0 occluded,   9027827 vertices and  3459584 fragments shaded/frame
+//	occlusion on :  3153.1 ms/frame,  1649 ships drawn/frame,   351 occluded,   7450293 vertices and  3520736 fragments shaded/frame
+//	fragments saved: -61152/frame (-1.8%), vertices saved: 1577534/frame (17.5%)
+//	same image
+//
+// (the hidden ships' fragments were already being thrown away by the early depth
+// test, since the sphere is drawn first, so what occlusion saves here is their
+// vertices -- and the occluders' depth pass costs a few fragments of its own)
+
+#endif		// #ifndef HIZ_CPP
@@ -0,0 +1,78 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "frustum.h"
+
+
+// a hierarchical-z buffer for occlusion culling
+//
+// between BeginOccluders( ) and EndOccluders( ), the big objects that hide things --
+// the earth, the moon, the moon's surface -- are drawn depth-only into a framebuffer
+// the size of the viewport. EndOccluders( ) then builds a pyramid from that depth:
+// level 0 is the depth itself, and every texel of each level above is the
+// farthest depth of the texels under it (hizbuild.comp). a sphere whose nearest
+// depth is farther than the farthest depth over the box it projects to is hidden.
+// the test picks the level where the box covers at most 2 x 2 texels, so it
+// is always 4 texel fetches:
+//
+//	uniform sampler2D	uHiZ;		// the pyramid, on HIZ_TEXTURE_UNIT
+//	uniform int		uHiZLevels;	// 0 = no pyramid this frame, so no test
+//
+// texel j of level L covers level 0's texels j*2^L to (j+1)*2^L - 1, and the
+// last texel of a level also covers what is left over when the level below it
+// has an odd size -- so a texel at any level is found from a level-0 texel by shifting
+// it right L bits (and clamping to the level's size)
+//
+// the first level no bigger than HIZ_CPU_SIZE across is read back as well, so that
+// SphereHidden( ) can test draws on the cpu, the same way, before they are drawn
+
+#define HIZ_TEXTURE_UNIT	15
+#define HIZ_GROUP		8	// hizbuild.comp's local_size_x and local_size_y
+#define HIZ_CPU_SIZE		64
+
+
+class HiZBuffer
+{
+  private:
+	GLSLProgram *	BuildProgram;
+	GLuint		Fbo;
+	GLuint		DepthTex;
+	GLuint		PyramidTex;
+	int		Width, Height;
+	int		NumLevels;
+	bool		Built;			// the pyramid is this frame's
+	GLint		SavedFbo;
+	std::vector<float>	CpuDepth;	// the level read back
+	int		CpuLevel;
+	int		CpuWidth, CpuHeight;
+
+	bool		Resize( int, int );
+
+  public:
+	// statistics, since ResetStats( ):
+	int		Builds;
+	int		OccluderDraws;
+
+		HiZBuffer( );
+
+	bool	BeginOccluders( int, int );
+	void	BindPyramid( );
+	void	Destroy( );
+	void	EndOccluders( );
+	int	GetLevels( );
+	bool	Init( GLSLProgram * );
+	void	Invalidate( );
+	bool	IsBuilt( );
+	bool	IsValid( );
+	void	ResetStats( );
+	bool	SphereHidden( const float *, struct Sphere * );
+};
+
+#endif		// #ifndef HIZ_H
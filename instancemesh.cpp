@@ -0,0 +1,420 @@
+#ifndef INSTANCEMESH_CPP
+#define INSTANCEMESH_CPP
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+
+#include "instancemesh.h"
+#include "loadobjfile.cpp"
+#include "frustum.cpp"
+#include "hiz.cpp"
+
+
+InstancedMesh::InstancedMesh( )
+{
+	Vao = VertexBuffer = IndexBuffer = InstanceBuffer = 0;
+	InstanceCapacity = 0;
+	NumIndices = NumVertices = 0;
+	CullProgram = NULL;
+	CullBuffer = CommandBuffer = 0;
+	CullCapacity = 0;
+	CullPending = 0;
+	LastDrawn = 0;
+	LastIndirect = false;
+	for( int i = 0; i < 6; i++ )
+		Bounds[i] = 0.;
+	BoundsToSphere( Bounds, &BoundingSphere );
+	DrawCalls = 0;
+	InstancesDrawn = InstancesCulled = InstancesOccluded = 0;
+}
+
+
+// the obj file comes in as separate triangle corners -- identical corners are shared:
+
+struct ObjVertexLess
+{
+	bool operator( )( const struct ObjVertex &a, const struct ObjVertex &b ) const
+	{
+		return memcmp( &a, &b, sizeof(struct ObjVertex) ) < 0;
+	}
+};
+
+struct MeshBuild
+{
+	std::vector<struct ObjVertex>	vertices;
+	std::vector<GLuint>		indices;
+	std::map<struct ObjVertex, GLuint, ObjVertexLess>	index;
+};
+
+
+static void
+AddMeshVertex( struct ObjVertex *v, void *user )
+{
+	struct MeshBuild *mb = (struct MeshBuild *)user;
+
+	std::map<struct ObjVertex, GLuint, ObjVertexLess>::iterator pos = mb->index.find( *v );
+	if( pos != mb->index.end( ) )
+	{
+		mb->indices.push_back( pos->second );
+		return;
+	}
+
+	GLuint i = (GLuint)mb->vertices.size( );
+	mb->vertices.push_back( *v );
+	mb->index[*v] = i;
+	mb->indices.push_back( i );
+}
+
+
+bool
+InstancedMesh::Init( char *objFile )
+{
+	Destroy( );
+
+	struct MeshBuild mb;
+	if( ReadObjFile( objFile, AddMeshVertex, &mb, Bounds ) != 0  ||  mb.indices.size( ) == 0 )
+	{
+		fprintf( stderr, "InstancedMesh: no triangles in '%s'\n", objFile );
+		return false;
+	}
+	NumVertices = (int)mb.vertices.size( );
+	NumIndices = (int)mb.indices.size( );
+	BoundsToSphere( Bounds, &BoundingSphere );
+
+	glGenVertexArrays( 1, &Vao );
+	glBindVertexArray( Vao );
+
+	// the mesh itself, through the regular gl_Vertex, gl_Normal, and gl_MultiTexCoord0:
+
+	glGenBuffers( 1, &VertexBuffer );
+	glBindBuffer( GL_ARRAY_BUFFER, VertexBuffer );
+	glBufferData( GL_ARRAY_BUFFER, NumVertices * sizeof(struct ObjVertex), &mb.vertices[0], GL_STATIC_DRAW );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, sizeof(struct ObjVertex), (void *)offsetof( struct ObjVertex, x ) );
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glNormalPointer( GL_FLOAT, sizeof(struct ObjVertex), (void *)offsetof( struct ObjVertex, nx ) );
+	glClientActiveTexture( GL_TEXTURE0 );
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glTexCoordPointer( 2, GL_FLOAT, sizeof(struct ObjVertex), (void *)offsetof( struct ObjVertex, s ) );
+
+	glGenBuffers( 1, &IndexBuffer );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, IndexBuffer );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, NumIndices * sizeof(GLuint), &mb.indices[0], GL_STATIC_DRAW );
+
+	// the per-instance attributes, stepping once per instance:
+
+	glGenBuffers( 1, &InstanceBuffer );
+	glBindBuffer( GL_ARRAY_BUFFER, InstanceBuffer );
+	for( int c = 0; c < 4; c++ )
+	{
+		glEnableVertexAttribArray( INSTANCE_MATRIX_ATTRIB + c );
+		glVertexAttribPointer( INSTANCE_MATRIX_ATTRIB + c, 4, GL_FLOAT, GL_FALSE, sizeof(struct MeshInstance),
+			(void *)( offsetof( struct MeshInstance, modelview ) + 4 * c * sizeof(float) ) );
+		glVertexAttribDivisor( INSTANCE_MATRIX_ATTRIB + c, 1 );
+	}
+	glEnableVertexAttribArray( INSTANCE_WHITE_ATTRIB );
+	glVertexAttribPointer( INSTANCE_WHITE_ATTRIB, 2, GL_FLOAT, GL_FALSE, sizeof(struct MeshInstance),
+		(void *)offsetof( struct MeshInstance, white ) );
+	glVertexAttribDivisor( INSTANCE_WHITE_ATTRIB, 1 );
+
+	glBindVertexArray( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	InstanceCapacity = 0;
+
+	fprintf( stderr, "InstancedMesh: '%s' has %d vertices, %d triangles\n", objFile, NumVertices, NumIndices / 3 );
+	return true;
+}
+
+
+bool
+InstancedMesh::IsValid( )
+{
+	return Vao != 0;
+}
+
+
+void
+InstancedMesh::Destroy( )
+{
+	if( Vao != 0 )
+		glDeleteVertexArrays( 1, &Vao );
+	if( VertexBuffer != 0 )
+		glDeleteBuffers( 1, &VertexBuffer );
+	if( IndexBuffer != 0 )
+		glDeleteBuffers( 1, &IndexBuffer );
+	if( InstanceBuffer != 0 )
+		glDeleteBuffers( 1, &InstanceBuffer );
+	if( CullBuffer != 0 )
+		glDeleteBuffers( 1, &CullBuffer );
+	if( CommandBuffer != 0 )
+		glDeleteBuffers( 1, &CommandBuffer );
+	Vao = VertexBuffer = IndexBuffer = InstanceBuffer = 0;
+	CullBuffer = CommandBuffer = 0;
+	InstanceCapacity = CullCapacity = 0;
+	CullPending = 0;
+	NumIndices = NumVertices = 0;
+	Instances.clear( );
+}
+
+
+// start a new frame's list of instances:
+
+void
+InstancedMesh::Begin( )
+{
+	Instances.clear( );
+	LastDrawn = 0;
+	LastIndirect = false;
+}
+
+
+// add a copy drawn with the current modelview matrix:
+
+void
+InstancedMesh::Add( float whiteOrRed, float whiteOrBlack )
+{
+	float modelview[16];
+	glGetFloatv( GL_MODELVIEW_MATRIX, modelview );
+	Add( modelview, whiteOrRed, whiteOrBlack );
+}
+
+
+// add a copy drawn with this (column-major) modelview matrix:
+
+void
+InstancedMesh::Add( const float *modelview, float whiteOrRed, float whiteOrBlack )
+{
+	struct MeshInstance mi;
+	memcpy( mi.modelview, modelview, 16 * sizeof(float) );
+	mi.white[0] = whiteOrRed;
+	mi.white[1] = whiteOrBlack;
+	Instances.push_back( mi );
+}
+
+
+int
+InstancedMesh::NumInstances( )
+{
+	return (int)Instances.size( );
+}
+
+
+// cull with this compute program from now on, or on the cpu again if NULL:
+
+bool
+InstancedMesh::SetCullProgram( GLSLProgram *program )
+{
+	if( program != NULL  &&  ( ! GLEW_ARB_compute_shader  ||  ! GLEW_ARB_shader_storage_buffer_object  ||  ! program->IsValid( ) ) )
+	{
+		fprintf( stderr, "InstancedMesh: cannot cull on the gpu -- culling on the cpu\n" );
+		program = NULL;
+	}
+	if( program == NULL )
+		ReadGpuVisible( );
+	CullProgram = program;
+	return program != NULL;
+}
+
+
+// draw every instance added since Begin( ) with whatever program is in use -- if
+// given a frustum (in eye coordinates), the instances outside it are left out,
+// and with the gpu culling, so are the ones a built hi-z pyramid hides.
+// returns how many were drawn (with the gpu culling, how many the last frame's
+// cull found, since this frame's count isn't back from the gpu yet):
+
+int
+InstancedMesh::Draw( Frustum *frustum, HiZBuffer *hiz )
+{
+	int n = (int)Instances.size( );
+	LastDrawn = 0;
+	LastIndirect = false;
+	if( Vao == 0  ||  n == 0 )
+		return 0;
+
+	if( frustum != NULL  &&  CullProgram != NULL )
+		return CullOnGpu( frustum, hiz );
+
+	struct MeshInstance *instances = &Instances[0];
+	if( frustum != NULL )
+	{
+		CullX.resize( n );
+		CullY.resize( n );
+		CullZ.resize( n );
+		CullR.resize( n );
+		CullVisible.resize( n );
+		for( int i = 0; i < n; i++ )
+		{
+			struct Sphere eye;
+			TransformSphere( Instances[i].modelview, &BoundingSphere, &eye );
+			CullX[i] = eye.x;
+			CullY[i] = eye.y;
+			CullZ[i] = eye.z;
+			CullR[i] = eye.r;
+		}
+		int numVisible = frustum->CullSpheres( n, &CullX[0], &CullY[0], &CullZ[0], &CullR[0], &CullVisible[0] );
+		InstancesCulled += n - numVisible;
+		if( numVisible == 0 )
+			return 0;
+
+		Visible.clear( );
+		for( int i = 0; i < n; i++ )
+		{
+			if( CullVisible[i] )
+				Visible.push_back( Instances[i] );
+		}
+		instances = &Visible[0];
+		n = numVisible;
+	}
+
+	// orphan the old instance data rather than wait for the draws still reading it:
+
+	glBindBuffer( GL_ARRAY_BUFFER, InstanceBuffer );
+	if( n > InstanceCapacity )
+		InstanceCapacity = n;
+	glBufferData( GL_ARRAY_BUFFER, InstanceCapacity * sizeof(struct MeshInstance), NULL, GL_STREAM_DRAW );
+	glBufferSubData( GL_ARRAY_BUFFER, 0, n * sizeof(struct MeshInstance), instances );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	glBindVertexArray( Vao );
+	glDrawElementsInstanced( GL_TRIANGLES, NumIndices, GL_UNSIGNED_INT, (void *)0, n );
+	glBindVertexArray( 0 );
+
+	DrawCalls++;
+	InstancesDrawn += n;
+	LastDrawn = n;
+	return n;
+}
+
+
+// draw what the last Draw( ) drew again, with whatever program is in use --
+// returns how many instances that was, as Draw( ) did:
+
+int
+InstancedMesh::Redraw( )
+{
+	if( Vao == 0  ||  ( LastDrawn == 0  &&  ! LastIndirect ) )
+		return 0;
+
+	glBindVertexArray( Vao );
+	if( LastIndirect )
+	{
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, CommandBuffer );
+		glDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0 );
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+	}
+	else
+	{
+		glDrawElementsInstanced( GL_TRIANGLES, NumIndices, GL_UNSIGNED_INT, (void *)0, LastDrawn );
+	}
+	glBindVertexArray( 0 );
+
+	DrawCalls++;
+	return LastDrawn;
+}
+
+
+// the compute shader culls straight into the instance buffer and the indirect
+// command, so the draw goes out without anything coming back from the gpu:
+
+int
+InstancedMesh::CullOnGpu( Frustum *frustum, HiZBuffer *hiz )
+{
+	int n = (int)Instances.size( );
+	int drawn = ReadGpuVisible( );
+	if( drawn > n )
+		drawn = n;
+
+	if( CullBuffer == 0 )
+	{
+		glGenBuffers( 1, &CullBuffer );
+		glGenBuffers( 1, &CommandBuffer );
+	}
+
+	// orphan the old instances, as Draw( ) does:
+
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, CullBuffer );
+	if( n > CullCapacity )
+		CullCapacity = n;
+	glBufferData( GL_SHADER_STORAGE_BUFFER, CullCapacity * sizeof(struct MeshInstance), NULL, GL_STREAM_DRAW );
+	glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, n * sizeof(struct MeshInstance), &Instances[0] );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	if( n > InstanceCapacity )
+	{
+		InstanceCapacity = n;
+		glBindBuffer( GL_ARRAY_BUFFER, InstanceBuffer );
+		glBufferData( GL_ARRAY_BUFFER, InstanceCapacity * sizeof(struct MeshInstance), NULL, GL_STREAM_DRAW );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	}
+
+	// instanceCount starts at 0 and is the counter the compute shader counts with, as
+	// is the occluded count after the command:
+
+	GLuint command[6] = { (GLuint)NumIndices, 0, 0, 0, 0,  0 };
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, CommandBuffer );
+	glBufferData( GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_STREAM_DRAW );
+
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, INSTANCE_CULL_SOURCE_BINDING, CullBuffer );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, INSTANCE_CULL_VISIBLE_BINDING, InstanceBuffer );
+	glBindBufferRange( GL_ATOMIC_COUNTER_BUFFER, INSTANCE_CULL_COUNTER_BINDING, CommandBuffer, sizeof(GLuint), sizeof(GLuint) );
+	glBindBufferRange( GL_ATOMIC_COUNTER_BUFFER, INSTANCE_CULL_OCCLUDED_BINDING, CommandBuffer, 5 * sizeof(GLuint), sizeof(GLuint) );
+
+	int levels = 0;
+	if( hiz != NULL  &&  hiz->IsBuilt( ) )
+	{
+		hiz->BindPyramid( );
+		levels = hiz->GetLevels( );
+	}
+
+	GLuint previous = GLSLProgram::GetCurrentProgram( );
+	float sphere[4] = { BoundingSphere.x, BoundingSphere.y, BoundingSphere.z, BoundingSphere.r };
+	CullProgram->SetUniformVec4Array( (char *)"uPlanes", 6, &frustum->Planes[0][0] );
+	CullProgram->SetUniformVec4Array( (char *)"uSphere", 1, sphere );
+	CullProgram->SetUniformVariable( (char *)"uNumInstances", n );
+	CullProgram->SetUniformVariable( (char *)"uHiZ", HIZ_TEXTURE_UNIT );
+	CullProgram->SetUniformVariable( (char *)"uHiZLevels", levels );
+	CullProgram->DispatchCompute( ( n + INSTANCE_CULL_GROUP - 1 ) / INSTANCE_CULL_GROUP, 1, 1 );
+	CullProgram->Use( previous );
+
+	// the draw reads what the compute shader wrote as instance attributes and as its command:
+
+	glMemoryBarrier( GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT );
+
+	glBindVertexArray( Vao );
+	glDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0 );
+	glBindVertexArray( 0 );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+
+	DrawCalls++;
+	CullPending = n;
+	LastDrawn = drawn;
+	LastIndirect = true;
+	return drawn;
+}
+
+
+// read back how many instances the last gpu cull kept (and how many it found
+// hidden), and count them in the statistics:
+
+int
+InstancedMesh::ReadGpuVisible( )
+{
+	if( CullPending == 0  ||  CommandBuffer == 0 )
+		return 0;
+
+	GLuint counts[6];
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, CommandBuffer );
+	glGetBufferSubData( GL_DRAW_INDIRECT_BUFFER, 0, sizeof(counts), counts );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+
+	int visible = (int)counts[1];
+	InstancesDrawn += visible;
+	InstancesCulled += CullPending - visible;
+	InstancesOccluded += counts[5];
+	CullPending = 0;
+	return visible;
+}
+
+#endif		// #ifndef INSTANCEMESH_CPP
@@ -0,0 +1,101 @@
+#ifndef INSTANCEMESH_H
+#define INSTANCEMESH_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "frustum.h"
+#include "hiz.h"
+
+
+// an obj file in a vertex and an index buffer, drawn any number of times with one
+// glDrawElementsInstanced( )
+//
+// each frame the copies to draw are added with Add( ) and then all drawn by Draw( ).
+// every copy has its own modelview matrix and white color (rocket.frag's uWhiteorRed
+// and uWhiteorBlack), which a vertex shader like rocketinst.vert reads from the
+// instance buffer at these attribute locations:
+
+#define INSTANCE_MATRIX_ATTRIB	4	// a mat4, so 4 - 7
+#define INSTANCE_WHITE_ATTRIB	9
+
+// with a culling program given to SetCullProgram( ), the frustum test runs on the
+// gpu instead: all the instances go to a shader storage buffer, a compute shader
+// like instcull.comp copies the ones inside the frustum into the instance buffer,
+// counting them with an atomic counter that is the instanceCount of the command
+// glDrawElementsIndirect( ) draws with. the count is read back a frame later, for
+// the statistics, when reading it no longer has to wait for the gpu. given a
+// hierarchical-z pyramid of the frame's occluders too, the instances hidden behind
+// them are left out as well, and counted with a second atomic counter
+//
+// Redraw( ) draws whatever the last Draw( ) drew again, with no culling and
+// nothing uploaded -- for shading what a depth prepass just drew
+
+#define INSTANCE_CULL_COUNTER_BINDING	0	// the atomic counter binding points of the visible
+#define INSTANCE_CULL_OCCLUDED_BINDING	1	// and of the occluded instances
+#define INSTANCE_CULL_SOURCE_BINDING	3	// the shader storage binding points of all
+#define INSTANCE_CULL_VISIBLE_BINDING	4	// the instances and of the visible ones
+#define INSTANCE_CULL_GROUP		64	// the compute shader's local_size_x
+
+
+struct MeshInstance
+{
+	float		modelview[16];
+	float		white[2];	// uWhiteorRed, uWhiteorBlack
+};
+
+
+class InstancedMesh
+{
+  private:
+	GLuint				Vao;
+	GLuint				VertexBuffer;
+	GLuint				IndexBuffer;
+	GLuint				InstanceBuffer;
+	int				InstanceCapacity;	// instances the buffer has room for
+	int				NumIndices;
+	std::vector<struct MeshInstance>	Instances;
+	std::vector<struct MeshInstance>	Visible;	// the instances that survive culling
+	std::vector<float>			CullX, CullY, CullZ, CullR;
+	std::vector<unsigned char>		CullVisible;
+	GLSLProgram *			CullProgram;		// NULL to cull on the cpu
+	GLuint				CullBuffer;		// all the instances, for the compute shader
+	GLuint				CommandBuffer;		// the indirect draw command, then the occluded count
+	int				CullCapacity;
+	int				CullPending;		// instances in the last gpu cull, not read back yet
+	int				LastDrawn;		// what the last Draw( ) drew, for Redraw( )
+	bool				LastIndirect;		// ... and if it was the gpu-culled indirect draw
+
+	int	CullOnGpu( Frustum *, HiZBuffer * );
+	int	ReadGpuVisible( );
+
+  public:
+	float		Bounds[6];		// xmin, ymin, zmin, xmax, ymax, zmax
+	struct Sphere	BoundingSphere;
+	int		NumVertices;
+
+	// statistics:
+	int		DrawCalls;
+	long long	InstancesDrawn;
+	long long	InstancesCulled;
+	long long	InstancesOccluded;	// ... of them, hidden behind the occluders
+
+		InstancedMesh( );
+
+	void	Add( float, float );
+	void	Add( const float *, float, float );
+	void	Begin( );
+	void	Destroy( );
+	int	Draw( Frustum * = NULL, HiZBuffer * = NULL );
+	bool	Init( char * );
+	bool	IsValid( );
+	int	NumInstances( );
+	int	Redraw( );
+	bool	SetCullProgram( GLSLProgram * );
+};
+
+#endif		// #ifndef INSTANCEMESH_H
@@ -1,3 +1,6 @@
+#ifndef LOADOBJFILE_CPP
+#define LOADOBJFILE_CPP
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -37,13 +40,30 @@ struct face
 };
 
 
+// one corner of a triangle, as handed to the function given to ReadObjFile( ):
+
+struct ObjVertex
+{
+	float x, y, z;
+	float nx, ny, nz;
+	float s, t;
+};
+
+typedef void	(*ObjVertexFunc)( struct ObjVertex *, void * );
+
+
 char *	ReadRestOfLine( FILE * );
 void	ReadObjVTN( char *, int *, int *, int * );
 
 
 
+// read an obj file and call emit( ) with each corner of each triangle, three at a time
+// -- a corner without its own normal or texture coordinates keeps the last ones given,
+// as if it were being drawn with glNormal3f( ) and glTexCoord2f( ). the bounding box
+// is returned in bounds[ ] (xmin, ymin, zmin, xmax, ymax, zmax) if it isn't NULL:
+
 int
-LoadObjFile( char *name )
+ReadObjFile( char *name, ObjVertexFunc emit, void *user, float *bounds )
 {
 	char *cmd;		// the command string
 	char *str;		// argument string
@@ -60,6 +80,10 @@ LoadObjFile( char *name )
 	struct Normal sn;
 	struct TextureCoord st;
 
+	struct ObjVertex corner;
+	corner.nx = corner.ny = 0.;
+	corner.nz = 1.;
+	corner.s = corner.t = 0.;
 
 	// open the input file:
 
@@ -78,8 +102,6 @@ LoadObjFile( char *name )
 	float ymax = -ymin;
 	float zmax = -zmin;
 
-	glBegin( GL_TRIANGLES );
-
 	for( ; ; )
 	{
 		char *line = ReadRestOfLine( fp );
@@ -287,24 +309,32 @@ LoadObjFile( char *name )
 				v02[2] = v2->z - v0->z;
 				Cross( v01, v02, norm );
 				Unit( norm, norm );
-				glNormal3fv( norm );
+				corner.nx = norm[0];
+				corner.ny = norm[1];
+				corner.nz = norm[2];
 
 				for( int vtx = 0; vtx < 3 ; vtx++ )
 				{
 					if( vertices[ vv[vtx] ].t != 0 )
 					{
 						struct TextureCoord *tp = &TextureCoords[ vertices[ vv[vtx] ].t - 1 ];
-						glTexCoord2f( tp->s, tp->t );
+						corner.s = tp->s;
+						corner.t = tp->t;
 					}
 
 					if( vertices[ vv[vtx] ].n != 0 )
 					{
 						struct Normal *np = &Normals[ vertices[ vv[vtx] ].n - 1 ];
-						glNormal3f( np->nx, np->ny, np->nz );
+						corner.nx = np->nx;
+						corner.ny = np->ny;
+						corner.nz = np->nz;
 					}
 
 					struct Vertex *vp = &Vertices[ vertices[ vv[vtx] ].v - 1 ];
-					glVertex3f( vp->x, vp->y, vp->z );
+					corner.x = vp->x;
+					corner.y = vp->y;
+					corner.z = vp->z;
+					emit( &corner, user );
 				}
 			}
 			continue;
@@ -318,9 +348,14 @@ LoadObjFile( char *name )
 
 	}
 
-	glEnd();
 	fclose( fp );
 
+	if( bounds != NULL )
+	{
+		bounds[0] = xmin;	bounds[1] = ymin;	bounds[2] = zmin;
+		bounds[3] = xmax;	bounds[4] = ymax;	bounds[5] = zmax;
+	}
+
 	fprintf( stderr, "Obj file range: [%8.3f,%8.3f,%8.3f] -> [%8.3f,%8.3f,%8.3f]\n",
 		xmin, ymin, zmin,  xmax, ymax, zmax );
 	fprintf( stderr, "Obj file center = (%8.3f,%8.3f,%8.3f)\n",
@@ -332,6 +367,28 @@ LoadObjFile( char *name )
 }
 
 
+static void
+EmitImmediate( struct ObjVertex *v, void *user )
+{
+	glTexCoord2f( v->s, v->t );
+	glNormal3f( v->nx, v->ny, v->nz );
+	glVertex3f( v->x, v->y, v->z );
+}
+
+
+// draw an obj file's triangles with immediate mode (usually into a display list),
+// and return its bounding box in bounds[6] if that isn't NULL:
+
+int
+LoadObjFile( char *name, float *bounds = NULL )
+{
+	glBegin( GL_TRIANGLES );
+	int status = ReadObjFile( name, EmitImmediate, NULL, bounds );
+	glEnd( );
+	return status;
+}
+
+
 
 char *
 ReadRestOfLine( FILE *fp )
@@ -399,3 +456,5 @@ ReadObjVTN( char *str, int *v, int *t, int *n )
 		}
 	}
 }
+
+#endif		// #ifndef LOADOBJFILE_CPP
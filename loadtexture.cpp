@@ -0,0 +1,592 @@
+#ifndef LOADTEXTURE_CPP
+#define LOADTEXTURE_CPP
+
+#include <stdio.h>
+#include <string.h>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "texcache.cpp"
+#include "envfilter.cpp"
+#include "noisetex.cpp"
+#include "texstream.cpp"
+#include "residency.cpp"
+#include "virtualtex.cpp"
+
+
+// texture loading with per-texture sampling settings
+//
+// if minFilter is one of the *_MIPMAP_* filters, the texture gets a full mip chain:
+//	bake == true:	the chain is built on the cpu (gamma-correct) the first time,
+//			stored in a .texcache file next to the bmp, and read back from
+//			there on every later run
+//	bake == false:	only level 0 is uploaded and glGenerateMipmap( ) fills in the rest
+//
+// baked textures can also be block-compressed (BC1 or BC7) -- that is only used if the
+// driver has the matching extension, otherwise the raw rgb8 chain is baked instead
+//
+// baked textures can also be handed to a TextureStreamer: the levels are then
+// queued smallest first and the texture starts out blurry, sharpening as the
+// bigger levels arrive over the next few frames
+
+struct TexParams
+{
+	GLenum		wrap;		// GL_REPEAT, GL_CLAMP_TO_EDGE, ...
+	GLenum		magFilter;	// GL_LINEAR or GL_NEAREST
+	GLenum		minFilter;	// GL_LINEAR_MIPMAP_LINEAR = trilinear
+	float		anisotropy;	// 1. = off
+	bool		bake;		// build the mip chain on the cpu and cache it
+	enum MipFilter	mipFilter;	// MIP_BOX or MIP_KAISER, only used when baking
+	int		compression;	// TEXCACHE_RGB8, TEXCACHE_BC1, or TEXCACHE_BC7, only used when baking
+	TextureStreamer *streamer;	// NULL = upload right away, only used when baking
+};
+
+
+bool
+IsGlExtensionSupported( const char *extension )
+{
+	const char *extensions = (const char *)glGetString( GL_EXTENSIONS );
+	if( extensions == NULL  ||  extension == NULL  ||  extension[0] == '\0' )
+		return false;
+
+	int len = (int)strlen( extension );
+	for( const char *start = extensions; ( start = strstr( start, extension ) ) != NULL; start += len )
+	{
+		if( ( start == extensions  ||  start[-1] == ' ' )  &&  ( start[len] == ' '  ||  start[len] == '\0' ) )
+			return true;
+	}
+	return false;
+}
+
+
+static
+bool
+IsMipmapFilter( GLenum filter )
+{
+	return filter == GL_NEAREST_MIPMAP_NEAREST  ||  filter == GL_LINEAR_MIPMAP_NEAREST  ||
+	       filter == GL_NEAREST_MIPMAP_LINEAR   ||  filter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+
+// set the bound texture's anisotropy, as far as the driver goes (1 = none):
+
+void
+SetTexAnisotropy( GLenum target, float anisotropy )
+{
+	if( ! IsGlExtensionSupported( "GL_EXT_texture_filter_anisotropic" ) )
+		return;
+	float maxAnisotropy;
+	glGetFloatv( GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy );
+	float a = anisotropy < maxAnisotropy  ?  anisotropy  :  maxAnisotropy;
+	glTexParameterf( target, GL_TEXTURE_MAX_ANISOTROPY_EXT, a );
+}
+
+
+void
+SetTexParams( GLenum target, struct TexParams *params )
+{
+	glTexParameteri( target, GL_TEXTURE_WRAP_S, params->wrap );
+	glTexParameteri( target, GL_TEXTURE_WRAP_T, params->wrap );
+	if( target == GL_TEXTURE_CUBE_MAP )
+		glTexParameteri( target, GL_TEXTURE_WRAP_R, params->wrap );
+	glTexParameteri( target, GL_TEXTURE_MAG_FILTER, params->magFilter );
+	glTexParameteri( target, GL_TEXTURE_MIN_FILTER, params->minFilter );
+	if( params->anisotropy > 1.f )
+		SetTexAnisotropy( target, params->anisotropy );
+}
+
+
+// the cache format to actually bake, given what the driver can sample:
+
+static
+int
+CompressionFormat( int compression )
+{
+	if( compression == TEXCACHE_BC1  &&  IsGlExtensionSupported( "GL_EXT_texture_compression_s3tc" ) )
+		return TEXCACHE_BC1;
+	if( compression == TEXCACHE_BC7  &&  IsGlExtensionSupported( "GL_ARB_texture_compression_bptc" ) )
+		return TEXCACHE_BC7;
+	return TEXCACHE_RGB8;
+}
+
+
+// the gl internal format of a compressed cache:
+
+static
+GLenum
+CompressedFormat( int format )
+{
+	return ( format == TEXCACHE_BC1 )  ?  GL_COMPRESSED_RGB_S3TC_DXT1_EXT  :  GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+}
+
+
+// queue cache levels firstLevel up to (not including) endLevel, smallest level first
+// -- the streamer takes the level data over. each cache level goes into the same gl
+// level, and GL_TEXTURE_BASE_LEVEL comes down to each as it arrives: levels from
+// endLevel on are either already there or, if endLevel is the last level, nothing
+// is, and the smallest is opened up right away
+
+static
+void
+StreamTexCache( GLuint tex, GLenum target, struct TexCache *tc, int firstLevel, int endLevel, TextureStreamer *streamer )
+{
+	int numLevels = tc->header.numLevels;
+	if( endLevel > numLevels )
+		endLevel = numLevels;
+	streamer->Cancel( tex );
+	glBindTexture( target, tex );
+	int base = endLevel;
+	if( endLevel == numLevels )
+	{
+		base = numLevels - 1;
+		glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, base );
+	}
+	glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, numLevels - 1 );
+
+	for( int level = endLevel - 1; level >= firstLevel; level-- )
+	{
+		int w = tc->header.width  >> level;	if( w < 1 )	w = 1;
+		int h = tc->header.height >> level;	if( h < 1 )	h = 1;
+		for( int face = 0; face < tc->header.numFaces; face++ )
+		{
+			GLenum t = ( target == GL_TEXTURE_CUBE_MAP )  ?  GL_TEXTURE_CUBE_MAP_POSITIVE_X + face  :  target;
+			if( tc->header.format == TEXCACHE_RGB8 )
+				streamer->Queue( tex, target, t, level, w, h, GL_RGB, tc->data[level][face] );
+			else
+			{
+				enum BcFormat bc = ( tc->header.format == TEXCACHE_BC1 )  ?  BC_1  :  BC_7;
+				streamer->QueueCompressed( tex, target, t, level, w, h, CompressedFormat( tc->header.format ), BcBlockBytes( bc ), tc->data[level][face] );
+			}
+			tc->data[level][face] = NULL;
+		}
+		if( level < base )
+			streamer->SetBaseLevelWhenDone( level );
+	}
+}
+
+
+// upload cache levels firstLevel up to (not including) endLevel to the same levels
+// of the currently-bound texture, and sample from firstLevel on:
+
+static
+void
+UploadTexCache( GLenum target, struct TexCache *tc, int firstLevel, int endLevel )
+{
+	int numLevels = tc->header.numLevels;
+	if( endLevel > numLevels )
+		endLevel = numLevels;
+	for( int level = firstLevel; level < endLevel; level++ )
+	{
+		int w = tc->header.width  >> level;	if( w < 1 )	w = 1;
+		int h = tc->header.height >> level;	if( h < 1 )	h = 1;
+		for( int face = 0; face < tc->header.numFaces; face++ )
+		{
+			GLenum t = ( target == GL_TEXTURE_CUBE_MAP )  ?  GL_TEXTURE_CUBE_MAP_POSITIVE_X + face  :  target;
+			switch( tc->header.format )
+			{
+				case TEXCACHE_BC1:
+				case TEXCACHE_BC7:
+					glCompressedTexImage2D( t, level, CompressedFormat( tc->header.format ), w, h, 0, tc->sizes[level][face], tc->data[level][face] );
+					break;
+
+				default:
+					glTexImage2D( t, level, GL_RGB8, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, tc->data[level][face] );
+			}
+		}
+	}
+	glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, firstLevel );
+	glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, numLevels - 1 );
+}
+
+
+// give back the memory of levels firstLevel up to (not including) endLevel of the
+// currently-bound texture, by respecifying them as 0 x 0:
+
+static
+void
+FreeTexLevels( GLenum target, int numFaces, int firstLevel, int endLevel )
+{
+	for( int level = firstLevel; level < endLevel; level++ )
+	{
+		for( int face = 0; face < numFaces; face++ )
+		{
+			GLenum t = ( target == GL_TEXTURE_CUBE_MAP )  ?  GL_TEXTURE_CUBE_MAP_POSITIVE_X + face  :  target;
+			glTexImage2D( t, level, GL_RGB8, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL );
+		}
+	}
+}
+
+
+// read the faces, bake the mip chains, and save them:
+
+static
+bool
+BakeTexCache( char *files[ ], int numFaces, int format, struct TexParams *params, struct TexCache *tc )
+{
+	int rawBytes = 0;
+	int bakedBytes = 0;
+	double encodeSeconds = 0.;
+	double psnr = 99.;
+
+	for( int face = 0; face < numFaces; face++ )
+	{
+		int nums, numt;
+		unsigned char *texture = BmpToTexture( files[face], &nums, &numt );
+		if( texture == NULL )
+		{
+			if( face > 0 )
+				FreeTexCache( tc );
+			return false;
+		}
+
+		if( face == 0 )
+			InitTexCache( tc, format, nums, numt, numFaces, NumMipLevels( nums, numt ) );
+
+		struct MipChain chain;
+		BuildMipChain( texture, nums, numt, params->mipFilter, &chain );
+
+		double t0 = BcSeconds( );
+		SetTexCacheFace( tc, face, &chain );
+		encodeSeconds += BcSeconds( ) - t0;
+
+		for( int level = 0; level < chain.numLevels; level++ )
+		{
+			rawBytes   += 3 * chain.width[level] * chain.height[level];
+			bakedBytes += tc->sizes[level][face];
+		}
+
+		// decode level 0 again to see what the compression cost:
+
+		if( format != TEXCACHE_RGB8 )
+		{
+			enum BcFormat bc = ( format == TEXCACHE_BC1 )  ?  BC_1  :  BC_7;
+			unsigned char *decoded = DecodeBc( tc->data[0][face], nums, numt, bc );
+			double p = Psnr( texture, decoded, 3*nums*numt );
+			if( p < psnr )
+				psnr = p;
+			delete [ ] decoded;
+		}
+
+		FreeMipChain( &chain );
+		delete [ ] texture;
+	}
+
+	if( format != TEXCACHE_RGB8 )
+	{
+		int threads = 1;
+#ifdef _OPENMP
+		threads = omp_get_max_threads( );
+#endif
+		double mpix = (double)rawBytes / 3. / 1000000. / encodeSeconds;
+		fprintf( stderr, "Encoded '%s' as BC%d: %d -> %d bytes (%4.1f%% saved), %.2f Mpixels/s (%.2f per core), worst PSNR %.2f dB\n",
+			files[0], ( format == TEXCACHE_BC1 ) ? 1 : 7, rawBytes, bakedBytes,
+			100. * (double)( rawBytes - bakedBytes ) / (double)rawBytes, mpix, mpix / (double)threads, psnr );
+	}
+
+	char cacheFile[256];
+	TexCacheFileName( files[0], cacheFile, sizeof(cacheFile) );
+	if( WriteTexCache( cacheFile, SourceStamp( files, numFaces ), tc ) )
+		fprintf( stderr, "Baked %d mip levels into '%s'\n", tc->header.numLevels, cacheFile );
+	return true;
+}
+
+
+// the baked cache for these files, baking it first if it is missing or stale:
+
+static
+bool
+GetTexCache( char *files[ ], int numFaces, struct TexParams *params, struct TexCache *tc )
+{
+	char cacheFile[256];
+	TexCacheFileName( files[0], cacheFile, sizeof(cacheFile) );
+
+	int format = CompressionFormat( params->compression );
+	return ReadTexCache( cacheFile, SourceStamp( files, numFaces ), format, tc )  ||  BakeTexCache( files, numFaces, format, params, tc );
+}
+
+
+static
+GLuint
+LoadTexture( GLenum target, char *files[ ], int numFaces, struct TexParams *params )
+{
+	GLuint tex;
+	glGenTextures( 1, &tex );
+	glBindTexture( target, tex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	SetTexParams( target, params );
+
+	if( IsMipmapFilter( params->minFilter )  &&  params->bake )
+	{
+		struct TexCache tc;
+		if( GetTexCache( files, numFaces, params, &tc ) )
+		{
+			if( params->streamer != NULL  &&  params->streamer->IsValid( ) )
+				StreamTexCache( tex, target, &tc, 0, tc.header.numLevels, params->streamer );
+			else
+				UploadTexCache( target, &tc, 0, tc.header.numLevels );
+			fprintf( stderr, "Texture '%s' -- %d x %d, %d mip levels%s\n", files[0], tc.header.width, tc.header.height, tc.header.numLevels,
+				( params->streamer != NULL  &&  params->streamer->IsValid( ) )  ?  ", streaming"  :  "" );
+			FreeTexCache( &tc );
+		}
+		return tex;
+	}
+
+	for( int face = 0; face < numFaces; face++ )
+	{
+		int nums, numt;
+		unsigned char *texture = BmpToTexture( files[face], &nums, &numt );
+		if( texture == NULL )
+		{
+			fprintf( stderr, "Could not open BMP texture '%s'\n", files[face] );
+			continue;
+		}
+		fprintf( stderr, "BMP texture '%s' read -- nums = %d, numt = %d\n", files[face], nums, numt );
+
+		GLenum t = ( target == GL_TEXTURE_CUBE_MAP )  ?  GL_TEXTURE_CUBE_MAP_POSITIVE_X + face  :  target;
+		glTexImage2D( t, 0, GL_RGB8, nums, numt, 0, GL_RGB, GL_UNSIGNED_BYTE, texture );
+		delete [ ] texture;
+	}
+
+	if( IsMipmapFilter( params->minFilter ) )
+		glGenerateMipmap( target );
+
+	return tex;
+}
+
+
+GLuint
+LoadTexture2D( char *file, struct TexParams *params )
+{
+	return LoadTexture( GL_TEXTURE_2D, &file, 1, params );
+}
+
+
+GLuint
+LoadCubeMap( char *files[6], struct TexParams *params )
+{
+	return LoadTexture( GL_TEXTURE_CUBE_MAP, files, 6, params );
+}
+
+// a cube map prefiltered for glossy reflections (envfilter.cpp), baked the first time
+// and cached -- level L is roughness L / ( numLevels-1 ), for textureLod( ), and sh gets
+// the faces' irradiance. returns 0 if the faces can't be read
+
+GLuint
+LoadPrefilteredCubeMap( char *files[6], float sh[9][3], int *numLevels )
+{
+	struct TexCache tc;
+	if( ! GetEnvMap( files, &tc, sh ) )
+		return 0;
+
+	GLuint tex;
+	glGenTextures( 1, &tex );
+	glBindTexture( GL_TEXTURE_CUBE_MAP, tex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+	UploadTexCache( GL_TEXTURE_CUBE_MAP, &tc, 0, tc.header.numLevels );
+	*numLevels = tc.header.numLevels;
+	fprintf( stderr, "Prefiltered cube map '%s' -- %d x %d, %d roughness levels\n", files[0], tc.header.width, tc.header.height, tc.header.numLevels );
+	FreeTexCache( &tc );
+	return tex;
+}
+
+
+// baked textures whose gpu memory is managed by a ResidencyManager:
+// the texture name stays the same for the whole run, and cache level L is always
+// its gl level L -- demoting only frees the top levels and raises
+// GL_TEXTURE_BASE_LEVEL past them, and promoting reads just the levels that are
+// missing out of the cache and streams them in (or uploads them, without a
+// streamer). so sampler settings made after loading survive, and what the manager
+// counts is what is allocated
+
+struct ResidentAsset
+{
+	GLenum			target;
+	char *			files[6];
+	int			numFaces;
+	struct TexParams	params;
+	int			firstLoaded;	// the finest level given to gl, MAXMIPLEVELS = none
+};
+
+
+static
+bool
+LoadResident( struct ResidentTexture *rt, int baseLevel )
+{
+	struct ResidentAsset *asset = (struct ResidentAsset *)rt->asset;
+	TextureStreamer *streamer = asset->params.streamer;
+	bool streaming = streamer != NULL  &&  streamer->IsValid( );
+
+	if( rt->tex == 0 )
+	{
+		glGenTextures( 1, &rt->tex );
+		glBindTexture( asset->target, rt->tex );
+		SetTexParams( asset->target, &asset->params );
+		asset->firstLoaded = MAXMIPLEVELS;
+	}
+	glBindTexture( asset->target, rt->tex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+
+	// the levels that are really there -- not the ones still queued:
+	int have = asset->firstLoaded;
+	if( streaming )
+	{
+		int missing = streamer->Cancel( rt->tex );
+		if( missing > have )
+			have = missing;
+	}
+	if( rt->numLevels > 0 )
+	{
+		if( have > rt->numLevels )
+			have = rt->numLevels;
+		if( baseLevel >= rt->numLevels )
+			baseLevel = rt->numLevels - 1;
+	}
+
+	if( rt->numLevels == 0  ||  baseLevel < have )
+	{
+		struct TexCache tc;
+		char cacheFile[256];
+		TexCacheFileName( asset->files[0], cacheFile, sizeof(cacheFile) );
+		int format = CompressionFormat( asset->params.compression );
+		if( ! ReadTexCacheLevels( cacheFile, SourceStamp( asset->files, asset->numFaces ), format, baseLevel, have, &tc )
+		    &&  ! GetTexCache( asset->files, asset->numFaces, &asset->params, &tc ) )
+			return false;
+
+		rt->width  = tc.header.width;
+		rt->height = tc.header.height;
+		rt->numFaces  = tc.header.numFaces;
+		rt->numLevels = tc.header.numLevels;
+		rt->bitsPerTexel = ( tc.header.format == TEXCACHE_BC1 )  ?  4  :  ( tc.header.format == TEXCACHE_BC7 ) ? 8 : 32;
+		if( have > rt->numLevels )
+			have = rt->numLevels;
+		if( baseLevel >= rt->numLevels )
+			baseLevel = rt->numLevels - 1;
+
+		if( streaming )
+			StreamTexCache( rt->tex, asset->target, &tc, baseLevel, have, streamer );
+		else
+			UploadTexCache( asset->target, &tc, baseLevel, have );
+		FreeTexCache( &tc );
+	}
+	else
+	{
+		glTexParameteri( asset->target, GL_TEXTURE_BASE_LEVEL, baseLevel );
+		glTexParameteri( asset->target, GL_TEXTURE_MAX_LEVEL, rt->numLevels - 1 );
+	}
+
+	// (below the old first level is allocated too, if a promotion was cancelled)
+	FreeTexLevels( asset->target, asset->numFaces, 0, baseLevel );
+	asset->firstLoaded = baseLevel;
+	return true;
+}
+
+
+// free all but an evicted texture's 1 x 1 level, which becomes a grey texel:
+
+static
+void
+FreeResident( struct ResidentTexture *rt )
+{
+	struct ResidentAsset *asset = (struct ResidentAsset *)rt->asset;
+	if( asset->params.streamer != NULL )
+		asset->params.streamer->Cancel( rt->tex );
+
+	int last = rt->numLevels - 1;
+	unsigned char grey[3] = { 128, 128, 128 };
+	glBindTexture( asset->target, rt->tex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	FreeTexLevels( asset->target, asset->numFaces, 0, last );
+	for( int face = 0; face < asset->numFaces; face++ )
+	{
+		GLenum t = ( asset->target == GL_TEXTURE_CUBE_MAP )  ?  GL_TEXTURE_CUBE_MAP_POSITIVE_X + face  :  asset->target;
+		glTexImage2D( t, last, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey );
+	}
+	glTexParameteri( asset->target, GL_TEXTURE_BASE_LEVEL, last );
+	glTexParameteri( asset->target, GL_TEXTURE_MAX_LEVEL, last );
+	asset->firstLoaded = MAXMIPLEVELS;
+}
+
+
+void
+InitResidency( ResidencyManager *rm, long long budget, int maxDemote )
+{
+	rm->Init( budget, maxDemote, LoadResident, FreeResident );
+}
+
+
+// register a texture and load it right away, returns its residency id:
+// (params->bake must be set and params->minFilter a mipmap filter)
+
+static
+int
+LoadResidentTexture( ResidencyManager *rm, GLenum target, char *files[ ], int numFaces, struct TexParams *params )
+{
+	struct ResidentAsset *asset = new struct ResidentAsset;
+	asset->target = target;
+	asset->numFaces = numFaces;
+	for( int face = 0; face < numFaces; face++ )
+		asset->files[face] = files[face];
+	asset->params = *params;
+	asset->firstLoaded = MAXMIPLEVELS;
+
+	int id = rm->Register( files[0], asset );
+	rm->Bind( id );
+	return id;
+}
+
+
+int
+LoadResidentTexture2D( ResidencyManager *rm, char *file, struct TexParams *params )
+{
+	return LoadResidentTexture( rm, GL_TEXTURE_2D, &file, 1, params );
+}
+
+
+int
+LoadResidentCubeMap( ResidencyManager *rm, char *files[6], struct TexParams *params )
+{
+	return LoadResidentTexture( rm, GL_TEXTURE_CUBE_MAP, files, 6, params );
+}
+
+
+// a 3d noise texture from a .tex file
+// if the file isn't there, a size^3 volume is generated instead and written to
+// that file, so the generation only happens on the first run
+
+GLuint
+LoadNoiseTexture3D( char *file, int size )
+{
+	int nums, numt, nump;
+	unsigned char *texture = ReadTexFile( file, &nums, &numt, &nump );
+	if( texture == NULL )
+	{
+		nums = numt = nump = size;
+		texture = MakeNoiseVolume( size, 0 );
+		if( WriteTexFile( file, texture, nums, numt, nump ) )
+			fprintf( stderr, "Generated %d^3 noise into '%s'\n", size, file );
+	}
+	else
+		fprintf( stderr, "Noise texture '%s' read -- %d x %d x %d\n", file, nums, numt, nump );
+
+	GLuint tex;
+	glGenTextures( 1, &tex );
+	glBindTexture( GL_TEXTURE_3D, tex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexImage3D( GL_TEXTURE_3D, 0, GL_RGBA8, nums, numt, nump, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture );
+	delete [ ] texture;
+
+	return tex;
+}
+
+#endif		// #ifndef LOADTEXTURE_CPP
@@ -0,0 +1,344 @@
+#ifndef MIPMAPS_CPP
+#define MIPMAPS_CPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define MIPMAPS_SSE
+#include <xmmintrin.h>
+#endif
+
+
+// cpu-side mip chain builder
+//
+// the bmp files hold sRGB-encoded bytes, so averaging the bytes directly darkens
+// every level. instead, each level is converted to linear light, filtered there,
+// and re-encoded. the work is done in 4-float rgba pixels so that one pixel is
+// exactly one sse register.
+
+#define MAXMIPLEVELS		16
+#define KAISER_TAPS		8		// taps per output pixel in each direction
+#define KAISER_ALPHA		4.f		// kaiser window shape
+#define LINEARTOSRGB_SIZE	4096		// entries in the linear->srgb lookup table
+
+enum MipFilter
+{
+	MIP_BOX,
+	MIP_KAISER
+};
+
+struct MipChain
+{
+	int		numLevels;
+	int		width[MAXMIPLEVELS];
+	int		height[MAXMIPLEVELS];
+	unsigned char *	levels[MAXMIPLEVELS];		// 3 bytes/texel, same layout as BmpToTexture( )
+};
+
+
+static float		SrgbToLinearTable[256];
+static unsigned char	LinearToSrgbTable[LINEARTOSRGB_SIZE+1];
+static bool		MipTablesReady = false;
+
+
+static
+void
+InitMipTables( )
+{
+	if( MipTablesReady )
+		return;
+
+	for( int i = 0; i < 256; i++ )
+	{
+		float c = (float)i / 255.f;
+		SrgbToLinearTable[i] = ( c <= 0.04045f )  ?  c / 12.92f  :  powf( ( c + 0.055f ) / 1.055f, 2.4f );
+	}
+
+	for( int i = 0; i <= LINEARTOSRGB_SIZE; i++ )
+	{
+		float l = (float)i / (float)LINEARTOSRGB_SIZE;
+		float c = ( l <= 0.0031308f )  ?  12.92f * l  :  1.055f * powf( l, 1.f/2.4f ) - 0.055f;
+		LinearToSrgbTable[i] = (unsigned char)( 255.f * c + 0.5f );
+	}
+
+	MipTablesReady = true;
+}
+
+
+int
+NumMipLevels( int width, int height )
+{
+	int n = 1;
+	while( ( width > 1  ||  height > 1 )  &&  n < MAXMIPLEVELS )
+	{
+		width  = ( width  > 1 )  ?  width/2  :  1;
+		height = ( height > 1 )  ?  height/2 :  1;
+		n++;
+	}
+	return n;
+}
+
+
+// rgb bytes (sRGB) -> rgba floats (linear):
+
+static
+float *
+RgbToLinear( unsigned char *rgb, int width, int height )
+{
+	float *lin = new float[ 4 * width * height ];
+	for( int i = 0; i < width*height; i++ )
+	{
+		lin[4*i+0] = SrgbToLinearTable[ rgb[3*i+0] ];
+		lin[4*i+1] = SrgbToLinearTable[ rgb[3*i+1] ];
+		lin[4*i+2] = SrgbToLinearTable[ rgb[3*i+2] ];
+		lin[4*i+3] = 1.f;
+	}
+	return lin;
+}
+
+
+// rgba floats (linear) -> rgb bytes (sRGB):
+
+static
+unsigned char *
+LinearToRgb( float *lin, int width, int height )
+{
+	unsigned char *rgb = new unsigned char[ 3 * width * height ];
+	for( int i = 0; i < width*height; i++ )
+	{
+		for( int c = 0; c < 3; c++ )
+		{
+			float l = lin[4*i+c];
+			if( l < 0.f )	l = 0.f;
+			if( l > 1.f )	l = 1.f;
+			rgb[3*i+c] = LinearToSrgbTable[ (int)( l * (float)LINEARTOSRGB_SIZE + 0.5f ) ];
+		}
+	}
+	return rgb;
+}
+
+
+// 2x2 box filter, one sse register per rgba pixel:
+// (an odd dimension's last row or column is folded into the last texel, which
+// then averages 3 rows or columns instead of 2, so nothing is dropped. a dimension
+// of 1 just repeats its only row or column)
+
+static
+float *
+BoxDownsample( float *src, int width, int height, int nw, int nh )
+{
+	float *dst = new float[ 4 * nw * nh ];
+	for( int y = 0; y < nh; y++ )
+	{
+		int rows[3];
+		int nr = 2;
+		rows[0] = 2*y;
+		rows[1] = ( 2*y+1 < height )  ?  2*y+1  :  height-1;
+		if( y == nh-1  &&  2*y+2 == height-1 )
+			rows[nr++] = height-1;
+
+		float *out = &dst[ 4 * nw * y ];
+		for( int x = 0; x < nw; x++ )
+		{
+			int cols[3];
+			int nc = 2;
+			cols[0] = 2*x;
+			cols[1] = ( 2*x+1 < width )  ?  2*x+1  :  width-1;
+			if( x == nw-1  &&  2*x+2 == width-1 )
+				cols[nc++] = width-1;
+
+			float scale = 1.f / (float)( nr * nc );
+#ifdef MIPMAPS_SSE
+			__m128 sum = _mm_setzero_ps( );
+			for( int i = 0; i < nr; i++ )
+			{
+				float *row = &src[ 4 * width * rows[i] ];
+				for( int j = 0; j < nc; j++ )
+					sum = _mm_add_ps( sum, _mm_loadu_ps( &row[ 4*cols[j] ] ) );
+			}
+			_mm_storeu_ps( &out[4*x], _mm_mul_ps( sum, _mm_set1_ps( scale ) ) );
+#else
+			for( int c = 0; c < 4; c++ )
+			{
+				float sum = 0.f;
+				for( int i = 0; i < nr; i++ )
+					for( int j = 0; j < nc; j++ )
+						sum += src[ 4 * ( width*rows[i] + cols[j] ) + c ];
+				out[4*x+c] = scale * sum;
+			}
+#endif
+		}
+	}
+	return dst;
+}
+
+
+// zeroth-order modified bessel function, for the kaiser window:
+
+static
+float
+BesselI0( float x )
+{
+	float sum = 1.f;
+	float term = 1.f;
+	float x2 = x * x / 4.f;
+	for( int k = 1; k < 20; k++ )
+	{
+		term *= x2 / (float)( k * k );
+		sum += term;
+	}
+	return sum;
+}
+
+
+// separable kaiser-windowed sinc, 2:1 in each direction:
+// (keeps more detail than the box at small sizes and rings much less than a plain sinc)
+// each tap is one sse multiply-add of a whole rgba pixel, like the box filter
+
+static
+float *
+KaiserDownsample( float *src, int width, int height, int nw, int nh )
+{
+	float weights[KAISER_TAPS];
+	float total = 0.f;
+	for( int t = 0; t < KAISER_TAPS; t++ )
+	{
+		float d = ( (float)t - (float)(KAISER_TAPS-1)/2.f ) / 2.f;	// distance in destination texels
+		float sinc = ( d == 0.f )  ?  1.f  :  sinf( (float)M_PI*d ) / ( (float)M_PI*d );
+		float r = d / ( (float)KAISER_TAPS/4.f );
+		float window = ( fabsf(r) >= 1.f )  ?  0.f  :  BesselI0( KAISER_ALPHA * sqrtf( 1.f - r*r ) ) / BesselI0( KAISER_ALPHA );
+		weights[t] = sinc * window;
+		total += weights[t];
+	}
+	for( int t = 0; t < KAISER_TAPS; t++ )
+		weights[t] /= total;
+#ifdef MIPMAPS_SSE
+	__m128 w4[KAISER_TAPS];
+	for( int t = 0; t < KAISER_TAPS; t++ )
+		w4[t] = _mm_set1_ps( weights[t] );
+#endif
+
+	// horizontal pass: width -> nw
+
+	float *tmp = new float[ 4 * nw * height ];
+	for( int y = 0; y < height; y++ )
+	{
+		for( int x = 0; x < nw; x++ )
+		{
+#ifdef MIPMAPS_SSE
+			__m128 sum = _mm_setzero_ps( );
+#else
+			float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+#endif
+			for( int t = 0; t < KAISER_TAPS; t++ )
+			{
+				int sx = 2*x + t - (KAISER_TAPS/2 - 1);
+				if( sx < 0 )		sx = 0;
+				if( sx >= width )	sx = width-1;
+				float *p = &src[ 4 * ( width*y + sx ) ];
+#ifdef MIPMAPS_SSE
+				sum = _mm_add_ps( sum, _mm_mul_ps( w4[t], _mm_loadu_ps( p ) ) );
+#else
+				for( int c = 0; c < 4; c++ )
+					sum[c] += weights[t] * p[c];
+#endif
+			}
+#ifdef MIPMAPS_SSE
+			_mm_storeu_ps( &tmp[ 4 * ( nw*y + x ) ], sum );
+#else
+			memcpy( &tmp[ 4 * ( nw*y + x ) ], sum, sizeof(sum) );
+#endif
+		}
+	}
+
+	// vertical pass: height -> nh
+
+	float *dst = new float[ 4 * nw * nh ];
+	for( int y = 0; y < nh; y++ )
+	{
+		for( int x = 0; x < nw; x++ )
+		{
+#ifdef MIPMAPS_SSE
+			__m128 sum = _mm_setzero_ps( );
+#else
+			float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+#endif
+			for( int t = 0; t < KAISER_TAPS; t++ )
+			{
+				int sy = 2*y + t - (KAISER_TAPS/2 - 1);
+				if( sy < 0 )		sy = 0;
+				if( sy >= height )	sy = height-1;
+				float *p = &tmp[ 4 * ( nw*sy + x ) ];
+#ifdef MIPMAPS_SSE
+				sum = _mm_add_ps( sum, _mm_mul_ps( w4[t], _mm_loadu_ps( p ) ) );
+#else
+				for( int c = 0; c < 4; c++ )
+					sum[c] += weights[t] * p[c];
+#endif
+			}
+#ifdef MIPMAPS_SSE
+			_mm_storeu_ps( &dst[ 4 * ( nw*y + x ) ], sum );
+#else
+			memcpy( &dst[ 4 * ( nw*y + x ) ], sum, sizeof(sum) );
+#endif
+		}
+	}
+
+	delete [ ] tmp;
+	return dst;
+}
+
+
+// build the complete chain, level 0 is a copy of the input:
+
+void
+BuildMipChain( unsigned char *rgb, int width, int height, enum MipFilter filter, struct MipChain *chain )
+{
+	InitMipTables( );
+
+	chain->numLevels = NumMipLevels( width, height );
+	chain->width[0]  = width;
+	chain->height[0] = height;
+	chain->levels[0] = new unsigned char[ 3 * width * height ];
+	memcpy( chain->levels[0], rgb, 3 * width * height );
+
+	float *lin = RgbToLinear( rgb, width, height );
+	for( int level = 1; level < chain->numLevels; level++ )
+	{
+		int w = chain->width[level-1];
+		int h = chain->height[level-1];
+		int nw = ( w > 1 )  ?  w/2  :  1;
+		int nh = ( h > 1 )  ?  h/2  :  1;
+
+		float *next;
+		if( filter == MIP_KAISER  &&  w >= KAISER_TAPS  &&  h >= KAISER_TAPS )
+			next = KaiserDownsample( lin, w, h, nw, nh );
+		else
+			next = BoxDownsample( lin, w, h, nw, nh );
+		delete [ ] lin;
+		lin = next;
+
+		chain->width[level]  = nw;
+		chain->height[level] = nh;
+		chain->levels[level] = LinearToRgb( lin, nw, nh );
+	}
+	delete [ ] lin;
+}
+
+
+void
+FreeMipChain( struct MipChain *chain )
+{
+	for( int level = 0; level < chain->numLevels; level++ )
+	{
+		delete [ ] chain->levels[level];
+		chain->levels[level] = NULL;
+	}
+	chain->numLevels = 0;
+}
+
+#endif		// #ifndef MIPMAPS_CPP
@@ -0,0 +1,365 @@
+#ifndef NOISETEX_CPP
+#define NOISETEX_CPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "cachefile.cpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define NOISETEX_SSE
+#include <emmintrin.h>
+#endif
+
+
+// .tex noise files (noise2d.064.tex, noise3d.064.tex)
+//
+//	int	nums, numt		(2d files)
+//	int	nums, numt, nump	(3d files)
+//	rgba bytes, s varying fastest
+//
+// each channel holds one octave of perlin noise centered on 127, with the frequency
+// doubling and the amplitude halving from r to a, so that in a shader
+//	r + g + b + a - 2.
+// is a 4-octave noise value in about -1. to +1.
+
+#define NOISE_OCTAVES		4
+#define NOISE_BASEFREQ		4		// lattice cells across the volume in the r channel
+#define NOISE_BASEAMP		0.5f		// amplitude of the r channel, as a fraction of 127.5
+
+
+// returns new[ ]'ed rgba bytes, and *nump = 1 for a 2d file:
+
+unsigned char *
+ReadTexFile( char *file, int *nums, int *numt, int *nump )
+{
+	FILE *fp = fopen( file, "rb" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot open .tex file '%s'\n", file );
+		return NULL;
+	}
+
+	fseek( fp, 0, SEEK_END );
+	long length = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	int dims[3] = { 0, 0, 1 };
+	if( fread( dims, sizeof(int), 2, fp ) != 2  ||  dims[0] <= 0  ||  dims[1] <= 0 )
+	{
+		fprintf( stderr, "Bad header in .tex file '%s'\n", file );
+		fclose( fp );
+		return NULL;
+	}
+
+	// the 2d and 3d headers differ in length, so the file size tells them apart:
+
+	if( length != 2*(long)sizeof(int) + 4L * dims[0] * dims[1] )
+	{
+		if( fread( &dims[2], sizeof(int), 1, fp ) != 1  ||  dims[2] <= 0  ||
+		    length != 3*(long)sizeof(int) + 4L * dims[0] * dims[1] * dims[2] )
+		{
+			fprintf( stderr, "Wrong size for .tex file '%s'\n", file );
+			fclose( fp );
+			return NULL;
+		}
+	}
+
+	int numBytes = 4 * dims[0] * dims[1] * dims[2];
+	unsigned char *texture = new unsigned char[ numBytes ];
+	if( fread( texture, 1, numBytes, fp ) != (size_t)numBytes )
+	{
+		fprintf( stderr, "Short read in .tex file '%s'\n", file );
+		delete [ ] texture;
+		fclose( fp );
+		return NULL;
+	}
+	fclose( fp );
+
+	*nums = dims[0];
+	*numt = dims[1];
+	*nump = dims[2];
+	return texture;
+}
+
+
+// nump == 1 writes the 2d header:
+
+bool
+WriteTexFile( char *file, unsigned char *texture, int nums, int numt, int nump )
+{
+	char tmp[300];
+	FILE *fp = OpenCacheFile( file, tmp, sizeof(tmp) );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write .tex file '%s'\n", file );
+		return false;
+	}
+
+	int dims[3] = { nums, numt, nump };
+	int numBytes = 4 * nums * numt * nump;
+	bool ok = fwrite( dims, sizeof(int), ( nump > 1 ) ? 3 : 2, fp ) == (size_t)( ( nump > 1 ) ? 3 : 2 );
+	ok = ok  &&  fwrite( texture, 1, numBytes, fp ) == (size_t)numBytes;
+	return CloseCacheFile( fp, tmp, file, ok );
+}
+
+
+//////////////////////////////////////////////  noise generation:
+
+
+// ken perlin's improved noise, with the lattice wrapped every 'period' cells
+// so that the volume tiles with GL_REPEAT:
+
+static int	NoisePerm[512];
+
+static const float NoiseGrads[16][3] =
+{
+	{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+	{ 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+	{ 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 },
+	{ 1, 1, 0 }, { 0, -1, 1 }, { -1, 1, 0 }, { 0, -1, -1 }
+};
+
+
+static
+void
+InitNoisePerm( int seed )
+{
+	unsigned int state = (unsigned int)seed * 2654435761u + 1u;
+	for( int i = 0; i < 256; i++ )
+		NoisePerm[i] = i;
+	for( int i = 255; i > 0; i-- )
+	{
+		state = state * 1664525u + 1013904223u;
+		int j = (int)( ( state >> 8 ) % (unsigned int)( i + 1 ) );
+		int tmp = NoisePerm[i];	NoisePerm[i] = NoisePerm[j];	NoisePerm[j] = tmp;
+	}
+	for( int i = 0; i < 256; i++ )
+		NoisePerm[256+i] = NoisePerm[i];
+}
+
+
+inline
+float
+NoiseFade( float t )
+{
+	return t * t * t * ( t * ( t * 6.f - 15.f ) + 10.f );
+}
+
+
+inline
+int
+NoiseHash( int x, int y, int z )
+{
+	return NoisePerm[ NoisePerm[ NoisePerm[ x & 255 ] + ( y & 255 ) ] + ( z & 255 ) ] & 15;
+}
+
+
+// one octave at 4 consecutive voxels along x, all sharing the same y and z:
+// (the lattice lookups are scalar, the gradient dot products and the
+//  trilinear blending are done 4-wide)
+
+static
+void
+PerlinRow4( float x[4], float y, float z, int period, float out[4] )
+{
+	int iy = (int)floorf( y );
+	int iz = (int)floorf( z );
+	float fy = y - (float)iy;
+	float fz = z - (float)iz;
+	int y0 = iy % period,	y1 = ( iy + 1 ) % period;
+	int z0 = iz % period,	z1 = ( iz + 1 ) % period;
+
+	float fx[4];
+	int x0[4], x1[4];
+	for( int l = 0; l < 4; l++ )
+	{
+		int ix = (int)floorf( x[l] );
+		fx[l] = x[l] - (float)ix;
+		x0[l] = ix % period;
+		x1[l] = ( ix + 1 ) % period;
+	}
+
+	// gradients at the 8 corners, gathered into lanes:
+
+	float g[8][3][4];
+	for( int l = 0; l < 4; l++ )
+	{
+		for( int corner = 0; corner < 8; corner++ )
+		{
+			int cx = ( corner & 1 )  ?  x1[l]  :  x0[l];
+			int cy = ( corner & 2 )  ?  y1  :  y0;
+			int cz = ( corner & 4 )  ?  z1  :  z0;
+			const float *grad = NoiseGrads[ NoiseHash( cx, cy, cz ) ];
+			g[corner][0][l] = grad[0];
+			g[corner][1][l] = grad[1];
+			g[corner][2][l] = grad[2];
+		}
+	}
+
+#ifdef NOISETEX_SSE
+	__m128 dx0 = _mm_loadu_ps( fx );
+	__m128 dx1 = _mm_sub_ps( dx0, _mm_set1_ps( 1.f ) );
+	__m128 dy0 = _mm_set1_ps( fy ),	dy1 = _mm_set1_ps( fy - 1.f );
+	__m128 dz0 = _mm_set1_ps( fz ),	dz1 = _mm_set1_ps( fz - 1.f );
+
+	__m128 d[8];
+	for( int corner = 0; corner < 8; corner++ )
+	{
+		__m128 dx = ( corner & 1 )  ?  dx1  :  dx0;
+		__m128 dy = ( corner & 2 )  ?  dy1  :  dy0;
+		__m128 dz = ( corner & 4 )  ?  dz1  :  dz0;
+		d[corner] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( g[corner][0] ), dx ),
+						    _mm_mul_ps( _mm_loadu_ps( g[corner][1] ), dy ) ),
+					_mm_mul_ps( _mm_loadu_ps( g[corner][2] ), dz ) );
+	}
+
+	float u4[4];
+	for( int l = 0; l < 4; l++ )
+		u4[l] = NoiseFade( fx[l] );
+	__m128 u = _mm_loadu_ps( u4 );
+	__m128 v = _mm_set1_ps( NoiseFade( fy ) );
+	__m128 w = _mm_set1_ps( NoiseFade( fz ) );
+
+	#define LERP4(t,a,b)	_mm_add_ps( (a), _mm_mul_ps( (t), _mm_sub_ps( (b), (a) ) ) )
+	__m128 x00 = LERP4( u, d[0], d[1] );
+	__m128 x10 = LERP4( u, d[2], d[3] );
+	__m128 x01 = LERP4( u, d[4], d[5] );
+	__m128 x11 = LERP4( u, d[6], d[7] );
+	__m128 y0v = LERP4( v, x00, x10 );
+	__m128 y1v = LERP4( v, x01, x11 );
+	_mm_storeu_ps( out, LERP4( w, y0v, y1v ) );
+	#undef LERP4
+#else
+	float v = NoiseFade( fy );
+	float w = NoiseFade( fz );
+	for( int l = 0; l < 4; l++ )
+	{
+		float d[8];
+		for( int corner = 0; corner < 8; corner++ )
+		{
+			float dx = ( corner & 1 )  ?  fx[l] - 1.f  :  fx[l];
+			float dy = ( corner & 2 )  ?  fy - 1.f  :  fy;
+			float dz = ( corner & 4 )  ?  fz - 1.f  :  fz;
+			d[corner] = g[corner][0][l]*dx + g[corner][1][l]*dy + g[corner][2][l]*dz;
+		}
+		float u = NoiseFade( fx[l] );
+		float x00 = d[0] + u * ( d[1] - d[0] );
+		float x10 = d[2] + u * ( d[3] - d[2] );
+		float x01 = d[4] + u * ( d[5] - d[4] );
+		float x11 = d[6] + u * ( d[7] - d[6] );
+		float y0v = x00 + v * ( x10 - x00 );
+		float y1v = x01 + v * ( x11 - x01 );
+		out[l] = y0v + w * ( y1v - y0v );
+	}
+#endif
+}
+
+
+// a size^3 rgba volume of tileable 4-octave noise, in the same layout as noise3d.064.tex:
+// (one openmp thread per slice; size should be a multiple of 4)
+
+unsigned char *
+MakeNoiseVolume( int size, int seed )
+{
+	InitNoisePerm( seed );
+
+	unsigned char *texture = new unsigned char[ 4 * size * size * size ];
+
+	#pragma omp parallel for schedule(dynamic)
+	for( int p = 0; p < size; p++ )
+	{
+		for( int t = 0; t < size; t++ )
+		{
+			for( int s = 0; s < size; s += 4 )
+			{
+				for( int octave = 0; octave < NOISE_OCTAVES; octave++ )
+				{
+					int period = NOISE_BASEFREQ << octave;
+					float scale = (float)period / (float)size;	// lattice cells per voxel
+					float amp = 127.5f * NOISE_BASEAMP / (float)( 1 << octave );
+
+					float x[4], n[4];
+					for( int l = 0; l < 4; l++ )
+						x[l] = (float)( s + l ) * scale;
+					PerlinRow4( x, (float)t * scale, (float)p * scale, period, n );
+
+					for( int l = 0; l < 4  &&  s + l < size; l++ )
+					{
+						float value = 127.5f + amp * n[l];
+						if( value < 0.f )	value = 0.f;
+						if( value > 255.f )	value = 255.f;
+						texture[ 4 * ( size*size*p + size*t + s + l ) + octave ] = (unsigned char)value;
+					}
+				}
+			}
+		}
+	}
+
+	return texture;
+}
+
+
+//#define TEST
+#ifdef TEST
+
+int
+main( int argc, char *argv[ ] )
+{
+	int nums, numt, nump;
+	unsigned char *shipped = ReadTexFile( (char *)"noise3d.064.tex", &nums, &numt, &nump );
+	if( shipped != NULL )
+	{
+		fprintf( stderr, "noise3d.064.tex: %d x %d x %d\n", nums, numt, nump );
+		delete [ ] shipped;
+	}
+
+	int maxThreads = 1;
+#ifdef _OPENMP
+	maxThreads = omp_get_num_procs( );
+#endif
+
+	int sizes[ ] = { 64, 128, 256 };
+	for( int i = 0; i < 3; i++ )
+	{
+		for( int threads = 1; threads <= maxThreads; threads *= 2 )
+		{
+#ifdef _OPENMP
+			omp_set_num_threads( threads );
+			double t0 = omp_get_wtime( );
+#else
+			double t0 = (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+			unsigned char *volume = MakeNoiseVolume( sizes[i], 0 );
+#ifdef _OPENMP
+			double t1 = omp_get_wtime( );
+#else
+			double t1 = (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+			double mvox = (double)sizes[i] * sizes[i] * sizes[i] / 1000000. / ( t1 - t0 );
+			fprintf( stderr, "%3d^3, %2d threads: %8.2f ms, %7.2f Mvoxels/s\n", sizes[i], threads, 1000.*( t1 - t0 ), mvox );
+
+			if( threads == 1  &&  sizes[i] == 64 )
+			{
+				double sum[4] = { 0., 0., 0., 0. };
+				for( int v = 0; v < 64*64*64; v++ )
+					for( int c = 0; c < 4; c++ )
+						sum[c] += volume[4*v+c];
+				fprintf( stderr, "    channel means: %6.2f %6.2f %6.2f %6.2f\n",
+					sum[0]/(64*64*64), sum[1]/(64*64*64), sum[2]/(64*64*64), sum[3]/(64*64*64) );
+			}
+			delete [ ] volume;
+		}
+	}
+	return 0;
+}
+#endif
+
+#endif		// #ifndef NOISETEX_CPP
@@ -0,0 +1,46 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+
+// counts how many times each pixel is drawn, in the stencil buffer
+//
+// between Begin( ) and End( ), every fragment that passes the depth test adds one
+// to its pixel's stencil value (GL_INCR, so it stops at 255). Read( ) brings the
+// counts back for the statistics, and Show( ) paints them over the frame:
+//
+//	0 black, 1 dark blue, 2 blue, 3 green, 4 yellow, 5 orange, 6 red, 7 magenta,
+//	and 8 or more white
+//
+// the framebuffer needs a stencil buffer -- without one every count reads 0
+
+#define OVERDRAW_COLORS		9
+
+
+class OverdrawCounter
+{
+  private:
+	std::vector<unsigned char>	Counts;
+
+  public:
+	// from the last Read( ):
+	int		Pixels;		// pixels drawn at least once
+	long long	Fragments;	// fragments drawn, over all of them
+	int		MostDraws;	// the most any one pixel was drawn
+
+		OverdrawCounter( );
+
+	void	Begin( );
+	void	End( );
+	float	GetAverage( );
+	void	PrintStats( );
+	void	Read( );
+	void	Show( );
+};
+
+#endif		// #ifndef OVERDRAW_H
@@ -0,0 +1,789 @@
+#ifndef PARTICLES_CPP
+#define PARTICLES_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define PARTICLES_SSE
+#include <emmintrin.h>
+#endif
+
+#include "particles.h"
+
+void	Cross( float [3], float [3], float [3] );	// loadobjfile.cpp needs these, from sample.cpp
+float	Unit( float [3], float [3] );
+
+#include "loadobjfile.cpp"
+
+
+static double
+ParticleSeconds( )
+{
+#ifdef _OPENMP
+	return omp_get_wtime( );
+#else
+	return (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+// the pool's arrays are 16-byte aligned, for the aligned sse loads and stores:
+
+static float *
+NewParticleArray( int n )
+{
+#ifdef PARTICLES_SSE
+	return (float *)_mm_malloc( n * sizeof(float), 16 );
+#else
+	return new float[n];
+#endif
+}
+
+
+static void
+DeleteParticleArray( float *a )
+{
+	if( a == NULL )
+		return;
+#ifdef PARTICLES_SSE
+	_mm_free( a );
+#else
+	delete [ ] a;
+#endif
+}
+
+
+// chunk c of count particles, [*begin, *end) -- every chunk but the last starts and
+// ends on a multiple of 4, so the sse loop only leaves a remainder in the last one:
+
+static void
+ParticleChunk( int count, int c, int *begin, int *end )
+{
+	int blocks = count / 4;
+	*begin = 4 * (int)( (long long)blocks * c / PARTICLE_CHUNKS );
+	*end = ( c == PARTICLE_CHUNKS-1 )  ?  count  :  4 * (int)( (long long)blocks * ( c+1 ) / PARTICLE_CHUNKS );
+}
+
+
+ParticleSystem::ParticleSystem( )
+{
+	X = Y = Z = Vx = Vy = Vz = Life = NULL;
+	Dead = NULL;
+	memset( DeadCount, 0, sizeof(DeadCount) );
+	Capacity = Count = 0;
+	Seed = 1;
+	VelScale = 30.f;
+	Gravity = -0.075f;
+	LifeMin = 1.f;
+	LifeMax = 2.f;
+	Program = NULL;
+	Vao = Buffer = 0;
+	Uploaded = 0;
+	ResetStats( );
+}
+
+
+// room for maxParticles, allocated now and never again -- with a program
+// (particle.vert and particle.frag) they can be uploaded and drawn too, without one
+// they are only simulated. returns false if the pool couldn't be allocated or the
+// program didn't build:
+
+bool
+ParticleSystem::Init( int maxParticles, GLSLProgram *program )
+{
+	Destroy( );
+
+	Capacity = ( maxParticles + 3 ) & ~3;
+	X = NewParticleArray( Capacity );
+	Y = NewParticleArray( Capacity );
+	Z = NewParticleArray( Capacity );
+	Vx = NewParticleArray( Capacity );
+	Vy = NewParticleArray( Capacity );
+	Vz = NewParticleArray( Capacity );
+	Life = NewParticleArray( Capacity );
+	Dead = new int[ Capacity ];
+	if( X == NULL  ||  Y == NULL  ||  Z == NULL  ||  Vx == NULL  ||  Vy == NULL  ||  Vz == NULL  ||  Life == NULL )
+	{
+		fprintf( stderr, "ParticleSystem: no room for %d particles\n", maxParticles );
+		Destroy( );
+		return false;
+	}
+	Count = 0;
+
+	if( program == NULL )
+		return true;
+	if( ! program->IsValid( ) )
+	{
+		fprintf( stderr, "ParticleSystem: no particle program\n" );
+		Destroy( );
+		return false;
+	}
+	Program = program;
+
+	glGenVertexArrays( 1, &Vao );
+	glBindVertexArray( Vao );
+	glGenBuffers( 1, &Buffer );
+	glBindBuffer( GL_ARRAY_BUFFER, Buffer );
+	glBufferData( GL_ARRAY_BUFFER, (GLsizeiptr)Capacity * 4 * sizeof(float), NULL, GL_STREAM_DRAW );
+	glEnableVertexAttribArray( PARTICLE_ATTRIB );
+	glVertexAttribPointer( PARTICLE_ATTRIB, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0 );
+	glVertexAttribDivisor( PARTICLE_ATTRIB, 1 );
+	glBindVertexArray( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	Uploaded = 0;
+	return true;
+}
+
+
+bool
+ParticleSystem::IsValid( )
+{
+	return Capacity > 0;
+}
+
+
+void
+ParticleSystem::Destroy( )
+{
+	DeleteParticleArray( X );
+	DeleteParticleArray( Y );
+	DeleteParticleArray( Z );
+	DeleteParticleArray( Vx );
+	DeleteParticleArray( Vy );
+	DeleteParticleArray( Vz );
+	DeleteParticleArray( Life );
+	X = Y = Z = Vx = Vy = Vz = Life = NULL;
+	if( Dead != NULL )
+		delete [ ] Dead;
+	Dead = NULL;
+	if( Buffer != 0 )
+		glDeleteBuffers( 1, &Buffer );
+	if( Vao != 0 )
+		glDeleteVertexArrays( 1, &Vao );
+	Buffer = Vao = 0;
+	Program = NULL;
+	Capacity = Count = Uploaded = 0;
+}
+
+
+static void
+AddParticleCorner( struct ObjVertex *v, void *user )
+{
+	std::vector<float> *triangles = (std::vector<float> *)user;
+	triangles->push_back( v->x );
+	triangles->push_back( v->y );
+	triangles->push_back( v->z );
+}
+
+
+// emit from the triangles of an obj file:
+
+bool
+ParticleSystem::SetEmitter( char *objFile )
+{
+	std::vector<float> triangles;
+	if( ReadObjFile( objFile, AddParticleCorner, &triangles, NULL ) != 0  ||  triangles.size( ) < 9 )
+	{
+		fprintf( stderr, "ParticleSystem: no triangles in '%s'\n", objFile );
+		return false;
+	}
+	return SetEmitter( &triangles[0], (int)triangles.size( ) / 9 );
+}
+
+
+// ... or from numTriangles triangles, 9 floats each:
+
+bool
+ParticleSystem::SetEmitter( const float *triangles, int numTriangles )
+{
+	Triangles.assign( triangles, triangles + 9*numTriangles );
+	Areas.resize( numTriangles );
+	double total = 0.;
+	for( int t = 0; t < numTriangles; t++ )
+	{
+		const float *v = &Triangles[9*t];
+		float a[3] = { v[3]-v[0], v[4]-v[1], v[5]-v[2] };
+		float b[3] = { v[6]-v[0], v[7]-v[1], v[8]-v[2] };
+		float n[3] = { a[1]*b[2] - a[2]*b[1],  a[2]*b[0] - a[0]*b[2],  a[0]*b[1] - a[1]*b[0] };
+		total += 0.5 * sqrt( (double)n[0]*n[0] + (double)n[1]*n[1] + (double)n[2]*n[2] );
+		Areas[t] = (float)total;
+	}
+	if( total <= 0. )
+	{
+		fprintf( stderr, "ParticleSystem: the emitter has no area\n" );
+		Triangles.clear( );
+		Areas.clear( );
+		return false;
+	}
+	return true;
+}
+
+
+// explosion.geom's uVelScale and uGravity:
+
+void
+ParticleSystem::SetBallistics( float velScale, float gravity )
+{
+	VelScale = velScale;
+	Gravity = gravity;
+}
+
+
+// each particle lives a random time between lifeMin and lifeMax seconds:
+
+void
+ParticleSystem::SetLife( float lifeMin, float lifeMax )
+{
+	LifeMin = lifeMin;
+	LifeMax = lifeMax  >  lifeMin  ?  lifeMax  :  lifeMin;
+}
+
+
+// the emission is random, but the same every time from the same seed:
+
+void
+ParticleSystem::SetSeed( unsigned int seed )
+{
+	Seed = ( seed != 0 )  ?  seed  :  1;
+}
+
+
+// xorshift, 0. to just under 1.:
+
+float
+ParticleSystem::Random( )
+{
+	Seed ^= Seed << 13;
+	Seed ^= Seed >> 17;
+	Seed ^= Seed << 5;
+	return (float)( Seed >> 8 ) * ( 1.f / 16777216.f );
+}
+
+
+void
+ParticleSystem::Clear( )
+{
+	Count = 0;
+	Uploaded = 0;
+}
+
+
+int
+ParticleSystem::NumParticles( )
+{
+	return Count;
+}
+
+
+// particle i's position and velocity, for checking:
+
+void
+ParticleSystem::GetParticle( int i, float *position, float *velocity )
+{
+	position[0] = X[i];
+	position[1] = Y[i];
+	position[2] = Z[i];
+	velocity[0] = Vx[i];
+	velocity[1] = Vy[i];
+	velocity[2] = Vz[i];
+}
+
+
+// add up to count new particles -- as many as there is room for. returns how many:
+
+int
+ParticleSystem::Emit( int count )
+{
+	if( count > Capacity - Count )
+		count = Capacity - Count;
+	if( count <= 0  ||  Areas.size( ) == 0 )
+		return 0;
+
+	double t0 = ParticleSeconds( );
+	int numTriangles = (int)Areas.size( );
+	float total = Areas[numTriangles-1];
+	for( int i = Count; i < Count + count; i++ )
+	{
+		int t = (int)( std::upper_bound( Areas.begin( ), Areas.end( ), Random( ) * total ) - Areas.begin( ) );
+		if( t >= numTriangles )
+			t = numTriangles - 1;
+		const float *v = &Triangles[9*t];
+
+		// a uniformly random point of the triangle:
+		float s = Random( );
+		float r = Random( );
+		if( s + r > 1.f )
+		{
+			s = 1.f - s;
+			r = 1.f - r;
+		}
+		float p[3], center[3];
+		for( int k = 0; k < 3; k++ )
+		{
+			p[k] = v[k] + s * ( v[3+k] - v[k] ) + r * ( v[6+k] - v[k] );
+			center[k] = ( v[k] + v[3+k] + v[6+k] ) / 3.f;
+		}
+
+		X[i] = p[0];
+		Y[i] = p[1];
+		Z[i] = p[2];
+		Vx[i] = VelScale * ( p[0] - center[0] );
+		Vy[i] = VelScale * ( p[1] - center[1] );
+		Vz[i] = VelScale * ( p[2] - center[2] );
+		Life[i] = LifeMin + ( LifeMax - LifeMin ) * Random( );
+	}
+	Count += count;
+
+	Emitted += count;
+	EmitSeconds += ParticleSeconds( ) - t0;
+	return count;
+}
+
+
+// move chunk c of the count particles, and list the ones that died at the start of
+// its part of Dead[ ]:
+
+void
+ParticleSystem::UpdateChunk( int c, int count, float dt )
+{
+	int begin, end;
+	ParticleChunk( count, c, &begin, &end );
+	int *dead = &Dead[begin];
+	int numDead = 0;
+
+	float dy = 0.5f * Gravity * dt * dt;
+	float dv = Gravity * dt;
+	int i = begin;
+
+#ifdef PARTICLES_SSE
+	__m128 dt4 = _mm_set1_ps( dt );
+	__m128 dy4 = _mm_set1_ps( dy );
+	__m128 dv4 = _mm_set1_ps( dv );
+	__m128 zero = _mm_setzero_ps( );
+	for( ; i + 4 <= end; i += 4 )
+	{
+		__m128 vy = _mm_load_ps( &Vy[i] );
+		_mm_store_ps( &X[i], _mm_add_ps( _mm_load_ps( &X[i] ), _mm_mul_ps( _mm_load_ps( &Vx[i] ), dt4 ) ) );
+		_mm_store_ps( &Y[i], _mm_add_ps( _mm_load_ps( &Y[i] ), _mm_add_ps( _mm_mul_ps( vy, dt4 ), dy4 ) ) );
+		_mm_store_ps( &Z[i], _mm_add_ps( _mm_load_ps( &Z[i] ), _mm_mul_ps( _mm_load_ps( &Vz[i] ), dt4 ) ) );
+		_mm_store_ps( &Vy[i], _mm_add_ps( vy, dv4 ) );
+		__m128 life = _mm_sub_ps( _mm_load_ps( &Life[i] ), dt4 );
+		_mm_store_ps( &Life[i], life );
+
+		int died = _mm_movemask_ps( _mm_cmple_ps( life, zero ) );
+		if( died != 0 )
+		{
+			for( int l = 0; l < 4; l++ )
+			{
+				if( died & ( 1 << l ) )
+					dead[numDead++] = i + l;
+			}
+		}
+	}
+#endif
+
+	for( ; i < end; i++ )
+	{
+		X[i] += Vx[i] * dt;
+		Y[i] += Vy[i] * dt + dy;
+		Z[i] += Vz[i] * dt;
+		Vy[i] += dv;
+		Life[i] -= dt;
+		if( Life[i] <= 0.f )
+			dead[numDead++] = i;
+	}
+
+	DeadCount[c] = numDead;
+}
+
+
+// take every particle dt seconds further, and remove the ones that died:
+
+void
+ParticleSystem::Update( float dt )
+{
+	double t0 = ParticleSeconds( );
+	int count = Count;
+	if( count > 0 )
+	{
+		#pragma omp parallel for schedule(static)
+		for( int c = 0; c < PARTICLE_CHUNKS; c++ )
+			UpdateChunk( c, count, dt );
+
+		// fill each hole with the last particle, from the highest hole down -- the
+		// dead are listed in increasing order, so every particle moved into a hole
+		// is alive, and this costs only as much as the number that died:
+		for( int c = PARTICLE_CHUNKS-1; c >= 0; c-- )
+		{
+			int begin, end;
+			ParticleChunk( count, c, &begin, &end );
+			for( int k = DeadCount[c]-1; k >= 0; k-- )
+			{
+				int hole = Dead[begin + k];
+				Count--;
+				if( hole != Count )
+				{
+					X[hole] = X[Count];
+					Y[hole] = Y[Count];
+					Z[hole] = Z[Count];
+					Vx[hole] = Vx[Count];
+					Vy[hole] = Vy[Count];
+					Vz[hole] = Vz[Count];
+					Life[hole] = Life[Count];
+				}
+			}
+		}
+		Died += count - Count;
+		Updated += count;
+	}
+	Updates++;
+	UpdateSeconds += ParticleSeconds( ) - t0;
+}
+
+
+// interleave chunk c into x, y, z, life's in the mapped buffer -- with sse, four
+// particles are one 4x4 transpose, written past the cache if the buffer is aligned:
+
+void
+ParticleSystem::UploadChunk( int c, float *mapped )
+{
+	int begin, end;
+	ParticleChunk( Count, c, &begin, &end );
+	float *out = &mapped[4*begin];
+	int i = begin;
+
+#ifdef PARTICLES_SSE
+	bool aligned = ( ( (size_t)out & 15 ) == 0 );
+	for( ; i + 4 <= end; i += 4 )
+	{
+		__m128 x = _mm_load_ps( &X[i] );
+		__m128 y = _mm_load_ps( &Y[i] );
+		__m128 z = _mm_load_ps( &Z[i] );
+		__m128 w = _mm_load_ps( &Life[i] );
+		_MM_TRANSPOSE4_PS( x, y, z, w );
+		if( aligned )
+		{
+			_mm_stream_ps( out,    x );
+			_mm_stream_ps( out+4,  y );
+			_mm_stream_ps( out+8,  z );
+			_mm_stream_ps( out+12, w );
+		}
+		else
+		{
+			_mm_storeu_ps( out,    x );
+			_mm_storeu_ps( out+4,  y );
+			_mm_storeu_ps( out+8,  z );
+			_mm_storeu_ps( out+12, w );
+		}
+		out += 16;
+	}
+	_mm_sfence( );
+#endif
+
+	for( ; i < end; i++ )
+	{
+		out[0] = X[i];
+		out[1] = Y[i];
+		out[2] = Z[i];
+		out[3] = Life[i];
+		out += 4;
+	}
+}
+
+
+// stream the particles into the vertex buffer for Draw( ):
+
+void
+ParticleSystem::Upload( )
+{
+	if( Vao == 0 )
+		return;
+
+	double t0 = ParticleSeconds( );
+	Uploaded = 0;
+	if( Count > 0 )
+	{
+		glBindBuffer( GL_ARRAY_BUFFER, Buffer );
+		float *mapped = (float *)glMapBufferRange( GL_ARRAY_BUFFER, 0, (GLsizeiptr)Count * 4 * sizeof(float),
+						GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+		if( mapped != NULL )
+		{
+			#pragma omp parallel for schedule(static)
+			for( int c = 0; c < PARTICLE_CHUNKS; c++ )
+				UploadChunk( c, mapped );
+			if( glUnmapBuffer( GL_ARRAY_BUFFER ) )
+				Uploaded = Count;
+		}
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	}
+	UploadSeconds += ParticleSeconds( ) - t0;
+}
+
+
+// draw what was last uploaded, in the coordinates of modelview, with the sprite tex
+// (0 = none). pointSize is a particle's size in those coordinates, and the projection
+// is the current ShaderState's:
+
+void
+ParticleSystem::Draw( GLuint tex, const float *modelview, float pointSize )
+{
+	if( Program == NULL  ||  Uploaded == 0 )
+		return;
+
+	GLint activeUnit;
+	glGetIntegerv( GL_ACTIVE_TEXTURE, &activeUnit );
+	glActiveTexture( GL_TEXTURE0 + PARTICLE_TEXTURE_UNIT );
+	glBindTexture( GL_TEXTURE_2D, tex );
+	glActiveTexture( activeUnit );
+
+	GLuint previous = GLSLProgram::GetCurrentProgram( );
+	Program->Use( );
+	Program->SetUniformMatrix4( (char *)"uModelView", modelview );
+	Program->SetUniformVariable( (char *)"uPointSize", pointSize );
+	Program->SetUniformVariable( (char *)"uLifeMax", LifeMax );
+	Program->SetUniformVariable( (char *)"uTexUnit", PARTICLE_TEXTURE_UNIT );
+	Program->SetUniformVariable( (char *)"uTexMix", tex != 0 ? 1.f : 0.f );
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+		state->Flush( );
+
+	glPushAttrib( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT );
+	glEnable( GL_DEPTH_TEST );
+	glDepthMask( GL_FALSE );
+	glEnable( GL_BLEND );
+	glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+	glBindVertexArray( Vao );
+	glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, PARTICLE_CORNERS, Uploaded );
+	glBindVertexArray( 0 );
+	glPopAttrib( );
+
+	Program->Use( previous );
+	Draws++;
+}
+
+
+void
+ParticleSystem::PrintStats( )
+{
+	if( Updates == 0 )
+		return;
+	double frames = (double)Updates;
+	fprintf( stderr, "Particles, %d of %d: %6.2f ms/frame emitting, %6.2f updating", Count, Capacity,
+		1000. * EmitSeconds / frames, 1000. * UpdateSeconds / frames );
+	if( UpdateSeconds > 0. )
+		fprintf( stderr, " (%.1f Mparticles/s)", Updated / UpdateSeconds / 1000000. );
+	fprintf( stderr, ", %6.2f uploading; %.0f emitted, %.0f died per frame\n",
+		1000. * UploadSeconds / frames, Emitted / frames, Died / frames );
+}
+
+
+void
+ParticleSystem::ResetStats( )
+{
+	Updates = 0;
+	Updated = Emitted = Died = 0.;
+	EmitSeconds = UpdateSeconds = UploadSeconds = 0.;
+	Draws = 0;
+}
+
+
+//#define TEST
+#if defined(TEST)  &&  ! defined(GPUPARTICLES_CPP)		// gpuparticles.cpp's test has its own main
+
+// a headless test, run from FinalProject/: the particles fly out of Starship.obj's
+// triangles. first a few that never die are checked against the closed form of the
+// ballistic curve after a second and a half of 60 Hz steps, then the pool is filled
+// and updated at 100 thousand to 10 million particles, on 1 thread and then up to
+// all of them, and finally a million are uploaded and drawn, to count what reaches
+// the screen. the context comes from HeadlessContext
+
+#undef TEST		// so the files included below leave their own tests out
+
+#include "headless.cpp"
+#include "glslprogram.cpp"
+#include "shaderstate.cpp"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#define CHECKED		1000
+#define STEPS		90
+#define WIDTH		256
+#define HEIGHT		256
+
+void
+SetMaterial( float, float, float, float )	// the test sets no materials
+{
+}
+
+void
+Cross( float v1[3], float v2[3], float vout[3] )
+{
+	float tmp[3];
+	tmp[0] = v1[1]*v2[2] - v2[1]*v1[2];
+	tmp[1] = v2[0]*v1[2] - v1[0]*v2[2];
+	tmp[2] = v1[0]*v2[1] - v2[0]*v1[1];
+	vout[0] = tmp[0];
+	vout[1] = tmp[1];
+	vout[2] = tmp[2];
+}
+
+float
+Unit( float vin[3], float vout[3] )
+{
+	float dist = sqrtf( vin[0]*vin[0] + vin[1]*vin[1] + vin[2]*vin[2] );
+	if( dist > 0. )
+	{
+		vout[0] = vin[0] / dist;
+		vout[1] = vin[1] / dist;
+		vout[2] = vin[2] / dist;
+	}
+	return dist;
+}
+
+int
+main( int argc, char *argv[ ] )
+{
+	ParticleSystem particles;
+
+	// exactly on the curve:
+	particles.Init( CHECKED, NULL );
+	if( ! particles.SetEmitter( (char *)"Starship.obj" ) )
+		return 1;
+	particles.SetBallistics( 30.f, -0.075f );
+	particles.SetLife( 1000.f, 1000.f );
+	particles.Emit( CHECKED );
+	ParticleSystem start;
+	start.Init( CHECKED, NULL );
+	start.SetEmitter( (char *)"Starship.obj" );
+	start.SetBallistics( 30.f, -0.075f );
+	start.SetLife( 1000.f, 1000.f );
+	start.Emit( CHECKED );		// the same seed, so the same particles, for their starting points
+	for( int s = 0; s < STEPS; s++ )
+		particles.Update( 1.f / 60.f );
+	float t = (float)STEPS / 60.f;
+	double worst = 0.;
+	for( int i = 0; i < CHECKED; i++ )
+	{
+		float p0[3], v0[3], p[3], v[3];
+		start.GetParticle( i, p0, v0 );
+		particles.GetParticle( i, p, v );
+		double curve[3] = { p0[0] + v0[0]*t,  p0[1] + v0[1]*t + 0.5 * -0.075 * t*t,  p0[2] + v0[2]*t };
+		double dist = sqrt( ( curve[0] - p[0] ) * ( curve[0] - p[0] ) + ( curve[1] - p[1] ) * ( curve[1] - p[1] )
+			+ ( curve[2] - p[2] ) * ( curve[2] - p[2] ) );
+		double travel = sqrt( (double)v0[0]*v0[0] + (double)v0[1]*v0[1] + (double)v0[2]*v0[2] ) * t;
+		double error = dist / ( travel + 1. );
+		if( error > worst )
+			worst = error;
+	}
+	fprintf( stderr, "%d particles after %d steps: worst distance from the curve %.2g of how far they went\n", CHECKED, STEPS, worst );
+
+	// the throughput, at a steady state -- the particles live a quarter of a second to
+	// a second and a quarter, so every frame a few percent die and are emitted again:
+	int maxThreads = 1;
+#ifdef _OPENMP
+	maxThreads = omp_get_num_procs( );
+#endif
+	int sizes[ ] = { 100000, 1000000, 10000000 };
+	for( int n = 0; n < 3; n++ )
+	{
+		particles.Init( sizes[n], NULL );
+		particles.SetEmitter( (char *)"Starship.obj" );
+		particles.SetLife( 0.25f, 1.25f );
+		for( int threads = 1; threads <= maxThreads; threads *= 2 )
+		{
+#ifdef _OPENMP
+			omp_set_num_threads( threads );
+#endif
+			particles.SetSeed( 1 );
+			particles.Clear( );
+			particles.Emit( sizes[n] );
+			particles.ResetStats( );
+			for( int frame = 0; frame < 60; frame++ )
+			{
+				particles.Update( 1.f / 60.f );
+				particles.Emit( sizes[n] );		// refill what died
+			}
+			fprintf( stderr, "%8d particles, %2d thread%s: ", sizes[n], threads, threads == 1 ? " " : "s" );
+			particles.PrintStats( );
+			if( threads < maxThreads  &&  threads * 2 > maxThreads )
+				threads = maxThreads / 2;
+		}
+	}
+	particles.Destroy( );
+	start.Destroy( );
+
+	// uploaded and drawn, into the context's framebuffer:
+	HeadlessContext headless;
+	if( ! headless.Init( WIDTH, HEIGHT ) )
+		return 1;
+
+	GLSLProgram program;
+	program.Init( );
+	program.Create( (char *)"particle.vert", (char *)"particle.frag" );
+	ShaderState state;
+	state.Init( );
+	state.MakeCurrent( );
+	state.Bind( &program );
+	glm::mat4 projection = glm::perspective( glm::radians( 70.f ), 1.f, 0.1f, 1000.f );
+	state.BeginFrame( glm::value_ptr( projection ) );
+	// the ship is 11.5 units long, along z:
+	glm::mat4 modelview = glm::lookAt( glm::vec3( 20.f, 0.f, 6.f ), glm::vec3( 0.f, 0.f, 6.f ), glm::vec3( 0.f, 0.f, 1.f ) );
+
+	if( ! particles.Init( 1000000, &program ) )
+		return 1;
+	particles.SetEmitter( (char *)"Starship.obj" );
+	particles.SetLife( 0.5f, 2.5f );
+	particles.Emit( 1000000 );
+	particles.ResetStats( );
+	glClearColor( 0.f, 0.f, 0.f, 1.f );
+	double t0 = ParticleSeconds( );
+	for( int frame = 0; frame < 30; frame++ )
+	{
+		particles.Update( 1.f / 60.f );
+		particles.Emit( 1000000 );
+		particles.Upload( );
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+		particles.Draw( 0, glm::value_ptr( modelview ), 0.05f );
+	}
+	glFinish( );
+	double ms = 1000. * ( ParticleSeconds( ) - t0 ) / 30.;
+	unsigned char *pixels = new unsigned char[ 4*WIDTH*HEIGHT ];
+	glReadPixels( 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+	int lit = 0;
+	for( int p = 0; p < WIDTH*HEIGHT; p++ )
+	{
+		if( pixels[4*p] > 0 )
+			lit++;
+	}
+	fprintf( stderr, "drawn: %d of %d pixels lit, %7.2f ms/frame with glFinish( ) -- ", lit, WIDTH*HEIGHT, ms );
+	particles.PrintStats( );
+	delete [ ] pixels;
+	return 0;
+}
+
+#endif
+
+// EXPECTED_RESULTS (g++ -O1 -fopenmp -DTEST -I.. ../particles.cpp -lGLEW -lEGL -lGL -lGLU, on mesa's llvmpipe, software rendering, one core):
+//
+//	1000 particles after 90 steps: worst distance from the curve 3.7e-05 of how far they went
+//	  100000 particles,  1 thread : Particles, 100000 of 100000:   0.19 ms/frame emitting,   0.26 updating (386.5 Mparticles/s),   0.00 uploading; 1453 emitted, 1453 died per frame
+//	 1000000 particles,  1 thread : Particles, 1000000 of 1000000:   1.69 ms/frame emitting,   4.02 updating (248.6 Mparticles/s),   0.00 uploading; 14538 emitted, 14538 died per frame
+//	10000000 particles,  1 thread : Particles, 10000000 of 10000000:  19.19 ms/frame emitting,  48.87 updating (204.6 Mparticles/s),   0.00 uploading; 145479 emitted, 145479 died per frame
+//	drawn: 11235 of 65536 pixels lit, 1347.73 ms/frame with glFinish( ) -- Particles, 1000000 of 1000000:   0.00 ms/frame emitting,   2.20 updating (454.1 Mparticles/s),   2.12 uploading; 0 emitted, 0 died per frame
+//
+// (the update is bound by memory past the caches -- 28 bytes read and written a
+// particle -- so the rate falls once the pool outgrows them. on more cores the table
+// goes on with 2, 4, ... threads. emitting is serial, and costs about a third of the
+// update at this turnover. drawing a million billboards is all of the frame on a
+// software renderer)
+
+#endif		// #ifndef PARTICLES_CPP
@@ -0,0 +1,115 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "shaderstate.h"
+
+
+// a particle system on the cpu -- the explosion, as sparks flying out of the
+// triangles of a mesh
+//
+// it is explosion.geom's ballistic model, a particle at a time: a particle starts at
+// a random point p0 on one of the emitter's triangles (picked by area), with the
+// velocity that point has when the triangle flies apart about its own center,
+//
+//	v0 = velScale * ( p0 - center )
+//
+// and then falls with gravity along y -- p( t ) = p0 + v0 t + 1/2 ( 0, gravity, 0 ) t^2.
+// Update( dt ) takes every particle dt further along that curve (exactly -- the
+// acceleration is constant, so the step is the closed form), and takes dt off of its
+// life. a particle whose life runs out is removed by moving the last particle into
+// its place, so the live ones are always the first NumParticles( )
+//
+// the particles are kept as separate arrays of x, y, z, vx, vy, vz, and life, all
+// allocated once by Init( ) for the most particles there will ever be, so a frame
+// allocates nothing. Update( ) runs 4 particles at a time with sse, in
+// PARTICLE_CHUNKS chunks spread over the openmp threads, and Upload( ) streams
+// x, y, z, life into a vertex buffer mapped for writing (the old contents orphaned,
+// so it never waits on the draw that is still reading them), which Draw( ) draws
+// as billboards with particle.vert and particle.frag -- one instance of a 4-vertex
+// triangle strip a particle:
+//
+//	in vec4			aParticle;	// x, y, z, and the life left in w, at PARTICLE_ATTRIB
+//	uniform mat4		uModelView;	// the emitter's -- particles are in its coordinates
+//	uniform float		uPointSize;	// a particle's size, in the same coordinates
+//	uniform float		uLifeMax;	// the longest life, for the color ramp
+//	uniform sampler2D	uTexUnit;	// a sprite, on PARTICLE_TEXTURE_UNIT
+//	uniform float		uTexMix;	// 0. = no sprite, a soft round spot instead
+//
+// drawn additively, depth-tested against the scene but not writing depth, so they
+// need no sorting. (gpuparticles.h's particles are drawn the same way)
+
+#define PARTICLE_CHUNKS		64		// Update( )'s and Upload( )'s units of work
+#define PARTICLE_ATTRIB		1
+#define PARTICLE_TEXTURE_UNIT	1
+#define PARTICLE_CORNERS	4		// a billboard's triangle strip
+
+
+class ParticleSystem
+{
+  private:
+	float *		X;		// the pool, each array Capacity floats, 16-byte aligned
+	float *		Y;
+	float *		Z;
+	float *		Vx;
+	float *		Vy;
+	float *		Vz;
+	float *		Life;
+	int *		Dead;		// the indices Update( ) found dead, by chunk
+	int		DeadCount[PARTICLE_CHUNKS];
+	int		Capacity;
+	int		Count;
+	std::vector<float>	Triangles;	// the emitter, 9 floats a triangle
+	std::vector<float>	Areas;		// ... and its running total of their areas
+	unsigned int	Seed;
+	float		VelScale;
+	float		Gravity;
+	float		LifeMin, LifeMax;
+	GLSLProgram *	Program;	// NULL = simulate only
+	GLuint		Vao;
+	GLuint		Buffer;		// Capacity x, y, z, life's
+	int		Uploaded;	// particles in it
+
+	float		Random( );
+	void		UpdateChunk( int, int, float );
+	void		UploadChunk( int, float * );
+
+  public:
+	// statistics, since ResetStats( ):
+	int		Updates;
+	double		Updated;		// particles moved, over all the Update( )s
+	double		Emitted;
+	double		Died;
+	double		EmitSeconds;
+	double		UpdateSeconds;
+	double		UploadSeconds;
+	int		Draws;
+
+		ParticleSystem( );
+
+	void	Clear( );
+	void	Destroy( );
+	void	Draw( GLuint, const float *, float );
+	int	Emit( int );
+	void	GetParticle( int, float *, float * );
+	bool	Init( int, GLSLProgram * );
+	bool	IsValid( );
+	int	NumParticles( );
+	void	PrintStats( );
+	void	ResetStats( );
+	void	SetBallistics( float, float );
+	bool	SetEmitter( char * );
+	bool	SetEmitter( const float *, int );
+	void	SetLife( float, float );
+	void	SetSeed( unsigned int );
+	void	Update( float );
+	void	Upload( );
+};
+
+#endif		// #ifndef PARTICLES_H
@@ -0,0 +1,576 @@
+#ifndef PROBE_CPP
+#define PROBE_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "probe.h"
+
+
+// where each face looks, and which way is up in it -- the cube map's own
+// orientation, +x, -x, +y, -y, +z, -z:
+
+static const float ProbeDirs[PROBE_FACES][3] =
+{
+	{  1.f,  0.f,  0.f },
+	{ -1.f,  0.f,  0.f },
+	{  0.f,  1.f,  0.f },
+	{  0.f, -1.f,  0.f },
+	{  0.f,  0.f,  1.f },
+	{  0.f,  0.f, -1.f }
+};
+
+static const float ProbeUps[PROBE_FACES][3] =
+{
+	{  0.f, -1.f,  0.f },
+	{  0.f, -1.f,  0.f },
+	{  0.f,  0.f,  1.f },
+	{  0.f,  0.f, -1.f },
+	{  0.f, -1.f,  0.f },
+	{  0.f, -1.f,  0.f }
+};
+
+
+ReflectionProbe::ReflectionProbe( )
+{
+	CubeTex = DepthRb = Fbo = 0;
+	TimeQueries[0] = TimeQueries[1] = 0;
+	QueryPending[0] = QueryPending[1] = false;
+	QueryIndex = 0;
+	Size = 0;
+	FacesPerFrame = 1;
+	Frame = 0;
+	NumFaces = 0;
+	SavedFbo = 0;
+	StartTime = 0.;
+	for( int f = 0; f < PROBE_FACES; f++ )
+		FaceFrame[f] = -1;
+	ResetStats( );
+}
+
+
+// a size x size cube map, rendering facesPerFrame of its faces a frame -- returns
+// false if the framebuffer can't be made:
+
+bool
+ReflectionProbe::Init( int size, int facesPerFrame )
+{
+	Destroy( );
+	Size = size;
+	SetFacesPerFrame( facesPerFrame );
+
+	glGenTextures( 1, &CubeTex );
+	glBindTexture( GL_TEXTURE_CUBE_MAP, CubeTex );
+	glTexStorage2D( GL_TEXTURE_CUBE_MAP, 1, GL_RGBA8, Size, Size );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+	glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
+
+	glGenRenderbuffers( 1, &DepthRb );
+	glBindRenderbuffer( GL_RENDERBUFFER, DepthRb );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Size, Size );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	// every face starts out black, until it is first rendered:
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &SavedFbo );
+	glGenFramebuffers( 1, &Fbo );
+	glBindFramebuffer( GL_FRAMEBUFFER, Fbo );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, DepthRb );
+	static const float black[4] = { 0.f, 0.f, 0.f, 1.f };
+	GLenum status = GL_FRAMEBUFFER_COMPLETE;
+	for( int f = 0; f < PROBE_FACES  &&  status == GL_FRAMEBUFFER_COMPLETE; f++ )
+	{
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, CubeTex, 0 );
+		status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+		if( status == GL_FRAMEBUFFER_COMPLETE )
+			glClearBufferfv( GL_COLOR, 0, black );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		fprintf( stderr, "ReflectionProbe: the probe framebuffer is incomplete (0x%x)\n", status );
+		Destroy( );
+		return false;
+	}
+
+	// without timer queries, only the cpu time is reported:
+	if( GLEW_ARB_timer_query )
+		glGenQueries( 2, TimeQueries );
+
+	// a 90 degree square frustum, like gluPerspective( 90., 1., PROBE_NEAR, PROBE_FAR ):
+	memset( Projection, 0, sizeof(Projection) );
+	Projection[0] = 1.f;
+	Projection[5] = 1.f;
+	Projection[10] = -( PROBE_FAR + PROBE_NEAR ) / ( PROBE_FAR - PROBE_NEAR );
+	Projection[11] = -1.f;
+	Projection[14] = -2.f * PROBE_FAR * PROBE_NEAR / ( PROBE_FAR - PROBE_NEAR );
+
+	Frame = 0;
+	for( int f = 0; f < PROBE_FACES; f++ )
+		FaceFrame[f] = -1;
+	return true;
+}
+
+
+bool
+ReflectionProbe::IsValid( )
+{
+	return Fbo != 0;
+}
+
+
+void
+ReflectionProbe::Destroy( )
+{
+	if( Fbo != 0 )
+		glDeleteFramebuffers( 1, &Fbo );
+	if( DepthRb != 0 )
+		glDeleteRenderbuffers( 1, &DepthRb );
+	if( CubeTex != 0 )
+		glDeleteTextures( 1, &CubeTex );
+	if( TimeQueries[0] != 0 )
+		glDeleteQueries( 2, TimeQueries );
+	CubeTex = DepthRb = Fbo = 0;
+	TimeQueries[0] = TimeQueries[1] = 0;
+	QueryPending[0] = QueryPending[1] = false;
+	Size = 0;
+}
+
+
+int
+ReflectionProbe::GetFacesPerFrame( )
+{
+	return FacesPerFrame;
+}
+
+
+// 1 to PROBE_FACES -- PROBE_FACES renders the whole cube every frame:
+
+void
+ReflectionProbe::SetFacesPerFrame( int faces )
+{
+	if( faces < 1 )
+		faces = 1;
+	if( faces > PROBE_FACES )
+		faces = PROBE_FACES;
+	FacesPerFrame = faces;
+}
+
+
+int
+ReflectionProbe::GetSize( )
+{
+	return Size;
+}
+
+
+GLuint
+ReflectionProbe::GetTexture( )
+{
+	return CubeTex;
+}
+
+
+// start this frame's faces, from center -- returns how many there are, to
+// go through with BeginFace( 0 ) ... BeginFace( n-1 ):
+
+int
+ReflectionProbe::Begin( const float *center )
+{
+	NumFaces = 0;
+	if( ! IsValid( ) )
+		return 0;
+
+	StartTime = omp_get_wtime( );
+	Frame++;
+	memcpy( Center, center, sizeof(Center) );
+
+	// the query used two frames ago is (almost always) done by now:
+	if( QueryPending[QueryIndex] )
+	{
+		GLuint available = 0;
+		glGetQueryObjectuiv( TimeQueries[QueryIndex], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( available )
+		{
+			GLuint64 ns;
+			glGetQueryObjectui64v( TimeQueries[QueryIndex], GL_QUERY_RESULT, &ns );
+			GpuSeconds += (double)ns / 1.e9;
+			GpuFrames++;
+		}
+		QueryPending[QueryIndex] = false;
+	}
+
+	// the faces rendered longest ago, the ones never rendered first -- a stable
+	// choice, so with equal ages they go round in order:
+	bool chosen[PROBE_FACES] = { false };
+	for( int n = 0; n < FacesPerFrame; n++ )
+	{
+		int oldest = -1;
+		for( int f = 0; f < PROBE_FACES; f++ )
+		{
+			if( ! chosen[f]  &&  ( oldest < 0  ||  FaceFrame[f] < FaceFrame[oldest] ) )
+				oldest = f;
+		}
+		chosen[oldest] = true;
+		Faces[NumFaces++] = oldest;
+	}
+
+	// how stale the cube the next frames look up will be:
+	for( int f = 0; f < PROBE_FACES; f++ )
+	{
+		if( chosen[f] )
+			continue;
+		int age = FaceFrame[f] < 0 ? Frame : Frame - FaceFrame[f];
+		if( age > StalestFrames )
+			StalestFrames = age;
+		if( FaceFrame[f] >= 0 )
+		{
+			float dx = Center[0] - FaceCenter[f][0];
+			float dy = Center[1] - FaceCenter[f][1];
+			float dz = Center[2] - FaceCenter[f][2];
+			float distance = sqrtf( dx*dx + dy*dy + dz*dz );
+			if( distance > StalestDistance )
+				StalestDistance = distance;
+		}
+	}
+
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &SavedFbo );
+	glGetIntegerv( GL_VIEWPORT, SavedViewport );
+	glBindFramebuffer( GL_FRAMEBUFFER, Fbo );
+	glViewport( 0, 0, Size, Size );
+
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix( );
+	glLoadMatrixf( Projection );
+	glMatrixMode( GL_MODELVIEW );
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+		state->BeginFrame( Projection );
+
+	if( TimeQueries[0] != 0 )
+		glBeginQuery( GL_TIME_ELAPSED, TimeQueries[QueryIndex] );
+	return NumFaces;
+}
+
+
+// render into this frame's i'th face next -- view gets the viewing transformation
+// out of the center through it:
+
+void
+ReflectionProbe::BeginFace( int i, float *view )
+{
+	int face = Faces[i];
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, CubeTex, 0 );
+	static const float black[4] = { 0.f, 0.f, 0.f, 1.f };	// (leaving the clear color alone)
+	glClearBufferfv( GL_COLOR, 0, black );
+	glClear( GL_DEPTH_BUFFER_BIT );
+
+	// like gluLookAt( center, center + dir, up ) -- the rows are side, up, and back:
+	const float *f = ProbeDirs[face];
+	const float *up = ProbeUps[face];
+	float s[3] = { f[1]*up[2] - f[2]*up[1],  f[2]*up[0] - f[0]*up[2],  f[0]*up[1] - f[1]*up[0] };
+	float u[3] = { s[1]*f[2] - s[2]*f[1],  s[2]*f[0] - s[0]*f[2],  s[0]*f[1] - s[1]*f[0] };
+	const float *c = Center;
+	for( int k = 0; k < 3; k++ )
+	{
+		view[4*k+0] =  s[k];
+		view[4*k+1] =  u[k];
+		view[4*k+2] = -f[k];
+		view[4*k+3] =  0.f;
+	}
+	view[12] = -( s[0]*c[0] + s[1]*c[1] + s[2]*c[2] );
+	view[13] = -( u[0]*c[0] + u[1]*c[1] + u[2]*c[2] );
+	view[14] =  ( f[0]*c[0] + f[1]*c[1] + f[2]*c[2] );
+	view[15] = 1.f;
+
+	FaceFrame[face] = Frame;
+	memcpy( FaceCenter[face], Center, sizeof(Center) );
+}
+
+
+void
+ReflectionProbe::EndFace( )
+{
+	FacesRendered++;
+}
+
+
+// put back what Begin( ) changed, but for the ShaderState's projection:
+
+void
+ReflectionProbe::End( )
+{
+	if( NumFaces == 0 )
+		return;
+
+	if( TimeQueries[0] != 0 )
+	{
+		glEndQuery( GL_TIME_ELAPSED );
+		QueryPending[QueryIndex] = true;
+		QueryIndex = 1 - QueryIndex;
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+	glViewport( SavedViewport[0], SavedViewport[1], SavedViewport[2], SavedViewport[3] );
+	glMatrixMode( GL_PROJECTION );
+	glPopMatrix( );
+	glMatrixMode( GL_MODELVIEW );
+
+	CpuSeconds += omp_get_wtime( ) - StartTime;
+	Frames++;
+}
+
+
+void
+ReflectionProbe::PrintStats( )
+{
+	if( Frames == 0 )
+		return;
+	fprintf( stderr, "Reflection probe, %d x %d, %d face%s a frame: %.2f faces/frame, %6.2f ms/frame cpu",
+		Size, Size, FacesPerFrame, FacesPerFrame == 1 ? "" : "s", (double)FacesRendered / (double)Frames,
+		1000. * CpuSeconds / (double)Frames );
+	if( GpuFrames > 0 )
+		fprintf( stderr, ", %6.2f ms/frame gpu", 1000. * GpuSeconds / (double)GpuFrames );
+	fprintf( stderr, "; stalest face %d frames old, %.2f units away\n", StalestFrames, StalestDistance );
+}
+
+
+void
+ReflectionProbe::ResetStats( )
+{
+	Frames = 0;
+	FacesRendered = 0;
+	CpuSeconds = GpuSeconds = 0.;
+	GpuFrames = 0;
+	StalestFrames = 0;
+	StalestDistance = 0.f;
+}
+
+
+//#define TEST
+#ifdef TEST
+
+// a headless test: the probe is first rendered seeing only a sky whose faces are
+// each split into four solid quadrants of their own colors -- every face of the probe
+// has to come out the same as the sky's, texel for texel, or the faces' views are
+// wrong. then a ring of spheres is added, the probe moves through it, and it is
+// rendered with 1, 2, and all 6 faces a frame, for the cost and the staleness.
+// there is no window -- the context comes from HeadlessContext
+
+#undef TEST		// so the files included below leave their own tests out
+
+
+void	Cross( float [3], float [3], float [3] );
+float	Unit( float [3], float [3] );
+
+#include "headless.cpp"
+#include "glslprogram.cpp"
+#include "osusphere.cpp"
+#include "hiz.cpp"
+#include "skybox.cpp"
+#include "instancemesh.cpp"
+#include "drawarena.cpp"
+#include "renderqueue.cpp"
+#include "shaderstate.cpp"
+
+#define SKYSIZE		64
+#define NUMSPHERES	32
+#define NUMFRAMES	60
+
+void
+SetMaterial( float, float, float, float )	// the test sets no materials
+{
+}
+
+void
+Cross( float v1[3], float v2[3], float vout[3] )
+{
+	float tmp[3];
+	tmp[0] = v1[1]*v2[2] - v2[1]*v1[2];
+	tmp[1] = v2[0]*v1[2] - v1[0]*v2[2];
+	tmp[2] = v1[0]*v2[1] - v2[0]*v1[1];
+	vout[0] = tmp[0];
+	vout[1] = tmp[1];
+	vout[2] = tmp[2];
+}
+
+float
+Unit( float vin[3], float vout[3] )
+{
+	float dist = sqrtf( vin[0]*vin[0] + vin[1]*vin[1] + vin[2]*vin[2] );
+	if( dist > 0. )
+	{
+		vout[0] = vin[0] / dist;
+		vout[1] = vin[1] / dist;
+		vout[2] = vin[2] / dist;
+	}
+	return dist;
+}
+
+ShaderState	State;
+RenderQueue	Queue;
+Skybox		Sky;
+ReflectionProbe	Probe;
+GLSLProgram	SkyProgram, SphereProgram;
+GLuint		SkyTex, WhiteTex, SphereList;
+UniformBlock	SphereUniforms;
+
+void
+RenderFaces( const float *center, bool spheres )
+{
+	int faces = Probe.Begin( center );
+	for( int i = 0; i < faces; i++ )
+	{
+		float view[16];
+		Probe.BeginFace( i, view );
+		if( spheres )
+		{
+			Queue.Begin( );
+			for( int s = 0; s < NUMSPHERES; s++ )
+			{
+				float ang = 2.f * (float)M_PI * (float)s / (float)NUMSPHERES;
+				float p[3] = { 10.f * cosf( ang ), 2.f * (float)( s % 3 - 1 ), 10.f * sinf( ang ) };
+				float modelview[16];
+				memcpy( modelview, view, sizeof(modelview) );
+				for( int r = 0; r < 3; r++ )
+					modelview[12+r] = view[r]*p[0] + view[4+r]*p[1] + view[8+r]*p[2] + view[12+r];
+				int draw = Queue.Submit( &SphereProgram, &SphereUniforms, SphereList, modelview );
+				Queue.Texture( draw, 1, GL_TEXTURE_2D, WhiteTex );
+			}
+			Queue.Execute( );
+		}
+		Sky.Draw( SkyTex, view );
+		Probe.EndFace( );
+	}
+	Probe.End( );
+}
+
+int
+main( int argc, char *argv[ ] )
+{
+	// (the probe draws into its own framebuffer -- the context's is only there to come back to)
+	HeadlessContext headless;
+	if( ! headless.Init( SKYSIZE, SKYSIZE ) )
+		return 1;
+	glEnable( GL_DEPTH_TEST );
+
+	// the sky: face f's quadrants are ( 30*f + 30*q, 255 - 30*f, 60*q ), q = 0 to 3:
+	unsigned char *texels = new unsigned char[ 4*SKYSIZE*SKYSIZE ];
+	glGenTextures( 1, &SkyTex );
+	glBindTexture( GL_TEXTURE_CUBE_MAP, SkyTex );
+	for( int f = 0; f < PROBE_FACES; f++ )
+	{
+		for( int t = 0; t < SKYSIZE; t++ )
+		{
+			for( int s = 0; s < SKYSIZE; s++ )
+			{
+				int q = ( s < SKYSIZE/2 ? 0 : 1 ) + ( t < SKYSIZE/2 ? 0 : 2 );
+				unsigned char *texel = &texels[ 4*( t*SKYSIZE + s ) ];
+				texel[0] = 30*f + 30*q;
+				texel[1] = 255 - 30*f;
+				texel[2] = 60*q;
+				texel[3] = 255;
+			}
+		}
+		glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_RGBA8, SKYSIZE, SKYSIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels );
+	}
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+	unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures( 1, &WhiteTex );
+	glBindTexture( GL_TEXTURE_2D, WhiteTex );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+
+	SkyProgram.Init( );
+	SphereProgram.Init( );
+	SkyProgram.Create( (char *)"skybox.vert", (char *)"skybox.frag" );
+	SphereProgram.Create( (char *)"earth.vert", (char *)"earth.frag" );
+	State.Init( );
+	State.MakeCurrent( );
+	State.Bind( &SkyProgram );
+	State.Bind( &SphereProgram );
+	Sky.Init( &SkyProgram );
+	SphereUniforms.Set( (char *)"uTexUnit1", 1 );
+
+	SphereList = glGenLists( 1 );
+	glNewList( SphereList, GL_COMPILE );
+		OsuSphere( 1., 64, 64 );
+	glEndList( );
+	float bounds[6] = { -1.f, -1.f, -1.f,   1.f, 1.f, 1.f };
+	Queue.SetBounds( SphereList, bounds );
+
+	if( ! Probe.Init( SKYSIZE, PROBE_FACES ) )
+		return 1;
+
+	// the sky alone, seen from anywhere, is the sky:
+	float center[3] = { 3.f, -2.f, 1.f };
+	RenderFaces( center, false );
+	int wrong = 0;
+	glBindTexture( GL_TEXTURE_CUBE_MAP, Probe.GetTexture( ) );
+	for( int f = 0; f < PROBE_FACES; f++ )
+	{
+		unsigned char *probed = new unsigned char[ 4*SKYSIZE*SKYSIZE ];
+		glGetTexImage( GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_RGBA, GL_UNSIGNED_BYTE, probed );
+		for( int t = 0; t < SKYSIZE; t++ )
+		{
+			for( int s = 0; s < SKYSIZE; s++ )
+			{
+				int q = ( s < SKYSIZE/2 ? 0 : 1 ) + ( t < SKYSIZE/2 ? 0 : 2 );
+				unsigned char *texel = &probed[ 4*( t*SKYSIZE + s ) ];
+				if( texel[0] != 30*f + 30*q  ||  texel[1] != 255 - 30*f  ||  texel[2] != 60*q )
+					wrong++;
+			}
+		}
+		delete [ ] probed;
+	}
+	fprintf( stderr, "sky alone: %d of %d texels differ from the sky's\n", wrong, PROBE_FACES*SKYSIZE*SKYSIZE );
+
+	// moving through the ring of spheres, with each budget:
+	for( int faces = 1; faces <= PROBE_FACES; faces++ )
+	{
+		if( faces != 1  &&  faces != 2  &&  faces != PROBE_FACES )
+			continue;
+		// (a full round of the faces first, so every one starts out on the path)
+		Probe.SetFacesPerFrame( faces );
+		double t0 = 0.;
+		for( int frame = -PROBE_FACES; frame < NUMFRAMES; frame++ )
+		{
+			if( frame == 0 )
+			{
+				glFinish( );
+				Probe.ResetStats( );
+				t0 = omp_get_wtime( );
+			}
+			center[0] = -3.f + 6.f * (float)frame / (float)NUMFRAMES;
+			center[1] = 0.f;
+			center[2] = 0.f;
+			RenderFaces( center, true );
+		}
+		glFinish( );
+		double ms = 1000. * ( omp_get_wtime( ) - t0 ) / (double)NUMFRAMES;
+		fprintf( stderr, "%d face%s a frame: %7.2f ms/frame with glFinish( ) -- ", faces, faces == 1 ? " " : "s", ms );
+		Probe.PrintStats( );
+	}
+	return 0;
+}
+
+#endif
+
+// EXPECTED_RESULTS (g++ -O1 -fopenmp -DTEST -I.. ../probe.cpp -lGLEW -lEGL -lGL -lGLU, on mesa's llvmpipe, software rendering):
+//
+//	sky alone: 0 of 24576 texels differ from the sky's
+//	1 face  a frame:   11.12 ms/frame with glFinish( ) -- Reflection probe, 64 x 64, 1 face a frame: 1.00 faces/frame,  11.06 ms/frame cpu,  11.13 ms/frame gpu; stalest face 5 frames old, 0.50 units away
+//	2 faces a frame:   24.53 ms/frame with glFinish( ) -- Reflection probe, 64 x 64, 2 faces a frame: 2.00 faces/frame,  24.46 ms/frame cpu,  24.35 ms/frame gpu; stalest face 2 frames old, 0.20 units away
+//	6 faces a frame:   71.61 ms/frame with glFinish( ) -- Reflection probe, 64 x 64, 6 faces a frame: 6.00 faces/frame,  71.55 ms/frame cpu,  72.84 ms/frame gpu; stalest face 0 frames old, 0.00 units away
+//
+// (the cost goes up with the faces a frame, and the staleness down -- on a software
+// renderer the cpu and gpu times are the same time)
+
+#endif		// #ifndef PROBE_CPP
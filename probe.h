@@ -0,0 +1,85 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdio.h>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "shaderstate.h"
+
+
+// a reflection probe -- a cube map rendered from one point in the scene
+//
+// the six faces are rendered a few at a time: Begin( ) picks this frame's share of
+// them, the ones rendered longest ago first, and then for each of them BeginFace( )
+// points the probe's framebuffer at the face and hands back the viewing
+// transformation out of the probe's center through it, and EndFace( ) finishes it.
+// End( ) puts back the framebuffer, viewport, and projection it found. so however
+// much the scene costs, a frame pays for at most GetFacesPerFrame( ) faces of it,
+// at GetSize( ) x GetSize( ) each, and the reflection is up to 6/faces frames old
+//
+// the center and the viewing transformations are in whatever coordinates the caller
+// looks the cube map up in -- for the rockets that is eye coordinates, so that a
+// face's view is applied on top of the main viewing transformation. the projection
+// is a 90 degree square, loaded into GL_PROJECTION (for the culling) and into the
+// current ShaderState, which keeps it until its next BeginFrame( )
+//
+// staleness is counted two ways: how many frames ago the oldest face was rendered,
+// and how far the center has moved since then
+
+#define PROBE_FACES		6
+#define PROBE_NEAR		0.1f
+#define PROBE_FAR		1000.f
+
+
+class ReflectionProbe
+{
+  private:
+	GLuint		CubeTex;
+	GLuint		DepthRb;
+	GLuint		Fbo;
+	GLuint		TimeQueries[2];		// the gpu time of this frame's faces, and last frame's
+	bool		QueryPending[2];
+	int		QueryIndex;
+	int		Size;
+	int		FacesPerFrame;
+	int		Frame;			// Begin( )s so far
+	int		FaceFrame[PROBE_FACES];	// the frame each face was last rendered, -1 = never
+	float		FaceCenter[PROBE_FACES][3];	// ... and from where
+	int		NumFaces;		// this frame's
+	int		Faces[PROBE_FACES];
+	float		Center[3];
+	float		Projection[16];
+	GLint		SavedFbo;
+	GLint		SavedViewport[4];
+	double		StartTime;
+
+  public:
+	// statistics, since ResetStats( ):
+	int		Frames;			// frames that rendered any faces
+	int		FacesRendered;
+	double		CpuSeconds;		// submitting the faces
+	double		GpuSeconds;		// drawing them, over GpuFrames of the frames
+	int		GpuFrames;
+	int		StalestFrames;		// the most frames any face went unrendered
+	float		StalestDistance;	// the farthest the center got from where a face was rendered
+
+		ReflectionProbe( );
+
+	int	Begin( const float * );
+	void	BeginFace( int, float * );
+	void	Destroy( );
+	void	End( );
+	void	EndFace( );
+	int	GetFacesPerFrame( );
+	int	GetSize( );
+	GLuint	GetTexture( );
+	bool	Init( int, int );
+	bool	IsValid( );
+	void	PrintStats( );
+	void	ResetStats( );
+	void	SetFacesPerFrame( int );
+};
+
+#endif		// #ifndef PROBE_H
@@ -0,0 +1,935 @@
+#ifndef RENDERQUEUE_CPP
+#define RENDERQUEUE_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "renderqueue.h"
+
+void	SetMaterial( float, float, float, float );	// setmaterial.cpp
+
+
+UniformBlock::UniformBlock( )
+{
+	NumUniforms = 0;
+}
+
+
+void
+UniformBlock::Clear( )
+{
+	NumUniforms = 0;
+}
+
+
+// setting a name that is already in the block replaces its value:
+
+struct DrawUniform *
+UniformBlock::Add( char *name, int type )
+{
+	for( int i = 0; i < NumUniforms; i++ )
+	{
+		if( Uniforms[i].name == name  ||  strcmp( Uniforms[i].name, name ) == 0 )
+		{
+			Uniforms[i].type = type;
+			return &Uniforms[i];
+		}
+	}
+
+	if( NumUniforms >= RQ_MAXUNIFORMS )
+	{
+		fprintf( stderr, "UniformBlock: no room for uniform '%s'\n", name );
+		return NULL;
+	}
+
+	struct DrawUniform *u = &Uniforms[NumUniforms++];
+	u->name = name;
+	u->type = type;
+	return u;
+}
+
+
+void
+UniformBlock::Set( char *name, int val )
+{
+	struct DrawUniform *u = Add( name, RQ_INT );
+	if( u != NULL )
+		u->i = val;
+}
+
+
+void
+UniformBlock::Set( char *name, float val )
+{
+	struct DrawUniform *u = Add( name, RQ_FLOAT );
+	if( u != NULL )
+		u->f[0] = val;
+}
+
+
+void
+UniformBlock::Set( char *name, float val0, float val1 )
+{
+	struct DrawUniform *u = Add( name, RQ_FLOAT2 );
+	if( u != NULL )
+	{
+		u->f[0] = val0;
+		u->f[1] = val1;
+	}
+}
+
+
+void
+UniformBlock::Set( char *name, float val0, float val1, float val2 )
+{
+	struct DrawUniform *u = Add( name, RQ_FLOAT3 );
+	if( u != NULL )
+	{
+		u->f[0] = val0;
+		u->f[1] = val1;
+		u->f[2] = val2;
+	}
+}
+
+
+void
+UniformBlock::Apply( GLSLProgram *program )
+{
+	for( int i = 0; i < NumUniforms; i++ )
+	{
+		struct DrawUniform *u = &Uniforms[i];
+		switch( u->type )
+		{
+			case RQ_INT:
+				program->SetUniformVariable( u->name, u->i );
+				break;
+
+			case RQ_FLOAT:
+				program->SetUniformVariable( u->name, u->f[0] );
+				break;
+
+			case RQ_FLOAT2:
+				program->SetUniformVariable( u->name, u->f[0], u->f[1] );
+				break;
+
+			case RQ_FLOAT3:
+				program->SetUniformVariable( u->name, u->f[0], u->f[1], u->f[2] );
+				break;
+		}
+	}
+}
+
+
+RenderQueue::RenderQueue( )
+{
+	Sorting = true;
+	Culling = true;
+	FrontToBack = false;
+	Prepass = false;
+	Occlusion = NULL;
+	Draws = MultiDraws = Instances = Tested = Culled = ProgramSwitches = TextureBinds = UniformUploads = 0;
+	Occluders = Occluded = PrepassDraws = 0;
+	NaiveProgramSwitches = NaiveTextureBinds = 0;
+}
+
+
+// start a new frame's list:
+
+void
+RenderQueue::Begin( )
+{
+	Items.clear( );
+	Programs.clear( );
+	Blocks.clear( );
+}
+
+
+bool
+RenderQueue::GetSorting( )
+{
+	return Sorting;
+}
+
+
+// false executes the draws in the order they were submitted (the state
+// filtering still happens), for comparing the counters:
+
+void
+RenderQueue::SetSorting( bool on )
+{
+	Sorting = on;
+}
+
+
+bool
+RenderQueue::GetCulling( )
+{
+	return Culling;
+}
+
+
+void
+RenderQueue::SetCulling( bool on )
+{
+	Culling = on;
+}
+
+
+bool
+RenderQueue::GetFrontToBack( )
+{
+	return FrontToBack;
+}
+
+
+// true sorts by depth before state (see renderqueue.h) -- fewer fragments
+// shaded without the prepass, at the cost of more state changes:
+
+void
+RenderQueue::SetFrontToBack( bool on )
+{
+	FrontToBack = on;
+}
+
+
+bool
+RenderQueue::GetPrepass( )
+{
+	return Prepass;
+}
+
+
+void
+RenderQueue::SetPrepass( bool on )
+{
+	Prepass = on;
+}
+
+
+// the draws with this program are opaque, and the prepass draws them with depth --
+// or, if depth is NULL, they aren't:
+
+void
+RenderQueue::SetDepthProgram( GLSLProgram *program, GLSLProgram *depth )
+{
+	if( depth != NULL  &&  ! depth->IsValid( ) )
+	{
+		fprintf( stderr, "RenderQueue: the depth program isn't valid -- no prepass for these draws\n" );
+		depth = NULL;
+	}
+	if( depth == NULL )
+		DepthPrograms.erase( program );
+	else
+		DepthPrograms[program] = depth;
+}
+
+
+GLSLProgram *
+RenderQueue::DepthProgramOf( GLSLProgram *program )
+{
+	std::map<GLSLProgram *, GLSLProgram *>::iterator pos = DepthPrograms.find( program );
+	return pos == DepthPrograms.end( ) ? NULL : pos->second;
+}
+
+
+HiZBuffer *
+RenderQueue::GetOcclusion( )
+{
+	return Occlusion;
+}
+
+
+// occlusion cull against this hi-z buffer, or not if NULL -- it only works with
+// culling on, since it is the gpu culling that tests against it:
+
+void
+RenderQueue::SetOcclusion( HiZBuffer *hiz )
+{
+	if( hiz != NULL  &&  ! hiz->IsValid( ) )
+		hiz = NULL;
+	Occlusion = hiz;
+}
+
+
+// the bounding box (xmin, ymin, zmin, xmax, ymax, zmax) of what a display list draws
+// -- draws of a list without one are never culled:
+
+void
+RenderQueue::SetBounds( GLuint list, const float *bounds )
+{
+	if( bounds[0] > bounds[3]  ||  bounds[1] > bounds[4]  ||  bounds[2] > bounds[5] )
+		return;
+
+	struct Sphere s;
+	BoundsToSphere( bounds, &s );
+	ListBounds[list] = s;
+}
+
+
+// add a draw of a display list with a program and (optionally) a uniform block
+// -- the current modelview matrix is captured with it, so set up the object's
+// transformation first. returns the draw's index for Texture( ) and Material( ):
+
+int
+RenderQueue::Submit( GLSLProgram *program, UniformBlock *uniforms, GLuint list )
+{
+	float modelview[16];
+	glGetFloatv( GL_MODELVIEW_MATRIX, modelview );
+	return Submit( program, uniforms, list, modelview );
+}
+
+
+// ... or with the object's modelview matrix given, as from a scene graph:
+
+int
+RenderQueue::Submit( GLSLProgram *program, UniformBlock *uniforms, GLuint list, const float *modelview )
+{
+	struct DrawItem item;
+	item.key = 0;
+	item.program = program;
+	item.uniforms = uniforms;
+	item.list = list;
+	item.mesh = NULL;
+	item.arena = NULL;
+	item.arenaMesh = item.arenaDraw = -1;
+	item.numTextures = 0;
+	item.hasMaterial = false;
+	item.culled = false;
+	item.occluder = false;
+	item.prepassed = false;
+	memcpy( item.modelview, modelview, sizeof(item.modelview) );
+
+	std::map<GLuint, struct Sphere>::iterator pos = ListBounds.find( list );
+	item.hasBounds = ( pos != ListBounds.end( ) );
+	if( item.hasBounds )
+		item.bounds = pos->second;
+
+	Items.push_back( item );
+	return (int)Items.size( ) - 1;
+}
+
+
+// add a draw of all of an instanced mesh's instances -- each carries its own
+// modelview matrix, so the current one only decides where the draw sorts:
+
+int
+RenderQueue::Submit( GLSLProgram *program, UniformBlock *uniforms, InstancedMesh *mesh )
+{
+	int draw = Submit( program, uniforms, (GLuint)0 );
+	Items[draw].mesh = mesh;
+	Items[draw].hasBounds = false;		// the mesh culls its instances itself
+	return draw;
+}
+
+
+// add a draw of one of an arena's meshes with this modelview matrix -- it is
+// culled with the mesh's bounding sphere:
+
+int
+RenderQueue::Submit( GLSLProgram *program, UniformBlock *uniforms, DrawArena *arena, int mesh, const float *modelview )
+{
+	int draw = Submit( program, uniforms, (GLuint)0, modelview );
+	struct DrawItem *item = &Items[draw];
+	item->arena = arena;
+	item->arenaMesh = mesh;
+	item->hasBounds = true;
+	item->bounds = *arena->GetSphere( mesh );
+	return draw;
+}
+
+
+void
+RenderQueue::Texture( int draw, int unit, GLenum target, GLuint tex )
+{
+	struct DrawItem *item = &Items[draw];
+	if( item->numTextures >= RQ_MAXTEXTURES  ||  unit < 0  ||  unit >= RQ_MAXUNITS )
+	{
+		fprintf( stderr, "RenderQueue: can't bind texture %d to unit %d\n", tex, unit );
+		return;
+	}
+
+	struct DrawTexture *t = &item->textures[item->numTextures++];
+	t->unit = unit;
+	t->target = target;
+	t->tex = tex;
+}
+
+
+// this draw hides what is behind it -- a display list or an arena mesh:
+
+void
+RenderQueue::Occluder( int draw )
+{
+	struct DrawItem *item = &Items[draw];
+	if( item->mesh == NULL )
+		item->occluder = true;
+}
+
+
+void
+RenderQueue::Material( int draw, float r, float g, float b, float shininess )
+{
+	struct DrawItem *item = &Items[draw];
+	item->hasMaterial = true;
+	item->material[0] = r;
+	item->material[1] = g;
+	item->material[2] = b;
+	item->material[3] = shininess;
+}
+
+
+int
+RenderQueue::IndexOf( GLSLProgram *program )
+{
+	for( int i = 0; i < (int)Programs.size( ); i++ )
+	{
+		if( Programs[i] == program )
+			return i;
+	}
+	Programs.push_back( program );
+	return (int)Programs.size( ) - 1;
+}
+
+
+int
+RenderQueue::IndexOf( UniformBlock *block )
+{
+	if( block == NULL )
+		return 0;
+	for( int i = 0; i < (int)Blocks.size( ); i++ )
+	{
+		if( Blocks[i] == block )
+			return i + 1;
+	}
+	Blocks.push_back( block );
+	return (int)Blocks.size( );
+}
+
+
+// the first draw with the same textures as this one -- its index stands for the set:
+
+int
+RenderQueue::TextureSetIndex( int draw )
+{
+	struct DrawItem *item = &Items[draw];
+	for( int i = 0; i < draw; i++ )
+	{
+		struct DrawItem *other = &Items[i];
+		if( other->numTextures == item->numTextures  &&
+		    memcmp( other->textures, item->textures, item->numTextures * sizeof(struct DrawTexture) ) == 0 )
+			return i;
+	}
+	return draw;
+}
+
+
+void
+RenderQueue::MakeKeys( )
+{
+	for( int i = 0; i < (int)Items.size( ); i++ )
+	{
+		struct DrawItem *item = &Items[i];
+
+		// the eye-space z of the object's origin is -modelview[14]:
+		float depth = -item->modelview[14] / RQ_FARDEPTH;
+		if( depth < 0.f )	depth = 0.f;
+		if( depth > 1.f )	depth = 1.f;
+		unsigned long long z = (unsigned long long)( depth * (float)0xffffff );
+
+		if( FrontToBack )
+		{
+			unsigned long long notOpaque = ( DepthProgramOf( item->program ) == NULL ) ? 1 : 0;
+			item->key = ( notOpaque << 63 )
+				  | ( z << 39 )
+				  | ( (unsigned long long)( IndexOf( item->program ) & 0xff ) << 31 )
+				  | ( (unsigned long long)( TextureSetIndex( i ) & 0xffff ) << 15 )
+				  | ( (unsigned long long)( IndexOf( item->uniforms ) & 0xff ) << 7 );
+		}
+		else
+		{
+			item->key = ( (unsigned long long)( IndexOf( item->program ) & 0xff ) << 56 )
+				  | ( (unsigned long long)( TextureSetIndex( i ) & 0xffff ) << 40 )
+				  | ( (unsigned long long)( IndexOf( item->uniforms ) & 0xff ) << 32 )
+				  | ( z << 8 );
+		}
+	}
+}
+
+
+// would a draw of this list with the current matrices survive culling? (for
+// work outside the queue that is only worth doing if the object is on screen):
+
+bool
+RenderQueue::Visible( GLuint list )
+{
+	float modelview[16];
+	glGetFloatv( GL_MODELVIEW_MATRIX, modelview );
+	return Visible( list, modelview );
+}
+
+
+// ... or with this modelview matrix:
+
+bool
+RenderQueue::Visible( GLuint list, const float *modelview )
+{
+	std::map<GLuint, struct Sphere>::iterator pos = ListBounds.find( list );
+	if( ! Culling  ||  pos == ListBounds.end( ) )
+		return true;
+
+	float projection[16];
+	glGetFloatv( GL_PROJECTION_MATRIX, projection );
+
+	Frustum frustum;
+	frustum.FromMatrix( projection );
+	struct Sphere eye;
+	TransformSphere( modelview, &pos->second, &eye );
+	return frustum.SphereVisible( eye.x, eye.y, eye.z, eye.r );
+}
+
+
+// mark the draws that are outside the frustum, all their spheres tested at once:
+
+void
+RenderQueue::Cull( )
+{
+	CullDraws.clear( );
+	CullX.clear( );
+	CullY.clear( );
+	CullZ.clear( );
+	CullR.clear( );
+	for( int i = 0; i < (int)Items.size( ); i++ )
+	{
+		struct DrawItem *item = &Items[i];
+		if( ! item->hasBounds )
+			continue;
+
+		struct Sphere eye;
+		TransformSphere( item->modelview, &item->bounds, &eye );
+		CullDraws.push_back( i );
+		CullX.push_back( eye.x );
+		CullY.push_back( eye.y );
+		CullZ.push_back( eye.z );
+		CullR.push_back( eye.r );
+	}
+
+	int n = (int)CullDraws.size( );
+	if( n == 0 )
+		return;
+
+	CullVisible.resize( n );
+	int numVisible = View.CullSpheres( n, &CullX[0], &CullY[0], &CullZ[0], &CullR[0], &CullVisible[0] );
+	for( int k = 0; k < n; k++ )
+		Items[ CullDraws[k] ].culled = ( CullVisible[k] == 0 );
+
+	Tested += n;
+	Culled += n - numVisible;
+}
+
+
+// draw the occluders that weren't culled depth-only into the hi-z buffer, with the
+// fixed-function pipeline, build its pyramid, and cull the draws behind them --
+// with no occluders this frame, there is no pyramid to test against:
+
+void
+RenderQueue::DrawOccluders( )
+{
+	Occlusion->Invalidate( );
+	if( ! Culling )
+		return;
+
+	int first = -1;
+	for( int i = 0; i < (int)Items.size( )  &&  first < 0; i++ )
+	{
+		if( Items[i].occluder  &&  ! Items[i].culled )
+			first = i;
+	}
+	if( first < 0 )
+		return;
+
+	GLint viewport[4];
+	glGetIntegerv( GL_VIEWPORT, viewport );
+	if( ! Occlusion->BeginOccluders( viewport[2], viewport[3] ) )
+		return;
+
+	GLuint previous = GLSLProgram::GetCurrentProgram( );
+	Items[first].program->UseFixedFunction( );
+	glMatrixMode( GL_MODELVIEW );
+	glPushMatrix( );
+	for( int i = first; i < (int)Items.size( ); i++ )
+	{
+		struct DrawItem *item = &Items[i];
+		if( ! item->occluder  ||  item->culled )
+			continue;
+
+		glLoadMatrixf( item->modelview );
+		if( item->arena != NULL )
+			item->arena->DrawMesh( item->arenaMesh );
+		else
+			glCallList( item->list );
+		Occluders++;
+	}
+	glPopMatrix( );
+	Items[first].program->Use( previous );
+
+	Occlusion->EndOccluders( );
+	Occlusion->OccluderDraws += Occluders;
+
+	// the draws with bounding spheres are tested here, on the cpu:
+	float projection[16];
+	glGetFloatv( GL_PROJECTION_MATRIX, projection );
+	for( int i = 0; i < (int)Items.size( ); i++ )
+	{
+		struct DrawItem *item = &Items[i];
+		if( item->occluder  ||  item->culled  ||  ! item->hasBounds )
+			continue;
+
+		struct Sphere eye;
+		TransformSphere( item->modelview, &item->bounds, &eye );
+		if( Occlusion->SphereHidden( projection, &eye ) )
+		{
+			item->culled = true;
+			Occluded++;
+		}
+	}
+}
+
+
+// can draw b go out in the same multi-draw as draw a?
+
+bool
+RenderQueue::SameArenaState( struct DrawItem *a, struct DrawItem *b )
+{
+	if( a->arena == NULL  ||  b->arena != a->arena  ||  b->program != a->program  ||  b->uniforms != a->uniforms )
+		return false;
+	if( b->numTextures != a->numTextures  ||  memcmp( b->textures, a->textures, a->numTextures * sizeof(struct DrawTexture) ) != 0 )
+		return false;
+	if( b->hasMaterial != a->hasMaterial )
+		return false;
+	return ! a->hasMaterial  ||  memcmp( b->material, a->material, sizeof(a->material) ) == 0;
+}
+
+
+struct DrawOrder
+{
+	std::vector<struct DrawItem> *items;
+
+	bool operator( )( int a, int b ) const
+	{
+		return (*items)[a].key < (*items)[b].key;
+	}
+};
+
+
+// sort (if sorting is on) and draw everything submitted since Begin( ):
+
+void
+RenderQueue::Execute( )
+{
+	Draws = MultiDraws = Instances = Tested = Culled = ProgramSwitches = TextureBinds = UniformUploads = 0;
+	NaiveProgramSwitches = NaiveTextureBinds = 0;
+	Occluders = Occluded = PrepassDraws = 0;
+
+	if( Culling )
+	{
+		float projection[16];
+		glGetFloatv( GL_PROJECTION_MATRIX, projection );
+		View.FromMatrix( projection );
+		Cull( );
+	}
+	if( Occlusion != NULL )
+		DrawOccluders( );
+
+	Order.clear( );
+	for( int i = 0; i < (int)Items.size( ); i++ )
+	{
+		if( ! Items[i].culled )
+			Order.push_back( i );
+	}
+
+	if( Sorting )
+	{
+		MakeKeys( );
+		struct DrawOrder byKey;
+		byKey.items = &Items;
+		std::stable_sort( Order.begin( ), Order.end( ), byKey );
+	}
+
+	// the arena draws' commands are written in the order they will be drawn, so
+	// every run of them with the same state is one range of commands:
+	Arenas.clear( );
+	for( int i = 0; i < (int)Order.size( ); i++ )
+	{
+		struct DrawItem *item = &Items[ Order[i] ];
+		if( item->arena == NULL )
+			continue;
+		if( std::find( Arenas.begin( ), Arenas.end( ), item->arena ) == Arenas.end( ) )
+		{
+			item->arena->Begin( );
+			Arenas.push_back( item->arena );
+		}
+		item->arenaDraw = item->arena->Add( item->arenaMesh, item->modelview );
+	}
+	for( int a = 0; a < (int)Arenas.size( ); a++ )
+		Arenas[a]->Upload( );
+
+	// what is bound to each unit -- nothing is assumed about what was there before:
+	GLenum boundTarget[RQ_MAXUNITS];
+	GLuint boundTex[RQ_MAXUNITS];
+	for( int u = 0; u < RQ_MAXUNITS; u++ )
+	{
+		boundTarget[u] = GL_NONE;
+		boundTex[u] = 0;
+	}
+
+	GLSLProgram *program = NULL;
+	UniformBlock *uniforms = NULL;
+	int activeUnit = -1;
+
+	// the shaders get their matrices, lights, and material from uniforms -- the
+	// fixed-function modelview is only loaded as well if asked for:
+	ShaderState *state = ShaderState::GetCurrent( );
+	bool fixed = ( state == NULL  ||  state->GetFixed( ) );
+	if( fixed )
+	{
+		glMatrixMode( GL_MODELVIEW );
+		glPushMatrix( );
+	}
+
+	// the opaque draws are shaded where the prepass left their depth, and the
+	// rest are drawn as they would have been:
+	GLint depthFunc = GL_LESS;
+	bool equal = false;
+	if( Prepass )
+	{
+		DrawPrepass( state );
+		glGetIntegerv( GL_DEPTH_FUNC, &depthFunc );
+		glPushAttrib( GL_DEPTH_BUFFER_BIT );
+	}
+
+	for( int i = 0; i < (int)Order.size( ); i++ )
+	{
+		struct DrawItem *item = &Items[ Order[i] ];
+
+		if( Prepass  &&  item->prepassed != equal )
+		{
+			equal = item->prepassed;
+			glDepthFunc( equal ? GL_EQUAL : depthFunc );
+			glDepthMask( equal ? GL_FALSE : GL_TRUE );
+		}
+
+		if( item->program != program )
+		{
+			program = item->program;
+			program->Use( );
+			uniforms = NULL;
+			ProgramSwitches++;
+		}
+
+		for( int t = 0; t < item->numTextures; t++ )
+		{
+			struct DrawTexture *dt = &item->textures[t];
+			if( boundTarget[dt->unit] != dt->target  ||  boundTex[dt->unit] != dt->tex )
+			{
+				if( activeUnit != dt->unit )
+				{
+					glActiveTexture( GL_TEXTURE0 + dt->unit );
+					activeUnit = dt->unit;
+				}
+				glBindTexture( dt->target, dt->tex );
+				boundTarget[dt->unit] = dt->target;
+				boundTex[dt->unit] = dt->tex;
+				TextureBinds++;
+			}
+		}
+
+		if( item->uniforms != NULL  &&  item->uniforms != uniforms )
+		{
+			item->uniforms->Apply( program );
+			uniforms = item->uniforms;
+			UniformUploads++;
+		}
+
+		if( item->hasMaterial )
+			SetMaterial( item->material[0], item->material[1], item->material[2], item->material[3] );
+
+		// (an instanced mesh carries a modelview matrix for each instance, and an
+		//  arena draw has its own in the arena)
+		if( item->mesh == NULL  &&  item->arena == NULL )
+		{
+			float normal[9];
+			NormalMatrix( item->modelview, normal );
+			program->SetUniformMatrix4( (char *)"uModelView", item->modelview );
+			program->SetUniformMatrix3( (char *)"uNormalMatrix", normal );
+			if( state != NULL )
+				state->MatrixCalls += 2;
+		}
+		if( fixed  &&  item->arena == NULL )
+		{
+			glLoadMatrixf( item->modelview );
+			if( state != NULL )
+				state->MatrixCalls++;
+		}
+		if( state != NULL )
+			state->Flush( );
+
+		if( item->arena != NULL )
+		{
+			int run = 1;
+			while( i + run < (int)Order.size( )  &&  SameArenaState( item, &Items[ Order[i+run] ] ) )
+				run++;
+			item->arena->Draw( program, item->arenaDraw, run );
+			Instances += run;
+			MultiDraws++;
+
+			// the rest of the run was drawn too:
+			for( int k = 1; k < run; k++ )
+			{
+				NaiveProgramSwitches++;
+				NaiveTextureBinds += Items[ Order[i+k] ].numTextures;
+			}
+			i += run - 1;
+		}
+		else if( item->mesh != NULL )
+		{
+			// (the prepass culled the mesh and drew what was left already)
+			if( item->prepassed )
+				item->mesh->Redraw( );
+			else
+				DrawMesh( item );
+		}
+		else
+		{
+			glCallList( item->list );
+			Instances++;
+		}
+
+		Draws++;
+		NaiveProgramSwitches++;
+		NaiveTextureBinds += item->numTextures;
+	}
+
+	if( Prepass )
+		glPopAttrib( );
+	if( fixed )
+		glPopMatrix( );
+	if( program != NULL )
+		program->UnUse( );
+}
+
+
+// draw all of an instanced mesh's instances that survive culling, and count them:
+
+void
+RenderQueue::DrawMesh( struct DrawItem *item )
+{
+	int n = item->mesh->NumInstances( );
+	long long occluded = item->mesh->InstancesOccluded;
+	int drawn = item->mesh->Draw( Culling ? &View : NULL, Occlusion );
+	Occluded += (int)( item->mesh->InstancesOccluded - occluded );
+	Instances += drawn;
+	if( Culling )
+	{
+		Tested += n;
+		Culled += n - drawn;
+	}
+}
+
+
+// draw the opaque draws depth-only, each with its program's depth program and
+// in the order they will be shaded. the instanced meshes are culled here, and
+// the shading draws the same instances again:
+
+void
+RenderQueue::DrawPrepass( ShaderState *state )
+{
+	glPushAttrib( GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+	glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+	glStencilMask( 0 );
+
+	GLSLProgram *program = NULL;
+	UniformBlock *uniforms = NULL;
+	for( int i = 0; i < (int)Order.size( ); i++ )
+	{
+		struct DrawItem *item = &Items[ Order[i] ];
+		GLSLProgram *depth = DepthProgramOf( item->program );
+		item->prepassed = ( depth != NULL );
+		if( depth == NULL )
+			continue;
+
+		if( depth != program )
+		{
+			program = depth;
+			program->Use( );
+			uniforms = NULL;
+			ProgramSwitches++;
+		}
+
+		// (the uniforms can move vertices, as uFlapWings does)
+		if( item->uniforms != NULL  &&  item->uniforms != uniforms )
+		{
+			item->uniforms->Apply( program );
+			uniforms = item->uniforms;
+			UniformUploads++;
+		}
+
+		if( item->mesh == NULL  &&  item->arena == NULL )
+		{
+			program->SetUniformMatrix4( (char *)"uModelView", item->modelview );
+			if( state != NULL )
+				state->MatrixCalls++;
+		}
+		if( state != NULL )
+			state->Flush( );
+
+		if( item->arena != NULL )
+		{
+			int run = 1;
+			while( i + run < (int)Order.size( )  &&  SameArenaState( item, &Items[ Order[i+run] ] ) )
+			{
+				Items[ Order[i+run] ].prepassed = true;
+				run++;
+			}
+			item->arena->Draw( program, item->arenaDraw, run );
+			i += run - 1;
+		}
+		else if( item->mesh != NULL )
+		{
+			DrawMesh( item );
+		}
+		else
+		{
+			glCallList( item->list );
+		}
+		PrepassDraws++;
+	}
+
+	if( program != NULL )
+		program->UnUse( );
+	glPopAttrib( );
+}
+
+
+void
+RenderQueue::PrintStats( )
+{
+	fprintf( stderr, "Render queue (%s): %d draws of %d objects, %d program switches (%d unqueued), %d texture binds (%d unqueued), %d uniform blocks sent\n",
+		Sorting ? "sorted" : "unsorted", Draws, Instances, ProgramSwitches, NaiveProgramSwitches,
+		TextureBinds, NaiveTextureBinds, UniformUploads );
+	if( MultiDraws > 0 )
+		fprintf( stderr, "Render queue: %d of the draws were multi-draws of arena meshes\n", MultiDraws );
+	if( Culling )
+		fprintf( stderr, "Render queue: %d of %d objects culled\n", Culled, Tested );
+	if( Prepass )
+		fprintf( stderr, "Render queue: %d draws drawn depth-only first, then shaded with GL_EQUAL%s\n", PrepassDraws,
+			FrontToBack ? ", front to back" : "" );
+	else if( FrontToBack )
+		fprintf( stderr, "Render queue: opaque draws sorted front to back\n" );
+	if( Culling  &&  Occlusion != NULL )
+		fprintf( stderr, "Render queue: %d occluder draws, %d objects culled as hidden behind them\n", Occluders, Occluded );
+	else if( ! Culling )
+		fprintf( stderr, "Render queue: culling off\n" );
+}
+
+#endif		// #ifndef RENDERQUEUE_CPP
@@ -0,0 +1,216 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <stdio.h>
+#include <vector>
+#include <map>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "instancemesh.h"
+#include "drawarena.h"
+#include "frustum.h"
+#include "hiz.h"
+#include "shaderstate.h"
+
+
+// a retained list of the frame's draws
+//
+// instead of each object doing its own Use( ) / bind / set-uniforms / draw / UnUse( ),
+// the draws are submitted as small records -- program, textures, uniform block,
+// display list, and the modelview matrix current when it was submitted -- and then
+// executed all at once. before executing they are sorted by a 64-bit key:
+//
+//	bits 56-63	program		(in the order the programs were first submitted)
+//	bits 40-55	texture set	(ditto)
+//	bits 32-39	uniform block	(ditto)
+//	bits  8-31	eye-space depth, near to far
+//
+// or, with SetFrontToBack( true ), by depth first, so the opaque draws go out
+// nearest first whatever their state, with the rest after them:
+//
+//	bit  63		not opaque
+//	bits 39-62	eye-space depth, near to far
+//	bits 31-38	program
+//	bits 15-30	texture set
+//	bits  7-14	uniform block
+//
+// so that every draw with the same program runs back to back with a single Use( ),
+// and state that hasn't changed since the previous draw isn't sent again.
+// a draw is either a display list, all the instances of an InstancedMesh, or
+// one mesh of a DrawArena -- a run of arena draws with the same program,
+// textures, uniform block, and material goes out as one glMultiDrawElementsIndirect( )
+//
+// with culling on, draws whose bounding sphere is outside the view frustum are
+// dropped before sorting -- display lists get their sphere from SetBounds( ),
+// instanced meshes cull each instance with the mesh's own bounds
+//
+// each draw's modelview and normal matrices are sent as the uModelView and
+// uNormalMatrix uniforms, and the current ShaderState is flushed before it
+//
+// given a HiZBuffer with SetOcclusion( ), the draws marked with Occluder( ) that
+// survive culling are drawn depth-only into it first. the draws with bounding
+// spheres hidden behind them are then dropped, and the instanced meshes culled
+// on the gpu leave out the instances hidden behind them
+//
+// a program given a depth program with SetDepthProgram( ) -- its own vertex shader
+// with depth.frag, and an invariant gl_Position in both -- draws opaque objects.
+// with SetPrepass( true ), the opaque draws are first drawn depth-only with their
+// depth programs, and then shaded with GL_EQUAL and no depth writes, so each pixel
+// of them is shaded once however much they overlap. (the prepass leaves the
+// stencil buffer alone, so an OverdrawCounter counts only the shading)
+
+#define RQ_MAXTEXTURES		4
+#define RQ_MAXUNIFORMS		24
+#define RQ_MAXUNITS		32
+#define RQ_FARDEPTH		1000.f		// depths past this all sort together
+
+
+enum UniformTypes
+{
+	RQ_INT,
+	RQ_FLOAT,
+	RQ_FLOAT2,
+	RQ_FLOAT3
+};
+
+struct DrawUniform
+{
+	char *		name;
+	int		type;
+	int		i;
+	float		f[3];
+};
+
+
+// a set of uniform values that one or more draws share -- consecutive draws
+// pointing at the same block only send it once
+
+class UniformBlock
+{
+  private:
+	int			NumUniforms;
+	struct DrawUniform	Uniforms[RQ_MAXUNIFORMS];
+
+	struct DrawUniform *	Add( char *, int );
+
+  public:
+		UniformBlock( );
+
+	void	Apply( GLSLProgram * );
+	void	Clear( );
+	void	Set( char *, int );
+	void	Set( char *, float );
+	void	Set( char *, float, float );
+	void	Set( char *, float, float, float );
+};
+
+
+struct DrawTexture
+{
+	int		unit;
+	GLenum		target;
+	GLuint		tex;
+};
+
+struct DrawItem
+{
+	unsigned long long	key;
+	GLSLProgram *		program;
+	UniformBlock *		uniforms;	// NULL = none
+	GLuint			list;		// display list to call
+	InstancedMesh *		mesh;		// ... or, if not NULL, the instances to draw
+	DrawArena *		arena;		// ... or, if not NULL, the arena arenaMesh is in
+	int			arenaMesh;
+	int			arenaDraw;	// its command in the arena, while executing
+	int			numTextures;
+	struct DrawTexture	textures[RQ_MAXTEXTURES];
+	bool			hasMaterial;
+	float			material[4];	// r, g, b, shininess for SetMaterial( )
+	float			modelview[16];
+	bool			hasBounds;
+	struct Sphere		bounds;		// in object coordinates
+	bool			culled;
+	bool			occluder;	// drawn into the hi-z buffer first
+	bool			prepassed;	// drawn depth-only in the prepass
+};
+
+
+class RenderQueue
+{
+  private:
+	std::vector<struct DrawItem>	Items;
+	std::vector<int>		Order;
+	std::vector<GLSLProgram *>	Programs;	// this frame's, in the order first submitted
+	std::vector<UniformBlock *>	Blocks;
+	std::vector<DrawArena *>	Arenas;		// the arenas this frame draws from
+	bool				Sorting;
+	bool				Culling;
+	bool				FrontToBack;
+	bool				Prepass;
+	std::map<GLSLProgram *, GLSLProgram *>	DepthPrograms;
+	std::map<GLuint, struct Sphere>	ListBounds;
+	Frustum				View;		// in eye coordinates, from the projection matrix
+	HiZBuffer *			Occlusion;	// NULL = no occlusion culling
+	std::vector<int>		CullDraws;
+	std::vector<float>		CullX, CullY, CullZ, CullR;
+	std::vector<unsigned char>	CullVisible;
+
+	int		IndexOf( GLSLProgram * );
+	int		IndexOf( UniformBlock * );
+	bool		SameArenaState( struct DrawItem *, struct DrawItem * );
+	int		TextureSetIndex( int );
+	void		Cull( );
+	GLSLProgram *	DepthProgramOf( GLSLProgram * );
+	void		DrawMesh( struct DrawItem * );
+	void		DrawOccluders( );
+	void		DrawPrepass( ShaderState * );
+	void		MakeKeys( );
+
+  public:
+	// counters for the last Execute( ):
+	int		Draws;
+	int		MultiDraws;		// ... of them multi-draws of arena meshes
+	int		Instances;		// objects drawn, counting every instance
+	int		Tested;			// objects tested against the frustum
+	int		Culled;			// ... and not drawn
+	int		Occluders;		// draws drawn into the hi-z buffer
+	int		Occluded;		// objects culled as hidden behind them (instances a frame late)
+	int		PrepassDraws;		// draws drawn depth-only before the shading
+	int		ProgramSwitches;
+	int		TextureBinds;
+	int		UniformUploads;		// uniform blocks sent
+	int		NaiveProgramSwitches;	// what one Use( ) and all binds per draw would have cost
+	int		NaiveTextureBinds;
+
+		RenderQueue( );
+
+	void	Begin( );
+	void	Execute( );
+	bool	GetCulling( );
+	bool	GetFrontToBack( );
+	HiZBuffer *	GetOcclusion( );
+	bool	GetPrepass( );
+	bool	GetSorting( );
+	void	Material( int, float, float, float, float );
+	void	Occluder( int );
+	void	PrintStats( );
+	void	SetBounds( GLuint, const float * );
+	void	SetCulling( bool );
+	void	SetDepthProgram( GLSLProgram *, GLSLProgram * );
+	void	SetFrontToBack( bool );
+	void	SetOcclusion( HiZBuffer * );
+	void	SetPrepass( bool );
+	void	SetSorting( bool );
+	int	Submit( GLSLProgram *, UniformBlock *, GLuint );
+	int	Submit( GLSLProgram *, UniformBlock *, GLuint, const float * );
+	int	Submit( GLSLProgram *, UniformBlock *, InstancedMesh * );
+	int	Submit( GLSLProgram *, UniformBlock *, DrawArena *, int, const float * );
+	void	Texture( int, int, GLenum, GLuint );
+	bool	Visible( GLuint );
+	bool	Visible( GLuint, const float * );
+};
+
+#endif		// #ifndef RENDERQUEUE_H
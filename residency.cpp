@@ -0,0 +1,364 @@
+#ifndef RESIDENCY_CPP
+#define RESIDENCY_CPP
+
+#include <stdio.h>
+#include <string.h>
+
+#include "residency.h"
+
+
+ResidencyManager::ResidencyManager( )
+{
+	Budget = 0;
+	BudgetChanged = false;
+	MaxDemote = 0;
+	Frame = 0;
+	Clock = 0;
+	Load = NULL;
+	Free = NULL;
+	Hits = Misses = Promotions = Demotions = Evictions = OverBudget = 0;
+	ResidentBytes = PeakBytes = LoadedBytes = 0;
+}
+
+
+// budget in bytes, how many top levels may be dropped before a texture is evicted,
+// and the functions that do the actual loading and freeing:
+
+void
+ResidencyManager::Init( long long budget, int maxDemote, ResidencyLoadFunc load, ResidencyFreeFunc free )
+{
+	Textures.clear( );
+	Budget = budget;
+	BudgetChanged = false;
+	MaxDemote = maxDemote;
+	Frame = 0;
+	Clock = 0;
+	Load = load;
+	Free = free;
+	Hits = Misses = Promotions = Demotions = Evictions = OverBudget = 0;
+	ResidentBytes = PeakBytes = LoadedBytes = 0;
+}
+
+
+int
+ResidencyManager::Register( const char *name, void *asset )
+{
+	struct ResidentTexture rt;
+	memset( &rt, 0, sizeof(struct ResidentTexture) );
+	strncpy( rt.name, name, sizeof(rt.name) - 1 );
+	rt.asset = asset;
+	rt.baseLevel = -1;
+	rt.lastFrame = -1;
+	Textures.push_back( rt );
+	return (int)Textures.size( ) - 1;
+}
+
+
+struct ResidentTexture *
+ResidencyManager::Get( int id )
+{
+	if( id < 0  ||  id >= (int)Textures.size( ) )
+		return NULL;
+	return &Textures[id];
+}
+
+
+long long
+ResidencyManager::GetBudget( )
+{
+	return Budget;
+}
+
+
+// a smaller budget takes effect at the start of the next frame:
+
+void
+ResidencyManager::SetBudget( long long budget )
+{
+	Budget = budget;
+	BudgetChanged = true;
+}
+
+
+// nothing has been bound yet this frame, so a new budget can be met by
+// demoting anything here:
+
+void
+ResidencyManager::BeginFrame( )
+{
+	Frame++;
+	if( BudgetChanged )
+		Enforce( -1 );
+	BudgetChanged = false;
+}
+
+
+// bytes used by levels baseLevel and up (block-compressed levels are stored
+// in whole 4x4 blocks, so the small ones are rounded up):
+
+long long
+ResidencyManager::EstimateBytes( struct ResidentTexture *rt, int baseLevel )
+{
+	long long bytes = 0;
+	for( int level = baseLevel; level < rt->numLevels; level++ )
+	{
+		int w = rt->width  >> level;	if( w < 1 )	w = 1;
+		int h = rt->height >> level;	if( h < 1 )	h = 1;
+		if( rt->bitsPerTexel < 16 )
+		{
+			w = 4 * ( (w+3) / 4 );
+			h = 4 * ( (h+3) / 4 );
+		}
+		bytes += (long long)rt->numFaces * w * h * rt->bitsPerTexel / 8;
+	}
+	return bytes;
+}
+
+
+// returns the gl texture to bind, loading it first if it isn't all there:
+
+unsigned int
+ResidencyManager::Bind( int id )
+{
+	struct ResidentTexture *rt = Get( id );
+	if( rt == NULL )
+		return 0;
+
+	rt->lastBind = ++Clock;
+	rt->lastFrame = Frame;
+
+	if( rt->baseLevel == 0 )
+	{
+		Hits++;
+		return rt->tex;
+	}
+	if( rt->failed )
+		return rt->tex;
+
+	if( rt->baseLevel < 0 )
+		Misses++;
+	else
+		Promotions++;
+
+	if( MakeResident( id, 0 ) )
+		Enforce( id );
+	return rt->tex;
+}
+
+
+bool
+ResidencyManager::MakeResident( int id, int baseLevel )
+{
+	struct ResidentTexture *rt = &Textures[id];
+	if( ! ( *Load )( rt, baseLevel ) )
+	{
+		fprintf( stderr, "Residency: could not load '%s'\n", rt->name );
+		ResidentBytes -= rt->bytes;
+		rt->bytes = 0;
+		rt->baseLevel = -1;
+		rt->failed = true;
+		return false;
+	}
+
+	// (a promotion only loads the levels that were missing)
+	long long bytes = EstimateBytes( rt, baseLevel );
+	if( rt->baseLevel < 0 )
+		LoadedBytes += bytes;
+	else if( baseLevel < rt->baseLevel )
+		LoadedBytes += bytes - rt->bytes;
+	ResidentBytes += bytes - rt->bytes;
+	rt->bytes = bytes;
+	rt->baseLevel = baseLevel;
+	if( ResidentBytes > PeakBytes )
+		PeakBytes = ResidentBytes;
+	return true;
+}
+
+
+void
+ResidencyManager::Evict( int id )
+{
+	struct ResidentTexture *rt = &Textures[id];
+	( *Free )( rt );
+	ResidentBytes -= rt->bytes;
+	rt->bytes = 0;
+	rt->baseLevel = -1;
+	Evictions++;
+}
+
+
+// the resident texture that was bound longest ago, not counting this frame's:
+
+int
+ResidencyManager::LeastRecentlyUsed( )
+{
+	int lru = -1;
+	for( int i = 0; i < (int)Textures.size( ); i++ )
+	{
+		struct ResidentTexture *rt = &Textures[i];
+		if( rt->baseLevel < 0  ||  rt->lastFrame == Frame )
+			continue;
+		if( lru < 0  ||  rt->lastBind < Textures[lru].lastBind )
+			lru = i;
+	}
+	return lru;
+}
+
+
+// get back under budget, never touching texture 'keep':
+
+void
+ResidencyManager::Enforce( int keep )
+{
+	while( ResidentBytes > Budget )
+	{
+		int victim = LeastRecentlyUsed( );
+		if( victim < 0  ||  victim == keep )
+		{
+			OverBudget++;
+			return;
+		}
+
+		struct ResidentTexture *rt = &Textures[victim];
+		if( rt->baseLevel < MaxDemote  &&  rt->baseLevel + 1 < rt->numLevels )
+		{
+			Demotions++;
+			if( ! MakeResident( victim, rt->baseLevel + 1 ) )
+				Evict( victim );
+		}
+		else
+			Evict( victim );
+	}
+}
+
+
+void
+ResidencyManager::PrintStats( )
+{
+	int binds = Hits + Misses + Promotions;
+	fprintf( stderr, "Residency: %d textures, %.2f of %.2f MB resident (peak %.2f MB), %.2f MB loaded\n",
+		(int)Textures.size( ), (double)ResidentBytes / ( 1024.*1024. ), (double)Budget / ( 1024.*1024. ),
+		(double)PeakBytes / ( 1024.*1024. ), (double)LoadedBytes / ( 1024.*1024. ) );
+	fprintf( stderr, "Residency: %d binds, %.1f%% hits, %d misses, %d promotions, %d demotions, %d evictions, %d over budget\n",
+		binds, binds > 0 ? 100. * (double)Hits / (double)binds : 0., Misses, Promotions, Demotions, Evictions, OverBudget );
+}
+
+
+//#define TEST
+#ifdef TEST
+
+// replays a fixed bind trace against fake textures -- a few big cube maps and
+// planets plus some small props, with a budget that fits only part of them
+
+struct FakeAsset
+{
+	int	size, faces, bits;
+};
+
+struct FakeAsset Assets[ ] =
+{
+	{ 1024, 6,  4 },	// BC1 cube maps
+	{ 1024, 6,  4 },
+	{  512, 6,  4 },
+	{ 2048, 1,  8 },	// BC7 planets
+	{ 2048, 1,  8 },
+	{ 1024, 1,  8 },
+	{  256, 1, 32 },	// rgba props
+	{  256, 1, 32 },
+	{  128, 1, 32 },
+	{  128, 1, 32 },
+};
+
+const int NUMASSETS = sizeof(Assets) / sizeof(struct FakeAsset);
+
+int	Loads, Frees;
+
+bool
+FakeLoad( struct ResidentTexture *rt, int baseLevel )
+{
+	struct FakeAsset *a = (struct FakeAsset *)rt->asset;
+	rt->width = rt->height = a->size;
+	rt->numFaces = a->faces;
+	rt->bitsPerTexel = a->bits;
+	rt->numLevels = 1;
+	for( int s = a->size; s > 1; s /= 2 )
+		rt->numLevels++;
+	Loads++;
+	rt->tex = Loads;
+	return true;
+}
+
+void
+FakeFree( struct ResidentTexture *rt )
+{
+	Frees++;
+}
+
+int
+main( int argc, char *argv[ ] )
+{
+	ResidencyManager rm;
+	rm.Init( 16*1024*1024, 2, FakeLoad, FakeFree );
+	for( int i = 0; i < NUMASSETS; i++ )
+	{
+		char name[32];
+		sprintf( name, "asset%d", i );
+		rm.Register( name, &Assets[i] );
+	}
+
+	// each frame binds a "camera" neighbourhood of 4 assets that drifts through
+	// the list, plus one pseudo-random extra:
+
+	unsigned int seed = 12345;
+	for( int frame = 0; frame < 400; frame++ )
+	{
+		rm.BeginFrame( );
+		int first = ( frame / 25 ) % NUMASSETS;
+		for( int i = 0; i < 4; i++ )
+			rm.Bind( ( first + i ) % NUMASSETS );
+		seed = 1103515245 * seed + 12345;
+		rm.Bind( ( seed >> 16 ) % NUMASSETS );
+
+		if( frame % 100 == 99 )
+		{
+			fprintf( stderr, "After frame %d:\n", frame+1 );
+			rm.PrintStats( );
+		}
+	}
+
+	for( int i = 0; i < NUMASSETS; i++ )
+	{
+		struct ResidentTexture *rt = rm.Get( i );
+		fprintf( stderr, "%-8s base level %2d  %8lld bytes\n", rt->name, rt->baseLevel, rt->bytes );
+	}
+	fprintf( stderr, "%d loads, %d frees\n", Loads, Frees );
+	return 0;
+}
+#endif
+#ifdef EXPECTED_RESULTS
+After frame 100:
+Residency: 10 textures, 14.83 of 16.00 MB resident (peak 21.17 MB), 81.00 MB loaded
+Residency: 500 binds, 90.0% hits, 48 misses, 2 promotions, 81 demotions, 39 evictions, 14 over budget
+After frame 200:
+Residency: 10 textures, 12.50 of 16.00 MB resident (peak 21.17 MB), 166.09 MB loaded
+Residency: 1000 binds, 91.8% hits, 63 misses, 19 promotions, 128 demotions, 54 evictions, 14 over budget
+After frame 300:
+Residency: 10 textures, 16.00 of 16.00 MB resident (peak 21.17 MB), 222.59 MB loaded
+Residency: 1500 binds, 92.3% hits, 87 misses, 28 promotions, 193 demotions, 82 evictions, 21 over budget
+After frame 400:
+Residency: 10 textures, 14.75 of 16.00 MB resident (peak 21.17 MB), 307.25 MB loaded
+Residency: 2000 binds, 92.0% hits, 124 misses, 35 promotions, 269 demotions, 116 evictions, 33 over budget
+asset0   base level -1         0 bytes
+asset1   base level  1   1048656 bytes
+asset2   base level  0   1048656 bytes
+asset3   base level  0   5592432 bytes
+asset4   base level  0   5592432 bytes
+asset5   base level  0   1398128 bytes
+asset6   base level  0    349524 bytes
+asset7   base level  0    349524 bytes
+asset8   base level  0     87380 bytes
+asset9   base level -1         0 bytes
+428 loads, 116 frees
+#endif
+
+#endif		// #ifndef RESIDENCY_CPP
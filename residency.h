@@ -0,0 +1,84 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <stdio.h>
+#include <vector>
+
+
+// keeps the textures that are resident on the gpu under a byte budget
+//
+// every texture is registered once and then bound through Bind( ) each time it is
+// used. when the estimated total goes over the budget, the least-recently-bound
+// textures (that haven't been used this frame) first lose their top mip level,
+// one level at a time down to maxDemote levels, and are then evicted outright.
+// binding a demoted or evicted texture loads it back in full.
+//
+// the class itself doesn't call opengl -- the actual (re)loading and freeing is done
+// by the two callbacks given to Init( ), so the policy can be run without a gpu
+
+struct ResidentTexture
+{
+	char		name[64];
+	void *		asset;		// whatever the callbacks need to reload this texture
+	unsigned int	tex;		// the gl texture name, set by the load callback
+
+	// filled in by the load callback the first time the texture is loaded:
+	int		width, height;	// of the full-size level 0
+	int		numFaces;
+	int		numLevels;
+	int		bitsPerTexel;	// 4 = BC1, 8 = BC7, 32 = rgb(a)8
+
+	int		baseLevel;	// first level on the gpu, -1 if not resident
+	bool		failed;		// the load failed, don't keep retrying
+	long long	bytes;		// estimated gpu bytes currently used
+	long long	lastBind;	// value of the bind clock when last bound
+	int		lastFrame;	// frame it was last bound in
+};
+
+typedef bool	(*ResidencyLoadFunc)( struct ResidentTexture *, int );	// (re)load starting at this level
+typedef void	(*ResidencyFreeFunc)( struct ResidentTexture * );
+
+
+class ResidencyManager
+{
+  private:
+	std::vector<struct ResidentTexture>	Textures;
+	long long		Budget;
+	bool			BudgetChanged;
+	int			MaxDemote;
+	int			Frame;
+	long long		Clock;
+	ResidencyLoadFunc	Load;
+	ResidencyFreeFunc	Free;
+
+	void		Enforce( int );
+	int		LeastRecentlyUsed( );
+	bool		MakeResident( int, int );
+	void		Evict( int );
+
+  public:
+	// statistics:
+	int		Hits;		// binds that found the texture fully resident
+	int		Misses;		// binds that had to load an evicted texture
+	int		Promotions;	// binds that had to reload a demoted texture
+	int		Demotions;
+	int		Evictions;
+	int		OverBudget;	// times the budget couldn't be met by evicting
+	long long	ResidentBytes;
+	long long	PeakBytes;
+	long long	LoadedBytes;	// total ever loaded
+
+		ResidencyManager( );
+
+	void		BeginFrame( );
+	unsigned int	Bind( int );
+	static long long EstimateBytes( struct ResidentTexture *, int );
+	struct ResidentTexture *Get( int );
+	long long	GetBudget( );
+	void		Init( long long, int, ResidencyLoadFunc, ResidencyFreeFunc );
+	void		PrintStats( );
+	int		Register( const char *, void * );
+	void		SetBudget( long long );
+};
+
+#endif		// #ifndef RESIDENCY_H
@@ -0,0 +1,65 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+
+// a flat scene graph
+//
+// the nodes live in arrays: each has the index of its parent (or -1), a local
+// translation, rotation, and scale, and a cached world matrix. a node can only be
+// added after its parent, so a single pass in index order always reaches a parent
+// before its children.
+//
+// Update( ) only rebuilds the nodes whose own transform was changed since the last
+// update, and the nodes under them -- everything else keeps its cached matrix.
+// the Set functions only mark a node dirty when the value really changes, so
+// setting a clamped keytime value every frame costs nothing once it stops moving.
+//
+// the local matrix is translate * rotate * scale, the same as glTranslatef( ),
+// glRotatef( ), glScalef( ) in that order. the world matrices are column-major, ready
+// for glLoadMatrixf( ) or a mat4 uniform. with SetSimd( true ) the dirty nodes are
+// gathered into a batch and multiplied by their parents' matrices with sse
+
+class SceneGraph
+{
+  private:
+	std::vector<int>		Parent;
+	std::vector<glm::vec3>		Translation;
+	std::vector<glm::quat>		Rotation;
+	std::vector<glm::vec3>		Scale;
+	std::vector<glm::mat4>		Local;
+	std::vector<glm::mat4>		World;
+	std::vector<unsigned char>	LocalDirty;	// its own transform changed
+	std::vector<unsigned char>	WorldDirty;	// ... or one of its ancestors' did
+	std::vector<int>		Batch;		// the nodes to multiply, in order
+	bool				Simd;
+
+	void		MakeLocal( int );
+
+  public:
+	// statistics:
+	int		NodesUpdated;		// by the last update
+
+			SceneGraph( );
+
+	int		AddNode( int = -1 );
+	void		Clear( );
+	bool		GetSimd( );
+	const float *	GetWorld( int );
+	void		GetModelview( int, const float *, float * );
+	int		NumNodes( );
+	void		SetRotation( int, float, float, float, float );
+	void		SetScale( int, float );
+	void		SetScale( int, float, float, float );
+	void		SetSimd( bool );
+	void		SetTranslation( int, float, float, float );
+	void		Update( );
+	void		UpdateAll( );
+};
+
+#endif		// #ifndef SCENEGRAPH_H
@@ -1,6 +1,21 @@
+#include "shaderstate.h"
+
+
+// with a ShaderState current, the lights go into its uniform buffer -- the
+// fixed-function calls are only made if it is asking for them too:
+
 void
 SetPointLight( int ilight, float x, float y, float z,  float r, float g, float b )
 {
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+	{
+		state->SetPointLight( ilight - GL_LIGHT0, x, y, z, r, g, b );
+		if( ! state->GetFixed( ) )
+			return;
+		state->LightCalls += 9;		// the calls below
+	}
+
 	glLightfv( ilight, GL_POSITION,  Array3( x, y, z ) );
 	glLightf(  ilight, GL_SPOT_CUTOFF, 180.f );
 	glLightfv( ilight, GL_AMBIENT,   MulArray3( 0.1f,  1.f, 1.f, 1.f ) );
@@ -15,6 +30,15 @@ SetPointLight( int ilight, float x, float y, float z,  float r, float g, float b
 void
 SetSpotLight( int ilight, float x, float y, float z,  float xdir, float ydir, float zdir, float r, float g, float b )
 {
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+	{
+		state->SetSpotLight( ilight - GL_LIGHT0, x, y, z, xdir, ydir, zdir, r, g, b );
+		if( ! state->GetFixed( ) )
+			return;
+		state->LightCalls += 11;	// the calls below
+	}
+
 	glLightfv( ilight, GL_POSITION,  Array3( x, y, z ) );
 	glLightfv( ilight, GL_SPOT_DIRECTION,  Array3(xdir,ydir,zdir) );
 	glLightf(  ilight, GL_SPOT_EXPONENT, 1.f );
@@ -28,3 +52,18 @@ SetSpotLight( int ilight, float x, float y, float z,  float xdir, float ydir, fl
 	glEnable( ilight );
 }
 
+void
+DisableLight( int ilight )
+{
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+	{
+		state->DisableLight( ilight - GL_LIGHT0 );
+		if( ! state->GetFixed( ) )
+			return;
+		state->LightCalls++;
+	}
+
+	glDisable( ilight );
+}
+
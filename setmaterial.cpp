@@ -1,6 +1,20 @@
+#include "shaderstate.h"
+
+
+// with a ShaderState current, the material goes into its uniform buffer instead:
+
 void
 SetMaterial( float r, float g, float b,  float shininess )
 {
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+	{
+		state->SetMaterial( r, g, b, shininess );
+		if( ! state->GetFixed( ) )
+			return;
+		state->MaterialCalls += 10;	// the calls below
+	}
+
 	glMaterialfv( GL_BACK, GL_EMISSION, Array3( 0., 0., 0. ) );
 	glMaterialfv( GL_BACK, GL_AMBIENT, MulArray3( .4f, (float *)WHITE ) );
 	glMaterialfv( GL_BACK, GL_DIFFUSE, MulArray3( 1., (float *)WHITE ) );
@@ -0,0 +1,290 @@
+#ifndef SHADERSTATE_CPP
+#define SHADERSTATE_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+
+#include "shaderstate.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+
+ShaderState *	ShaderState::Current = NULL;
+
+
+ShaderState::ShaderState( )
+{
+	memset( &Block, 0, sizeof(Block) );
+	Buffer = 0;
+	DirtyStart = 0;
+	DirtyEnd = sizeof(Block);
+	memcpy( Modelview, glm::value_ptr( glm::mat4( 1.f ) ), sizeof(Modelview) );
+	Fixed = false;
+	ResetStats( );
+}
+
+
+// the projection matrix for this frame (column-major):
+
+void
+ShaderState::BeginFrame( const float *projection )
+{
+	if( memcmp( Block.projection, projection, sizeof(Block.projection) ) != 0 )
+	{
+		memcpy( Block.projection, projection, sizeof(Block.projection) );
+		Touch( Block.projection, sizeof(Block.projection) );
+	}
+}
+
+
+// connect a program's SceneState block to the buffer:
+
+void
+ShaderState::Bind( GLSLProgram *program )
+{
+	program->SetUniformBlockBinding( (char *)"SceneState", STATE_BINDING );
+}
+
+
+void
+ShaderState::DisableLight( int light )
+{
+	if( light < 0  ||  light >= STATE_MAXLIGHTS )
+		return;
+
+	struct StateLight *sl = &Block.lights[light];
+	if( sl->ambient[3] != 0.f )
+	{
+		sl->ambient[3] = 0.f;
+		Touch( &sl->ambient[3], sizeof(float) );
+	}
+}
+
+
+// send the part of the block that changed since the last flush:
+
+void
+ShaderState::Flush( )
+{
+	if( Buffer == 0  ||  DirtyEnd <= DirtyStart )
+		return;
+
+	glBufferSubData( GL_UNIFORM_BUFFER, DirtyStart, DirtyEnd - DirtyStart, (char *)&Block + DirtyStart );
+	BufferCalls++;
+	DirtyStart = sizeof(Block);
+	DirtyEnd = 0;
+}
+
+
+ShaderState *
+ShaderState::GetCurrent( )
+{
+	return Current;
+}
+
+
+bool
+ShaderState::GetFixed( )
+{
+	return Fixed;
+}
+
+
+// a copy of light's entry in the block, as the shaders see it -- returns whether it is on:
+
+bool
+ShaderState::GetLight( int light, struct StateLight *sl )
+{
+	if( light < 0  ||  light >= STATE_MAXLIGHTS )
+		return false;
+
+	*sl = Block.lights[light];
+	return sl->ambient[3] != 0.f;
+}
+
+
+const float *
+ShaderState::GetModelview( )
+{
+	return Modelview;
+}
+
+
+// the buffer stays bound to GL_UNIFORM_BUFFER, so Flush( ) doesn't have to bind it again:
+
+bool
+ShaderState::Init( )
+{
+	glGenBuffers( 1, &Buffer );
+	if( Buffer == 0 )
+	{
+		fprintf( stderr, "ShaderState: cannot create the uniform buffer\n" );
+		return false;
+	}
+
+	glBindBuffer( GL_UNIFORM_BUFFER, Buffer );
+	glBufferData( GL_UNIFORM_BUFFER, sizeof(Block), &Block, GL_DYNAMIC_DRAW );
+	glBindBufferBase( GL_UNIFORM_BUFFER, STATE_BINDING, Buffer );
+	DirtyStart = sizeof(Block);
+	DirtyEnd = 0;
+	return true;
+}
+
+
+void
+ShaderState::MakeCurrent( )
+{
+	Current = this;
+}
+
+
+void
+ShaderState::PrintStats( int numFrames )
+{
+	if( numFrames <= 0 )
+		numFrames = 1;
+	fprintf( stderr, "Shader state (%s): %5.1f gl calls/frame for matrices, %5.1f for lights, %5.1f for materials, %5.1f buffer updates\n",
+		Fixed ? "with the fixed-function calls" : "uniform buffer",
+		(float)MatrixCalls / (float)numFrames, (float)LightCalls / (float)numFrames,
+		(float)MaterialCalls / (float)numFrames, (float)BufferCalls / (float)numFrames );
+}
+
+
+void
+ShaderState::ResetStats( )
+{
+	MatrixCalls = LightCalls = MaterialCalls = BufferCalls = 0;
+}
+
+
+void
+ShaderState::SetFixed( bool fixed )
+{
+	Fixed = fixed;
+}
+
+
+// the same material SetMaterial( ) gives the front faces:
+
+void
+ShaderState::SetMaterial( float r, float g, float b, float shininess )
+{
+	float ambient[4]  = { r, g, b, 1.f };
+	float diffuse[4]  = { r, g, b, 1.f };
+	float specular[4] = { .8f, .8f, .8f, shininess };
+	if( memcmp( Block.ambient, ambient, sizeof(ambient) ) != 0  ||  memcmp( Block.diffuse, diffuse, sizeof(diffuse) ) != 0
+	||  memcmp( Block.specular, specular, sizeof(specular) ) != 0 )
+	{
+		memcpy( Block.ambient, ambient, sizeof(ambient) );
+		memcpy( Block.diffuse, diffuse, sizeof(diffuse) );
+		memcpy( Block.specular, specular, sizeof(specular) );
+		Touch( Block.ambient, 3*4*sizeof(float) );
+	}
+}
+
+
+// the matrix light positions are given in -- with the fixed-function calls on, it is
+// loaded into the modelview matrix too:
+
+void
+ShaderState::SetModelview( const float *modelview )
+{
+	memcpy( Modelview, modelview, sizeof(Modelview) );
+	if( Fixed )
+	{
+		glMatrixMode( GL_MODELVIEW );
+		glLoadMatrixf( modelview );
+		MatrixCalls += 2;
+	}
+}
+
+
+// the same light SetPointLight( ) makes:
+
+void
+ShaderState::SetPointLight( int light, float x, float y, float z,  float r, float g, float b )
+{
+	if( light < 0  ||  light >= STATE_MAXLIGHTS )
+		return;
+
+	glm::mat4 m = glm::make_mat4( Modelview );
+	glm::vec4 eye = m * glm::vec4( x, y, z, 1.f );
+
+	struct StateLight sl;
+	for( int c = 0; c < 4; c++ )
+		sl.position[c] = eye[c];
+	sl.direction[0] = 0.f;	sl.direction[1] = 0.f;	sl.direction[2] = -1.f;	sl.direction[3] = -1.f;
+	sl.ambient[0] = .1f;	sl.ambient[1] = .1f;	sl.ambient[2] = .1f;	sl.ambient[3] = 1.f;
+	sl.diffuse[0] = .6f*r;	sl.diffuse[1] = .6f*g;	sl.diffuse[2] = .6f*b;	sl.diffuse[3] = 1.f;
+	sl.specular[0] = .4f;	sl.specular[1] = .4f;	sl.specular[2] = .4f;	sl.specular[3] = 0.f;
+
+	if( memcmp( &Block.lights[light], &sl, sizeof(sl) ) != 0 )
+	{
+		Block.lights[light] = sl;
+		Touch( &Block.lights[light], sizeof(sl) );
+	}
+}
+
+
+// the same light SetSpotLight( ) makes:
+
+void
+ShaderState::SetSpotLight( int light, float x, float y, float z,  float xdir, float ydir, float zdir, float r, float g, float b )
+{
+	if( light < 0  ||  light >= STATE_MAXLIGHTS )
+		return;
+
+	glm::mat4 m = glm::make_mat4( Modelview );
+	glm::vec4 eye = m * glm::vec4( x, y, z, 1.f );
+	glm::vec3 dir = glm::mat3( m ) * glm::vec3( xdir, ydir, zdir );
+
+	struct StateLight sl;
+	for( int c = 0; c < 4; c++ )
+		sl.position[c] = eye[c];
+	sl.direction[0] = dir.x;	sl.direction[1] = dir.y;	sl.direction[2] = dir.z;
+	sl.direction[3] = cosf( 45.f * (float)M_PI / 180.f );
+	sl.ambient[0] = 0.f;	sl.ambient[1] = 0.f;	sl.ambient[2] = 0.f;	sl.ambient[3] = 1.f;
+	sl.diffuse[0] = r;	sl.diffuse[1] = g;	sl.diffuse[2] = b;	sl.diffuse[3] = 1.f;
+	sl.specular[0] = r;	sl.specular[1] = g;	sl.specular[2] = b;	sl.specular[3] = 1.f;
+
+	if( memcmp( &Block.lights[light], &sl, sizeof(sl) ) != 0 )
+	{
+		Block.lights[light] = sl;
+		Touch( &Block.lights[light], sizeof(sl) );
+	}
+}
+
+
+int
+ShaderState::StateCalls( )
+{
+	return MatrixCalls + LightCalls + MaterialCalls + BufferCalls;
+}
+
+
+// widen the range of bytes Flush( ) has to send:
+
+void
+ShaderState::Touch( void *start, int bytes )
+{
+	int offset = (int)( (char *)start - (char *)&Block );
+	if( offset < DirtyStart )
+		DirtyStart = offset;
+	if( offset + bytes > DirtyEnd )
+		DirtyEnd = offset + bytes;
+}
+
+
+// the inverse transpose of a modelview's upper 3x3, for transforming normals:
+
+void
+NormalMatrix( const float *modelview, float *normal )
+{
+	glm::mat3 n = glm::inverseTranspose( glm::mat3( glm::make_mat4( modelview ) ) );
+	memcpy( normal, glm::value_ptr( n ), 9*sizeof(float) );
+}
+
+#endif		// #ifndef SHADERSTATE_CPP
@@ -0,0 +1,111 @@
+#ifndef SHADERSTATE_H
+#define SHADERSTATE_H
+
+#include <stdio.h>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+
+
+// the per-frame state the shaders used to get from the fixed-function pipeline --
+// the projection matrix, the material, and the lights -- kept in one std140
+// uniform buffer, the SceneState block:
+//
+//	struct Light
+//	{
+//		vec4	position;	// eye coordinates
+//		vec4	direction;	// spot direction, eye coordinates, w = cos( cutoff ), -1. for a point light
+//		vec4	ambient;	// w = 1. if the light is on
+//		vec4	diffuse;
+//		vec4	specular;	// w = spot exponent
+//	};
+//
+//	layout( std140 ) uniform SceneState
+//	{
+//		mat4	uProjection;
+//		vec4	uMaterialAmbient;
+//		vec4	uMaterialDiffuse;
+//		vec4	uMaterialSpecular;	// w = shininess
+//		Light	uLights[8];
+//	};
+//
+// (a shader that only needs the projection can declare just the first member.)
+// the modelview and normal matrices change every draw, so they are plain uniforms,
+// uModelView and uNormalMatrix, that the render queue sets.
+//
+// while a ShaderState is current, SetPointLight( ), SetSpotLight( ), and SetMaterial( )
+// only change its copy of the block, and Flush( ) sends whatever changed with one
+// glBufferSubData( ). light positions are transformed by the matrix given to
+// SetModelview( ), as glLightfv( ) would by the modelview matrix. SetFixed( true )
+// makes them issue the old fixed-function calls as well, to compare
+
+#define STATE_MAXLIGHTS		8
+#define STATE_BINDING		1	// the uniform buffer binding point SceneState is on
+
+struct StateLight
+{
+	float		position[4];
+	float		direction[4];
+	float		ambient[4];
+	float		diffuse[4];
+	float		specular[4];
+};
+
+struct StateBlock
+{
+	float			projection[16];
+	float			ambient[4];
+	float			diffuse[4];
+	float			specular[4];
+	struct StateLight	lights[STATE_MAXLIGHTS];
+};
+
+
+class ShaderState
+{
+  private:
+	struct StateBlock	Block;
+	GLuint			Buffer;
+	int			DirtyStart, DirtyEnd;	// bytes of Block not yet sent
+	float			Modelview[16];
+	bool			Fixed;
+
+	static ShaderState *	Current;
+
+	void			Touch( void *, int );
+
+  public:
+	// statistics -- the gl calls made for matrices, lights, and materials since ResetStats( ):
+	int		MatrixCalls;
+	int		LightCalls;
+	int		MaterialCalls;
+	int		BufferCalls;
+
+			ShaderState( );
+
+	void		BeginFrame( const float * );
+	void		Bind( GLSLProgram * );
+	void		DisableLight( int );
+	void		Flush( );
+	static ShaderState *	GetCurrent( );
+	bool		GetFixed( );
+	bool		GetLight( int, struct StateLight * );
+	const float *	GetModelview( );
+	bool		Init( );
+	void		MakeCurrent( );
+	void		PrintStats( int );
+	void		ResetStats( );
+	void		SetFixed( bool );
+	void		SetMaterial( float, float, float, float );
+	void		SetModelview( const float * );
+	void		SetPointLight( int, float, float, float, float, float, float );
+	void		SetSpotLight( int, float, float, float, float, float, float, float, float, float );
+	int		StateCalls( );
+};
+
+
+void	NormalMatrix( const float *, float * );
+
+#endif		// #ifndef SHADERSTATE_H
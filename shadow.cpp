@@ -0,0 +1,828 @@
+#ifndef SHADOW_CPP
+#define SHADOW_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "shadow.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+
+// where a point light's tiles look, and which way is up in them -- the cube map
+// order, +x, -x, +y, -y, +z, -z, which is also how the shaders pick the tile:
+
+static const float ShadowDirs[SHADOW_FACES][3] =
+{
+	{  1.f,  0.f,  0.f },
+	{ -1.f,  0.f,  0.f },
+	{  0.f,  1.f,  0.f },
+	{  0.f, -1.f,  0.f },
+	{  0.f,  0.f,  1.f },
+	{  0.f,  0.f, -1.f }
+};
+
+static const float ShadowUps[SHADOW_FACES][3] =
+{
+	{  0.f, -1.f,  0.f },
+	{  0.f, -1.f,  0.f },
+	{  0.f,  0.f,  1.f },
+	{  0.f,  0.f, -1.f },
+	{  0.f, -1.f,  0.f },
+	{  0.f, -1.f,  0.f }
+};
+
+
+ShadowAtlas::ShadowAtlas( )
+{
+	AtlasTex = CacheTex = AtlasFbo = CacheFbo = Buffer = 0;
+	memset( TimeQueries, 0, sizeof(TimeQueries) );
+	memset( QueryPending, 0, sizeof(QueryPending) );
+	QueryIndex = 0;
+	Size = TileSize = TilesAcross = MaxTiles = 0;
+	Caching = true;
+	Pcf = SHADOW_PCF;
+	Darkness = SHADOW_DARKNESS;
+	StaticKey = 0;
+	NumTiles = 0;
+	memset( Tiles, 0, sizeof(Tiles) );
+	memset( &Block, 0, sizeof(Block) );
+	for( int l = 0; l < SHADOW_MAXLIGHTS; l++ )
+	{
+		FirstTile[l] = -1;
+		Block.lights[l][3] = -1.f;
+	}
+	SavedFbo = 0;
+	LightStart = FrameStart = 0.;
+	ResetStats( );
+}
+
+
+// a size x size atlas of tileSize x tileSize tiles (up to SHADOW_MAXTILES of them) -- returns
+// false if the framebuffers can't be made:
+
+bool
+ShadowAtlas::Init( int size, int tileSize )
+{
+	Destroy( );
+	if( tileSize <= 0  ||  tileSize > size )
+	{
+		fprintf( stderr, "ShadowAtlas: a %d tile doesn't fit in a %d atlas\n", tileSize, size );
+		return false;
+	}
+	Size = size;
+	TileSize = tileSize;
+	TilesAcross = size / tileSize;
+	MaxTiles = TilesAcross * TilesAcross;
+	if( MaxTiles > SHADOW_MAXTILES )
+		MaxTiles = SHADOW_MAXTILES;
+
+	// the atlas is looked up with depth comparisons, the cache is only copied from:
+	GLuint *textures[2] = { &AtlasTex, &CacheTex };
+	GLuint *fbos[2] = { &AtlasFbo, &CacheFbo };
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &SavedFbo );
+	GLenum status = GL_FRAMEBUFFER_COMPLETE;
+	for( int i = 0; i < 2  &&  status == GL_FRAMEBUFFER_COMPLETE; i++ )
+	{
+		glGenTextures( 1, textures[i] );
+		glBindTexture( GL_TEXTURE_2D, *textures[i] );
+		glTexStorage2D( GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, Size, Size );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, i == 0 ? GL_LINEAR : GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, i == 0 ? GL_LINEAR : GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+		if( i == 0 )
+		{
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL );
+		}
+		glBindTexture( GL_TEXTURE_2D, 0 );
+
+		// every tile starts out as far as it can be -- nothing in shadow:
+		glGenFramebuffers( 1, fbos[i] );
+		glBindFramebuffer( GL_FRAMEBUFFER, *fbos[i] );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, *textures[i], 0 );
+		glDrawBuffer( GL_NONE );
+		glReadBuffer( GL_NONE );
+		status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+		if( status == GL_FRAMEBUFFER_COMPLETE )
+		{
+			static const float farthest = 1.f;
+			glClearBufferfv( GL_DEPTH, 0, &farthest );
+		}
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		fprintf( stderr, "ShadowAtlas: the atlas framebuffer is incomplete (0x%x)\n", status );
+		Destroy( );
+		return false;
+	}
+
+	// the ShadowState block's buffer -- leaving GL_UNIFORM_BUFFER as it was, since
+	// the ShaderState counts on its own buffer staying bound there:
+	GLint savedBuffer;
+	glGetIntegerv( GL_UNIFORM_BUFFER_BINDING, &savedBuffer );
+	glGenBuffers( 1, &Buffer );
+	glBindBuffer( GL_UNIFORM_BUFFER, Buffer );
+	glBufferData( GL_UNIFORM_BUFFER, sizeof(Block), &Block, GL_DYNAMIC_DRAW );
+	glBindBufferBase( GL_UNIFORM_BUFFER, SHADOW_BINDING, Buffer );
+	glBindBuffer( GL_UNIFORM_BUFFER, savedBuffer );
+
+	// without timer queries, only the cpu time is reported:
+	if( GLEW_ARB_timer_query )
+		glGenQueries( 2*SHADOW_MAXLIGHTS, &TimeQueries[0][0] );
+
+	for( int t = 0; t < SHADOW_MAXTILES; t++ )
+		Tiles[t].cached = Tiles[t].liveIsCache = false;
+	return true;
+}
+
+
+bool
+ShadowAtlas::IsValid( )
+{
+	return AtlasFbo != 0;
+}
+
+
+void
+ShadowAtlas::Destroy( )
+{
+	if( AtlasFbo != 0 )
+		glDeleteFramebuffers( 1, &AtlasFbo );
+	if( CacheFbo != 0 )
+		glDeleteFramebuffers( 1, &CacheFbo );
+	if( AtlasTex != 0 )
+		glDeleteTextures( 1, &AtlasTex );
+	if( CacheTex != 0 )
+		glDeleteTextures( 1, &CacheTex );
+	if( Buffer != 0 )
+		glDeleteBuffers( 1, &Buffer );
+	if( TimeQueries[0][0] != 0 )
+		glDeleteQueries( 2*SHADOW_MAXLIGHTS, &TimeQueries[0][0] );
+	AtlasTex = CacheTex = AtlasFbo = CacheFbo = Buffer = 0;
+	memset( TimeQueries, 0, sizeof(TimeQueries) );
+	memset( QueryPending, 0, sizeof(QueryPending) );
+	Size = TileSize = TilesAcross = MaxTiles = 0;
+	NumTiles = 0;
+}
+
+
+// connect a receiving program's ShadowState block to the buffer:
+
+void
+ShadowAtlas::Bind( GLSLProgram *program )
+{
+	program->SetUniformBlockBinding( (char *)"ShadowState", SHADOW_BINDING );
+}
+
+
+bool
+ShadowAtlas::GetCaching( )
+{
+	return Caching;
+}
+
+
+// turning caching on starts the cache over, since nothing went into it while it was off:
+
+void
+ShadowAtlas::SetCaching( bool on )
+{
+	if( on  &&  ! Caching )
+	{
+		for( int t = 0; t < SHADOW_MAXTILES; t++ )
+			Tiles[t].cached = Tiles[t].liveIsCache = false;
+	}
+	Caching = on;
+}
+
+
+void
+ShadowAtlas::SetDarkness( float darkness )
+{
+	Darkness = darkness;
+}
+
+
+// 0 is a single bilinear lookup, 1 is 3x3 of them, ...
+
+void
+ShadowAtlas::SetPcf( int radius )
+{
+	Pcf = radius < 0 ? 0 : radius;
+}
+
+
+GLuint
+ShadowAtlas::GetTexture( )
+{
+	return AtlasTex;
+}
+
+
+// tile t's lower-left corner and size, in texels:
+
+void
+ShadowAtlas::TileRect( int t, int *rect )
+{
+	rect[0] = TileSize * ( t % TilesAcross );
+	rect[1] = TileSize * ( t / TilesAcross );
+	rect[2] = TileSize;
+	rect[3] = TileSize;
+}
+
+
+// start this frame's shadow maps -- view is the frame's viewing transformation, and
+// staticKey whatever number the caller changes when the static casters do. returns
+// how many tiles there are, to go through with BeginTile( 0 ) ... BeginTile( n-1 )
+
+int
+ShadowAtlas::Begin( const float *view, unsigned int staticKey )
+{
+	NumTiles = 0;
+	for( int l = 0; l < SHADOW_MAXLIGHTS; l++ )
+	{
+		FirstTile[l] = -1;
+		Block.lights[l][3] = -1.f;
+	}
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( ! IsValid( )  ||  state == NULL )
+		return 0;
+
+	FrameStart = omp_get_wtime( );
+	StaticKey = staticKey;
+
+	// the queries used two frames ago are (almost always) done by now:
+	for( int l = 0; l < SHADOW_MAXLIGHTS; l++ )
+	{
+		if( ! QueryPending[QueryIndex][l] )
+			continue;
+		GLuint available = 0;
+		glGetQueryObjectuiv( TimeQueries[QueryIndex][l], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( available )
+		{
+			GLuint64 ns;
+			glGetQueryObjectui64v( TimeQueries[QueryIndex][l], GL_QUERY_RESULT, &ns );
+			GpuSeconds[l] += (double)ns / 1.e9;
+			GpuFrames[l]++;
+		}
+		QueryPending[QueryIndex][l] = false;
+	}
+
+	glm::mat4 eyeToWorld = glm::inverse( glm::make_mat4( view ) );
+	memcpy( Block.eyeToWorld, glm::value_ptr( eyeToWorld ), sizeof(Block.eyeToWorld) );
+
+	// the frusta are widened so that a tile's pcf taps along its edges still see
+	// what is just past them, instead of the neighboring tile:
+	float margin = (float)TileSize / (float)( TileSize - 2 * ( Pcf + 1 ) );
+
+	for( int l = 0; l < SHADOW_MAXLIGHTS; l++ )
+	{
+		struct StateLight sl;
+		if( ! state->GetLight( l, &sl ) )
+			continue;
+		bool point = ( sl.direction[3] <= -1.f );
+		int need = point ? SHADOW_FACES : 1;
+		if( NumTiles + need > MaxTiles )
+		{
+			Dropped++;
+			continue;
+		}
+
+		glm::vec3 eyePosition( sl.position[0], sl.position[1], sl.position[2] );
+		glm::vec3 eyeDirection( sl.direction[0], sl.direction[1], sl.direction[2] );
+		glm::vec3 position = glm::vec3( eyeToWorld * glm::vec4( eyePosition, 1.f ) );
+		glm::vec3 direction = point ? glm::vec3( 0.f, 0.f, -1.f ) : glm::normalize( glm::mat3( eyeToWorld ) * eyeDirection );
+
+		FirstTile[l] = NumTiles;
+		for( int c = 0; c < 3; c++ )
+		{
+			Block.lights[l][c] = sl.position[c];
+			Block.spots[l][c] = sl.direction[c];
+			Block.colors[l][c] = sl.diffuse[c];
+		}
+		Block.lights[l][3] = (float)NumTiles;
+		Block.spots[l][3] = sl.direction[3];
+		Block.colors[l][3] = 1.f;
+
+		for( int f = 0; f < need; f++ )
+		{
+			struct ShadowTile *tile = &Tiles[NumTiles];
+			tile->light = l;
+			tile->face = point ? f : -1;
+			for( int c = 0; c < 3; c++ )
+			{
+				tile->position[c] = position[c];
+				tile->direction[c] = direction[c];
+			}
+
+			// looking out of the light, along a cube face or down the cone:
+			glm::mat4 lightView, lightProjection;
+			if( point )
+			{
+				glm::vec3 dir( ShadowDirs[f][0], ShadowDirs[f][1], ShadowDirs[f][2] );
+				glm::vec3 up( ShadowUps[f][0], ShadowUps[f][1], ShadowUps[f][2] );
+				lightView = glm::lookAt( position, position + dir, up );
+				float halfAngle = atanf( margin );
+				lightProjection = glm::perspective( 2.f * halfAngle, 1.f, SHADOW_NEAR, SHADOW_FAR );
+			}
+			else
+			{
+				glm::vec3 up = fabsf( direction.y ) < 0.9f ? glm::vec3( 0.f, 1.f, 0.f ) : glm::vec3( 1.f, 0.f, 0.f );
+				lightView = glm::lookAt( position, position + direction, up );
+				float cutoff = acosf( sl.direction[3] );
+				float halfAngle = atanf( margin * tanf( cutoff ) );
+				if( halfAngle > 1.5f )
+					halfAngle = 1.5f;
+				lightProjection = glm::perspective( 2.f * halfAngle, 1.f, SHADOW_NEAR, SHADOW_FAR );
+			}
+			memcpy( tile->view, glm::value_ptr( lightView ), sizeof(tile->view) );
+			memcpy( tile->projection, glm::value_ptr( lightProjection ), sizeof(tile->projection) );
+
+			// from eye coordinates to the tile's part of the atlas:
+			int rect[4];
+			TileRect( NumTiles, rect );
+			float a = (float)Size;
+			glm::mat4 toTile( 1.f );
+			toTile[0][0] = 0.5f * (float)rect[2] / a;
+			toTile[1][1] = 0.5f * (float)rect[3] / a;
+			toTile[2][2] = 0.5f;
+			toTile[3][0] = ( (float)rect[0] + 0.5f * (float)rect[2] ) / a;
+			toTile[3][1] = ( (float)rect[1] + 0.5f * (float)rect[3] ) / a;
+			toTile[3][2] = 0.5f;
+			glm::mat4 m = toTile * lightProjection * lightView * eyeToWorld;
+			memcpy( Block.matrices[NumTiles], glm::value_ptr( m ), sizeof(Block.matrices[0]) );
+			Block.rects[NumTiles][0] = ( (float)rect[0] + 0.5f ) / a;
+			Block.rects[NumTiles][1] = ( (float)rect[1] + 0.5f ) / a;
+			Block.rects[NumTiles][2] = ( (float)( rect[0] + rect[2] ) - 0.5f ) / a;
+			Block.rects[NumTiles][3] = ( (float)( rect[1] + rect[3] ) - 0.5f ) / a;
+			NumTiles++;
+		}
+	}
+	Block.params[0] = 1.f / (float)Size;
+	Block.params[1] = (float)Pcf;
+	Block.params[2] = Darkness;
+	Block.params[3] = 0.f;
+
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &SavedFbo );
+	glGetIntegerv( GL_VIEWPORT, SavedViewport );
+	glPushAttrib( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT | GL_POLYGON_BIT | GL_SCISSOR_BIT );
+	glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+	glEnable( GL_DEPTH_TEST );
+	glDepthFunc( GL_LESS );
+	glDepthMask( GL_TRUE );
+	glEnable( GL_POLYGON_OFFSET_FILL );
+	glPolygonOffset( SHADOW_SLOPE_BIAS, SHADOW_UNITS_BIAS );
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix( );
+	glMatrixMode( GL_MODELVIEW );
+	return NumTiles;
+}
+
+
+// render tile i next -- lightView gets its viewing transformation from world
+// coordinates. returns whether the static casters have to be drawn into it
+
+bool
+ShadowAtlas::BeginTile( int i, float *lightView )
+{
+	struct ShadowTile *tile = &Tiles[i];
+	if( FirstTile[tile->light] == i )
+	{
+		LightStart = omp_get_wtime( );
+		if( TimeQueries[0][0] != 0 )
+			glBeginQuery( GL_TIME_ELAPSED, TimeQueries[QueryIndex][tile->light] );
+	}
+
+	memcpy( lightView, tile->view, sizeof(tile->view) );
+	int rect[4];
+	TileRect( i, rect );
+	glViewport( rect[0], rect[1], rect[2], rect[3] );
+	glMatrixMode( GL_PROJECTION );
+	glLoadMatrixf( tile->projection );
+	glMatrixMode( GL_MODELVIEW );
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+		state->BeginFrame( tile->projection );
+
+	if( Caching )
+	{
+		bool same = tile->cached  &&  tile->cachedLight == tile->light  &&  tile->cachedFace == tile->face  &&  tile->cachedKey == StaticKey;
+		for( int c = 0; c < 3  &&  same; c++ )
+		{
+			same = fabsf( tile->position[c] - tile->cachedPosition[c] ) < SHADOW_EPSILON
+			    && fabsf( tile->direction[c] - tile->cachedDirection[c] ) < SHADOW_EPSILON;
+		}
+		if( same )
+		{
+			StaticReuses++;
+			return false;
+		}
+
+		tile->cached = true;
+		tile->cachedLight = tile->light;
+		tile->cachedFace = tile->face;
+		tile->cachedKey = StaticKey;
+		memcpy( tile->cachedPosition, tile->position, sizeof(tile->position) );
+		memcpy( tile->cachedDirection, tile->direction, sizeof(tile->direction) );
+		tile->liveIsCache = false;
+		glBindFramebuffer( GL_FRAMEBUFFER, CacheFbo );
+	}
+	else
+	{
+		glBindFramebuffer( GL_FRAMEBUFFER, AtlasFbo );
+	}
+
+	glEnable( GL_SCISSOR_TEST );
+	glScissor( rect[0], rect[1], rect[2], rect[3] );
+	glClear( GL_DEPTH_BUFFER_BIT );
+	glDisable( GL_SCISSOR_TEST );
+	StaticDraws++;
+	return true;
+}
+
+
+// go on to tile i's moving casters -- with caching on, the tile's static depths
+// are put in the atlas first, unless they are all that is there already:
+
+void
+ShadowAtlas::BeginDynamic( int i )
+{
+	if( ! Caching )
+		return;
+
+	struct ShadowTile *tile = &Tiles[i];
+	if( ! tile->liveIsCache )
+	{
+		int rect[4];
+		TileRect( i, rect );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, CacheFbo );
+		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, AtlasFbo );
+		glBlitFramebuffer( rect[0], rect[1], rect[0] + rect[2], rect[1] + rect[3],
+				   rect[0], rect[1], rect[0] + rect[2], rect[1] + rect[3], GL_DEPTH_BUFFER_BIT, GL_NEAREST );
+		tile->liveIsCache = true;
+		Copies++;
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, AtlasFbo );
+}
+
+
+// tile i is done -- dynamicDraws is how many moving casters were drawn into it:
+
+void
+ShadowAtlas::EndTile( int i, int dynamicDraws )
+{
+	struct ShadowTile *tile = &Tiles[i];
+	if( dynamicDraws > 0 )
+	{
+		tile->liveIsCache = false;
+		DynamicDraws++;
+	}
+
+	int l = tile->light;
+	if( i + 1 == NumTiles  ||  Tiles[i+1].light != l )
+	{
+		if( TimeQueries[0][0] != 0 )
+		{
+			glEndQuery( GL_TIME_ELAPSED );
+			QueryPending[QueryIndex][l] = true;
+		}
+		CpuSeconds[l] += omp_get_wtime( ) - LightStart;
+		LightFrames[l]++;
+	}
+}
+
+
+// put back what Begin( ) changed, but for the ShaderState's projection, and send
+// the ShadowState block:
+
+void
+ShadowAtlas::End( )
+{
+	if( ! IsValid( ) )
+		return;
+
+	if( FrameStart != 0. )
+	{
+		glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+		glViewport( SavedViewport[0], SavedViewport[1], SavedViewport[2], SavedViewport[3] );
+		glMatrixMode( GL_PROJECTION );
+		glPopMatrix( );
+		glMatrixMode( GL_MODELVIEW );
+		glPopAttrib( );
+		FrameSeconds += omp_get_wtime( ) - FrameStart;
+		FrameStart = 0.;
+		QueryIndex = 1 - QueryIndex;
+		Frames++;
+	}
+
+	GLint savedBuffer;
+	glGetIntegerv( GL_UNIFORM_BUFFER_BINDING, &savedBuffer );
+	glBindBuffer( GL_UNIFORM_BUFFER, Buffer );
+	glBufferSubData( GL_UNIFORM_BUFFER, 0, sizeof(Block), &Block );
+	glBindBuffer( GL_UNIFORM_BUFFER, savedBuffer );
+}
+
+
+void
+ShadowAtlas::PrintStats( )
+{
+	if( Frames == 0 )
+		return;
+	fprintf( stderr, "Shadow atlas, %d x %d in %d x %d tiles, caching %s: %6.2f ms/frame cpu; %.2f static draws, %.2f reuses, %.2f copies, %.2f moving draws per frame",
+		Size, Size, TileSize, TileSize, Caching ? "on " : "off", 1000. * FrameSeconds / (double)Frames,
+		(double)StaticDraws / (double)Frames, (double)StaticReuses / (double)Frames, (double)Copies / (double)Frames, (double)DynamicDraws / (double)Frames );
+	if( Dropped > 0 )
+		fprintf( stderr, "; %d lights left out", Dropped );
+	fprintf( stderr, "\n" );
+	for( int l = 0; l < SHADOW_MAXLIGHTS; l++ )
+	{
+		if( LightFrames[l] == 0 )
+			continue;
+		fprintf( stderr, "\tGL_LIGHT%d: %6.2f ms/frame cpu", l, 1000. * CpuSeconds[l] / (double)LightFrames[l] );
+		if( GpuFrames[l] > 0 )
+			fprintf( stderr, ", %6.2f ms/frame gpu", 1000. * GpuSeconds[l] / (double)GpuFrames[l] );
+		fprintf( stderr, ", in %d of the %d frames\n", LightFrames[l], Frames );
+	}
+}
+
+
+void
+ShadowAtlas::ResetStats( )
+{
+	Frames = 0;
+	for( int l = 0; l < SHADOW_MAXLIGHTS; l++ )
+	{
+		LightFrames[l] = 0;
+		CpuSeconds[l] = GpuSeconds[l] = 0.;
+		GpuFrames[l] = 0;
+	}
+	FrameSeconds = 0.;
+	StaticDraws = StaticReuses = Copies = DynamicDraws = Dropped = 0;
+}
+
+
+//#define TEST
+#ifdef TEST
+
+// a headless test: a floor with a ball over it, lit by a spot light straight above
+// and a point light off to the side. the floor is drawn with earth.frag, and the
+// spots where the ball's two shadows should fall are read back against open floor.
+// then a field of balls is added and one ball flies over it, and the frames are
+// timed with the caching off and on -- the two have to look the same, texel for
+// texel. there is no window -- the context, and the framebuffer the frames are
+// drawn into, come from HeadlessContext
+
+#undef TEST		// so the files included below leave their own tests out
+
+
+void	Cross( float [3], float [3], float [3] );
+float	Unit( float [3], float [3] );
+
+#include "headless.cpp"
+#include "glslprogram.cpp"
+#include "osusphere.cpp"
+#include "hiz.cpp"
+#include "instancemesh.cpp"
+#include "drawarena.cpp"
+#include "renderqueue.cpp"
+#include "shaderstate.cpp"
+
+#define WIDTH		256
+#define HEIGHT		256
+#define FIELD		20		// x FIELD balls
+#define NUMFRAMES	30
+
+void
+SetMaterial( float, float, float, float )	// the test sets no materials
+{
+}
+
+void
+Cross( float v1[3], float v2[3], float vout[3] )
+{
+	float tmp[3];
+	tmp[0] = v1[1]*v2[2] - v2[1]*v1[2];
+	tmp[1] = v2[0]*v1[2] - v1[0]*v2[2];
+	tmp[2] = v1[0]*v2[1] - v2[0]*v1[1];
+	vout[0] = tmp[0];
+	vout[1] = tmp[1];
+	vout[2] = tmp[2];
+}
+
+float
+Unit( float vin[3], float vout[3] )
+{
+	float dist = sqrtf( vin[0]*vin[0] + vin[1]*vin[1] + vin[2]*vin[2] );
+	if( dist > 0. )
+	{
+		vout[0] = vin[0] / dist;
+		vout[1] = vin[1] / dist;
+		vout[2] = vin[2] / dist;
+	}
+	return dist;
+}
+
+ShaderState	State;
+RenderQueue	Queue, CasterQueue;
+ShadowAtlas	Shadows;
+GLSLProgram	FloorProgram, DepthProgram;
+GLuint		WhiteTex, BallList, FloorList;
+UniformBlock	FloorUniforms;
+glm::mat4	View, Projection;
+
+void
+BallModelview( const float *view, float x, float y, float z, float r, float *modelview )
+{
+	glm::mat4 m = glm::make_mat4( view ) * glm::translate( glm::mat4( 1.f ), glm::vec3( x, y, z ) ) * glm::scale( glm::mat4( 1.f ), glm::vec3( r ) );
+	memcpy( modelview, glm::value_ptr( m ), 16*sizeof(float) );
+}
+
+// the static balls are the field, the moving one is at flyer (or nowhere if it is NULL):
+
+void
+Frame( bool field, const float *flyer, unsigned char *pixels )
+{
+	State.SetModelview( glm::value_ptr( View ) );
+	State.SetSpotLight( 0,  0.f, 8.f, 0.f,   0.f, -1.f, 0.f,   1.f, 1.f, 1.f );
+	State.SetPointLight( 1,  6.f, 4.f, 0.f,   1.f, 1.f, 1.f );
+
+	float modelview[16];
+	int tiles = Shadows.Begin( glm::value_ptr( View ), field ? 1 : 0 );
+	for( int i = 0; i < tiles; i++ )
+	{
+		float lightView[16];
+		if( Shadows.BeginTile( i, lightView ) )
+		{
+			CasterQueue.Begin( );
+			BallModelview( lightView, 0.f, 2.f, 0.f, 1.f, modelview );
+			CasterQueue.Submit( &DepthProgram, NULL, BallList, modelview );
+			for( int b = 0; field  &&  b < FIELD*FIELD; b++ )
+			{
+				BallModelview( lightView, -9.f + 18.f * (float)( b % FIELD ) / (float)FIELD, 0.3f, -9.f + 18.f * (float)( b / FIELD ) / (float)FIELD, 0.25f, modelview );
+				CasterQueue.Submit( &DepthProgram, NULL, BallList, modelview );
+			}
+			CasterQueue.Execute( );
+		}
+		Shadows.BeginDynamic( i );
+		CasterQueue.Begin( );
+		if( flyer != NULL )
+		{
+			BallModelview( lightView, flyer[0], flyer[1], flyer[2], 0.5f, modelview );
+			CasterQueue.Submit( &DepthProgram, NULL, BallList, modelview );
+		}
+		CasterQueue.Execute( );
+		Shadows.EndTile( i, CasterQueue.Draws );
+	}
+	Shadows.End( );
+	State.BeginFrame( glm::value_ptr( Projection ) );
+
+	glClearColor( 0.f, 0.f, 0.f, 1.f );
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	Queue.Begin( );
+	int draw = Queue.Submit( &FloorProgram, &FloorUniforms, FloorList, glm::value_ptr( View ) );
+	Queue.Texture( draw, 1, GL_TEXTURE_2D, WhiteTex );
+	Queue.Texture( draw, SHADOW_TEXTURE_UNIT, GL_TEXTURE_2D, Shadows.GetTexture( ) );
+	Queue.Execute( );
+	if( pixels != NULL )
+		glReadPixels( 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+}
+
+// the floor's brightness where the point ( x, 0, z ) on it is seen:
+
+int
+FloorAt( unsigned char *pixels, float x, float z )
+{
+	glm::vec4 clip = Projection * View * glm::vec4( x, 0.f, z, 1.f );
+	int px = (int)( ( clip.x / clip.w * 0.5f + 0.5f ) * (float)WIDTH );
+	int py = (int)( ( clip.y / clip.w * 0.5f + 0.5f ) * (float)HEIGHT );
+	return pixels[ 4*( py*WIDTH + px ) ];
+}
+
+int
+main( int argc, char *argv[ ] )
+{
+	// the context, with its framebuffer bound, that everything is drawn into:
+	HeadlessContext headless;
+	if( ! headless.Init( WIDTH, HEIGHT ) )
+		return 1;
+
+	glEnable( GL_DEPTH_TEST );
+
+	unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures( 1, &WhiteTex );
+	glBindTexture( GL_TEXTURE_2D, WhiteTex );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+
+	FloorProgram.Init( );
+	DepthProgram.Init( );
+	FloorProgram.Create( (char *)"earth.vert", (char *)"earth.frag" );
+	DepthProgram.Create( (char *)"earth.vert", (char *)"depth.frag" );
+	State.Init( );
+	State.MakeCurrent( );
+	State.Bind( &FloorProgram );
+	State.Bind( &DepthProgram );
+	if( ! Shadows.Init( 2048, 512 ) )
+		return 1;
+	Shadows.Bind( &FloorProgram );
+	FloorUniforms.Set( (char *)"uTexUnit1", 1 );
+	FloorUniforms.Set( (char *)"uShadowUnit", SHADOW_TEXTURE_UNIT );
+	FloorUniforms.Set( (char *)"uShadowsOn", 1.f );
+
+	BallList = glGenLists( 1 );
+	glNewList( BallList, GL_COMPILE );
+		OsuSphere( 1., 32, 32 );
+	glEndList( );
+	float bounds[6] = { -1.f, -1.f, -1.f,   1.f, 1.f, 1.f };
+	CasterQueue.SetBounds( BallList, bounds );
+
+	// the floor is finely divided, so the depths it is compared at are as exact as the casters':
+	FloorList = glGenLists( 1 );
+	glNewList( FloorList, GL_COMPILE );
+		glNormal3f( 0.f, 1.f, 0.f );
+		for( int j = 0; j < 40; j++ )
+		{
+			glBegin( GL_QUAD_STRIP );
+			for( int i = 0; i <= 40; i++ )
+			{
+				glTexCoord2f( 0.f, 0.f );
+				glVertex3f( -10.f + 0.5f*(float)i, 0.f, -10.f + 0.5f*(float)j );
+				glVertex3f( -10.f + 0.5f*(float)i, 0.f, -10.f + 0.5f*(float)( j+1 ) );
+			}
+			glEnd( );
+		}
+	glEndList( );
+	Queue.SetCulling( false );
+
+	View = glm::lookAt( glm::vec3( 0.f, 14.f, 10.f ), glm::vec3( 0.f, 0.f, 0.f ), glm::vec3( 0.f, 1.f, 0.f ) );
+	Projection = glm::perspective( glm::radians( 60.f ), 1.f, 0.1f, 100.f );
+	glMatrixMode( GL_PROJECTION );
+	glLoadMatrixf( glm::value_ptr( Projection ) );
+	glMatrixMode( GL_MODELVIEW );
+	State.BeginFrame( glm::value_ptr( Projection ) );
+
+	// the ball alone: the spot light's shadow is straight under it, the point
+	// light's out along the line from the light through it:
+	unsigned char *pixels = new unsigned char[ 4*WIDTH*HEIGHT ];
+	Frame( false, NULL, pixels );
+	fprintf( stderr, "floor brightness: under the ball %d, in the point light's shadow %d, in the open %d and %d\n",
+		FloorAt( pixels, 0.f, 0.f ), FloorAt( pixels, -3.f, 0.f ), FloorAt( pixels, 3.f, 3.f ), FloorAt( pixels, -3.f, 3.f ) );
+
+	// the field, with a ball flying over it, caching off and then on:
+	unsigned char *last[2];
+	for( int caching = 0; caching < 2; caching++ )
+	{
+		Shadows.SetCaching( caching != 0 );
+		last[caching] = new unsigned char[ 4*WIDTH*HEIGHT ];
+		double t0 = 0.;
+		for( int frame = -2; frame < NUMFRAMES; frame++ )
+		{
+			if( frame == 0 )
+			{
+				glFinish( );
+				Shadows.ResetStats( );
+				t0 = omp_get_wtime( );
+			}
+			float flyer[3] = { -6.f + 12.f * (float)frame / (float)NUMFRAMES, 3.f, 1.f };
+			Frame( true, flyer, frame == NUMFRAMES-1 ? last[caching] : NULL );
+		}
+		glFinish( );
+		double ms = 1000. * ( omp_get_wtime( ) - t0 ) / (double)NUMFRAMES;
+		fprintf( stderr, "%d balls, caching %s: %7.2f ms/frame with glFinish( ) -- ", FIELD*FIELD + 2, caching ? "on " : "off", ms );
+		Shadows.PrintStats( );
+	}
+	int wrong = 0;
+	for( int i = 0; i < 4*WIDTH*HEIGHT; i++ )
+	{
+		if( last[0][i] != last[1][i] )
+			wrong++;
+	}
+	fprintf( stderr, "cached and uncached frames: %d of %d bytes differ\n", wrong, 4*WIDTH*HEIGHT );
+	return 0;
+}
+
+#endif
+
+// EXPECTED_RESULTS (g++ -O1 -fopenmp -DTEST -I.. ../shadow.cpp -lGLEW -lEGL -lGL -lGLU, on mesa's llvmpipe, software rendering):
+//
+//	floor brightness: under the ball 112, in the point light's shadow 215, in the open 255 and 255
+//	402 balls, caching off:  428.93 ms/frame with glFinish( ) -- Shadow atlas, 2048 x 2048 in 512 x 512 tiles, caching off: 426.38 ms/frame cpu; 7.00 static draws, 0.00 reuses, 0.00 copies, 2.33 moving draws per frame
+//		GL_LIGHT0: 197.45 ms/frame cpu, 181.27 ms/frame gpu, in 30 of the 30 frames
+//		GL_LIGHT1: 228.89 ms/frame cpu, 186.79 ms/frame gpu, in 30 of the 30 frames
+//	402 balls, caching on :   57.48 ms/frame with glFinish( ) -- Shadow atlas, 2048 x 2048 in 512 x 512 tiles, caching on :  55.05 ms/frame cpu; 0.00 static draws, 7.00 reuses, 2.23 copies, 2.33 moving draws per frame
+//		GL_LIGHT0:  53.70 ms/frame cpu,   6.47 ms/frame gpu, in 30 of the 30 frames
+//		GL_LIGHT1:   1.32 ms/frame cpu,   7.60 ms/frame gpu, in 30 of the 30 frames
+//	cached and uncached frames: 0 of 262144 bytes differ
+//
+// (the cache saves the field's 400 balls in all seven tiles, 7-8x here, and the
+// pictures come out the same. the first light's cpu time with caching on is mostly
+// the software renderer catching up on the last frame's drawing)
+
+#endif		// #ifndef SHADOW_CPP
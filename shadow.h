@@ -0,0 +1,161 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdio.h>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "shaderstate.h"
+
+
+// shadow maps for the ShaderState's lights, all in one depth texture -- the atlas
+//
+// the atlas is cut into square tiles. Begin( ) reads which lights are on from the
+// current ShaderState and hands out the tiles: a spot light gets one, looking down
+// its cone, and a point light gets six, looking along the world's axes like the
+// faces of a cube map. (lights that don't fit are left unshadowed, and counted.)
+// then for each tile:
+//
+//	if( BeginTile( i, lightView ) )		true: draw the static casters
+//		...
+//	BeginDynamic( i );			draw the moving casters
+//	...
+//	EndTile( i, number of moving casters drawn );
+//
+// lightView is the tile's viewing transformation, from world coordinates -- the
+// projection is loaded into GL_PROJECTION (for the culling) and into the current
+// ShaderState, which keeps it until its next BeginFrame( ). End( ) puts back the
+// framebuffer, viewport, and projection it found
+//
+// with caching on, what doesn't move is drawn into a second atlas, the cache, and
+// only again when the light moves or the caller's static key changes. each frame a
+// tile's cached depths are copied into the atlas (if it isn't still holding just
+// them) and the moving casters drawn over them. with caching off, everything is
+// drawn straight into the atlas every frame
+//
+// the receiving shaders get the atlas as a sampler2DShadow, and from the
+// ShadowState uniform block -- filled in by Begin( ) and sent by End( ):
+//
+//	layout( std140 ) uniform ShadowState
+//	{
+//		mat4	uShadowEyeToWorld;		// the inverse of the viewing transformation
+//		mat4	uShadowMatrices[16];		// each tile's, from eye coordinates to the atlas
+//		vec4	uShadowRects[16];		// each tile's part of the atlas, s0, t0, s1, t1
+//		vec4	uShadowLights[8];		// eye position, w = its first tile, -1. = none
+//		vec4	uShadowSpots[8];		// eye spot direction, w = cos( cutoff ), -1. for a point light
+//		vec4	uShadowColors[8];		// diffuse color
+//		vec4	uShadowParams;			// 1 / atlas size, pcf radius in texels, darkness
+//	};
+//
+// everything is in eye coordinates, so the receivers need nothing but their eye
+// position and normal. the pcf is ( 2*radius + 1 )^2 taps, each one bilinear
+
+#define SHADOW_MAXLIGHTS	STATE_MAXLIGHTS
+#define SHADOW_MAXTILES		16
+#define SHADOW_FACES		6		// a point light's tiles
+#define SHADOW_BINDING		2		// the uniform buffer binding point ShadowState is on
+#define SHADOW_TEXTURE_UNIT	16		// where the receivers' draws bind the atlas
+#define SHADOW_NEAR		0.1f
+#define SHADOW_FAR		300.f
+#define SHADOW_PCF		1
+#define SHADOW_DARKNESS		0.75f		// how much of a light's share a shadow takes away
+#define SHADOW_SLOPE_BIAS	2.f		// the glPolygonOffset( ) the casters are drawn with
+#define SHADOW_UNITS_BIAS	4.f
+#define SHADOW_EPSILON		0.001f		// how far a light can move without its cache going stale
+
+
+struct ShadowBlock
+{
+	float		eyeToWorld[16];
+	float		matrices[SHADOW_MAXTILES][16];
+	float		rects[SHADOW_MAXTILES][4];
+	float		lights[SHADOW_MAXLIGHTS][4];
+	float		spots[SHADOW_MAXLIGHTS][4];
+	float		colors[SHADOW_MAXLIGHTS][4];
+	float		params[4];
+};
+
+struct ShadowTile
+{
+	int		light;
+	int		face;			// 0-5 for a point light, -1 for a spot light
+	float		position[3];		// the light, in world coordinates
+	float		direction[3];		// ... and its spot direction
+	float		view[16];		// world to light
+	float		projection[16];
+	// what the tile of the cache holds:
+	bool		cached;
+	int		cachedLight, cachedFace;
+	float		cachedPosition[3], cachedDirection[3];
+	unsigned int	cachedKey;
+	bool		liveIsCache;		// the atlas's tile holds just the cached depths
+};
+
+
+class ShadowAtlas
+{
+  private:
+	GLuint		AtlasTex;
+	GLuint		CacheTex;
+	GLuint		AtlasFbo;
+	GLuint		CacheFbo;
+	GLuint		Buffer;
+	GLuint		TimeQueries[2][SHADOW_MAXLIGHTS];	// each light's gpu time, this frame's and last frame's
+	bool		QueryPending[2][SHADOW_MAXLIGHTS];
+	int		QueryIndex;
+	int		Size;
+	int		TileSize;
+	int		TilesAcross;
+	int		MaxTiles;
+	bool		Caching;
+	int		Pcf;
+	float		Darkness;
+	unsigned int	StaticKey;
+	int		NumTiles;			// this frame's
+	struct ShadowTile	Tiles[SHADOW_MAXTILES];
+	int		FirstTile[SHADOW_MAXLIGHTS];	// -1 = not shadowed this frame
+	struct ShadowBlock	Block;
+	GLint		SavedFbo;
+	GLint		SavedViewport[4];
+	double		LightStart;
+	double		FrameStart;
+
+	void		TileRect( int, int * );
+
+  public:
+	// statistics, since ResetStats( ):
+	int		Frames;
+	int		LightFrames[SHADOW_MAXLIGHTS];	// frames each light was shadowed
+	double		CpuSeconds[SHADOW_MAXLIGHTS];	// submitting its tiles
+	double		GpuSeconds[SHADOW_MAXLIGHTS];	// drawing them, over GpuFrames of the frames
+	int		GpuFrames[SHADOW_MAXLIGHTS];
+	double		FrameSeconds;			// all of the frames' shadow passes, on the cpu
+	int		StaticDraws;			// tiles whose static casters were drawn
+	int		StaticReuses;			// ... or were already in the cache
+	int		Copies;				// tiles copied from the cache to the atlas
+	int		DynamicDraws;			// tiles with moving casters drawn into them
+	int		Dropped;			// lights that got no tiles
+
+			ShadowAtlas( );
+
+	int		Begin( const float *, unsigned int );
+	bool		BeginTile( int, float * );
+	void		BeginDynamic( int );
+	void		Bind( GLSLProgram * );
+	void		Destroy( );
+	void		End( );
+	void		EndTile( int, int );
+	bool		GetCaching( );
+	GLuint		GetTexture( );
+	bool		Init( int, int );
+	bool		IsValid( );
+	void		PrintStats( );
+	void		ResetStats( );
+	void		SetCaching( bool );
+	void		SetDarkness( float );
+	void		SetPcf( int );
+};
+
+#endif		// #ifndef SHADOW_H
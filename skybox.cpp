@@ -0,0 +1,97 @@
+#ifndef SKYBOX_CPP
+#define SKYBOX_CPP
+
+#include <stdio.h>
+
+#include "skybox.h"
+
+
+Skybox::Skybox( )
+{
+	Program = NULL;
+	Vao = 0;
+	ResetStats( );
+}
+
+
+// the program that draws it, skybox.vert and skybox.frag -- returns false if it
+// didn't build:
+
+bool
+Skybox::Init( GLSLProgram *program )
+{
+	Destroy( );
+	if( program == NULL  ||  ! program->IsValid( ) )
+	{
+		fprintf( stderr, "Skybox: no skybox program\n" );
+		return false;
+	}
+	Program = program;
+	glGenVertexArrays( 1, &Vao );
+	return true;
+}
+
+
+bool
+Skybox::IsValid( )
+{
+	return Program != NULL;
+}
+
+
+void
+Skybox::Destroy( )
+{
+	if( Vao != 0 )
+		glDeleteVertexArrays( 1, &Vao );
+	Vao = 0;
+	Program = NULL;
+}
+
+
+// draw the cube map cubeTex behind everything drawn so far -- view is the
+// viewing transformation, and the projection is the current ShaderState's:
+
+void
+Skybox::Draw( GLuint cubeTex, const float *view )
+{
+	if( Program == NULL )
+		return;
+
+	GLint activeUnit;
+	glGetIntegerv( GL_ACTIVE_TEXTURE, &activeUnit );
+	glActiveTexture( GL_TEXTURE0 + SKYBOX_TEXTURE_UNIT );
+	glBindTexture( GL_TEXTURE_CUBE_MAP, cubeTex );
+	glActiveTexture( activeUnit );
+
+	GLuint previous = GLSLProgram::GetCurrentProgram( );
+	Program->Use( );
+	Program->SetUniformMatrix4( (char *)"uView", view );
+	Program->SetUniformVariable( (char *)"uSkyUnit", SKYBOX_TEXTURE_UNIT );
+	ShaderState *state = ShaderState::GetCurrent( );
+	if( state != NULL )
+		state->Flush( );
+
+	glPushAttrib( GL_DEPTH_BUFFER_BIT );
+	glEnable( GL_DEPTH_TEST );
+	glDepthFunc( GL_LEQUAL );
+	glDepthMask( GL_FALSE );
+	glBindVertexArray( Vao );
+	glDrawArrays( GL_TRIANGLES, 0, SKYBOX_VERTICES );
+	glBindVertexArray( 0 );
+	glPopAttrib( );
+
+	Program->Use( previous );
+	Draws++;
+	Vertices += SKYBOX_VERTICES;
+}
+
+
+void
+Skybox::ResetStats( )
+{
+	Draws = 0;
+	Vertices = 0;
+}
+
+#endif		// #ifndef SKYBOX_CPP
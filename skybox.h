@@ -0,0 +1,51 @@
+#ifndef SKYBOX_H
+#define SKYBOX_H
+
+#include <stdio.h>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#include "glslprogram.h"
+#include "shaderstate.h"
+
+
+// a cube-map backdrop, drawn last
+//
+// it is one triangle that covers the whole viewport, with its corners on the far
+// plane (skybox.vert) -- each corner gets its direction out of the eye in world
+// coordinates, and the fragment shader looks the cube map up along the interpolated
+// direction. the depth test is GL_LEQUAL against the cleared depth, with depth writes
+// off, so once everything else is drawn only the pixels nothing covered are shaded,
+// and each of them once:
+//
+//	uniform mat4		uView;		// the viewing transformation -- only its rotation is used
+//	uniform samplerCube	uSkyUnit;	// the cube map, on SKYBOX_TEXTURE_UNIT
+//
+// the corners come from gl_VertexID, so there are no vertex buffers at all
+
+#define SKYBOX_TEXTURE_UNIT	14
+#define SKYBOX_VERTICES		3
+
+
+class Skybox
+{
+  private:
+	GLSLProgram *	Program;
+	GLuint		Vao;		// empty -- a draw just needs one bound
+
+  public:
+	// statistics, since ResetStats( ):
+	int		Draws;
+	long long	Vertices;
+
+		Skybox( );
+
+	void	Destroy( );
+	void	Draw( GLuint, const float * );
+	bool	Init( GLSLProgram * );
+	bool	IsValid( );
+	void	ResetStats( );
+};
+
+#endif		// #ifndef SKYBOX_H
@@ -0,0 +1,226 @@
+#ifndef TEXCACHE_CPP
+#define TEXCACHE_CPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mipmaps.cpp"
+#include "bcencode.cpp"
+#include "cachefile.cpp"
+
+
+// baked texture cache
+//
+// a .texcache file holds every mip level of every face of one texture, ready to
+// hand to opengl, so the filtering (and block compression) only has to be done
+// once per source image.
+// layout (little-endian, written on the machine that reads it):
+//
+//	struct TexCacheHeader
+//	for each level, for each face:
+//		int	number of bytes
+//		bytes
+//
+// the header remembers the size and time stamp of the source files -- if either
+// changes, or a different format is asked for, the cache is considered stale and
+// gets rebaked.
+
+#define TEXCACHE_MAGIC		0x4354534f		// "OSTC"
+#define TEXCACHE_VERSION	1
+#define TEXCACHE_EXTENSION	".texcache"
+
+enum TexCacheFormat
+{
+	TEXCACHE_RGB8,
+	TEXCACHE_BC1,		// GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	TEXCACHE_BC7		// GL_COMPRESSED_RGBA_BPTC_UNORM
+};
+
+struct TexCacheHeader
+{
+	int		magic;
+	int		version;
+	int		format;		// one of TexCacheFormat
+	int		width, height;	// size of level 0
+	int		numFaces;	// 1 for a 2d texture, 6 for a cube map
+	int		numLevels;
+	int		pad;
+	long long	sourceStamp;	// SourceStamp( ) of the files this was baked from
+};
+
+struct TexCache
+{
+	struct TexCacheHeader	header;
+	int			sizes[MAXMIPLEVELS][6];
+	unsigned char *		data[MAXMIPLEVELS][6];
+};
+
+
+// combine the size and modification time of the source files:
+
+long long
+SourceStamp( char *files[ ], int numFiles )
+{
+	long long stamp = 0;
+	for( int i = 0; i < numFiles; i++ )
+	{
+		struct stat st;
+		if( stat( files[i], &st ) != 0 )
+			return -1;
+		stamp = 31 * stamp + (long long)st.st_size;
+		stamp = 31 * stamp + (long long)st.st_mtime;
+	}
+	return stamp;
+}
+
+
+void
+TexCacheFileName( char *source, char *name, int maxLength )
+{
+	snprintf( name, maxLength, "%s%s", source, TEXCACHE_EXTENSION );
+}
+
+
+void
+InitTexCache( struct TexCache *tc, int format, int width, int height, int numFaces, int numLevels )
+{
+	memset( tc, 0, sizeof(struct TexCache) );
+	tc->header.magic     = TEXCACHE_MAGIC;
+	tc->header.version   = TEXCACHE_VERSION;
+	tc->header.format    = format;
+	tc->header.width     = width;
+	tc->header.height    = height;
+	tc->header.numFaces  = numFaces;
+	tc->header.numLevels = numLevels;
+}
+
+
+// copy a cpu mip chain in as one face, compressing it if the cache format asks for that:
+
+void
+SetTexCacheFace( struct TexCache *tc, int face, struct MipChain *chain )
+{
+	for( int level = 0; level < chain->numLevels; level++ )
+	{
+		int w = chain->width[level];
+		int h = chain->height[level];
+		if( tc->header.format == TEXCACHE_RGB8 )
+		{
+			tc->sizes[level][face] = 3 * w * h;
+			tc->data[level][face]  = new unsigned char[ 3 * w * h ];
+			memcpy( tc->data[level][face], chain->levels[level], 3 * w * h );
+		}
+		else
+		{
+			enum BcFormat format = ( tc->header.format == TEXCACHE_BC1 )  ?  BC_1  :  BC_7;
+			tc->sizes[level][face] = BcImageBytes( format, w, h );
+			tc->data[level][face]  = EncodeBc( chain->levels[level], w, h, format );
+		}
+	}
+}
+
+
+void
+FreeTexCache( struct TexCache *tc )
+{
+	for( int level = 0; level < MAXMIPLEVELS; level++ )
+	{
+		for( int face = 0; face < 6; face++ )
+		{
+			delete [ ] tc->data[level][face];
+			tc->data[level][face] = NULL;
+		}
+	}
+}
+
+
+// read levels firstLevel up to (not including) endLevel -- the others are skipped
+// over, and left NULL. returns false if the file is missing, damaged, or was baked
+// from a different source:
+
+bool
+ReadTexCacheLevels( char *file, long long sourceStamp, int format, int firstLevel, int endLevel, struct TexCache *tc )
+{
+	memset( tc, 0, sizeof(struct TexCache) );
+
+	FILE *fp = fopen( file, "rb" );
+	if( fp == NULL )
+		return false;
+
+	bool ok = fread( &tc->header, sizeof(struct TexCacheHeader), 1, fp ) == 1;
+	ok = ok  &&  tc->header.magic == TEXCACHE_MAGIC  &&  tc->header.version == TEXCACHE_VERSION;
+	ok = ok  &&  tc->header.sourceStamp == sourceStamp  &&  tc->header.format == format;
+	ok = ok  &&  tc->header.numLevels > 0  &&  tc->header.numLevels <= MAXMIPLEVELS;
+	ok = ok  &&  ( tc->header.numFaces == 1  ||  tc->header.numFaces == 6 );
+
+	if( endLevel > tc->header.numLevels )
+		endLevel = tc->header.numLevels;
+	for( int level = 0; ok  &&  level < endLevel; level++ )
+	{
+		for( int face = 0; ok  &&  face < tc->header.numFaces; face++ )
+		{
+			int size;
+			ok = fread( &size, sizeof(int), 1, fp ) == 1  &&  size > 0;
+			if( ok )
+			{
+				tc->sizes[level][face] = size;
+				if( level < firstLevel )
+				{
+					ok = fseek( fp, size, SEEK_CUR ) == 0;
+					continue;
+				}
+				tc->data[level][face]  = new unsigned char[size];
+				ok = fread( tc->data[level][face], 1, size, fp ) == (size_t)size;
+			}
+		}
+	}
+	fclose( fp );
+
+	if( ! ok )
+		FreeTexCache( tc );
+	return ok;
+}
+
+
+// ... all the levels:
+
+bool
+ReadTexCache( char *file, long long sourceStamp, int format, struct TexCache *tc )
+{
+	return ReadTexCacheLevels( file, sourceStamp, format, 0, MAXMIPLEVELS, tc );
+}
+
+
+bool
+WriteTexCache( char *file, long long sourceStamp, struct TexCache *tc )
+{
+	char tmp[300];
+	FILE *fp = OpenCacheFile( file, tmp, sizeof(tmp) );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write texture cache '%s'\n", file );
+		return false;
+	}
+
+	tc->header.sourceStamp = sourceStamp;
+	bool ok = fwrite( &tc->header, sizeof(struct TexCacheHeader), 1, fp ) == 1;
+	for( int level = 0; ok  &&  level < tc->header.numLevels; level++ )
+	{
+		for( int face = 0; ok  &&  face < tc->header.numFaces; face++ )
+		{
+			int size = tc->sizes[level][face];
+			ok = fwrite( &size, sizeof(int), 1, fp ) == 1;
+			ok = ok  &&  fwrite( tc->data[level][face], 1, size, fp ) == (size_t)size;
+		}
+	}
+	ok = CloseCacheFile( fp, tmp, file, ok );
+
+	if( ! ok )
+		fprintf( stderr, "Error writing texture cache '%s'\n", file );
+	return ok;
+}
+
+#endif		// #ifndef TEXCACHE_CPP
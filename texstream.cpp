@@ -0,0 +1,448 @@
+#ifndef TEXSTREAM_CPP
+#define TEXSTREAM_CPP
+
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "texstream.h"
+
+
+bool	IsGlExtensionSupported( const char * );
+
+
+TextureStreamer::TextureStreamer( )
+{
+	Pbo = 0;
+	Mapped = NULL;
+	Persistent = false;
+	Blocking = false;
+	NumSlots = 0;
+	SlotBytes = 0;
+	NextSlot = 0;
+	BytesUploaded = 0;
+	SlotWaits = 0;
+	for( int i = 0; i < TEXSTREAM_MAXSLOTS; i++ )
+		Fences[i] = 0;
+}
+
+
+// numSlots buffers of slotBytes each:
+// (each call to Update( ) can fill at most all of them)
+
+void
+TextureStreamer::Init( int numSlots, int slotBytes )
+{
+	if( numSlots > TEXSTREAM_MAXSLOTS )
+		numSlots = TEXSTREAM_MAXSLOTS;
+	NumSlots = numSlots;
+	SlotBytes = slotBytes;
+	NextSlot = 0;
+
+	glGenBuffers( 1, &Pbo );
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, Pbo );
+
+	Persistent = IsGlExtensionSupported( "GL_ARB_buffer_storage" );
+	if( Persistent )
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_PIXEL_UNPACK_BUFFER, NumSlots * SlotBytes, NULL, flags );
+		Mapped = (unsigned char *)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, NumSlots * SlotBytes, flags );
+		if( Mapped == NULL )
+		{
+			fprintf( stderr, "Could not persistently map the texture streaming buffer\n" );
+			Persistent = false;
+			glDeleteBuffers( 1, &Pbo );
+			glGenBuffers( 1, &Pbo );
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, Pbo );
+		}
+	}
+
+	// without persistent mapping, each slot is mapped unsynchronized on its own --
+	// the fences already guarantee the gpu is done with it:
+
+	if( ! Persistent )
+		glBufferData( GL_PIXEL_UNPACK_BUFFER, NumSlots * SlotBytes, NULL, GL_STREAM_DRAW );
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+	fprintf( stderr, "Texture streamer: %d slots x %d KB, %s\n", NumSlots, SlotBytes / 1024,
+		Persistent ? "persistently mapped" : "mapped per upload" );
+}
+
+
+void
+TextureStreamer::Destroy( )
+{
+	while( ! Jobs.empty( ) )
+	{
+		delete [ ] Jobs.front( ).pixels;
+		Jobs.pop_front( );
+	}
+
+	for( int i = 0; i < NumSlots; i++ )
+	{
+		if( Fences[i] != 0 )
+			glDeleteSync( Fences[i] );
+		Fences[i] = 0;
+	}
+
+	if( Pbo != 0 )
+	{
+		if( Persistent )
+		{
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, Pbo );
+			glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+		}
+		glDeleteBuffers( 1, &Pbo );
+	}
+	Pbo = 0;
+	Mapped = NULL;
+}
+
+
+// forget whatever is still queued for texture tex (it is about to be respecified) --
+// returns one more than the coarsest level that hadn't all arrived, so the levels
+// from there on are the ones that did, or -1 if nothing was still queued:
+
+int
+TextureStreamer::Cancel( GLuint tex )
+{
+	int missing = -1;
+	for( std::deque<struct StreamJob>::iterator it = Jobs.begin( ); it != Jobs.end( ); )
+	{
+		if( it->tex == tex )
+		{
+			if( it->level + 1 > missing )
+				missing = it->level + 1;
+			delete [ ] it->pixels;
+			it = Jobs.erase( it );
+		}
+		else
+			it++;
+	}
+	return missing;
+}
+
+
+bool
+TextureStreamer::IsValid( )
+{
+	return Pbo != 0;
+}
+
+
+// wait for a busy slot, rather than leave the rest to the next frame:
+
+void
+TextureStreamer::SetBlocking( bool blocking )
+{
+	Blocking = blocking;
+}
+
+
+bool
+TextureStreamer::IsIdle( )
+{
+	return Jobs.empty( );
+}
+
+
+int
+TextureStreamer::NumPending( )
+{
+	return (int)Jobs.size( );
+}
+
+
+unsigned char *
+TextureStreamer::MapSlot( int slot )
+{
+	if( Persistent )
+		return Mapped + slot * SlotBytes;
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+	return (unsigned char *)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, slot * SlotBytes, SlotBytes, flags );
+}
+
+
+void
+TextureStreamer::UnmapSlot( )
+{
+	if( ! Persistent )
+		glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+}
+
+
+// queue one uncompressed level (format is GL_RGB or GL_RGBA, unsigned bytes)
+// the storage is allocated right away, the streamer takes ownership of the pixels
+
+void
+TextureStreamer::Queue( GLuint tex, GLenum bindTarget, GLenum imageTarget, int level, int width, int height, GLenum format, unsigned char *pixels )
+{
+	int bpp = ( format == GL_RGBA )  ?  4  :  3;
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	glBindTexture( bindTarget, tex );
+	glTexImage2D( imageTarget, level, ( format == GL_RGBA ) ? GL_RGBA8 : GL_RGB8, width, height, 0, format, GL_UNSIGNED_BYTE, NULL );
+
+	struct StreamJob job;
+	job.tex = tex;
+	job.bindTarget = bindTarget;
+	job.imageTarget = imageTarget;
+	job.level = level;
+	job.width = width;
+	job.height = height;
+	job.format = format;
+	job.compressed = false;
+	job.rowBytes = bpp * width;
+	job.numRows = height;
+	job.pixels = pixels;
+	job.nextRow = 0;
+	job.setBaseLevel = -1;
+	Jobs.push_back( job );
+}
+
+
+// queue one block-compressed level (4x4 blocks of blockBytes each):
+
+void
+TextureStreamer::QueueCompressed( GLuint tex, GLenum bindTarget, GLenum imageTarget, int level, int width, int height, GLenum format, int blockBytes, unsigned char *blocks )
+{
+	int bw = ( width+3 ) / 4;
+	int bh = ( height+3 ) / 4;
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	glBindTexture( bindTarget, tex );
+	glCompressedTexImage2D( imageTarget, level, format, width, height, 0, blockBytes * bw * bh, NULL );
+
+	struct StreamJob job;
+	job.tex = tex;
+	job.bindTarget = bindTarget;
+	job.imageTarget = imageTarget;
+	job.level = level;
+	job.width = width;
+	job.height = height;
+	job.format = format;
+	job.compressed = true;
+	job.rowBytes = blockBytes * bw;
+	job.numRows = bh;
+	job.pixels = blocks;
+	job.nextRow = 0;
+	job.setBaseLevel = -1;
+	Jobs.push_back( job );
+}
+
+
+// stream up to maxBytes this frame, returns the number of bytes sent:
+// the call that finishes the last queued level of a texture can also
+// open that level up for sampling (see StreamJob.setBaseLevel)
+
+int
+TextureStreamer::Update( int maxBytes )
+{
+	int bytes = 0;
+	if( Pbo == 0 )
+		return 0;
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, Pbo );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+
+	while( ! Jobs.empty( )  &&  bytes < maxBytes )
+	{
+		// is the gpu done with the next slot?
+
+		int slot = NextSlot;
+		if( Fences[slot] != 0 )
+		{
+			GLenum status = glClientWaitSync( Fences[slot], 0, 0 );
+			if( status == GL_TIMEOUT_EXPIRED )
+			{
+				SlotWaits++;
+				if( ! Blocking )
+					break;
+				while( glClientWaitSync( Fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 ) == GL_TIMEOUT_EXPIRED )
+					;
+			}
+			glDeleteSync( Fences[slot] );
+			Fences[slot] = 0;
+		}
+
+		struct StreamJob *job = &Jobs.front( );
+		int rows = SlotBytes / job->rowBytes;
+		if( rows > job->numRows - job->nextRow )
+			rows = job->numRows - job->nextRow;
+		if( rows < 1 )
+		{
+			fprintf( stderr, "Texture streamer: a %d-byte row does not fit in a %d-byte slot\n", job->rowBytes, SlotBytes );
+			delete [ ] job->pixels;
+			Jobs.pop_front( );
+			continue;
+		}
+
+		int size = rows * job->rowBytes;
+		unsigned char *dst = MapSlot( slot );
+		if( dst == NULL )
+			break;
+		memcpy( dst, job->pixels + job->nextRow * job->rowBytes, size );
+		UnmapSlot( );
+
+		glBindTexture( job->bindTarget, job->tex );
+		GLintptr offset = slot * SlotBytes;
+		if( job->compressed )
+		{
+			int y = 4 * job->nextRow;
+			int h = 4 * rows;
+			if( y + h > job->height )
+				h = job->height - y;
+			glCompressedTexSubImage2D( job->imageTarget, job->level, 0, y, job->width, h, job->format, size, (const void *)offset );
+		}
+		else
+		{
+			glTexSubImage2D( job->imageTarget, job->level, 0, job->nextRow, job->width, rows, job->format, GL_UNSIGNED_BYTE, (const void *)offset );
+		}
+
+		Fences[slot] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		NextSlot = ( slot + 1 ) % NumSlots;
+
+		bytes += size;
+		job->nextRow += rows;
+		if( job->nextRow >= job->numRows )
+		{
+			if( job->setBaseLevel >= 0 )
+				glTexParameteri( job->bindTarget, GL_TEXTURE_BASE_LEVEL, job->setBaseLevel );
+			delete [ ] job->pixels;
+			Jobs.pop_front( );
+		}
+	}
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	BytesUploaded += bytes;
+	return bytes;
+}
+
+
+// once the most recently queued job is done, set GL_TEXTURE_BASE_LEVEL to level
+// (so a texture streamed smallest level first becomes sharper as it arrives)
+
+void
+TextureStreamer::SetBaseLevelWhenDone( int level )
+{
+	if( ! Jobs.empty( ) )
+		Jobs.back( ).setBaseLevel = level;
+}
+
+
+//////////////////////////////////////////////  stress test:
+
+
+// streams numTextures synthetic size x size rgb textures and reports the
+// per-frame cost of the uploads -- call StreamStressFrame( ) once per frame
+// until it returns false. the report has the spread of the frames' costs as
+// well as their average, since a hitch is one bad frame, not a bad average
+
+struct StreamStress
+{
+	int		numTextures;
+	GLuint *	textures;
+	int		frames;
+	double		sumMs, minMs, maxMs;
+	std::vector<double>	frameMs;	// each frame's
+	long long	startBytes;
+	double		startTime;
+};
+
+
+double
+StreamSeconds( )
+{
+#ifdef _OPENMP
+	return omp_get_wtime( );
+#else
+	return (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+void
+StartStreamStress( TextureStreamer *streamer, struct StreamStress *stress, int numTextures, int size )
+{
+	stress->numTextures = numTextures;
+	stress->textures = new GLuint[numTextures];
+	stress->frames = 0;
+	stress->sumMs = 0.;
+	stress->minMs = 1.e+37;
+	stress->maxMs = 0.;
+	stress->frameMs.clear( );
+	stress->startBytes = streamer->BytesUploaded;
+
+	glGenTextures( numTextures, stress->textures );
+	for( int i = 0; i < numTextures; i++ )
+	{
+		unsigned char *pixels = new unsigned char[ 3 * size * size ];
+		for( int t = 0; t < size; t++ )
+		{
+			for( int s = 0; s < size; s++ )
+			{
+				unsigned char *p = &pixels[ 3 * ( size*t + s ) ];
+				p[0] = (unsigned char)( s + i );
+				p[1] = (unsigned char)( t + 3*i );
+				p[2] = (unsigned char)( ( ( s / 32 ) + ( t / 32 ) + i ) & 1 ? 255 : 0 );
+			}
+		}
+		glBindTexture( GL_TEXTURE_2D, stress->textures[i] );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+		streamer->Queue( stress->textures[i], GL_TEXTURE_2D, GL_TEXTURE_2D, 0, size, size, GL_RGB, pixels );
+	}
+
+	fprintf( stderr, "Stream stress: queued %d textures of %d x %d (%.1f MB)\n",
+		numTextures, size, size, (double)numTextures * 3. * size * size / ( 1024. * 1024. ) );
+	stress->startTime = StreamSeconds( );
+}
+
+
+bool
+StreamStressFrame( TextureStreamer *streamer, struct StreamStress *stress, int maxBytesPerFrame )
+{
+	if( stress->textures == NULL )
+		return false;
+
+	double t0 = StreamSeconds( );
+	streamer->Update( maxBytesPerFrame );
+	double ms = 1000. * ( StreamSeconds( ) - t0 );
+
+	stress->frames++;
+	stress->sumMs += ms;
+	stress->frameMs.push_back( ms );
+	if( ms < stress->minMs )	stress->minMs = ms;
+	if( ms > stress->maxMs )	stress->maxMs = ms;
+
+	if( ! streamer->IsIdle( ) )
+		return true;
+
+	glFinish( );
+	double seconds = StreamSeconds( ) - stress->startTime;
+	double mb = (double)( streamer->BytesUploaded - stress->startBytes ) / ( 1024. * 1024. );
+	fprintf( stderr, "Stream stress: %d textures in %d frames, upload time per frame: min %.3f ms, avg %.3f ms, max %.3f ms\n",
+		stress->numTextures, stress->frames, stress->minMs, stress->sumMs / (double)stress->frames, stress->maxMs );
+	std::vector<double> sorted = stress->frameMs;
+	std::sort( sorted.begin( ), sorted.end( ) );
+	int n = (int)sorted.size( );
+	fprintf( stderr, "Stream stress: upload time per frame: median %.3f ms, 95th percentile %.3f ms, 99th %.3f ms\n",
+		sorted[ n/2 ], sorted[ ( 95*(n-1) ) / 100 ], sorted[ ( 99*(n-1) ) / 100 ] );
+	fprintf( stderr, "Stream stress: %.1f MB in %.3f s = %.1f MB/s, %d waits for a free slot\n",
+		mb, seconds, mb / seconds, streamer->SlotWaits );
+
+	glDeleteTextures( stress->numTextures, stress->textures );
+	delete [ ] stress->textures;
+	stress->textures = NULL;
+	return false;
+}
+
+#endif		// #ifndef TEXSTREAM_CPP
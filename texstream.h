@@ -0,0 +1,76 @@
+#ifndef TEXSTREAM_H
+#define TEXSTREAM_H
+
+#include <stdio.h>
+#include <deque>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+
+// streams texture levels to the gpu a few rows at a time through a ring of
+// persistently-mapped pixel unpack buffers, so that big textures arrive over
+// several frames instead of stalling the frame that loads them
+//
+// each slot of the ring is fenced after its glTexSubImage2D( ) -- a slot is only
+// refilled once the gpu has finished reading it, and if no slot is free the
+// upload simply waits for the next frame rather than blocking. (SetBlocking( true )
+// waits for the slot instead, so what arrives by which frame doesn't depend on how
+// fast the gpu is -- for batch rendering, where the same frame has to come out the
+// same every time)
+
+#define TEXSTREAM_MAXSLOTS	16
+
+struct StreamJob
+{
+	GLuint		tex;
+	GLenum		bindTarget;	// GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+	GLenum		imageTarget;	// GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP_POSITIVE_X + face
+	int		level;
+	int		width, height;
+	GLenum		format;		// GL_RGB, GL_RGBA, or a GL_COMPRESSED_* internal format
+	bool		compressed;
+	int		rowBytes;	// bytes in one row (one row of 4x4 blocks if compressed)
+	int		numRows;	// rows (block rows if compressed)
+	unsigned char *	pixels;		// owned by the job, delete[ ]'ed when it is done
+	int		nextRow;
+	int		setBaseLevel;	// >= 0: set GL_TEXTURE_BASE_LEVEL to this once done
+};
+
+
+class TextureStreamer
+{
+  private:
+	GLuint			Pbo;
+	unsigned char *		Mapped;		// the whole ring, if persistently mapped
+	bool			Persistent;
+	bool			Blocking;
+	int			NumSlots;
+	int			SlotBytes;
+	int			NextSlot;
+	GLsync			Fences[TEXSTREAM_MAXSLOTS];
+	std::deque<struct StreamJob>	Jobs;
+
+	unsigned char *	MapSlot( int );
+	void		UnmapSlot( );
+
+  public:
+	long long		BytesUploaded;
+	int			SlotWaits;	// times Update( ) stopped because the ring was full
+
+		TextureStreamer( );
+
+	void	Destroy( );
+	int	Cancel( GLuint );
+	void	Init( int, int );
+	bool	IsIdle( );
+	bool	IsValid( );
+	int	NumPending( );
+	void	Queue( GLuint, GLenum, GLenum, int, int, int, GLenum, unsigned char * );
+	void	QueueCompressed( GLuint, GLenum, GLenum, int, int, int, GLenum, int, unsigned char * );
+	void	SetBaseLevelWhenDone( int );
+	void	SetBlocking( bool );
+	int	Update( int );
+};
+
+#endif		// #ifndef TEXSTREAM_H
@@ -0,0 +1,61 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdio.h>
+#include <vector>
+
+
+// which scene objects and lights are active at each point of a looping animation
+//
+// every object declares the intervals of the loop it is active in with Add( ), under
+// a small integer id. Build( ) cuts the loop at every interval's start and end, so
+// that nothing turns on or off inside a segment, and gives each segment a bitmask
+// of its active ids. each frame Update( ) finds the segment the time is in -- almost
+// always the same one as last frame, or the next -- and IsActive( ) is then a single
+// bit test, no matter how many objects or intervals there are.
+//
+// an interval is [start, end), in seconds from the start of the loop
+
+struct TimelineInterval
+{
+	int		id;
+	float		start, end;
+};
+
+
+class Timeline
+{
+  private:
+	std::vector<struct TimelineInterval>	Intervals;
+	std::vector<float>			Cuts;		// segment i is [ Cuts[i], Cuts[i+1] )
+	std::vector<unsigned int>		Masks;		// NumWords per segment
+	float		Period;
+	int		NumIds;
+	int		NumWords;
+	int		Segment;		// the segment the last Update( ) was in
+	unsigned int *	Current;		// its mask
+	bool		Built;
+	bool		Enabled;
+
+	int		FindSegment( float );
+
+  public:
+	// statistics:
+	int		SegmentChanges;		// times Update( ) moved to a new segment
+	int		Searches;		// ... and had to search for it
+
+			Timeline( );
+
+	void		Add( int, float, float );
+	void		Build( );
+	bool		GetEnabled( );
+	int		GetSegment( );
+	void		Init( float );
+	bool		IsActive( int );
+	int		NumActive( );
+	void		PrintIntervals( char ** = NULL );
+	void		SetEnabled( bool );
+	void		Update( float );
+};
+
+#endif		// #ifndef TIMELINE_H
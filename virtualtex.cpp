@@ -0,0 +1,589 @@
+#ifndef VIRTUALTEX_CPP
+#define VIRTUALTEX_CPP
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "vtpages.cpp"
+#include "virtualtex.h"
+
+
+bool	IsGlExtensionSupported( const char * );
+
+
+// a page is named by its level and position:
+
+#define VT_KEY( level, x, y )	( ( (level) << 24 ) | ( (y) << 12 ) | (x) )
+#define VT_KEYLEVEL( key )	( (key) >> 24 )
+#define VT_KEYY( key )		( ( (key) >> 12 ) & 0xfff )
+#define VT_KEYX( key )		( (key) & 0xfff )
+
+
+VirtualTexture::VirtualTexture( )
+{
+	memset( &PageFile, 0, sizeof(struct VtPageFile) );
+	CacheTiles = 0;
+	Compressed = false;
+	CacheTex = IndirectionTex = 0;
+	FeedbackFbo = FeedbackColor = FeedbackDepth = 0;
+	LodBias = 0.f;
+	Frame = 0;
+	IndirectionDirty = false;
+	Blocking = false;
+	LoaderGone = true;
+	Quit = false;
+	PagesRequested = PageHits = PagesLoaded = PagesEvicted = 0;
+	CacheFull = 0;
+	FeedbackPasses = 0;
+	FeedbackMs = 0.;
+}
+
+
+// only stops the loader -- the gl objects go with the context:
+
+VirtualTexture::~VirtualTexture( )
+{
+	StopLoader( );
+}
+
+
+void
+VirtualTexture::StopLoader( )
+{
+	if( Loader.joinable( ) )
+	{
+		{
+			std::lock_guard<std::mutex> guard( Lock );
+			Quit = true;
+		}
+		Wake.notify_all( );
+		Loader.join( );
+		LoaderGone = true;
+	}
+}
+
+
+// open the page file and set up the page cache (cacheTiles x cacheTiles pages),
+// the indirection texture, the feedback framebuffer, and the loader thread:
+
+bool
+VirtualTexture::Init( char *file, long long sourceStamp, int cacheTiles )
+{
+	if( ! OpenPageFile( file, sourceStamp, &PageFile ) )
+	{
+		fprintf( stderr, "Cannot open page file '%s'\n", file );
+		return false;
+	}
+	int top = PageFile.header.numLevels - 1;
+	if( PageFile.pagesX[0] > 4096  ||  PageFile.pagesY[0] > 4096  ||  cacheTiles > 255  ||
+	    cacheTiles * cacheTiles <= PageFile.pagesX[top] * PageFile.pagesY[top] )
+	{
+		fprintf( stderr, "Page file '%s' doesn't fit a %d x %d page cache\n", file, cacheTiles, cacheTiles );
+		ClosePageFile( &PageFile );
+		return false;
+	}
+
+	CacheTiles = cacheTiles;
+	Slots.resize( CacheTiles * CacheTiles );
+	for( int i = 0; i < (int)Slots.size( ); i++ )
+	{
+		Slots[i].key = -1;
+		Slots[i].lastFrame = -1;
+		Slots[i].pinned = false;
+	}
+
+	// the page cache -- BC1 if the driver can sample it, otherwise pages are decoded to rgb:
+
+	Compressed = IsGlExtensionSupported( "GL_EXT_texture_compression_s3tc" );
+	int size = CacheTiles * VT_TILESIZE;
+	glGenTextures( 1, &CacheTex );
+	glBindTexture( GL_TEXTURE_2D, CacheTex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0 );
+	if( Compressed )
+		glCompressedTexImage2D( GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, size, size, 0, BcImageBytes( BC_1, size, size ), NULL );
+	else
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL );
+
+	// the indirection texture -- one texel per page, one mip level per virtual level:
+
+	glGenTextures( 1, &IndirectionTex );
+	glBindTexture( GL_TEXTURE_2D, IndirectionTex );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, top );
+	for( int level = 0; level <= top; level++ )
+	{
+		Indirection[level].assign( 4 * PageFile.pagesX[level] * PageFile.pagesY[level], 0 );
+		glTexImage2D( GL_TEXTURE_2D, level, GL_RGBA8, PageFile.pagesX[level], PageFile.pagesY[level], 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+	}
+
+	// the feedback framebuffer:
+
+	glGetIntegerv( GL_FRAMEBUFFER_BINDING, &SavedFbo );
+	glGenFramebuffers( 1, &FeedbackFbo );
+	glBindFramebuffer( GL_FRAMEBUFFER, FeedbackFbo );
+	glGenRenderbuffers( 1, &FeedbackColor );
+	glBindRenderbuffer( GL_RENDERBUFFER, FeedbackColor );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, VT_FEEDBACKWIDTH, VT_FEEDBACKHEIGHT );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, FeedbackColor );
+	glGenRenderbuffers( 1, &FeedbackDepth );
+	glBindRenderbuffer( GL_RENDERBUFFER, FeedbackDepth );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, VT_FEEDBACKWIDTH, VT_FEEDBACKHEIGHT );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, FeedbackDepth );
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		fprintf( stderr, "Virtual texture feedback framebuffer is incomplete (0x%x)\n", status );
+		Destroy( );
+		return false;
+	}
+	FeedbackPixels.resize( 4 * VT_FEEDBACKWIDTH * VT_FEEDBACKHEIGHT );
+
+	// the coarsest level goes in now and stays:
+
+	unsigned char *blocks = new unsigned char[ PageFile.header.pageBytes ];
+	for( int y = 0; y < PageFile.pagesY[top]; y++ )
+	{
+		for( int x = 0; x < PageFile.pagesX[top]; x++ )
+		{
+			if( ! ReadPage( &PageFile, top, x, y, blocks ) )
+				continue;
+			int slot = FindSlot( );
+			int key = VT_KEY( top, x, y );
+			Slots[slot].key = key;
+			Slots[slot].pinned = true;
+			Resident[key] = slot;
+			if( Compressed )
+				Upload( slot, blocks );
+			else
+			{
+				unsigned char *rgb = DecodeBc( blocks, VT_TILESIZE, VT_TILESIZE, BC_1 );
+				Upload( slot, rgb );
+				delete [ ] rgb;
+			}
+		}
+	}
+	delete [ ] blocks;
+	RebuildIndirection( );
+
+	strncpy( FileName, file, sizeof(FileName) - 1 );
+	FileName[ sizeof(FileName) - 1 ] = '\0';
+	Quit = false;
+	LoaderGone = false;
+	Loader = std::thread( &VirtualTexture::LoaderThread, this );
+
+	fprintf( stderr, "Virtual texture '%s': %d x %d, %d levels, %d x %d page cache (%s)\n",
+		file, PageFile.header.width, PageFile.header.height, PageFile.header.numLevels, CacheTiles, CacheTiles,
+		Compressed ? "BC1" : "rgb8" );
+	return true;
+}
+
+
+void
+VirtualTexture::Destroy( )
+{
+	StopLoader( );
+	while( ! Loaded.empty( ) )
+	{
+		delete [ ] Loaded.front( ).second;
+		Loaded.pop_front( );
+	}
+	Requests.clear( );
+	InFlight.clear( );
+	Resident.clear( );
+	Slots.clear( );
+
+	if( CacheTex != 0 )		glDeleteTextures( 1, &CacheTex );
+	if( IndirectionTex != 0 )	glDeleteTextures( 1, &IndirectionTex );
+	if( FeedbackFbo != 0 )		glDeleteFramebuffers( 1, &FeedbackFbo );
+	if( FeedbackColor != 0 )	glDeleteRenderbuffers( 1, &FeedbackColor );
+	if( FeedbackDepth != 0 )	glDeleteRenderbuffers( 1, &FeedbackDepth );
+	CacheTex = IndirectionTex = FeedbackFbo = FeedbackColor = FeedbackDepth = 0;
+	ClosePageFile( &PageFile );
+}
+
+
+bool
+VirtualTexture::IsValid( )
+{
+	return CacheTex != 0;
+}
+
+
+int
+VirtualTexture::GetNumLevels( )
+{
+	return PageFile.header.numLevels;
+}
+
+
+int
+VirtualTexture::GetCacheTiles( )
+{
+	return CacheTiles;
+}
+
+
+int
+VirtualTexture::VirtualWidth( )
+{
+	return PageFile.header.width;
+}
+
+
+int
+VirtualTexture::VirtualHeight( )
+{
+	return PageFile.header.height;
+}
+
+
+// how many levels coarser the feedback pass sees things than the window does:
+
+float
+VirtualTexture::GetLodBias( )
+{
+	return LodBias;
+}
+
+
+// the loader reads pages with its own file handle so the main thread never waits on the disk:
+
+void
+VirtualTexture::LoaderThread( )
+{
+	struct VtPageFile pf;
+	if( ! OpenPageFile( FileName, PageFile.header.sourceStamp, &pf ) )
+	{
+		fprintf( stderr, "Virtual texture loader cannot open '%s'\n", FileName );
+		std::lock_guard<std::mutex> guard( Lock );
+		LoaderGone = true;
+		Arrived.notify_all( );
+		return;
+	}
+
+	for( ; ; )
+	{
+		int key;
+		{
+			std::unique_lock<std::mutex> guard( Lock );
+			while( ! Quit  &&  Requests.empty( ) )
+				Wake.wait( guard );
+			if( Quit )
+				break;
+			key = Requests.front( );
+			Requests.pop_front( );
+		}
+
+		unsigned char *data = new unsigned char[ pf.header.pageBytes ];
+		if( ! ReadPage( &pf, VT_KEYLEVEL( key ), VT_KEYX( key ), VT_KEYY( key ), data ) )
+		{
+			delete [ ] data;
+			data = NULL;
+		}
+		else if( ! Compressed )
+		{
+			unsigned char *rgb = DecodeBc( data, VT_TILESIZE, VT_TILESIZE, BC_1 );
+			delete [ ] data;
+			data = rgb;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard( Lock );
+			Loaded.push_back( std::make_pair( key, data ) );
+		}
+		Arrived.notify_one( );
+	}
+	ClosePageFile( &pf );
+}
+
+
+// a free slot, or the least-recently-wanted page that wasn't wanted this frame:
+
+int
+VirtualTexture::FindSlot( )
+{
+	int lru = -1;
+	for( int i = 0; i < (int)Slots.size( ); i++ )
+	{
+		if( Slots[i].key < 0 )
+			return i;
+		if( Slots[i].pinned  ||  Slots[i].lastFrame >= Frame )
+			continue;
+		if( lru < 0  ||  Slots[i].lastFrame < Slots[lru].lastFrame )
+			lru = i;
+	}
+	return lru;
+}
+
+
+void
+VirtualTexture::Upload( int slot, unsigned char *data )
+{
+	int x = ( slot % CacheTiles ) * VT_TILESIZE;
+	int y = ( slot / CacheTiles ) * VT_TILESIZE;
+	glBindTexture( GL_TEXTURE_2D, CacheTex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	if( Compressed )
+		glCompressedTexSubImage2D( GL_TEXTURE_2D, 0, x, y, VT_TILESIZE, VT_TILESIZE, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, PageFile.header.pageBytes, data );
+	else
+		glTexSubImage2D( GL_TEXTURE_2D, 0, x, y, VT_TILESIZE, VT_TILESIZE, GL_RGB, GL_UNSIGNED_BYTE, data );
+	IndirectionDirty = true;
+}
+
+
+// every page points at itself if it is resident, or else at whatever its parent points at:
+
+void
+VirtualTexture::RebuildIndirection( )
+{
+	int top = PageFile.header.numLevels - 1;
+	glBindTexture( GL_TEXTURE_2D, IndirectionTex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	for( int level = top; level >= 0; level-- )
+	{
+		int px = PageFile.pagesX[level];
+		int py = PageFile.pagesY[level];
+		unsigned char *table = &Indirection[level][0];
+		for( int y = 0; y < py; y++ )
+		{
+			for( int x = 0; x < px; x++ )
+			{
+				unsigned char *e = &table[ 4 * ( y*px + x ) ];
+				std::map<int,int>::iterator it = Resident.find( VT_KEY( level, x, y ) );
+				if( it != Resident.end( ) )
+				{
+					e[0] = (unsigned char)( it->second % CacheTiles );
+					e[1] = (unsigned char)( it->second / CacheTiles );
+					e[2] = (unsigned char)level;
+					e[3] = 255;
+				}
+				else if( level < top )
+				{
+					int ppx = PageFile.pagesX[level+1];
+					unsigned char *parent = &Indirection[level+1][ 4 * ( (y/2)*ppx + x/2 ) ];
+					memcpy( e, parent, 4 );
+				}
+			}
+		}
+		glTexSubImage2D( GL_TEXTURE_2D, level, 0, 0, px, py, GL_RGBA, GL_UNSIGNED_BYTE, table );
+	}
+	IndirectionDirty = false;
+}
+
+
+// switch to the feedback framebuffer -- draw the virtually-textured objects with the
+// vtfeedback.frag program and the usual matrices between this and EndFeedback( ):
+
+void
+VirtualTexture::BeginFeedback( )
+{
+	Frame++;
+	glGetIntegerv( GL_FRAMEBUFFER_BINDING, &SavedFbo );
+	glGetIntegerv( GL_VIEWPORT, SavedViewport );
+	LodBias = 0.5f * ( log2f( (float)SavedViewport[2] / (float)VT_FEEDBACKWIDTH ) + log2f( (float)SavedViewport[3] / (float)VT_FEEDBACKHEIGHT ) );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, FeedbackFbo );
+	glViewport( 0, 0, VT_FEEDBACKWIDTH, VT_FEEDBACKHEIGHT );
+	glClearColor( 0., 0., 0., 0. );
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+}
+
+
+// read the feedback back and ask the loader for the pages that aren't resident:
+
+void
+VirtualTexture::EndFeedback( )
+{
+	double t0 = BcSeconds( );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, VT_FEEDBACKWIDTH, VT_FEEDBACKHEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, &FeedbackPixels[0] );
+	glBindFramebuffer( GL_FRAMEBUFFER, SavedFbo );
+	glViewport( SavedViewport[0], SavedViewport[1], SavedViewport[2], SavedViewport[3] );
+
+	// pixel: page x low bits, page y low bits, high bits of both, level+1 (0 = nothing drawn)
+
+	std::vector<int> keys;
+	for( int i = 0; i < VT_FEEDBACKWIDTH * VT_FEEDBACKHEIGHT; i++ )
+	{
+		unsigned char *p = &FeedbackPixels[ 4*i ];
+		if( p[3] == 0 )
+			continue;
+		int x = p[0] | ( ( p[2] & 0xf ) << 8 );
+		int y = p[1] | ( ( p[2] >> 4 ) << 8 );
+		keys.push_back( VT_KEY( p[3] - 1, x, y ) );
+	}
+	std::sort( keys.begin( ), keys.end( ) );
+	keys.erase( std::unique( keys.begin( ), keys.end( ) ), keys.end( ) );
+
+	// coarse levels first, so the fallbacks fill in before the detail:
+
+	std::vector<int> wanted;
+	for( int i = (int)keys.size( ) - 1; i >= 0; i-- )
+	{
+		PagesRequested++;
+		std::map<int,int>::iterator it = Resident.find( keys[i] );
+		if( it != Resident.end( ) )
+		{
+			PageHits++;
+			Slots[it->second].lastFrame = Frame;
+		}
+		else if( InFlight.find( keys[i] ) == InFlight.end( )  &&  (int)InFlight.size( ) < VT_MAXINFLIGHT )
+		{
+			InFlight[ keys[i] ] = true;
+			wanted.push_back( keys[i] );
+		}
+	}
+	if( ! wanted.empty( ) )
+	{
+		{
+			std::lock_guard<std::mutex> guard( Lock );
+			Requests.insert( Requests.end( ), wanted.begin( ), wanted.end( ) );
+		}
+		Wake.notify_one( );
+	}
+
+	FeedbackPasses++;
+	FeedbackMs += 1000. * ( BcSeconds( ) - t0 );
+}
+
+
+// make Update( ) wait for every page asked for, and take them all:
+
+void
+VirtualTexture::SetBlocking( bool blocking )
+{
+	Blocking = blocking;
+}
+
+
+// move the pages the loader has finished into the cache:
+
+void
+VirtualTexture::Update( )
+{
+	// (every key in InFlight is either still with the loader or waiting in Loaded)
+	if( Blocking )
+	{
+		std::unique_lock<std::mutex> guard( Lock );
+		while( ! LoaderGone  &&  Loaded.size( ) < InFlight.size( ) )
+			Arrived.wait( guard );
+	}
+
+	for( int n = 0; Blocking  ||  n < VT_UPLOADSPERFRAME; n++ )
+	{
+		std::pair<int, unsigned char *> page;
+		{
+			std::lock_guard<std::mutex> guard( Lock );
+			if( Loaded.empty( ) )
+				break;
+			page = Loaded.front( );
+			Loaded.pop_front( );
+		}
+		InFlight.erase( page.first );
+		if( page.second == NULL )
+			continue;
+
+		int slot = FindSlot( );
+		if( slot < 0 )
+		{
+			// everything in the cache is in use this frame -- the page is asked for again later
+			CacheFull++;
+			delete [ ] page.second;
+			continue;
+		}
+		if( Slots[slot].key >= 0 )
+		{
+			Resident.erase( Slots[slot].key );
+			PagesEvicted++;
+		}
+		Slots[slot].key = page.first;
+		Slots[slot].lastFrame = Frame;
+		Resident[page.first] = slot;
+		Upload( slot, page.second );
+		delete [ ] page.second;
+		PagesLoaded++;
+	}
+
+	if( IndirectionDirty )
+		RebuildIndirection( );
+}
+
+
+// bind the page cache and the indirection texture to these texture units:
+
+void
+VirtualTexture::Bind( int cacheUnit, int indirectionUnit )
+{
+	glActiveTexture( GL_TEXTURE0 + cacheUnit );
+	glBindTexture( GL_TEXTURE_2D, CacheTex );
+	glActiveTexture( GL_TEXTURE0 + indirectionUnit );
+	glBindTexture( GL_TEXTURE_2D, IndirectionTex );
+}
+
+
+// the two textures Bind( ) binds, for binding them some other way:
+
+GLuint
+VirtualTexture::GetCacheTex( )
+{
+	return CacheTex;
+}
+
+
+GLuint
+VirtualTexture::GetIndirectionTex( )
+{
+	return IndirectionTex;
+}
+
+
+void
+VirtualTexture::PrintStats( )
+{
+	fprintf( stderr, "Virtual texture: %lld page requests, %.1f%% hits, %lld loaded, %lld evicted, %d cache-full, %d resident of %d slots\n",
+		PagesRequested, PagesRequested > 0 ? 100. * (double)PageHits / (double)PagesRequested : 0.,
+		PagesLoaded, PagesEvicted, CacheFull, (int)Resident.size( ), (int)Slots.size( ) );
+	if( FeedbackPasses > 0 )
+		fprintf( stderr, "Virtual texture: %.3f ms/frame reading back and scanning feedback\n", FeedbackMs / (double)FeedbackPasses );
+}
+
+
+// the page file for a bmp magnified to width x width/2 with synthetic detail, baked on the first run:
+
+bool
+LoadVirtualPlanet( VirtualTexture *vt, char *bmpFile, int width, int cacheTiles )
+{
+	char pageFile[256];
+	snprintf( pageFile, sizeof(pageFile), "%s.%d.vtpages", bmpFile, width );
+	long long stamp = 31 * SourceStamp( &bmpFile, 1 ) + width;
+
+	struct VtPageFile pf;
+	if( OpenPageFile( pageFile, stamp, &pf ) )
+		ClosePageFile( &pf );
+	else
+	{
+		struct PlanetSource ps;
+		if( ! InitPlanetSource( &ps, bmpFile, width ) )
+			return false;
+		fprintf( stderr, "Baking %d x %d virtual texture from '%s' into '%s'\n", width, width/2, bmpFile, pageFile );
+		bool ok = BuildPageFile( pageFile, width, width/2, stamp, PlanetTexel, &ps );
+		FreePlanetSource( &ps );
+		if( ! ok )
+			return false;
+	}
+	return vt->Init( pageFile, stamp, cacheTiles );
+}
+
+#endif		// #ifndef VIRTUALTEX_CPP
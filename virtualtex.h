@@ -0,0 +1,120 @@
+#ifndef VIRTUALTEX_H
+#define VIRTUALTEX_H
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "glew.h"
+#include <GL/gl.h>
+
+
+// a virtual texture drawn from a page file (see vtpages.cpp)
+//
+// each frame:
+//	1. the objects using it are drawn into a small feedback framebuffer whose
+//	   pixels say which page, at which level, each fragment wants
+//	2. the feedback is read back, and every page that isn't in the page cache is
+//	   handed to a loader thread that reads it from the page file
+//	3. pages the loader has finished are copied into free (or least-recently-used)
+//	   slots of the page cache texture, and the indirection texture is rebuilt
+//	4. the objects are drawn with earthvt.frag, which looks up each fragment's page
+//	   in the indirection texture and samples the page cache there -- a page that isn't
+//	   in yet falls back to the closest coarser level that is
+//
+// the coarsest level is loaded up front and never evicted, so there is always
+// something to fall back to.
+//
+// a page comes in whenever the loader gets to it, so what is drawn depends on the
+// disk's timing. SetBlocking( true ) makes Update( ) wait for every page the last
+// feedback pass asked for, and move them all into the cache, so that what a frame
+// draws depends only on the frames before it (for rendering a batch of frames).
+
+#define VT_FEEDBACKWIDTH	160
+#define VT_FEEDBACKHEIGHT	120
+#define VT_MAXINFLIGHT		64		// pages queued for the loader at once
+#define VT_UPLOADSPERFRAME	16
+
+
+struct VtSlot
+{
+	int		key;		// page in this slot, -1 = free
+	int		lastFrame;	// last frame the page was asked for
+	bool		pinned;
+};
+
+
+class VirtualTexture
+{
+  private:
+	struct VtPageFile	PageFile;
+	char			FileName[256];
+	int			CacheTiles;	// the page cache is CacheTiles x CacheTiles slots
+	bool			Compressed;	// the page cache is BC1, else the pages are decoded
+	GLuint			CacheTex;
+	GLuint			IndirectionTex;
+	GLuint			FeedbackFbo, FeedbackColor, FeedbackDepth;
+	GLint			SavedFbo, SavedViewport[4];
+	float			LodBias;
+	int			Frame;
+
+	std::vector<struct VtSlot>		Slots;
+	std::map<int,int>			Resident;	// page key -> slot
+	std::map<int,bool>			InFlight;	// page keys requested from the loader
+	std::vector<unsigned char>		Indirection[VT_MAXLEVELS];	// rgba per page: slot x, slot y, level
+	std::vector<unsigned char>		FeedbackPixels;
+	bool					IndirectionDirty;
+	bool					Blocking;
+
+	// the loader thread and what it shares with the main thread:
+	std::thread				Loader;
+	std::mutex				Lock;
+	std::condition_variable			Wake;
+	std::condition_variable			Arrived;	// the loader has finished a page
+	std::deque<int>				Requests;
+	std::deque< std::pair<int, unsigned char *> >	Loaded;
+	bool					Quit;
+	bool					LoaderGone;	// there's no loader to wait for
+
+	void		LoaderThread( );
+	int		FindSlot( );
+	void		Upload( int, unsigned char * );
+	void		RebuildIndirection( );
+	void		StopLoader( );
+
+  public:
+	// statistics:
+	long long	PagesRequested;		// unique pages wanted, summed over all feedback passes
+	long long	PageHits;		// ... of those, the ones already resident
+	long long	PagesLoaded;
+	long long	PagesEvicted;
+	int		CacheFull;		// uploads skipped because every slot was in use
+	int		FeedbackPasses;
+	double		FeedbackMs;		// cpu time spent reading back and scanning feedback
+
+		VirtualTexture( );
+		~VirtualTexture( );
+
+	void	BeginFeedback( );
+	void	Bind( int, int );
+	void	Destroy( );
+	void	EndFeedback( );
+	GLuint	GetCacheTex( );
+	int	GetCacheTiles( );
+	GLuint	GetIndirectionTex( );
+	float	GetLodBias( );
+	int	GetNumLevels( );
+	bool	Init( char *, long long, int );
+	bool	IsValid( );
+	void	PrintStats( );
+	void	SetBlocking( bool );
+	void	Update( );
+	int	VirtualHeight( );
+	int	VirtualWidth( );
+};
+
+#endif		// #ifndef VIRTUALTEX_H
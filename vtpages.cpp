@@ -0,0 +1,464 @@
+#ifndef VTPAGES_CPP
+#define VTPAGES_CPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// (keep the modules below from compiling their own TEST mains into this one's)
+
+#ifdef TEST
+#undef TEST
+#define VTPAGES_TEST
+#endif
+
+#include "mipmaps.cpp"
+#include "bcencode.cpp"
+#include "cachefile.cpp"
+
+
+unsigned char *	BmpToTexture( char *, int *, int * );
+
+
+// page files for virtual texturing
+//
+// a virtual texture too big to upload whole is cut into VT_PAGESIZE x VT_PAGESIZE pages,
+// at every mip level down to the one where it is a single page tall. each page is
+// stored with a VT_BORDER-texel apron copied from its neighbours (wrapping around in s,
+// clamped in t) so that bilinear filtering inside the page cache never reads the page
+// next door. pages are BC1-compressed and all the same size, so a page is found by
+// arithmetic alone:
+//
+//	struct VtHeader
+//	level 0 pages, row by row from t = 0
+//	level 1 pages
+//	...
+//
+// rows run in the same direction as BmpToTexture( ) -- page row 0 is at t = 0.
+
+#define VT_MAGIC	0x5054564f		// "OVTP"
+#define VT_VERSION	1
+#define VT_PAGESIZE	128
+#define VT_BORDER	4
+#define VT_TILESIZE	( VT_PAGESIZE + 2*VT_BORDER )
+#define VT_MAXLEVELS	16
+
+struct VtHeader
+{
+	int		magic;
+	int		version;
+	int		width, height;	// of virtual level 0, multiples of VT_PAGESIZE
+	int		pageSize;
+	int		border;
+	int		numLevels;
+	int		pageBytes;	// one BC1 tile
+	long long	sourceStamp;
+};
+
+struct VtPageFile
+{
+	struct VtHeader	header;
+	int		pagesX[VT_MAXLEVELS];
+	int		pagesY[VT_MAXLEVELS];
+	long long	firstPage[VT_MAXLEVELS];	// index of the level's first page in the file
+	FILE *		fp;
+};
+
+
+// produces the color of the texel centered at (s,t) of virtual level 'level':
+
+typedef void	(*VtTexelFunc)( void *, int, float, float, unsigned char[3] );
+
+
+// fill in the page counts of every level:
+
+static
+void
+VtLayout( struct VtPageFile *pf, int width, int height )
+{
+	struct VtHeader *h = &pf->header;
+	h->magic = VT_MAGIC;
+	h->version = VT_VERSION;
+	h->width = width;
+	h->height = height;
+	h->pageSize = VT_PAGESIZE;
+	h->border = VT_BORDER;
+	h->pageBytes = BcImageBytes( BC_1, VT_TILESIZE, VT_TILESIZE );
+
+	long long first = 0;
+	int level = 0;
+	int px = width / VT_PAGESIZE;
+	int py = height / VT_PAGESIZE;
+	while( level < VT_MAXLEVELS )
+	{
+		pf->pagesX[level] = px;
+		pf->pagesY[level] = py;
+		pf->firstPage[level] = first;
+		first += (long long)px * py;
+		level++;
+		if( px == 1  ||  py == 1 )
+			break;
+		px /= 2;
+		py /= 2;
+	}
+	h->numLevels = level;
+}
+
+
+// bake a page file, returns false if it couldn't be written:
+
+bool
+BuildPageFile( char *file, int width, int height, long long sourceStamp, VtTexelFunc texel, void *user )
+{
+	struct VtPageFile pf;
+	memset( &pf, 0, sizeof(struct VtPageFile) );
+	if( width % VT_PAGESIZE != 0  ||  height % VT_PAGESIZE != 0 )
+	{
+		fprintf( stderr, "Virtual texture size %d x %d is not a multiple of %d\n", width, height, VT_PAGESIZE );
+		return false;
+	}
+	VtLayout( &pf, width, height );
+	pf.header.sourceStamp = sourceStamp;
+
+	char tmp[300];
+	FILE *fp = OpenCacheFile( file, tmp, sizeof(tmp) );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write page file '%s'\n", file );
+		return false;
+	}
+	bool ok = fwrite( &pf.header, sizeof(struct VtHeader), 1, fp ) == 1;
+
+	double t0 = BcSeconds( );
+	int pageBytes = pf.header.pageBytes;
+	for( int level = 0; ok  &&  level < pf.header.numLevels; level++ )
+	{
+		int px = pf.pagesX[level];
+		int py = pf.pagesY[level];
+		float lw = (float)( px * VT_PAGESIZE );
+		float lh = (float)( py * VT_PAGESIZE );
+		unsigned char *row = new unsigned char[ px * pageBytes ];
+
+		// a row of pages at a time -- each page is generated and compressed by one thread:
+
+		for( int y = 0; ok  &&  y < py; y++ )
+		{
+			#pragma omp parallel for schedule(dynamic)
+			for( int x = 0; x < px; x++ )
+			{
+				unsigned char *tile = new unsigned char[ 3 * VT_TILESIZE * VT_TILESIZE ];
+				for( int j = 0; j < VT_TILESIZE; j++ )
+				{
+					float tt = ( (float)( y*VT_PAGESIZE - VT_BORDER + j ) + 0.5f ) / lh;
+					if( tt < 0.f )		tt = 0.5f / lh;
+					if( tt > 1.f )		tt = 1.f - 0.5f / lh;
+					for( int i = 0; i < VT_TILESIZE; i++ )
+					{
+						float ss = ( (float)( x*VT_PAGESIZE - VT_BORDER + i ) + 0.5f ) / lw;
+						ss -= floorf( ss );
+						( *texel )( user, level, ss, tt, &tile[ 3 * ( j*VT_TILESIZE + i ) ] );
+					}
+				}
+				unsigned char *blocks = EncodeBc( tile, VT_TILESIZE, VT_TILESIZE, BC_1 );
+				memcpy( &row[ x * pageBytes ], blocks, pageBytes );
+				delete [ ] blocks;
+				delete [ ] tile;
+			}
+			ok = fwrite( row, 1, px * pageBytes, fp ) == (size_t)( px * pageBytes );
+		}
+		delete [ ] row;
+		fprintf( stderr, "Page file '%s': level %2d, %4d x %4d pages done, %6.1f s\n", file, level, px, py, BcSeconds( ) - t0 );
+	}
+	ok = CloseCacheFile( fp, tmp, file, ok );
+
+	if( ! ok )
+		fprintf( stderr, "Error writing page file '%s'\n", file );
+	return ok;
+}
+
+
+// open a page file for reading, returns false if it is missing or stale:
+
+bool
+OpenPageFile( char *file, long long sourceStamp, struct VtPageFile *pf )
+{
+	memset( pf, 0, sizeof(struct VtPageFile) );
+	FILE *fp = fopen( file, "rb" );
+	if( fp == NULL )
+		return false;
+
+	struct VtHeader h;
+	bool ok = fread( &h, sizeof(struct VtHeader), 1, fp ) == 1;
+	ok = ok  &&  h.magic == VT_MAGIC  &&  h.version == VT_VERSION  &&  h.sourceStamp == sourceStamp;
+	ok = ok  &&  h.pageSize == VT_PAGESIZE  &&  h.border == VT_BORDER;
+	if( ! ok )
+	{
+		fclose( fp );
+		return false;
+	}
+
+	VtLayout( pf, h.width, h.height );
+	pf->header.sourceStamp = h.sourceStamp;
+	pf->fp = fp;
+	return true;
+}
+
+
+void
+ClosePageFile( struct VtPageFile *pf )
+{
+	if( pf->fp != NULL )
+		fclose( pf->fp );
+	pf->fp = NULL;
+}
+
+
+// read one BC1 tile (pf->header.pageBytes bytes):
+// (not thread-safe on the same VtPageFile -- give each thread its own)
+
+bool
+ReadPage( struct VtPageFile *pf, int level, int x, int y, unsigned char *blocks )
+{
+	if( level < 0  ||  level >= pf->header.numLevels  ||  x < 0  ||  x >= pf->pagesX[level]  ||  y < 0  ||  y >= pf->pagesY[level] )
+		return false;
+
+	long long page = pf->firstPage[level] + (long long)y * pf->pagesX[level] + x;
+	long long offset = (long long)sizeof(struct VtHeader) + page * pf->header.pageBytes;
+#ifdef WIN32
+	if( _fseeki64( pf->fp, offset, SEEK_SET ) != 0 )
+#else
+	if( fseeko( pf->fp, (off_t)offset, SEEK_SET ) != 0 )
+#endif
+		return false;
+	return fread( blocks, 1, pf->header.pageBytes, pf->fp ) == (size_t)pf->header.pageBytes;
+}
+
+
+//////////////////////////////////////////////  a synthetic giant planet:
+
+
+// a planet texture far bigger than any bmp on disk: the source image is magnified to
+// the virtual size and fractal value noise fills in the detail it doesn't have.
+// every virtual level samples the source mip level whose texels are closest to its own
+// size, and leaves out the noise octaves that are finer than a texel, so the levels
+// come out prefiltered without ever building level 0 in memory.
+
+struct PlanetSource
+{
+	struct MipChain	chain;		// of the source image
+	int		width;		// virtual level 0 width
+	int		octaves;	// detail octaves below the source's resolution
+};
+
+
+static
+float
+LatticeValue( int x, int y, int period )
+{
+	x %= period;
+	if( x < 0 )
+		x += period;
+	unsigned int h = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+	h = ( h ^ ( h >> 13 ) ) * 1274126177u;
+	h ^= h >> 16;
+	return (float)( h & 0xffff ) / 32767.5f - 1.f;
+}
+
+
+// smooth value noise with a lattice spacing of 'cell' level-0 texels, periodic in x:
+
+static
+float
+ValueNoise( float x, float y, int cell, int width )
+{
+	x /= (float)cell;
+	y /= (float)cell;
+	int ix = (int)floorf( x );
+	int iy = (int)floorf( y );
+	float fx = x - (float)ix;
+	float fy = y - (float)iy;
+	fx = fx * fx * ( 3.f - 2.f * fx );
+	fy = fy * fy * ( 3.f - 2.f * fy );
+	int period = width / cell;
+	float a = LatticeValue( ix,   iy,   period );
+	float b = LatticeValue( ix+1, iy,   period );
+	float c = LatticeValue( ix,   iy+1, period );
+	float d = LatticeValue( ix+1, iy+1, period );
+	return ( a + fx * ( b - a ) ) + fy * ( ( c + fx * ( d - c ) ) - ( a + fx * ( b - a ) ) );
+}
+
+
+static
+void
+SampleBilinear( unsigned char *rgb, int w, int h, float s, float t, float out[3] )
+{
+	float x = s * (float)w - 0.5f;
+	float y = t * (float)h - 0.5f;
+	int x0 = (int)floorf( x );
+	int y0 = (int)floorf( y );
+	float fx = x - (float)x0;
+	float fy = y - (float)y0;
+	int x1 = ( x0 + 1 ) % w;
+	x0 = ( x0 + w ) % w;
+	int y1 = y0 + 1;
+	if( y0 < 0 )		y0 = 0;
+	if( y1 > h-1 )		y1 = h-1;
+
+	unsigned char *p00 = &rgb[ 3 * ( y0*w + x0 ) ];
+	unsigned char *p10 = &rgb[ 3 * ( y0*w + x1 ) ];
+	unsigned char *p01 = &rgb[ 3 * ( y1*w + x0 ) ];
+	unsigned char *p11 = &rgb[ 3 * ( y1*w + x1 ) ];
+	for( int c = 0; c < 3; c++ )
+	{
+		float top = (float)p00[c] + fx * (float)( p10[c] - p00[c] );
+		float bot = (float)p01[c] + fx * (float)( p11[c] - p01[c] );
+		out[c] = top + fy * ( bot - top );
+	}
+}
+
+
+void
+PlanetTexel( void *user, int level, float s, float t, unsigned char rgb[3] )
+{
+	struct PlanetSource *ps = (struct PlanetSource *)user;
+
+	// virtual texels per source texel at this level:
+
+	int magnify = ps->width / ps->chain.width[0];
+	int srcLevel = 0;
+	for( int m = magnify; m < ( 1 << level )  &&  srcLevel < ps->chain.numLevels - 1; m *= 2 )
+		srcLevel++;
+
+	float c[3];
+	SampleBilinear( ps->chain.levels[srcLevel], ps->chain.width[srcLevel], ps->chain.height[srcLevel], s, t, c );
+
+	// detail: octaves with a wavelength of at least two texels of this level
+
+	float x = s * (float)ps->width;
+	float y = t * (float)( ps->width / 2 );
+	float detail = 0.f;
+	float amp = 0.5f;
+	int cell = magnify;
+	for( int o = 0; o < ps->octaves  &&  cell >= ( 2 << level ); o++ )
+	{
+		detail += amp * ValueNoise( x, y, cell, ps->width );
+		amp *= 0.6f;
+		cell /= 2;
+	}
+
+	float f = 1.f + 0.35f * detail;
+	for( int i = 0; i < 3; i++ )
+	{
+		float v = c[i] * f;
+		rgb[i] = (unsigned char)( v < 0.f ? 0.f : ( v > 255.f ? 255.f : v + 0.5f ) );
+	}
+}
+
+
+// set up a PlanetSource from a bmp, width is the virtual level 0 width (height is half):
+
+bool
+InitPlanetSource( struct PlanetSource *ps, char *bmpFile, int width )
+{
+	int nums, numt;
+	unsigned char *texture = BmpToTexture( bmpFile, &nums, &numt );
+	if( texture == NULL )
+	{
+		fprintf( stderr, "Cannot read planet source '%s'\n", bmpFile );
+		return false;
+	}
+	BuildMipChain( texture, nums, numt, MIP_BOX, &ps->chain );
+	delete [ ] texture;
+
+	ps->width = width;
+	ps->octaves = 0;
+	for( int m = width / nums; m > 1; m /= 2 )
+		ps->octaves++;
+	return true;
+}
+
+
+void
+FreePlanetSource( struct PlanetSource *ps )
+{
+	FreeMipChain( &ps->chain );
+}
+
+
+//#define TEST
+#if defined(TEST) || defined(VTPAGES_TEST)
+
+#include <time.h>
+#include "bmptotexture.cpp"
+
+// bakes a small page file from Earth.bmp and checks pages read back from it:
+
+int
+main( int argc, char *argv[ ] )
+{
+	int width = ( argc > 1 )  ?  atoi( argv[1] )  :  4096;
+	struct PlanetSource ps;
+	if( ! InitPlanetSource( &ps, (char *)"Earth.bmp", width ) )
+		return 1;
+
+	double t0 = BcSeconds( );
+	if( ! BuildPageFile( (char *)"test.vtpages", width, width/2, 1, PlanetTexel, &ps ) )
+		return 1;
+	double seconds = BcSeconds( ) - t0;
+
+	struct VtPageFile pf;
+	if( ! OpenPageFile( (char *)"test.vtpages", 1, &pf ) )
+		return 1;
+	long long pages = pf.firstPage[pf.header.numLevels-1] + pf.pagesX[pf.header.numLevels-1] * pf.pagesY[pf.header.numLevels-1];
+	double texels = (double)pages * VT_TILESIZE * VT_TILESIZE;
+	fprintf( stderr, "%d x %d virtual, %d levels, %lld pages, %.1f MB, baked in %.2f s (%.2f Mtexels/s)\n",
+		width, width/2, pf.header.numLevels, pages, (double)pages * pf.header.pageBytes / ( 1024.*1024. ),
+		seconds, texels / seconds / 1000000. );
+
+	// every level's corner page should decode to what the generator makes:
+
+	unsigned char *blocks = new unsigned char[ pf.header.pageBytes ];
+	unsigned char *tile = new unsigned char[ 3 * VT_TILESIZE * VT_TILESIZE ];
+	double worst = 99.;
+	for( int level = 0; level < pf.header.numLevels; level++ )
+	{
+		int x = pf.pagesX[level] - 1;
+		int y = pf.pagesY[level] / 2;
+		if( ! ReadPage( &pf, level, x, y, blocks ) )
+		{
+			fprintf( stderr, "Could not read level %d page (%d,%d)\n", level, x, y );
+			return 1;
+		}
+		float lw = (float)( pf.pagesX[level] * VT_PAGESIZE );
+		float lh = (float)( pf.pagesY[level] * VT_PAGESIZE );
+		for( int j = 0; j < VT_TILESIZE; j++ )
+		{
+			float tt = ( (float)( y*VT_PAGESIZE - VT_BORDER + j ) + 0.5f ) / lh;
+			for( int i = 0; i < VT_TILESIZE; i++ )
+			{
+				float ss = ( (float)( x*VT_PAGESIZE - VT_BORDER + i ) + 0.5f ) / lw;
+				ss -= floorf( ss );
+				PlanetTexel( &ps, level, ss, tt, &tile[ 3 * ( j*VT_TILESIZE + i ) ] );
+			}
+		}
+		unsigned char *decoded = DecodeBc( blocks, VT_TILESIZE, VT_TILESIZE, BC_1 );
+		double p = Psnr( tile, decoded, 3 * VT_TILESIZE * VT_TILESIZE );
+		if( p < worst )
+			worst = p;
+		delete [ ] decoded;
+	}
+	fprintf( stderr, "Pages read back, worst PSNR %.2f dB\n", worst );
+
+	ClosePageFile( &pf );
+	FreePlanetSource( &ps );
+	remove( "test.vtpages" );
+	return 0;
+}
+#endif
+
+#endif		// #ifndef VTPAGES_CPP
@@ -0,0 +1,422 @@
+#ifndef WORKERS_CPP
+#define WORKERS_CPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "workers.h"
+
+
+static double
+WorkerSeconds( )
+{
+#ifdef _OPENMP
+	return omp_get_wtime( );
+#else
+	return (double)clock( ) / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+#ifndef WIN32
+// all n bytes through fd, however many writes that takes:
+
+static bool
+WriteAll( int fd, const void *buffer, size_t n )
+{
+	const char *p = (const char *)buffer;
+	while( n > 0 )
+	{
+		ssize_t put = write( fd, p, n );
+		if( put < 0  &&  errno == EINTR )
+			continue;
+		if( put <= 0 )
+			return false;
+		p += put;
+		n -= (size_t)put;
+	}
+	return true;
+}
+#endif
+
+
+FrameWorkers::FrameWorkers( )
+{
+	NumWorkers = 0;
+	Worker = -1;
+	First = 0;
+	Block = 1;
+	Frames = 0;
+	Bytes = 0.;
+	PipeSeconds = 0.;
+	MostEarly = 0;
+}
+
+
+int
+FrameWorkers::NumCores( )
+{
+#ifdef WIN32
+	return 1;
+#else
+	long cores = sysconf( _SC_NPROCESSORS_ONLN );
+	return cores > 0 ? (int)cores : 1;
+#endif
+}
+
+
+// fork n workers for the frames from first on, dealt out block frames at a time --
+// returns the worker's number in each worker, and -1 in the parent:
+
+int
+FrameWorkers::Fork( int n, int first, int block )
+{
+#ifdef WIN32
+	fprintf( stderr, "FrameWorkers: no worker processes on windows\n" );
+	return -1;
+#else
+	First = first;
+	Block = block > 0 ? block : 1;
+	Worker = -1;
+	Pipes.clear( );
+	Pids.clear( );
+	WorkerFrames.assign( n, 0 );
+	Frames = 0;
+	Bytes = 0.;
+	PipeSeconds = 0.;
+	MostEarly = 0;
+
+	// (so the workers don't each flush a copy of what the parent has buffered)
+	fflush( stdout );
+	fflush( stderr );
+	for( int w = 0; w < n; w++ )
+	{
+		int fds[2];
+		if( pipe( fds ) != 0 )
+		{
+			fprintf( stderr, "FrameWorkers: no pipe for worker %d\n", w );
+			break;
+		}
+		pid_t pid = fork( );
+		if( pid < 0 )
+		{
+			fprintf( stderr, "FrameWorkers: cannot fork worker %d\n", w );
+			close( fds[0] );
+			close( fds[1] );
+			break;
+		}
+		if( pid == 0 )
+		{
+			// the worker keeps only its own write end:
+			close( fds[0] );
+			for( int i = 0; i < (int)Pipes.size( ); i++ )
+				close( Pipes[i] );
+			Pipes.assign( 1, fds[1] );
+			Pids.clear( );
+			NumWorkers = n;
+			Worker = w;
+
+			int share = NumCores( ) / n;
+			if( share < 1 )
+				share = 1;
+			char threads[16];
+			sprintf( threads, "%d", share );
+			setenv( "LP_NUM_THREADS", threads, 0 );
+#ifdef _OPENMP
+			omp_set_num_threads( share );
+#endif
+			return Worker;
+		}
+		close( fds[1] );
+		Pipes.push_back( fds[0] );
+		Pids.push_back( (int)pid );
+	}
+	NumWorkers = (int)Pids.size( );
+	struct WorkerFrame none;
+	memset( &none, 0, sizeof(struct WorkerFrame) );
+	Incoming.assign( NumWorkers, none );
+	Early.assign( NumWorkers, std::deque<struct WorkerFrame>( ) );
+	if( NumWorkers < n )
+	{
+		Wait( );
+		NumWorkers = 0;
+	}
+	return -1;
+#endif
+}
+
+
+bool
+FrameWorkers::IsValid( )
+{
+	return NumWorkers > 0;
+}
+
+
+bool
+FrameWorkers::IsWorker( )
+{
+	return Worker >= 0;
+}
+
+
+int
+FrameWorkers::GetNumWorkers( )
+{
+	return NumWorkers;
+}
+
+
+int
+FrameWorkers::GetWorker( )
+{
+	return Worker;
+}
+
+
+// which worker draws frame:
+
+int
+FrameWorkers::GetOwner( int frame )
+{
+	if( NumWorkers <= 0 )
+		return -1;
+	return ( ( frame - First ) / Block ) % NumWorkers;
+}
+
+
+// whether this process draws frame -- the parent draws none, and with no workers,
+// there is only this process to draw them all:
+
+bool
+FrameWorkers::Owns( int frame )
+{
+	if( NumWorkers <= 0 )
+		return true;
+	return GetOwner( frame ) == Worker;
+}
+
+
+// in a worker, send frame, width x height rgba, to the parent:
+
+bool
+FrameWorkers::Send( int frame, int width, int height, const unsigned char *rgba )
+{
+#ifdef WIN32
+	return false;
+#else
+	if( Worker < 0 )
+		return false;
+	double t0 = WorkerSeconds( );
+	int header[3] = { frame, width, height };
+	bool ok = WriteAll( Pipes[0], header, sizeof(header) )  &&  WriteAll( Pipes[0], rgba, (size_t)4 * width * height );
+	PipeSeconds += WorkerSeconds( ) - t0;
+	if( ok )
+	{
+		Frames++;
+		Bytes += 4. * width * height;
+	}
+	return ok;
+#endif
+}
+
+
+// in the parent, read what worker w's pipe has now, without waiting for more -- false
+// if the worker has closed it, or sent something that isn't a frame:
+
+bool
+FrameWorkers::ReadSome( int w )
+{
+#ifdef WIN32
+	return false;
+#else
+	struct WorkerFrame *in = &Incoming[w];
+	size_t want = in->rgba == NULL ? sizeof(in->header) : (size_t)4 * in->header[1] * in->header[2];
+	char *p = in->rgba == NULL ? (char *)in->header : (char *)in->rgba;
+	ssize_t got = read( Pipes[w], p + in->got, want - in->got );
+	if( got < 0  &&  errno == EINTR )
+		return true;
+	if( got <= 0 )
+	{
+		if( in->got > 0  ||  in->rgba != NULL )
+			fprintf( stderr, "FrameWorkers: worker %d stopped in the middle of a frame\n", w );
+		return false;
+	}
+	in->got += (size_t)got;
+	if( in->got < want )
+		return true;
+
+	if( in->rgba == NULL )
+	{
+		if( in->header[1] <= 0  ||  in->header[2] <= 0 )
+		{
+			fprintf( stderr, "FrameWorkers: worker %d sent a %d x %d frame\n", w, in->header[1], in->header[2] );
+			return false;
+		}
+		in->rgba = new unsigned char[ (size_t)4 * in->header[1] * in->header[2] ];
+		in->got = 0;
+		return true;
+	}
+
+	Early[w].push_back( *in );
+	in->rgba = NULL;
+	in->got = 0;
+	int early = 0;
+	for( int i = 0; i < NumWorkers; i++ )
+		early += (int)Early[i].size( );
+	if( early > MostEarly )
+		MostEarly = early;
+	return true;
+#endif
+}
+
+
+// in the parent, wait for frame from the worker that draws it, reading the others'
+// frames as they come in the meantime -- the pixels come from new[ ], width x height
+// rgba, or NULL if that worker is gone:
+
+unsigned char *
+FrameWorkers::Receive( int frame, int *width, int *height )
+{
+#ifdef WIN32
+	return NULL;
+#else
+	int w = GetOwner( frame );
+	if( Worker >= 0  ||  w < 0 )
+		return NULL;
+	double t0 = WorkerSeconds( );
+	while( Early[w].empty( )  &&  Pipes[w] >= 0 )
+	{
+		std::vector<struct pollfd> fds;
+		std::vector<int> which;
+		for( int i = 0; i < NumWorkers; i++ )
+		{
+			if( Pipes[i] < 0 )
+				continue;
+			struct pollfd fd;
+			fd.fd = Pipes[i];
+			fd.events = POLLIN;
+			fd.revents = 0;
+			fds.push_back( fd );
+			which.push_back( i );
+		}
+		if( poll( &fds[0], (nfds_t)fds.size( ), -1 ) < 0 )
+		{
+			if( errno == EINTR )
+				continue;
+			break;
+		}
+		for( int k = 0; k < (int)fds.size( ); k++ )
+		{
+			if( fds[k].revents != 0  &&  ! ReadSome( which[k] ) )
+			{
+				close( Pipes[ which[k] ] );
+				Pipes[ which[k] ] = -1;
+			}
+		}
+	}
+	PipeSeconds += WorkerSeconds( ) - t0;
+
+	if( Early[w].empty( ) )
+	{
+		fprintf( stderr, "FrameWorkers: worker %d didn't send frame %d\n", w, frame );
+		return NULL;
+	}
+	struct WorkerFrame in = Early[w].front( );
+	Early[w].pop_front( );
+	if( in.header[0] != frame )
+	{
+		fprintf( stderr, "FrameWorkers: worker %d sent frame %d instead of frame %d\n", w, in.header[0], frame );
+		delete [ ] in.rgba;
+		return NULL;
+	}
+	*width = in.header[1];
+	*height = in.header[2];
+	Frames++;
+	Bytes += 4. * in.header[1] * in.header[2];
+	WorkerFrames[w]++;
+	return in.rgba;
+#endif
+}
+
+
+// in the parent, close the pipes and collect the workers -- true if they all
+// finished cleanly. (a worker whose frames aren't wanted any more, after a failure,
+// stops at its next Send( ), on the closed pipe.) in a worker, just close its pipe:
+
+bool
+FrameWorkers::Wait( )
+{
+#ifdef WIN32
+	return true;
+#else
+	for( int i = 0; i < (int)Pipes.size( ); i++ )
+	{
+		if( Pipes[i] >= 0 )
+			close( Pipes[i] );
+	}
+	Pipes.clear( );
+	if( Worker >= 0 )
+		return true;
+
+	// (the frames that came and weren't asked for)
+	for( int i = 0; i < (int)Incoming.size( ); i++ )
+	{
+		delete [ ] Incoming[i].rgba;
+		Incoming[i].rgba = NULL;
+		while( ! Early[i].empty( ) )
+		{
+			delete [ ] Early[i].front( ).rgba;
+			Early[i].pop_front( );
+		}
+	}
+
+	bool ok = true;
+	for( int i = 0; i < (int)Pids.size( ); i++ )
+	{
+		int status = 0;
+		while( waitpid( (pid_t)Pids[i], &status, 0 ) < 0  &&  errno == EINTR )
+			;
+		if( ! WIFEXITED( status )  ||  WEXITSTATUS( status ) != 0 )
+		{
+			fprintf( stderr, "FrameWorkers: worker %d failed\n", i );
+			ok = false;
+		}
+	}
+	Pids.clear( );
+	return ok;
+#endif
+}
+
+
+void
+FrameWorkers::PrintStats( )
+{
+	if( Worker >= 0 )
+	{
+		fprintf( stderr, "Worker %d of %d: %d frames sent, %.1f MB, %6.2f ms/frame blocked on the pipe\n", Worker, NumWorkers,
+			Frames, Bytes / 1000000., Frames > 0 ? 1000. * PipeSeconds / (double)Frames : 0. );
+		return;
+	}
+	fprintf( stderr, "Workers: %d, blocks of %d frames: %d frames received, %.1f MB, %6.2f ms/frame waiting for them, at most %d held early;",
+		NumWorkers, Block, Frames, Bytes / 1000000., Frames > 0 ? 1000. * PipeSeconds / (double)Frames : 0., MostEarly );
+	for( int w = 0; w < (int)WorkerFrames.size( ); w++ )
+		fprintf( stderr, " %d", WorkerFrames[w] );
+	fprintf( stderr, " each\n" );
+}
+
+#endif		// #ifndef WORKERS_CPP
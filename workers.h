@@ -0,0 +1,81 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+
+
+// renders a batch in several processes at once -- each a worker with a headless
+// context of its own -- and gathers their frames back, in order
+//
+// Fork( n, first, block ) forks n workers, each with a pipe back to the parent, and
+// returns the worker's number (0 to n-1) in each of them, and -1 in the parent. it
+// has to come before anything makes a gl context, since a context doesn't survive a
+// fork. the frames are dealt out a block at a time, round robin -- frame f is
+// worker ( ( f - first ) / block ) % n's -- so every worker gets its share of each
+// part of the loop, however differently they cost, and a block of consecutive frames
+// keeps a worker's steps short, for what is simulated from one frame to the next
+//
+// a worker draws the frames it Owns( ), in order, and Send( )s each as it is done.
+// the parent Receive( )s the frames in order. while it waits for the one it needs
+// next, it reads whatever any of the workers has sent, and keeps the frames that
+// come early until they are asked for -- a pipe only holds 64 KB or so, much less
+// than a frame, so a worker that is ahead would otherwise sit in its write until
+// the parent got round to it, and the workers would take turns. Wait( ) then
+// collects the workers
+//
+// each worker gets an even share of the cores: llvmpipe's rasterizer threads
+// (LP_NUM_THREADS, unless it is already set) and the openmp threads are cores / n,
+// at least 1. there are no workers on windows -- Fork( ) returns -1, and
+// IsValid( ) is false
+
+// a frame coming in from a worker, or in and waiting for the parent to want it:
+
+struct WorkerFrame
+{
+	int		header[3];	// frame, width, height
+	unsigned char *	rgba;		// NULL until the header is in
+	size_t		got;		// bytes of the header, then of the pixels, read so far
+};
+
+
+class FrameWorkers
+{
+  private:
+	int			NumWorkers;
+	int			Worker;		// this process's number, or -1 in the parent
+	int			First, Block;
+	std::vector<int>	Pipes;		// the parent's read ends (-1 once closed), or a worker's write end
+	std::vector<int>	Pids;
+	std::vector<struct WorkerFrame>			Incoming;	// one from each worker, in the parent
+	std::vector< std::deque<struct WorkerFrame> >	Early;		// ... and the ones that are in
+
+	bool		ReadSome( int );
+
+  public:
+	// statistics:
+	int		Frames;			// sent, or received
+	double		Bytes;
+	double		PipeSeconds;		// blocked on the pipes -- waiting for the workers, in the parent
+	std::vector<int>	WorkerFrames;	// received from each, in the parent
+	int		MostEarly;		// frames held at once, that came before they were wanted
+
+		FrameWorkers( );
+
+	int		Fork( int, int, int );
+	int		GetNumWorkers( );
+	int		GetOwner( int );
+	int		GetWorker( );
+	bool		IsValid( );
+	bool		IsWorker( );
+	bool		Owns( int );
+	void		PrintStats( );
+	unsigned char *	Receive( int, int *, int * );
+	bool		Send( int, int, int, const unsigned char * );
+	bool		Wait( );
+
+	static int	NumCores( );
+};
+
+#endif		// #ifndef WORKERS_H